@@ -31,6 +31,11 @@ struct kline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  mowgli_node_t node;  /* for klnlist */
+  mowgli_node_t inode; /* for the host index, see node.c */
+  mowgli_node_t cnode; /* for the CIDR index */
+  unsigned int heapidx; /* position in the expiry heap */
 };
 
 /* xline list struct */
@@ -65,6 +70,9 @@ struct svsignore_ {
   time_t settime;
   char *setby;
   char *reason;
+
+  compiled_mask_t cmask;
+  mowgli_node_t inode; /* in the host index, see svsignore.c */
 };
 
 /* services accounts */
@@ -96,6 +104,13 @@ struct myuser_
   language_t *language;
 
   mowgli_list_t cert_fingerprints;
+
+  /* for myuser_index_t */
+  timeheap_node_t regnode;
+  timeheap_node_t loginnode;
+  mowgli_node_t holdnode;
+
+  timeheap_node_t expirynode; /* for expire_check() */
 };
 
 /* Keep this synchronized with mu_flags in libathemecore/flags.c */
@@ -134,6 +149,8 @@ struct mynick_
   time_t lastseen;
 
   mowgli_node_t node; /* for myuser_t.nicks */
+
+  timeheap_node_t expirynode; /* for expire_check() */
 };
 
 /* record about a name that used to exist */
@@ -161,6 +178,8 @@ struct mychan_
 
   channel_t *chan;
   mowgli_list_t chanacs;
+  mowgli_patricia_t *chanacs_entities;	/* entity entries, by entity id */
+  mowgli_list_t chanacs_masks;		/* hostmask and non-account entries */
   time_t registered;
   time_t used;
 
@@ -170,6 +189,13 @@ struct mychan_
   char *mlock_key;
 
   unsigned int flags;
+
+  /* for mychan_index_t */
+  timeheap_node_t regnode;
+  timeheap_node_t usednode;
+  mowgli_node_t holdnode;
+
+  timeheap_node_t expirynode; /* for expire_check() */
 };
 
 /* Keep this synchronized with mc_flags in libathemecore/flags.c */
@@ -208,8 +234,11 @@ struct chanacs_
 
 	mowgli_node_t    cnode;
 	mowgli_node_t    unode;
+	mowgli_node_t    mnode;
 
 	stringref setter;
+
+	compiled_mask_t  cmask; /* host entries only */
 };
 
 /* the new atheme-style channel flags */
@@ -345,11 +374,42 @@ typedef struct {
 	const char *oldname;
 } hook_user_rename_t;
 
+/*
+ * Secondary indexes for LIST style searches. They are built the first
+ * time they are asked for and kept up to date from then on. The time
+ * heaps hold lower bounds (see searchindex.h); the foreach functions
+ * below re-key what they visit.
+ */
+typedef struct {
+	trigram_index_t *names;		/* myuser_t by account name */
+	trigram_index_t *nicks;		/* mynick_t by nick */
+	trigram_index_t *emails;	/* myuser_t by email */
+	timeheap_t registered;
+	timeheap_t lastlogin;
+	metadata_index_t *marked;
+	metadata_index_t *frozen;
+	metadata_index_t *restricted;
+	mowgli_list_t held;
+} myuser_index_t;
+
+typedef struct {
+	trigram_index_t *names;		/* mychan_t by name */
+	timeheap_t registered;
+	timeheap_t used;
+	metadata_index_t *marked;
+	metadata_index_t *closed;
+	mowgli_list_t held;
+} mychan_index_t;
+
+typedef void (*myuser_index_cb_t)(myuser_t *mu, void *priv);
+typedef void (*mychan_index_cb_t)(mychan_t *mc, void *priv);
+
 /* pmodule.c XXX */
 E bool backend_loaded;
 
 /* dbhandler.c */
 E void (*db_save)(void *arg);
+E void (*db_save_background)(void *arg);
 E void (*db_load)(const char *arg);
 
 /* function.c */
@@ -362,6 +422,7 @@ E kline_t *kline_add_with_id(const char *user, const char *host, const char *rea
 E kline_t *kline_add(const char *user, const char *host, const char *reason, long duration, const char *setby);
 E kline_t *kline_add_user(user_t *user, const char *reason, long duration, const char *setby);
 E void kline_delete(kline_t *k);
+E void kline_settime(kline_t *k, time_t settime);
 E kline_t *kline_find(const char *user, const char *host);
 E kline_t *kline_find_num(unsigned long number);
 E kline_t *kline_find_user(user_t *u);
@@ -399,6 +460,7 @@ E void myuser_delete(myuser_t *mu);
 //inline myuser_t *myuser_find(const char *name);
 E void myuser_rename(myuser_t *mu, const char *name);
 E void myuser_set_email(myuser_t *mu, const char *newemail);
+E void registration_changed(void *target);
 E myuser_t *myuser_find_ext(const char *name);
 E void myuser_notice(const char *from, myuser_t *target, const char *fmt, ...) PRINTFLIKE(3, 4);
 
@@ -409,6 +471,13 @@ E void myuser_access_delete(myuser_t *mu, const char *mask);
 
 E mynick_t *mynick_add(myuser_t *mu, const char *name);
 E void mynick_delete(mynick_t *mn);
+
+E myuser_index_t *myuser_index(void);
+E void myuser_reindex(myuser_t *mu);
+E void myuser_recanonicalize(myuser_t *mu);
+E mowgli_list_t *myuser_email_canonical_list(stringref email_canonical);
+E unsigned int myuser_index_foreach_registered(time_t cutoff, myuser_index_cb_t cb, void *priv);
+E unsigned int myuser_index_foreach_lastlogin(time_t cutoff, myuser_index_cb_t cb, void *priv);
 //inline mynick_t *mynick_find(const char *name);
 
 E myuser_name_t *myuser_name_add(const char *name);
@@ -421,6 +490,11 @@ E void mycertfp_delete(mycertfp_t *mcfp);
 E mycertfp_t *mycertfp_find(const char *certfp);
 
 E mychan_t *mychan_add(char *name);
+
+E mychan_index_t *mychan_index(void);
+E void mychan_reindex(mychan_t *mc);
+E unsigned int mychan_index_foreach_registered(time_t cutoff, mychan_index_cb_t cb, void *priv);
+E unsigned int mychan_index_foreach_used(time_t cutoff, mychan_index_cb_t cb, void *priv);
 //inline mychan_t *mychan_find(const char *name);
 E bool mychan_isused(mychan_t *mc);
 E unsigned int mychan_num_founders(mychan_t *mc);
@@ -458,6 +532,7 @@ E bool chanacs_change(mychan_t *mychan, myentity_t *mt, const char *hostmask, un
 E bool chanacs_change_simple(mychan_t *mychan, myentity_t *mt, const char *hostmask, unsigned int addflags, unsigned int removeflags, myentity_t *setter);
 
 E void expire_check(void *arg);
+E void expire_sweep(void *arg);
 /* Check the database for (version) problems common to all backends */
 E void db_check(void);
 
@@ -26,6 +26,8 @@
 #include "atheme_string.h"
 #include "atheme_memory.h"
 #include "table.h"
+#include "match.h"
+#include "searchindex.h"
 #include "servers.h"
 #include "channels.h"
 #include "module.h"
@@ -34,7 +36,6 @@
 #include "base64.h"
 #include "md5.h"
 #include "sasl.h"
-#include "match.h"
 #include "sysconf.h"
 #include "account.h"
 #include "auth.h"
@@ -15,6 +15,37 @@ E void *srealloc(void *oldptr, size_t newsize);
 E char *sstrdup(const char *s);
 E char *sstrndup(const char *s, int len);
 
+/*
+ * Allocation accounting by subsystem, see STATS M. Memory from
+ * sharedheap_alloc() is counted against the tag it was allocated with.
+ */
+typedef struct memtag_ {
+	const char *name;
+	size_t objects;			/* live allocations */
+	size_t bytes;			/* their requested size */
+	mowgli_node_t node;
+} memtag_t;
+
+E mowgli_list_t memtag_list;
+
+E memtag_t memtag_users;
+E memtag_t memtag_servers;
+E memtag_t memtag_channels;
+E memtag_t memtag_chanusers;
+E memtag_t memtag_chanbans;
+E memtag_t memtag_metadata;
+E memtag_t memtag_sendq;
+E memtag_t memtag_accounts;
+E memtag_t memtag_nicks;
+E memtag_t memtag_mychans;
+E memtag_t memtag_chanacs;
+E memtag_t memtag_strings;
+E memtag_t memtag_klines;
+
+E void memtag_init(void);
+E void memtag_register(memtag_t *tag);
+E void memtag_unregister(memtag_t *tag);
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -12,6 +12,33 @@
 E void set_password(myuser_t *mu, const char *newpassword);
 E bool verify_password(myuser_t *mu, const char *password);
 
+/* verify_password_async() results */
+#define VERIFY_FAIL		0
+#define VERIFY_OK		1
+#define VERIFY_PENDING		2	/* cb will be called later */
+
+typedef struct verify_request_ verify_request_t;
+
+/* mu is NULL if the account was dropped in the meantime */
+typedef void (*verify_password_cb_t)(myuser_t *mu, bool verified, void *priv);
+
+E int verify_password_async(myuser_t *mu, const char *password, verify_password_cb_t cb, void *priv, verify_request_t **reqp);
+E void verify_password_cancel(verify_request_t *req);
+E void verify_password_drain(void);
+
+/* general::password_threads counters, see STATS P */
+typedef struct {
+	unsigned int threads;		/* running */
+	unsigned int queued;		/* handed to the threads */
+	unsigned int pending;		/* queued or running right now */
+	unsigned int direct;		/* verified on the main thread */
+	unsigned int full;		/* of those, because the queue was full */
+	uint64_t totallatency;		/* ms from queueing to the callback */
+	unsigned int maxlatency;
+} verify_stats_t;
+
+E verify_stats_t verify_stats;
+
 E bool auth_module_loaded;
 E bool (*auth_user_custom)(myuser_t *mu, const char *password);
 
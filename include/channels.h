@@ -30,6 +30,7 @@ struct channel_
   time_t topicts;
 
   mowgli_list_t members;
+  mowgli_list_t services; /* members that are internal clients */
   mowgli_list_t bans;
 
   unsigned int flags;
@@ -45,6 +46,7 @@ struct chanuser_
   unsigned int modes;
   mowgli_node_t unode;
   mowgli_node_t cnode;
+  mowgli_node_t snode; /* for channel_t.services */
 };
 
 struct chanban_
@@ -54,6 +56,7 @@ struct chanban_
   int type; /* 'b', 'e', 'I', etc -- jilles */
   mowgli_node_t node; /* for channel_t.bans */
   unsigned int flags;
+  compiled_mask_t cmask;
 };
 
 /* channel_t.modes */
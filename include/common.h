@@ -166,6 +166,18 @@ stringref strshare_get(const char *str);
 stringref strshare_ref(stringref str);
 void strshare_unref(stringref str);
 
+typedef struct {
+	unsigned int strings;		/* distinct strings */
+	unsigned int refs;		/* references to them */
+	size_t bytes;			/* size of the distinct strings */
+	size_t refbytes;		/* size if every reference had a copy */
+	unsigned int tablesize;
+	unsigned long lookups;		/* strshare_get() calls */
+	unsigned long hits;		/* ...that found the string already there */
+} strshare_stats_t;
+
+extern strshare_stats_t strshare_stats;
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs ts=8 sw=8 noexpandtab
@@ -18,6 +18,12 @@ typedef struct {
 	const char *(*crypt)(const char *key, const char *salt);
 	const char *(*salt)(void);
 
+	/* optional: like crypt, but writes to buf and may be called from
+	 * any thread; returns NULL if buflen is too small or the salt is
+	 * unusable. Needed to verify passwords off the main thread.
+	 */
+	const char *(*crypt_r)(const char *key, const char *salt, char *buf, size_t buflen);
+
 	mowgli_node_t node;
 } crypt_impl_t;
 
@@ -25,6 +31,8 @@ E void crypt_register(crypt_impl_t *impl);
 E void crypt_unregister(crypt_impl_t *impl);
 E const crypt_impl_t *crypt_verify_password(const char *user_input, const char *pass);
 E const crypt_impl_t *crypt_get_default_provider(void);
+E unsigned int crypt_get_reentrant_providers(const crypt_impl_t **impls, unsigned int max);
+E const crypt_impl_t *crypt_verify_password_r(const char *user_input, const char *pass, const crypt_impl_t *const *impls, unsigned int count, char *buf, size_t buflen);
 
 #endif
 
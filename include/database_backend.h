@@ -35,11 +35,13 @@ typedef struct {
 	bool (*write_uint)(database_handle_t *hdl, unsigned int num);
 	bool (*write_time)(database_handle_t *hdl, time_t time);
 	bool (*commit_row)(database_handle_t *hdl);
+	bool (*flush)(database_handle_t *hdl);
 } database_vtable_t;
 
 typedef enum {
 	DB_READ,
-	DB_WRITE
+	DB_WRITE,
+	DB_APPEND
 } database_transaction_t;
 
 struct database_handle_ {
@@ -49,16 +51,17 @@ struct database_handle_ {
 	char *file;
 	unsigned int line;
 	unsigned int token;
+	bool error;		/* reading stopped at a damaged row */
 };
 
 typedef struct {
 	database_handle_t *(*db_open)(const char *filename, database_transaction_t txn);
-	void (*db_close)(database_handle_t *db);
+	bool (*db_close)(database_handle_t *db);
 	void (*db_parse)(database_handle_t *db);
 } database_module_t;
 
 E database_handle_t *db_open(const char *filename, database_transaction_t txn);
-E void db_close(database_handle_t *db);
+E bool db_close(database_handle_t *db);
 E void db_parse(database_handle_t *db);
 
 E bool db_read_next_row(database_handle_t *db);
@@ -83,6 +86,7 @@ E bool db_write_uint(database_handle_t *db, unsigned int num);
 E bool db_write_time(database_handle_t *db, time_t time);
 E bool db_write_format(database_handle_t *db, const char *str, ...);
 E bool db_commit_row(database_handle_t *db);
+E bool db_flush(database_handle_t *db);
 
 typedef void (*database_handler_f)(database_handle_t *db, const char *type);
 
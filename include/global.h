@@ -80,6 +80,7 @@ struct ConfOption
   unsigned int kline_time;          /* default expire for klines  */
   unsigned int clone_time;          /* default expire for clone exemptions */
   unsigned int commit_interval;     /* interval between commits   */
+  bool db_save_fork;                /* do periodic commits in a child process */
 
   bool silent;               /* stop sending WALLOPS?      */
   bool join_chans;           /* join registered channels?  */
@@ -103,6 +104,17 @@ struct ConfOption
   bool clone_increase;  /* If the clone limit will increase based on # of identified clones */
 
   unsigned int uplink_sendq_limit;
+  unsigned int uplink_recvq_budget; /* max lines parsed per wakeup, 0 = no limit */
+
+  bool log_async;                   /* write log files from a separate thread */
+  unsigned int log_async_buffer;    /* size of its queue, in KB */
+  unsigned int log_flush_interval;  /* milliseconds between its writes */
+  bool log_async_block;             /* wait instead of dropping lines when full */
+
+  unsigned int password_threads;    /* threads verifying passwords */
+  unsigned int password_queue;      /* verifications queued before doing them inline */
+
+  bool hugepages;                   /* back large object arenas with huge pages */
 
   char *language;		/* default language */
 
@@ -13,6 +13,8 @@
 /* cidr.c */
 E int match_ips(const char *mask, const char *address);
 E int match_cidr(const char *mask, const char *address);
+E int parse_ip(const char *ip, unsigned char *addr);
+E int match_ip_bits(const unsigned char *addr, const unsigned char *mask, unsigned int bits);
 
 /* match.c */
 #define MATCH_RFC1459   0
@@ -53,6 +55,36 @@ E void noopcanon(char *);
 E int match(const char *, const char *);
 E char *collapse(char *);
 
+/*
+ * A mask prepared for repeated matching against many names, see
+ * mask_compile(). Most names are rejected on the literal prefix and
+ * suffix alone; anything else falls through to match() so the result
+ * is always the same as match() on the original mask.
+ */
+typedef struct {
+	const char *source;	/* original mask, owned by the caller */
+	char *folded;		/* ToLower()ed copy of the mask */
+	size_t len;
+	size_t prefixlen;	/* literal characters at the start */
+	size_t suffixlen;	/* literal characters at the end */
+	unsigned int flags;
+
+	/* n!u@ip/bits masks, for match_cidr() */
+	char *cidruser;
+	int cidrfamily;
+	unsigned int cidrbits;
+	unsigned char cidraddr[16];
+} compiled_mask_t;
+
+#define CMASK_ALL	0x1	/* mask is "*" */
+#define CMASK_LITERAL	0x2	/* no wildcards or escapes at all */
+#define CMASK_CIDR	0x4	/* cidr* fields are valid */
+
+E void mask_compile(compiled_mask_t *cm, const char *mask);
+E void mask_free(compiled_mask_t *cm);
+E bool mask_match(const compiled_mask_t *cm, const char *name, size_t namelen);
+E bool mask_match_cidr(const compiled_mask_t *cm, const char *nickuser, int family, const unsigned char *addr);
+
 /* regex_create() flags */
 #define AREGEX_ICASE	1 /* case insensitive */
 #define AREGEX_PCRE	2 /* use libpcre engine */
@@ -64,6 +96,23 @@ E char *regex_extract(char *pattern, char **pend, int *pflags);
 E bool regex_match(atheme_regex_t *preg, char *string);
 E bool regex_destroy(atheme_regex_t *preg);
 
+/*
+ * A list of compiled regexes matched against one string at a time, see
+ * regex_set_match(). A literal that each pattern needs in order to match
+ * is pulled out when it is added, and all of those are looked for in a
+ * single pass over the string; only patterns whose literal was seen (or
+ * that have none) are handed to the regex engine. The regexes stay owned
+ * by the caller.
+ */
+typedef struct regex_set_ regex_set_t;
+typedef void (*regex_set_cb_t)(void *priv, void *arg);
+
+E regex_set_t *regex_set_create(void);
+E void regex_set_destroy(regex_set_t *set);
+E void regex_set_add(regex_set_t *set, atheme_regex_t *preg, const char *pattern, int flags, void *priv);
+E void regex_set_delete(regex_set_t *set, void *priv);
+E unsigned int regex_set_match(regex_set_t *set, char *string, regex_set_cb_t cb, void *arg);
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
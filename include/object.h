@@ -12,12 +12,21 @@
 struct metadata_ {
 	stringref name;
 	char *value;
+	mowgli_node_t *inode;	/* in a metadata_index_t, if one covers it */
 };
 
 typedef struct metadata_ metadata_t;
 
 typedef void (*destructor_t)(void *);
 
+/* the objects of one kind (by destructor) that carry a given metadata */
+typedef struct {
+	stringref name;
+	destructor_t kind;
+	mowgli_list_t objects;
+	mowgli_node_t node;
+} metadata_index_t;
+
 typedef struct {
 	int refcount;
 	destructor_t destructor;
@@ -41,6 +50,9 @@ E void metadata_delete(void *target, const char *name);
 E metadata_t *metadata_find(void *target, const char *name);
 E void metadata_delete_all(void *target);
 
+E metadata_index_t *metadata_index_create(const char *name, destructor_t kind);
+E void metadata_index_scan(metadata_index_t *mi, void *target);
+
 E void *privatedata_get(void *target, const char *key);
 E void privatedata_set(void *target, const char *key, void *data);
 
@@ -29,6 +29,7 @@ typedef struct {
 typedef struct {
   void *ptr; /* pointer used by callback to identify request */
   void (*callback)(void *vptr, dns_reply_t *reply); /* callback to call */
+  bool nxdomain; /* a NULL reply means the name has no such record, not a failure */
 } dns_query_t;
 
 extern nsaddr_t irc_nsaddr_list[];
@@ -40,6 +41,6 @@ extern void delete_resolver_queries(const dns_query_t *);
 extern void gethost_byname_type(const char *, dns_query_t *, int);
 extern void gethost_byaddr(const sockaddr_any_t *, dns_query_t *);
 extern void add_local_domain(char *, size_t);
-extern void report_dns_servers(sourceinfo_t *);
+extern void report_dns_servers(user_t *);
 
 #endif
@@ -49,9 +49,11 @@ typedef struct {
 #define ASASL_FAIL 0 /* client supplied invalid credentials / screwed up their formatting */
 #define ASASL_MORE 1 /* everything looks good so far, but we're not done yet */
 #define ASASL_DONE 2 /* client successfully authenticated */
+#define ASASL_PENDING 3 /* mechanism will call sasl_resume() with one of the above */
 
 #define ASASL_MARKED_FOR_DELETION   1 /* see delete_stale() in saslserv/main.c */
 #define ASASL_NEED_LOG              2 /* user auth success needs to be logged still */
+#define ASASL_PENDING_STEP          4 /* waiting for the mechanism, see ASASL_PENDING */
 
 #endif
 
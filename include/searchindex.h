@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Indexes for LIST style searches.
+ *
+ */
+
+#ifndef ATHEME_SEARCHINDEX_H
+#define ATHEME_SEARCHINDEX_H
+
+/*
+ * Trigram index: maps case-folded names to objects, so that a match()
+ * pattern containing a literal run can be answered by looking at the
+ * objects sharing its trigrams instead of every object. Searches return
+ * candidates; the caller still has to match() them.
+ */
+typedef struct trigram_index_ trigram_index_t;
+typedef void (*trigram_index_cb_t)(void *obj, void *priv);
+
+E trigram_index_t *trigram_index_create(void);
+E void trigram_index_destroy(trigram_index_t *idx);
+E void trigram_index_add(trigram_index_t *idx, const char *name, void *obj);
+E void trigram_index_delete(trigram_index_t *idx, const char *name, void *obj);
+E unsigned int trigram_index_estimate(trigram_index_t *idx, const char *pattern);
+E unsigned int trigram_index_search(trigram_index_t *idx, const char *pattern, trigram_index_cb_t cb, void *priv);
+
+/* no literal run to look up; the caller has to scan */
+#define TRIGRAM_NOINDEX		UINT_MAX
+
+/*
+ * Time heap: a min-heap of nodes embedded in objects, keyed on a
+ * timestamp. A node's key only has to be a lower bound of the time it
+ * stands for; owners may let the real time move forward and re-key
+ * lazily when a search turns the node up.
+ */
+typedef struct {
+	time_t key;
+	unsigned int idx;
+	void *data;		/* NULL while not in a heap */
+} timeheap_node_t;
+
+typedef struct {
+	timeheap_node_t **nodes;
+	unsigned int count, size;
+} timeheap_t;
+
+typedef void (*timeheap_cb_t)(timeheap_node_t *n, void *priv);
+
+E void timeheap_add(timeheap_t *h, timeheap_node_t *n, void *data, time_t key);
+E void timeheap_delete(timeheap_t *h, timeheap_node_t *n);
+E void timeheap_update(timeheap_t *h, timeheap_node_t *n, time_t key);
+E void timeheap_clear(timeheap_t *h);
+E unsigned int timeheap_count_before(timeheap_t *h, time_t cutoff, unsigned int limit);
+E unsigned int timeheap_foreach_before(timeheap_t *h, time_t cutoff, timeheap_cb_t cb, void *priv);
+
+#endif
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -17,6 +17,7 @@
 #endif
 
 #include <stdbool.h>
+#include <inttypes.h>
 
 #endif
 
@@ -55,6 +55,19 @@ E char *log_path; /* contains path to default log. */
 E int log_force;
 
 E logfile_t *logfile_new(const char *log_path_, unsigned int log_mask);
+
+/* general::log_async counters, see STATS L */
+typedef struct {
+	bool running;
+	unsigned int lines;		/* queued for the writer thread */
+	unsigned int dropped;		/* lost because the queue was full */
+	unsigned int blocked;		/* waited because the queue was full */
+	unsigned int batches;		/* write()s done by the writer */
+	uint64_t totallatency;		/* ms from queueing to write(), summed per batch */
+	unsigned int maxlatency;
+} log_async_stats_t;
+
+E log_async_stats_t log_async_stats;
 E void logfile_register(logfile_t *lf);
 E void logfile_unregister(logfile_t *lf);
 
@@ -98,6 +111,7 @@ E void log_open(void);
 E void log_shutdown(void);
 E bool log_debug_enabled(void);
 E void log_master_set_mask(unsigned int mask);
+E void log_flush(void);
 E logfile_t *logfile_find_mask(unsigned int log_mask);
 E void slog(unsigned int level, const char *fmt, ...) PRINTFLIKE(2, 3);
 E void logcommand(sourceinfo_t *si, int level, const char *fmt, ...) PRINTFLIKE(3, 4);
@@ -169,6 +183,17 @@ E void decode_p10_ip(const char *b64, char ipstring[HOSTIPLEN]);
 /* sharedheap.c */
 E mowgli_heap_t *sharedheap_get(size_t size);
 E void sharedheap_unref(mowgli_heap_t *heap);
+E void *sharedheap_alloc(memtag_t *tag, size_t size);
+E void sharedheap_free(memtag_t *tag, void *ptr, size_t size);
+
+typedef struct {
+	unsigned int chunks;		/* 64 KB arena chunks in use */
+	unsigned int hugechunks;	/* ...of which from huge page regions */
+	unsigned int hugeregions;	/* 2 MB regions mapped */
+	size_t large;			/* objects too big for the arena */
+} sharedheap_stats_t;
+
+E sharedheap_stats_t sharedheap_stats;
 E char *combine_path(const char *parent, const char *child);
 
 #if !HAVE_VSNPRINTF
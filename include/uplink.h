@@ -42,10 +42,36 @@ E uplink_t *uplink_find(const char *name);
 E void uplink_connect(void);
 
 /* packet.c */
+typedef struct uplink_stats_ uplink_stats_t;
+
+struct uplink_stats_
+{
+	unsigned int reads;		/* recv() calls on the uplink */
+	uint64_t readbytes;		/* bytes returned by those calls */
+	unsigned int wakeups;		/* recvq handler runs that parsed lines */
+	unsigned int lines;		/* lines parsed in those runs */
+	unsigned int maxlines;		/* most lines parsed in a single run */
+	unsigned int deferred;		/* runs cut short by uplink_recvq_budget */
+
+	unsigned int writes;		/* write calls on the uplink */
+	uint64_t writebytes;		/* bytes accepted by those calls */
+	size_t sendq_hwm;		/* largest sendq seen, in bytes */
+	unsigned int flushes;		/* times the sendq was drained */
+	uint64_t flushms;		/* total time data waited in the sendq */
+	unsigned int maxflushms;	/* longest time until the sendq drained */
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval sendq_since;	/* when the sendq last became nonempty */
+#endif
+};
+
+E uplink_stats_t uplink_stats;
+
 /* bursting timer */
 #if HAVE_GETTIMEOFDAY
 E struct timeval burstime;
+E unsigned int burst_lines_per_sec(void);
 #endif
+E unsigned int burstlines;
 
 E void (*parse)(char *line);
 E void irc_handle_connect(connection_t *cptr);
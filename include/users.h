@@ -9,6 +9,8 @@
 #ifndef USERS_H
 #define USERS_H
 
+typedef struct user_masks_ user_masks_t;
+
 struct user_
 {
 	object_t parent;
@@ -38,6 +40,37 @@ struct user_
 	mowgli_node_t snode; /* for server_t.userlist */
 
 	char *certfp; /* client certificate fingerprint */
+
+	user_masks_t *masks; /* see user_get_masks() */
+};
+
+/*
+ * nick!user@host forms of a user for matching bans and access masks,
+ * built on first use. The strings they were built from are kept
+ * referenced, so comparing pointers tells whether they are stale.
+ */
+struct user_masks_
+{
+	stringref nick;
+	stringref user;
+	stringref host;
+	stringref chost;
+	stringref vhost;
+	stringref ip;
+
+	char *nickuser;		/* nick!user */
+	char *hostmask;		/* nick!user@host */
+	char *chostmask;	/* nick!user@chost */
+	char *vhostmask;	/* nick!user@vhost */
+	char *ipmask;		/* nick!user@ip, nick!user@ if unknown */
+	size_t hostlen, chostlen, vhostlen, iplen;
+
+	int ipfamily;		/* from parse_ip(), 0 if ip is unknown */
+	unsigned char ipaddr[16];
+
+	/* svsignore_find() verdict, valid for one ignore list generation */
+	unsigned int svsignore_gen;
+	svsignore_t *svsignore;
 };
 
 #define FLOOD_MSGS_FACTOR 256
@@ -88,6 +121,7 @@ E bool user_changenick(user_t *u, const char *nick, time_t ts);
 E void user_mode(user_t *user, const char *modes);
 E void user_sethost(user_t *source, user_t *target, const char *host);
 E const char *user_get_umodestr(user_t *u);
+E const user_masks_t *user_get_masks(user_t *u);
 
 /* uid.c */
 E void init_uid(void);
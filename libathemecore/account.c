@@ -32,12 +32,6 @@ mowgli_patricia_t *oldnameslist;
 mowgli_patricia_t *mclist;
 mowgli_patricia_t *certfplist;
 
-mowgli_heap_t *myuser_heap;   /* HEAP_USER */
-mowgli_heap_t *mynick_heap;   /* HEAP_USER */
-mowgli_heap_t *mycertfp_heap; /* HEAP_USER */
-mowgli_heap_t *myuser_name_heap;	/* HEAP_USER / 2 */
-mowgli_heap_t *mychan_heap;	/* HEAP_CHANNEL */
-mowgli_heap_t *chanacs_heap;	/* HEAP_CHANACS */
 
 /*
  * init_accounts()
@@ -55,26 +49,376 @@ mowgli_heap_t *chanacs_heap;	/* HEAP_CHANACS */
  */
 void init_accounts(void)
 {
-	myuser_heap = sharedheap_get(sizeof(myuser_t));
-	mynick_heap = sharedheap_get(sizeof(myuser_t));
-	myuser_name_heap = sharedheap_get(sizeof(myuser_name_t));
-	mychan_heap = sharedheap_get(sizeof(mychan_t));
-	chanacs_heap = sharedheap_get(sizeof(chanacs_t));
-	mycertfp_heap = sharedheap_get(sizeof(mycertfp_t));
-
-	if (myuser_heap == NULL || mynick_heap == NULL || mychan_heap == NULL
-			|| chanacs_heap == NULL || mycertfp_heap == NULL)
-	{
-		slog(LG_ERROR, "init_accounts(): block allocator failure.");
-		exit(EXIT_FAILURE);
-	}
-
 	nicklist = mowgli_patricia_create(irccasecanon);
 	oldnameslist = mowgli_patricia_create(irccasecanon);
 	mclist = mowgli_patricia_create(irccasecanon);
 	certfplist = mowgli_patricia_create(strcasecanon);
 }
 
+/*******************************
+ * S E A R C H   I N D E X E S *
+ *******************************/
+
+static myuser_index_t *mu_index;
+static mychan_index_t *mc_index;
+static mowgli_patricia_t *email_canonical_index;
+
+static void mychan_delete(mychan_t *mc);
+
+/* see expire_check() */
+static timeheap_t mu_expiry, mn_expiry, mc_expiry;
+
+static void expiry_schedule(timeheap_t *h, timeheap_node_t *n, void *data, time_t when)
+{
+	if (n->data == NULL)
+		timeheap_add(h, n, data, when);
+	else
+		timeheap_update(h, n, when);
+}
+
+/* makes the next expire_check() look at the account and its nicks again */
+static void myuser_expiry_reset(myuser_t *mu)
+{
+	mowgli_node_t *n;
+	mynick_t *mn;
+
+	expiry_schedule(&mu_expiry, &mu->expirynode, mu, 0);
+
+	MOWGLI_ITER_FOREACH(n, mu->nicks.head)
+	{
+		mn = n->data;
+		expiry_schedule(&mn_expiry, &mn->expirynode, mn, 0);
+	}
+}
+
+static void myuser_index_insert(myuser_t *mu, time_t regkey, time_t loginkey)
+{
+	trigram_index_add(mu_index->names, entity(mu)->name, mu);
+	if (mu->email != NULL)
+		trigram_index_add(mu_index->emails, mu->email, mu);
+
+	timeheap_add(&mu_index->registered, &mu->regnode, mu, regkey);
+	timeheap_add(&mu_index->lastlogin, &mu->loginnode, mu, loginkey);
+
+	if (mu->flags & MU_HOLD)
+		mowgli_node_add(mu, &mu->holdnode, &mu_index->held);
+}
+
+static void myuser_index_remove(myuser_t *mu)
+{
+	trigram_index_delete(mu_index->names, entity(mu)->name, mu);
+	if (mu->email != NULL)
+		trigram_index_delete(mu_index->emails, mu->email, mu);
+
+	timeheap_delete(&mu_index->registered, &mu->regnode);
+	timeheap_delete(&mu_index->lastlogin, &mu->loginnode);
+
+	if (mu->holdnode.data != NULL)
+	{
+		mowgli_node_delete(&mu->holdnode, &mu_index->held);
+		mu->holdnode.data = NULL;
+	}
+}
+
+/*
+ * myuser_index()
+ *
+ * Returns the account search indexes, building them on first use.
+ *
+ * Inputs:
+ *      - none
+ *
+ * Outputs:
+ *      - the indexes
+ *
+ * Side Effects:
+ *      - the first call walks all accounts and nicks
+ */
+myuser_index_t *myuser_index(void)
+{
+	myentity_iteration_state_t state;
+	mowgli_patricia_iteration_state_t nstate;
+	myentity_t *mt;
+	myuser_t *mu;
+	mynick_t *mn;
+
+	if (mu_index != NULL)
+		return mu_index;
+
+	mu_index = smalloc(sizeof(myuser_index_t));
+	mu_index->names = trigram_index_create();
+	mu_index->nicks = trigram_index_create();
+	mu_index->emails = trigram_index_create();
+	mu_index->marked = metadata_index_create("private:mark:setter", (destructor_t) myuser_delete);
+	mu_index->frozen = metadata_index_create("private:freeze:freezer", (destructor_t) myuser_delete);
+	mu_index->restricted = metadata_index_create("private:restrict:setter", (destructor_t) myuser_delete);
+
+	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+	{
+		mu = user(mt);
+
+		myuser_index_insert(mu, mu->registered, mu->lastlogin);
+		metadata_index_scan(mu_index->marked, mu);
+		metadata_index_scan(mu_index->frozen, mu);
+		metadata_index_scan(mu_index->restricted, mu);
+	}
+
+	MOWGLI_PATRICIA_FOREACH(mn, &nstate, nicklist)
+		trigram_index_add(mu_index->nicks, mn->nick, mn);
+
+	slog(LG_DEBUG, "myuser_index(): indexed %u accounts", mu_index->registered.count);
+
+	return mu_index;
+}
+
+/*
+ * myuser_reindex(myuser_t *mu)
+ *
+ * Updates the account search indexes after a change to the account's
+ * flags or times that the indexes cannot notice by themselves, such as
+ * setting or clearing MU_HOLD.
+ */
+void myuser_reindex(myuser_t *mu)
+{
+	return_if_fail(mu != NULL);
+
+	myuser_expiry_reset(mu);
+
+	if (mu_index == NULL)
+		return;
+
+	timeheap_update(&mu_index->registered, &mu->regnode, mu->registered);
+	timeheap_update(&mu_index->lastlogin, &mu->loginnode, mu->lastlogin);
+
+	if ((mu->flags & MU_HOLD) && mu->holdnode.data == NULL)
+		mowgli_node_add(mu, &mu->holdnode, &mu_index->held);
+	else if (!(mu->flags & MU_HOLD) && mu->holdnode.data != NULL)
+	{
+		mowgli_node_delete(&mu->holdnode, &mu_index->held);
+		mu->holdnode.data = NULL;
+	}
+}
+
+static void email_canonical_index_add(myuser_t *mu)
+{
+	mowgli_list_t *l;
+
+	if (email_canonical_index == NULL || mu->email_canonical == NULL)
+		return;
+
+	if ((l = mowgli_patricia_retrieve(email_canonical_index, mu->email_canonical)) == NULL)
+	{
+		l = mowgli_list_create();
+		mowgli_patricia_add(email_canonical_index, mu->email_canonical, l);
+	}
+
+	mowgli_node_add(mu, mowgli_node_create(), l);
+}
+
+static void email_canonical_index_delete(myuser_t *mu)
+{
+	mowgli_list_t *l;
+	mowgli_node_t *n;
+
+	if (email_canonical_index == NULL || mu->email_canonical == NULL)
+		return;
+
+	if ((l = mowgli_patricia_retrieve(email_canonical_index, mu->email_canonical)) == NULL)
+		return;
+
+	if ((n = mowgli_node_find(mu, l)) != NULL)
+	{
+		mowgli_node_delete(n, l);
+		mowgli_node_free(n);
+	}
+
+	if (MOWGLI_LIST_LENGTH(l) == 0)
+	{
+		mowgli_patricia_delete(email_canonical_index, mu->email_canonical);
+		mowgli_list_free(l);
+	}
+}
+
+/*
+ * myuser_email_canonical_list(stringref email_canonical)
+ *
+ * Returns the list of accounts whose canonical email address is the
+ * given one, or NULL if there are none. The list belongs to the index
+ * and must not be changed.
+ */
+mowgli_list_t *myuser_email_canonical_list(stringref email_canonical)
+{
+	myentity_iteration_state_t state;
+	myentity_t *mt;
+
+	return_val_if_fail(email_canonical != NULL, NULL);
+
+	if (email_canonical_index == NULL)
+	{
+		email_canonical_index = mowgli_patricia_create(noopcanon);
+
+		MYENTITY_FOREACH_T(mt, &state, ENT_USER)
+			email_canonical_index_add(user(mt));
+	}
+
+	return mowgli_patricia_retrieve(email_canonical_index, email_canonical);
+}
+
+/*
+ * myuser_recanonicalize(myuser_t *mu)
+ *
+ * Recomputes an account's canonical email address, after the email
+ * canonicalizers changed.
+ */
+void myuser_recanonicalize(myuser_t *mu)
+{
+	return_if_fail(mu != NULL);
+
+	email_canonical_index_delete(mu);
+	strshare_unref(mu->email_canonical);
+	mu->email_canonical = canonicalize_email(mu->email);
+	email_canonical_index_add(mu);
+}
+
+typedef struct {
+	timeheap_t *heap;
+	time_t cutoff;
+	size_t offset;		/* of the time_t in the object */
+	void (*cb)(void *obj, void *priv);
+	void *priv;
+	unsigned int count;
+} index_time_search_t;
+
+static void index_time_visit(timeheap_node_t *n, void *priv)
+{
+	index_time_search_t *s = priv;
+	time_t t = *(time_t *)((char *)n->data + s->offset);
+
+	/* the key is only a lower bound; catch up with the real time */
+	if (t > n->key)
+		timeheap_update(s->heap, n, t);
+
+	if (t <= s->cutoff)
+	{
+		s->cb(n->data, s->priv);
+		s->count++;
+	}
+}
+
+static unsigned int index_time_search(timeheap_t *heap, time_t cutoff, size_t offset, void (*cb)(void *obj, void *priv), void *priv)
+{
+	index_time_search_t s = { heap, cutoff, offset, cb, priv, 0 };
+
+	timeheap_foreach_before(heap, cutoff, index_time_visit, &s);
+
+	return s.count;
+}
+
+/*
+ * myuser_index_foreach_registered(time_t cutoff, myuser_index_cb_t cb, void *priv)
+ * myuser_index_foreach_lastlogin(time_t cutoff, myuser_index_cb_t cb, void *priv)
+ *
+ * Call cb for every account registered or last logged in at or before
+ * cutoff, and return how many there were. Only those accounts and a few
+ * whose index entries are out of date are looked at.
+ */
+unsigned int myuser_index_foreach_registered(time_t cutoff, myuser_index_cb_t cb, void *priv)
+{
+	return index_time_search(&myuser_index()->registered, cutoff, offsetof(myuser_t, registered), (void (*)(void *, void *)) cb, priv);
+}
+
+unsigned int myuser_index_foreach_lastlogin(time_t cutoff, myuser_index_cb_t cb, void *priv)
+{
+	return index_time_search(&myuser_index()->lastlogin, cutoff, offsetof(myuser_t, lastlogin), (void (*)(void *, void *)) cb, priv);
+}
+
+static void mychan_index_insert(mychan_t *mc, time_t regkey, time_t usedkey)
+{
+	trigram_index_add(mc_index->names, mc->name, mc);
+
+	timeheap_add(&mc_index->registered, &mc->regnode, mc, regkey);
+	timeheap_add(&mc_index->used, &mc->usednode, mc, usedkey);
+
+	if (mc->flags & MC_HOLD)
+		mowgli_node_add(mc, &mc->holdnode, &mc_index->held);
+}
+
+static void mychan_index_remove(mychan_t *mc)
+{
+	trigram_index_delete(mc_index->names, mc->name, mc);
+
+	timeheap_delete(&mc_index->registered, &mc->regnode);
+	timeheap_delete(&mc_index->used, &mc->usednode);
+
+	if (mc->holdnode.data != NULL)
+	{
+		mowgli_node_delete(&mc->holdnode, &mc_index->held);
+		mc->holdnode.data = NULL;
+	}
+}
+
+/*
+ * mychan_index()
+ *
+ * Returns the channel search indexes, building them on first use.
+ */
+mychan_index_t *mychan_index(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	mychan_t *mc;
+
+	if (mc_index != NULL)
+		return mc_index;
+
+	mc_index = smalloc(sizeof(mychan_index_t));
+	mc_index->names = trigram_index_create();
+	mc_index->marked = metadata_index_create("private:mark:setter", (destructor_t) mychan_delete);
+	mc_index->closed = metadata_index_create("private:close:closer", (destructor_t) mychan_delete);
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	{
+		mychan_index_insert(mc, mc->registered, mc->used);
+		metadata_index_scan(mc_index->marked, mc);
+		metadata_index_scan(mc_index->closed, mc);
+	}
+
+	slog(LG_DEBUG, "mychan_index(): indexed %u channels", mc_index->registered.count);
+
+	return mc_index;
+}
+
+/* like myuser_reindex(), for MC_HOLD */
+void mychan_reindex(mychan_t *mc)
+{
+	return_if_fail(mc != NULL);
+
+	expiry_schedule(&mc_expiry, &mc->expirynode, mc, 0);
+
+	if (mc_index == NULL)
+		return;
+
+	timeheap_update(&mc_index->registered, &mc->regnode, mc->registered);
+	timeheap_update(&mc_index->used, &mc->usednode, mc->used);
+
+	if ((mc->flags & MC_HOLD) && mc->holdnode.data == NULL)
+		mowgli_node_add(mc, &mc->holdnode, &mc_index->held);
+	else if (!(mc->flags & MC_HOLD) && mc->holdnode.data != NULL)
+	{
+		mowgli_node_delete(&mc->holdnode, &mc_index->held);
+		mc->holdnode.data = NULL;
+	}
+}
+
+unsigned int mychan_index_foreach_registered(time_t cutoff, mychan_index_cb_t cb, void *priv)
+{
+	return index_time_search(&mychan_index()->registered, cutoff, offsetof(mychan_t, registered), (void (*)(void *, void *)) cb, priv);
+}
+
+unsigned int mychan_index_foreach_used(time_t cutoff, mychan_index_cb_t cb, void *priv)
+{
+	return index_time_search(&mychan_index()->used, cutoff, offsetof(mychan_t, used), (void (*)(void *, void *)) cb, priv);
+}
+
 /*
  * myuser_add(const char *name, const char *pass, const char *email,
  * unsigned int flags)
@@ -121,7 +465,7 @@ myuser_t *myuser_add_id(const char *id, const char *name, const char *pass, cons
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "myuser_add(): %s -> %s", name, email);
 
-	mu = mowgli_heap_alloc(myuser_heap);
+	mu = sharedheap_alloc(&memtag_accounts, sizeof(myuser_t));
 	object_init(object(mu), name, (destructor_t) myuser_delete);
 
 	entity(mu)->type = ENT_USER;
@@ -169,6 +513,12 @@ myuser_t *myuser_add_id(const char *id, const char *name, const char *pass, cons
 
 	myuser_name_restore(entity(mu)->name, mu);
 
+	/* times may still be backdated by the caller, so start from 0 */
+	if (mu_index != NULL)
+		myuser_index_insert(mu, 0, 0);
+	email_canonical_index_add(mu);
+	timeheap_add(&mu_expiry, &mu->expirynode, mu, 0);
+
 	cnt.myuser++;
 
 	return mu;
@@ -325,11 +675,16 @@ void myuser_delete(myuser_t *mu)
 	/* entity(mu)->name is the index for this dtree */
 	myentity_del(entity(mu));
 
+	if (mu_index != NULL)
+		myuser_index_remove(mu);
+	email_canonical_index_delete(mu);
+	timeheap_delete(&mu_expiry, &mu->expirynode);
+
 	strshare_unref(mu->email);
 	strshare_unref(mu->email_canonical);
 	strshare_unref(entity(mu)->name);
 
-	mowgli_heap_free(myuser_heap, mu);
+	sharedheap_free(&memtag_accounts, mu, sizeof(myuser_t));
 
 	cnt.myuser--;
 }
@@ -375,11 +730,19 @@ void myuser_rename(myuser_t *mu, const char *name)
 		}
 	}
 	myentity_del(entity(mu));
+	if (mu_index != NULL)
+		trigram_index_delete(mu_index->names, entity(mu)->name, mu);
 
 	strshare_unref(entity(mu)->name);
 	entity(mu)->name = newname;
 
 	myentity_put(entity(mu));
+	if (mu_index != NULL)
+		trigram_index_add(mu_index->names, entity(mu)->name, mu);
+
+	/* another nick may be the main one now */
+	myuser_expiry_reset(mu);
+
 	if (authservice_loaded)
 	{
 		MOWGLI_ITER_FOREACH(n, mu->logins.head)
@@ -414,11 +777,53 @@ void myuser_set_email(myuser_t *mu, const char *newemail)
 	return_if_fail(mu != NULL);
 	return_if_fail(newemail != NULL);
 
+	if (mu_index != NULL && mu->email != NULL)
+		trigram_index_delete(mu_index->emails, mu->email, mu);
+	email_canonical_index_delete(mu);
+
 	strshare_unref(mu->email);
 	strshare_unref(mu->email_canonical);
 
 	mu->email = strshare_get(newemail);
 	mu->email_canonical = canonicalize_email(newemail);
+
+	if (mu_index != NULL)
+		trigram_index_add(mu_index->emails, mu->email, mu);
+	email_canonical_index_add(mu);
+
+	hook_call_myuser_changed(mu);
+}
+
+/*
+ * registration_changed(void *target)
+ *
+ * Announces that the stored state of an account or channel registration
+ * has changed, for instance to a database journal. Other objects, and
+ * objects that are being destroyed, are ignored.
+ *
+ * Inputs:
+ *      - an object
+ *
+ * Outputs:
+ *      - nothing
+ *
+ * Side Effects:
+ *      - the myuser_changed or mychan_changed hook is called
+ */
+void registration_changed(void *target)
+{
+	object_t *obj;
+
+	return_if_fail(target != NULL);
+
+	obj = object(target);
+	if (obj->refcount == -1)
+		return;
+
+	if (obj->destructor == (destructor_t) myuser_delete)
+		hook_call_myuser_changed(target);
+	else if (obj->destructor == (destructor_t) mychan_delete)
+		hook_call_mychan_changed(target);
 }
 
 /*
@@ -685,7 +1090,7 @@ mynick_t *mynick_add(myuser_t *mu, const char *name)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "mynick_add(): %s -> %s", name, entity(mu)->name);
 
-	mn = mowgli_heap_alloc(mynick_heap);
+	mn = sharedheap_alloc(&memtag_nicks, sizeof(mynick_t));
 	object_init(object(mn), name, (destructor_t) mynick_delete);
 
 	mowgli_strlcpy(mn->nick, name, NICKLEN);
@@ -694,6 +1099,9 @@ mynick_t *mynick_add(myuser_t *mu, const char *name)
 
 	mowgli_patricia_add(nicklist, mn->nick, mn);
 	mowgli_node_add(mn, &mn->node, &mu->nicks);
+	if (mu_index != NULL)
+		trigram_index_add(mu_index->nicks, mn->nick, mn);
+	timeheap_add(&mn_expiry, &mn->expirynode, mn, 0);
 
 	myuser_name_restore(mn->nick, mu);
 
@@ -727,8 +1135,11 @@ void mynick_delete(mynick_t *mn)
 
 	mowgli_patricia_delete(nicklist, mn->nick);
 	mowgli_node_delete(&mn->node, &mn->owner->nicks);
+	if (mu_index != NULL)
+		trigram_index_delete(mu_index->nicks, mn->nick, mn);
+	timeheap_delete(&mn_expiry, &mn->expirynode);
 
-	mowgli_heap_free(mynick_heap, mn);
+	sharedheap_free(&memtag_nicks, mn, sizeof(mynick_t));
 
 	cnt.mynick--;
 }
@@ -763,7 +1174,7 @@ myuser_name_t *myuser_name_add(const char *name)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "myuser_name_add(): %s", name);
 
-	mun = mowgli_heap_alloc(myuser_name_heap);
+	mun = sharedheap_alloc(&memtag_accounts, sizeof(myuser_name_t));
 	object_init(object(mun), name, (destructor_t) myuser_name_delete);
 
 	mowgli_strlcpy(mun->name, name, NICKLEN);
@@ -800,7 +1211,7 @@ static void myuser_name_delete(myuser_name_t *mun)
 
 	metadata_delete_all(mun);
 
-	mowgli_heap_free(myuser_name_heap, mun);
+	sharedheap_free(&memtag_accounts, mun, sizeof(myuser_name_t));
 
 	cnt.myuser_name--;
 }
@@ -927,7 +1338,7 @@ mycertfp_t *mycertfp_add(myuser_t *mu, const char *certfp)
 	return_val_if_fail(mu != NULL, NULL);
 	return_val_if_fail(certfp != NULL, NULL);
 
-	mcfp = mowgli_heap_alloc(mycertfp_heap);
+	mcfp = sharedheap_alloc(&memtag_accounts, sizeof(mycertfp_t));
 	mcfp->mu = mu;
 	mcfp->certfp = sstrdup(certfp);
 
@@ -947,7 +1358,7 @@ void mycertfp_delete(mycertfp_t *mcfp)
 	mowgli_patricia_delete(certfplist, mcfp->certfp);
 
 	free(mcfp->certfp);
-	mowgli_heap_free(mycertfp_heap, mcfp);
+	sharedheap_free(&memtag_accounts, mcfp, sizeof(mycertfp_t));
 }
 
 mycertfp_t *mycertfp_find(const char *certfp)
@@ -978,13 +1389,19 @@ static void mychan_delete(mychan_t *mc)
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
 		object_unref(n->data);
 
+	if (mc->chanacs_entities != NULL)
+		mowgli_patricia_destroy(mc->chanacs_entities, NULL, NULL);
+
 	metadata_delete_all(mc);
 
 	mowgli_patricia_delete(mclist, mc->name);
+	if (mc_index != NULL)
+		mychan_index_remove(mc);
+	timeheap_delete(&mc_expiry, &mc->expirynode);
 
 	strshare_unref(mc->name);
 
-	mowgli_heap_free(mychan_heap, mc);
+	sharedheap_free(&memtag_mychans, mc, sizeof(mychan_t));
 
 	cnt.mychan--;
 }
@@ -999,7 +1416,7 @@ mychan_t *mychan_add(char *name)
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "mychan_add(): %s", name);
 
-	mc = mowgli_heap_alloc(mychan_heap);
+	mc = sharedheap_alloc(&memtag_mychans, sizeof(mychan_t));
 
 	object_init(object(mc), name, (destructor_t) mychan_delete);
 	mc->name = strshare_get(name);
@@ -1010,6 +1427,9 @@ mychan_t *mychan_add(char *name)
 		mc->chan->mychan = mc;
 
 	mowgli_patricia_add(mclist, mc->name, mc);
+	if (mc_index != NULL)
+		mychan_index_insert(mc, 0, 0);
+	timeheap_add(&mc_expiry, &mc->expirynode, mc, 0);
 
 	cnt.mychan++;
 
@@ -1342,6 +1762,71 @@ const char *mychan_get_sts_mlock(mychan_t *mc)
  * C H A N A C S *
  *****************/
 
+/*
+ * Besides the full access list, each mychan indexes its entity entries by
+ * entity id (exttargets have none and use their name) and keeps the entries
+ * that may match more than one account -- hostmasks, groups and exttargets --
+ * on a separate list, so lookups only need to scan those.
+ */
+static inline const char *chanacs_entity_key(myentity_t *mt)
+{
+	return *mt->id != '\0' ? mt->id : mt->name;
+}
+
+static inline bool chanacs_is_mask(chanacs_t *ca)
+{
+	return ca->entity == NULL || !isuser(ca->entity);
+}
+
+static void chanacs_index(chanacs_t *ca)
+{
+	mychan_t *mc = ca->mychan;
+
+	if (ca->entity != NULL)
+	{
+		if (mc->chanacs_entities == NULL)
+			mc->chanacs_entities = mowgli_patricia_create(noopcanon);
+
+		/* duplicates are possible in old databases; the first one wins */
+		if (mowgli_patricia_retrieve(mc->chanacs_entities, chanacs_entity_key(ca->entity)) == NULL)
+			mowgli_patricia_add(mc->chanacs_entities, chanacs_entity_key(ca->entity), ca);
+	}
+
+	if (chanacs_is_mask(ca))
+		mowgli_node_add(ca, &ca->mnode, &mc->chanacs_masks);
+}
+
+static void chanacs_unindex(chanacs_t *ca)
+{
+	mychan_t *mc = ca->mychan;
+	mowgli_node_t *n;
+	chanacs_t *ca2;
+	const char *key;
+
+	if (ca->entity != NULL && mc->chanacs_entities != NULL)
+	{
+		key = chanacs_entity_key(ca->entity);
+		if (mowgli_patricia_retrieve(mc->chanacs_entities, key) == ca)
+		{
+			mowgli_patricia_delete(mc->chanacs_entities, key);
+
+			/* promote a duplicate, if there is one */
+			MOWGLI_ITER_FOREACH(n, ca->entity->chanacs.head)
+			{
+				ca2 = n->data;
+				if (ca2 != ca && ca2->mychan == mc)
+				{
+					mowgli_patricia_add(mc->chanacs_entities, key, ca2);
+					break;
+				}
+			}
+		}
+	}
+
+	if (chanacs_is_mask(ca))
+		mowgli_node_delete(&ca->mnode, &mc->chanacs_masks);
+}
+
 /* private destructor for chanacs_t */
 static void chanacs_delete(chanacs_t *ca)
 {
@@ -1352,6 +1837,7 @@ static void chanacs_delete(chanacs_t *ca)
 		slog(LG_DEBUG, "chanacs_delete(): %s -> %s [%s]", ca->mychan->name,
 			ca->entity != NULL ? entity(ca->entity)->name : ca->host,
 			ca->entity != NULL ? "entity" : "hostmask");
+	chanacs_unindex(ca);
 	mowgli_node_delete(&ca->cnode, &ca->mychan->chanacs);
 
 	if (ca->entity != NULL)
@@ -1368,9 +1854,12 @@ static void chanacs_delete(chanacs_t *ca)
 	metadata_delete_all(ca);
 
 	if (ca->host != NULL)
+	{
+		mask_free(&ca->cmask);
 		free(ca->host);
+	}
 
-	mowgli_heap_free(chanacs_heap, ca);
+	sharedheap_free(&memtag_chanacs, ca, sizeof(chanacs_t));
 
 	cnt.chanacs--;
 }
@@ -1407,7 +1896,7 @@ chanacs_t *chanacs_add(mychan_t *mychan, myentity_t *mt, unsigned int level, tim
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "chanacs_add(): %s -> %s", mychan->name, mt->name);
 
-	ca = mowgli_heap_alloc(chanacs_heap);
+	ca = sharedheap_alloc(&memtag_chanacs, sizeof(chanacs_t));
 
 	object_init(object(ca), mt->name, (destructor_t) chanacs_delete);
 	ca->mychan = mychan;
@@ -1419,6 +1908,7 @@ chanacs_t *chanacs_add(mychan_t *mychan, myentity_t *mt, unsigned int level, tim
 
 	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
 	mowgli_node_add(ca, &ca->unode, &mt->chanacs);
+	chanacs_index(ca);
 
 	cnt.chanacs++;
 
@@ -1457,17 +1947,19 @@ chanacs_t *chanacs_add_host(mychan_t *mychan, const char *host, unsigned int lev
 	if (!(runflags & RF_STARTING))
 		slog(LG_DEBUG, "chanacs_add_host(): %s -> %s", mychan->name, host);
 
-	ca = mowgli_heap_alloc(chanacs_heap);
+	ca = sharedheap_alloc(&memtag_chanacs, sizeof(chanacs_t));
 
 	object_init(object(ca), host, (destructor_t) chanacs_delete);
 	ca->mychan = mychan;
 	ca->entity = NULL;
 	ca->host = sstrdup(host);
+	mask_compile(&ca->cmask, ca->host);
 	ca->level = level & ca_all;
 	ca->tmodified = ts;
 	ca->setter = setter != NULL ? strshare_ref(setter->name) : NULL;
 
 	mowgli_node_add(ca, &ca->cnode, &mychan->chanacs);
+	chanacs_index(ca);
 
 	cnt.chanacs++;
 
@@ -1484,7 +1976,7 @@ chanacs_t *chanacs_find(mychan_t *mychan, myentity_t *mt, unsigned int level)
 	if ((ca = chanacs_find_literal(mychan, mt, level)) != NULL)
 		return ca;
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_masks.head)
 	{
 		entity_chanacs_validation_vtable_t *vt;
 
@@ -1514,22 +2006,21 @@ unsigned int chanacs_entity_flags(mychan_t *mychan, myentity_t *mt)
 
 	return_val_if_fail(mychan != NULL && mt != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	if ((ca = chanacs_find_literal(mychan, mt, 0)) != NULL)
+		result |= ca->level;
+
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_masks.head)
 	{
 		entity_chanacs_validation_vtable_t *vt;
 
 		ca = (chanacs_t *)n->data;
 
-		if (ca->entity == NULL)
+		if (ca->entity == NULL || ca->entity == mt)
 			continue;
-		if (ca->entity == mt)
+
+		vt = myentity_get_chanacs_validator(ca->entity);
+		if (vt->match_entity(ca, mt) != NULL)
 			result |= ca->level;
-		else
-		{
-			vt = myentity_get_chanacs_validator(ca->entity);
-			if (vt->match_entity(ca, mt) != NULL)
-				result |= ca->level;
-		}
 	}
 
 	slog(LG_DEBUG, "chanacs_entity_flags(%s, %s): return %s", mychan->name, mt->name, bitmask_to_flags(result));
@@ -1539,25 +2030,21 @@ unsigned int chanacs_entity_flags(mychan_t *mychan, myentity_t *mt)
 
 chanacs_t *chanacs_find_literal(mychan_t *mychan, myentity_t *mt, unsigned int level)
 {
-	mowgli_node_t *n;
 	chanacs_t *ca;
 
 	return_val_if_fail(mychan != NULL && mt != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
-	{
-		ca = (chanacs_t *)n->data;
+	if (mychan->chanacs_entities == NULL)
+		return NULL;
 
-		if (level != 0x0)
-		{
-			if (ca->entity == mt && ((ca->level & level) == level))
-				return ca;
-		}
-		else if (ca->entity == mt)
-			return ca;
-	}
+	ca = mowgli_patricia_retrieve(mychan->chanacs_entities, chanacs_entity_key(mt));
+	if (ca == NULL || ca->entity != mt)
+		return NULL;
 
-	return NULL;
+	if (level != 0x0 && (ca->level & level) != level)
+		return NULL;
+
+	return ca;
 }
 
 chanacs_t *chanacs_find_host(mychan_t *mychan, const char *host, unsigned int level)
@@ -1567,7 +2054,7 @@ chanacs_t *chanacs_find_host(mychan_t *mychan, const char *host, unsigned int le
 
 	return_val_if_fail(mychan != NULL && host != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_masks.head)
 	{
 		ca = (chanacs_t *)n->data;
 
@@ -1591,7 +2078,7 @@ unsigned int chanacs_host_flags(mychan_t *mychan, const char *host)
 
 	return_val_if_fail(mychan != NULL && host != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_masks.head)
 	{
 		ca = (chanacs_t *)n->data;
 
@@ -1610,7 +2097,7 @@ chanacs_t *chanacs_find_host_literal(mychan_t *mychan, const char *host, unsigne
 	if ((!mychan) || (!host))
 		return NULL;
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_masks.head)
 	{
 		ca = (chanacs_t *)n->data;
 
@@ -1633,7 +2120,7 @@ chanacs_t *chanacs_find_host_by_user(mychan_t *mychan, user_t *u, unsigned int l
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
-	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
+	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs_masks.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
 	{
 		ca = n->data;
 		if ((ca->level & level) == level)
@@ -1651,7 +2138,7 @@ static unsigned int chanacs_host_flags_by_user(mychan_t *mychan, user_t *u)
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
-	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
+	for (n = next_matching_host_chanacs(mychan, u, mychan->chanacs_masks.head); n != NULL; n = next_matching_host_chanacs(mychan, u, n->next))
 	{
 		ca = n->data;
 		result |= ca->level;
@@ -1700,7 +2187,9 @@ bool chanacs_user_has_flag(mychan_t *mychan, user_t *u, unsigned int level)
 	return false;
 }
 
-static unsigned int chanacs_entity_flags_by_user(mychan_t *mychan, user_t *u)
+/* flags from the non-account entity entries matching u or its account mt,
+ * in a single pass over them */
+static unsigned int chanacs_entity_flags_by_user(mychan_t *mychan, user_t *u, myentity_t *mt)
 {
 	mowgli_node_t *n;
 	unsigned int result = 0;
@@ -1708,19 +2197,19 @@ static unsigned int chanacs_entity_flags_by_user(mychan_t *mychan, user_t *u)
 	return_val_if_fail(mychan != NULL, 0);
 	return_val_if_fail(u != NULL, 0);
 
-	MOWGLI_ITER_FOREACH(n, mychan->chanacs.head)
+	MOWGLI_ITER_FOREACH(n, mychan->chanacs_masks.head)
 	{
 		chanacs_t *ca = n->data;
-		myentity_t *mt;
 		entity_chanacs_validation_vtable_t *vt;
 
 		if (ca->entity == NULL)
 			continue;
 
-		mt = ca->entity;
-		vt = myentity_get_chanacs_validator(mt);
+		vt = myentity_get_chanacs_validator(ca->entity);
 
-		if (vt->match_user && vt->match_user(ca, u) != NULL)
+		if (mt != NULL && ca->entity != mt && vt->match_entity(ca, mt) != NULL)
+			result |= ca->level;
+		else if (vt->match_user && vt->match_user(ca, u) != NULL)
 			result |= ca->level;
 	}
 
@@ -1732,15 +2221,16 @@ static unsigned int chanacs_entity_flags_by_user(mychan_t *mychan, user_t *u)
 unsigned int chanacs_user_flags(mychan_t *mychan, user_t *u)
 {
 	myentity_t *mt;
+	chanacs_t *ca;
 	unsigned int result = 0;
 
 	return_val_if_fail(mychan != NULL && u != NULL, 0);
 
 	mt = entity(u->myuser);
-	if (mt != NULL)
-		result |= chanacs_entity_flags(mychan, mt);
+	if (mt != NULL && (ca = chanacs_find_literal(mychan, mt, 0)) != NULL)
+		result |= ca->level;
 
-	result |= chanacs_entity_flags_by_user(mychan, u);
+	result |= chanacs_entity_flags_by_user(mychan, u, mt);
 	result |= chanacs_host_flags_by_user(mychan, u);
 
 	slog(LG_DEBUG, "chanacs_user_flags(%s, %s): return %s", mychan->name, u->nick, bitmask_to_flags(result));
@@ -1938,12 +2428,69 @@ bool chanacs_change_simple(mychan_t *mychan, myentity_t *mt, const char *hostmas
 	return chanacs_change(mychan, mt, hostmask, &a, &r, ca_all, setter);
 }
 
-static int expire_myuser_cb(myentity_t *mt, void *unused)
+/*
+ * Expiry queues
+ *
+ * Accounts, nicks and channels sit in a time heap keyed on the earliest
+ * time expire_check() may have anything to do with them, so an hourly
+ * run only looks at the ones that are due. Keys are lower bounds:
+ * lastlogin, lastseen and used only move forward, so touching them needs
+ * no re-key, and expire_check() catches up with the real time when it
+ * visits a node. New objects go in at 0. An object with nothing pending
+ * (a held account, or expiry disabled) is left out of its queue until
+ * myuser_reindex(), mychan_reindex() or a change of the expiry settings
+ * puts it back.
+ *
+ * expire_sweep() still does the old full pass once a day, and complains
+ * about anything the queues should have found.
+ */
+
+/* the settings the queue keys were computed with */
+static unsigned int expiry_nick_period, expiry_chan_period;
+
+/* when the last used time of a channel in use is refreshed, see below */
+#define MYCHAN_USED_REFRESH	(86400 - 3660)
+
+static time_t myuser_expiry_due(myuser_t *mu)
 {
-	hook_expiry_req_t req;
-	myuser_t *mu = user(mt);
+	time_t due = 0;
 
-	return_val_if_fail(isuser(mt), 0);
+	if (nicksvs.expiry > 0)
+		due = mu->lastlogin + nicksvs.expiry;
+	if (mu->flags & MU_WAITAUTH && (due == 0 || mu->registered + 86400 < due))
+		due = mu->registered + 86400;
+
+	return due;
+}
+
+static time_t mynick_expiry_due(mynick_t *mn)
+{
+	if (nicksvs.expiry == 0)
+		return 0;
+
+	return mn->lastseen + nicksvs.expiry;
+}
+
+static time_t mychan_expiry_due(mychan_t *mc)
+{
+	if (chansvs.expiry > 0 && chansvs.expiry < MYCHAN_USED_REFRESH)
+		return mc->used + chansvs.expiry;
+
+	return mc->used + MYCHAN_USED_REFRESH;
+}
+
+/* puts the object back at its due time, or takes it out if there is none */
+static void expiry_reschedule(timeheap_t *h, timeheap_node_t *n, void *data, time_t due)
+{
+	if (due == 0)
+		timeheap_delete(h, n);
+	else
+		expiry_schedule(h, n, data, due);
+}
+
+static void expire_myuser(myuser_t *mu)
+{
+	hook_expiry_req_t req;
 
 	/* If they're logged in, update lastlogin time.
 	 * To decrease db traffic, may want to only do
@@ -1953,18 +2500,29 @@ static int expire_myuser_cb(myentity_t *mt, void *unused)
 	if (MOWGLI_LIST_LENGTH(&mu->logins) > 0)
 	{
 		mu->lastlogin = CURRTIME;
-		return 0;
+		expiry_reschedule(&mu_expiry, &mu->expirynode, mu, myuser_expiry_due(mu));
+		return;
 	}
 
 	if (MU_HOLD & mu->flags)
-		return 0;
+	{
+		timeheap_delete(&mu_expiry, &mu->expirynode);
+		return;
+	}
 
+	if (myuser_expiry_due(mu) == 0 || myuser_expiry_due(mu) > CURRTIME)
+	{
+		expiry_reschedule(&mu_expiry, &mu->expirynode, mu, myuser_expiry_due(mu));
+		return;
+	}
+
+	/* vetoed or kept accounts are due again on the next run */
 	req.data.mu = mu;
 	req.do_expire = 1;
 	hook_call_user_check_expire(&req);
 
 	if (!req.do_expire)
-		return 0;
+		return;
 
 	if ((nicksvs.expiry > 0 && mu->lastlogin < CURRTIME && (unsigned int)(CURRTIME - mu->lastlogin) >= nicksvs.expiry) ||
 			(mu->flags & MU_WAITAUTH && CURRTIME - mu->registered >= 86400))
@@ -1973,7 +2531,7 @@ static int expire_myuser_cb(myentity_t *mt, void *unused)
 		 * otherwise someone can reregister
 		 * them and take the privs -- jilles */
 		if (is_conf_soper(mu))
-			return 0;
+			return;
 
 		slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2 "), entity(mu)->name, mu->email);
 		slog(LG_VERBOSE, "expire_check(): expiring account %s (unused %ds, email %s, nicks %zu, chanacs %zu)",
@@ -1982,104 +2540,243 @@ static int expire_myuser_cb(myentity_t *mt, void *unused)
 				MOWGLI_LIST_LENGTH(&entity(mu)->chanacs));
 		object_dispose(mu);
 	}
+}
 
-	return 0;
+static void expire_mynick(mynick_t *mn)
+{
+	hook_expiry_req_t req;
+	user_t *u;
+
+	if (mynick_expiry_due(mn) == 0 || mynick_expiry_due(mn) > CURRTIME)
+	{
+		expiry_reschedule(&mn_expiry, &mn->expirynode, mn, mynick_expiry_due(mn));
+		return;
+	}
+
+	req.do_expire = 1;
+	req.data.mn = mn;
+
+	hook_call_nick_check_expire(&req);
+
+	if (!req.do_expire)
+		return;
+
+	if (nicksvs.expiry > 0 && mn->lastseen < CURRTIME &&
+			(unsigned int)(CURRTIME - mn->lastseen) >= nicksvs.expiry)
+	{
+		/* held accounts and main nicks come back through
+		 * myuser_reindex() and myuser_rename() */
+		if (MU_HOLD & mn->owner->flags)
+		{
+			timeheap_delete(&mn_expiry, &mn->expirynode);
+			return;
+		}
+
+		/* do not drop main nick like this */
+		if (!irccasecmp(mn->nick, entity(mn->owner)->name))
+		{
+			timeheap_delete(&mn_expiry, &mn->expirynode);
+			return;
+		}
+
+		u = user_find_named(mn->nick);
+		if (u != NULL && u->myuser == mn->owner)
+		{
+			/* still logged in, bleh */
+			mn->lastseen = CURRTIME;
+			mn->owner->lastlogin = CURRTIME;
+			expiry_reschedule(&mn_expiry, &mn->expirynode, mn, mynick_expiry_due(mn));
+			return;
+		}
+
+		slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2"), mn->nick, entity(mn->owner)->name);
+		slog(LG_VERBOSE, "expire_check(): expiring nick %s (unused %lds, account %s)",
+				mn->nick, (long)(CURRTIME - mn->lastseen),
+				entity(mn->owner)->name);
+		object_unref(mn);
+	}
 }
 
-void expire_check(void *arg)
+static void expire_mychan(mychan_t *mc)
 {
+	hook_expiry_req_t req;
+
+	if (mychan_expiry_due(mc) > CURRTIME)
+	{
+		expiry_schedule(&mc_expiry, &mc->expirynode, mc, mychan_expiry_due(mc));
+		return;
+	}
+
+	req.do_expire = 1;
+	req.data.mc = mc;
+
+	hook_call_channel_check_expire(&req);
+
+	if (!req.do_expire)
+		return;
+
+	if ((CURRTIME - mc->used) >= MYCHAN_USED_REFRESH)
+	{
+		/* keep last used time accurate to
+		 * within a day, making sure an active
+		 * channel will never get "Last used"
+		 * in /cs info -- jilles */
+		if (mychan_isused(mc))
+		{
+			mc->used = CURRTIME;
+			expiry_schedule(&mc_expiry, &mc->expirynode, mc, mychan_expiry_due(mc));
+			slog(LG_DEBUG, "expire_check(): updating last used time on %s because it appears to be still in use", mc->name);
+			return;
+		}
+	}
+
+	if (chansvs.expiry > 0 && mc->used < CURRTIME &&
+			(unsigned int)(CURRTIME - mc->used) >= chansvs.expiry)
+	{
+		/* held channels only need the last used refresh */
+		if (MC_HOLD & mc->flags)
+		{
+			expiry_schedule(&mc_expiry, &mc->expirynode, mc, CURRTIME + MYCHAN_USED_REFRESH);
+			return;
+		}
+
+		slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2"), mc->name, mychan_founder_names(mc));
+		slog(LG_VERBOSE, "expire_check(): expiring channel %s (unused %lds, founder %s, chanacs %zu)",
+				mc->name, (long)(CURRTIME - mc->used),
+				mychan_founder_names(mc),
+				MOWGLI_LIST_LENGTH(&mc->chanacs));
+
+		hook_call_channel_drop(mc);
+		if (mc->chan != NULL && !(mc->chan->flags & CHAN_LOG))
+			part(mc->name, chansvs.nick);
+
+		object_unref(mc);
+		return;
+	}
+
+	/* Idle but not in use: the next join updates the last used
+	 * time, so nothing happens before it could expire. */
+	expiry_reschedule(&mc_expiry, &mc->expirynode, mc,
+			chansvs.expiry > 0 ? mc->used + chansvs.expiry : 0);
+}
+
+/* the expiry settings changed; every key may be too late now */
+static void expiry_requeue(void)
+{
+	myentity_iteration_state_t mestate;
+	mowgli_patricia_iteration_state_t state;
+	myentity_t *mt;
 	mynick_t *mn;
 	mychan_t *mc;
-	user_t *u;
-	mowgli_patricia_iteration_state_t state;
-	hook_expiry_req_t req;
+
+	if (expiry_nick_period != nicksvs.expiry)
+	{
+		MYENTITY_FOREACH_T(mt, &mestate, ENT_USER)
+			expiry_schedule(&mu_expiry, &user(mt)->expirynode, user(mt), 0);
+		MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+			expiry_schedule(&mn_expiry, &mn->expirynode, mn, 0);
+		expiry_nick_period = nicksvs.expiry;
+	}
+
+	if (expiry_chan_period != chansvs.expiry)
+	{
+		MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+			expiry_schedule(&mc_expiry, &mc->expirynode, mc, 0);
+		expiry_chan_period = chansvs.expiry;
+	}
+}
+
+static void expire_myuser_node(timeheap_node_t *n, void *unused)
+{
+	expire_myuser(n->data);
+}
+
+static void expire_mynick_node(timeheap_node_t *n, void *unused)
+{
+	expire_mynick(n->data);
+}
+
+static void expire_mychan_node(timeheap_node_t *n, void *unused)
+{
+	expire_mychan(n->data);
+}
+
+void expire_check(void *arg)
+{
+	unsigned int accounts, nicks, channels;
 
 	/* Let them know about this and the likely subsequent db_save()
 	 * right away -- jilles */
 	if (curr_uplink != NULL && curr_uplink->conn != NULL)
 		sendq_flush(curr_uplink->conn);
 
-	myentity_foreach_t(ENT_USER, expire_myuser_cb, NULL);
+	expiry_requeue();
 
-	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
-	{
-		req.do_expire = 1;
-		req.data.mn = mn;
+	/* Each pass only deletes the objects it visits and ones of other
+	 * kinds (an account takes its nicks along), which is what the
+	 * collected node lists can cope with. */
+	accounts = timeheap_foreach_before(&mu_expiry, CURRTIME, expire_myuser_node, NULL);
+	nicks = timeheap_foreach_before(&mn_expiry, CURRTIME, expire_mynick_node, NULL);
+	channels = timeheap_foreach_before(&mc_expiry, CURRTIME, expire_mychan_node, NULL);
 
-		hook_call_nick_check_expire(&req);
+	slog(LG_DEBUG, "expire_check(): looked at %u accounts, %u nicks, %u channels", accounts, nicks, channels);
+}
 
-		if (!req.do_expire)
-			continue;
+/* the queue would have skipped this object; it should not be due */
+static void expire_sweep_verify(timeheap_node_t *n, time_t due, const char *what, const char *name)
+{
+	if (due == 0 || due > CURRTIME)
+		return;
 
-		if (nicksvs.expiry > 0 && mn->lastseen < CURRTIME &&
-				(unsigned int)(CURRTIME - mn->lastseen) >= nicksvs.expiry)
-		{
-			if (MU_HOLD & mn->owner->flags)
-				continue;
+	if (n->data == NULL || n->key > CURRTIME)
+		slog(LG_ERROR, "expire_sweep(): %s %s is due but not queued", what, name);
+}
 
-			/* do not drop main nick like this */
-			if (!irccasecmp(mn->nick, entity(mn->owner)->name))
-				continue;
+static int expire_sweep_myuser_cb(myentity_t *mt, void *unused)
+{
+	myuser_t *mu = user(mt);
 
-			u = user_find_named(mn->nick);
-			if (u != NULL && u->myuser == mn->owner)
-			{
-				/* still logged in, bleh */
-				mn->lastseen = CURRTIME;
-				mn->owner->lastlogin = CURRTIME;
-				continue;
-			}
+	return_val_if_fail(isuser(mt), 0);
 
-			slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2"), mn->nick, entity(mn->owner)->name);
-			slog(LG_VERBOSE, "expire_check(): expiring nick %s (unused %lds, account %s)",
-					mn->nick, (long)(CURRTIME - mn->lastseen),
-					entity(mn->owner)->name);
-			object_unref(mn);
-		}
-	}
+	if (!(MU_HOLD & mu->flags) && MOWGLI_LIST_LENGTH(&mu->logins) == 0)
+		expire_sweep_verify(&mu->expirynode, myuser_expiry_due(mu), "account", entity(mu)->name);
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
-	{
-		req.do_expire = 1;
-		req.data.mc = mc;
+	expire_myuser(mu);
+
+	return 0;
+}
 
-		hook_call_channel_check_expire(&req);
+/*
+ * expire_sweep()
+ *
+ * Does what expire_check() does by looking at every account, nick and
+ * channel instead of the due ones, and logs anything the expiry queues
+ * missed.
+ */
+void expire_sweep(void *arg)
+{
+	mowgli_patricia_iteration_state_t state;
+	mynick_t *mn;
+	mychan_t *mc;
 
-		if (!req.do_expire)
-			continue;
+	expiry_requeue();
 
-		if ((CURRTIME - mc->used) >= 86400 - 3660)
-		{
-			/* keep last used time accurate to
-			 * within a day, making sure an active
-			 * channel will never get "Last used"
-			 * in /cs info -- jilles */
-			if (mychan_isused(mc))
-			{
-				mc->used = CURRTIME;
-				slog(LG_DEBUG, "expire_check(): updating last used time on %s because it appears to be still in use", mc->name);
-				continue;
-			}
-		}
+	myentity_foreach_t(ENT_USER, expire_sweep_myuser_cb, NULL);
 
-		if (chansvs.expiry > 0 && mc->used < CURRTIME &&
-				(unsigned int)(CURRTIME - mc->used) >= chansvs.expiry)
-		{
-			if (MC_HOLD & mc->flags)
-				continue;
+	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+	{
+		if (!(MU_HOLD & mn->owner->flags) && irccasecmp(mn->nick, entity(mn->owner)->name))
+			expire_sweep_verify(&mn->expirynode, mynick_expiry_due(mn), "nick", mn->nick);
 
-			slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2"), mc->name, mychan_founder_names(mc));
-			slog(LG_VERBOSE, "expire_check(): expiring channel %s (unused %lds, founder %s, chanacs %zu)",
-					mc->name, (long)(CURRTIME - mc->used),
-					mychan_founder_names(mc),
-					MOWGLI_LIST_LENGTH(&mc->chanacs));
+		expire_mynick(mn);
+	}
 
-			hook_call_channel_drop(mc);
-			if (mc->chan != NULL && !(mc->chan->flags & CHAN_LOG))
-				part(mc->name, chansvs.nick);
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	{
+		if (!(MC_HOLD & mc->flags) && chansvs.expiry > 0)
+			expire_sweep_verify(&mc->expirynode, mc->used + chansvs.expiry, "channel", mc->name);
 
-			object_unref(mc);
-		}
+		expire_mychan(mc);
 	}
 }
 
@@ -62,6 +62,7 @@ bool offline_mode = false;
 bool permissive_mode = false;
 
 void (*db_save) (void *arg) = NULL;
+void (*db_save_background) (void *arg) = NULL;
 void (*db_load) (const char *name) = NULL;
 
 /* *INDENT-OFF* */
@@ -218,7 +219,8 @@ void atheme_init(char *execname, char *log_p)
 	/* set signal handlers */
 	init_signal_handlers();
 
-	/* initialize strshare */
+	/* initialize allocation accounting and strshare */
+	memtag_init();
 	strshare_init();
 
 	/* open log */
@@ -425,13 +427,17 @@ int atheme_main(int argc, char *argv[])
 	/* we probably have a few open already... */
 	me.maxfd = 3;
 
-	/* DB commit interval is configurable */
+	/* DB commit interval is configurable; periodic saves may be done
+	 * in the background if the backend supports it */
 	if (db_save && !readonly)
-		mowgli_timer_add(base_eventloop, "db_save", db_save, NULL, config_options.commit_interval);
+		mowgli_timer_add(base_eventloop, "db_save", db_save_background != NULL ? db_save_background : db_save, NULL, config_options.commit_interval);
 
 	/* check expires every hour */
 	mowgli_timer_add(base_eventloop, "expire_check", expire_check, NULL, 3600);
 
+	/* and check the expiry queues against everything once a day */
+	mowgli_timer_add(base_eventloop, "expire_sweep", expire_sweep, NULL, 86400);
+
 	/* check k/x/q line expires every minute */
 	mowgli_timer_add(base_eventloop, "kline_expire", kline_expire, NULL, 60);
 	mowgli_timer_add(base_eventloop, "xline_expire", xline_expire, NULL, 60);
@@ -467,6 +473,7 @@ int atheme_main(int argc, char *argv[])
 	if (runflags & RF_RESTART)
 	{
 		slog(LG_INFO, "main(): restarting");
+		log_flush();
 
 #ifdef HAVE_EXECVE
 		execv(BINDIR "/atheme-services", argv);
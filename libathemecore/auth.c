@@ -23,9 +23,15 @@
 
 #include "atheme.h"
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 bool auth_module_loaded = false;
 bool (*auth_user_custom)(myuser_t *mu, const char *password);
 
+verify_stats_t verify_stats;
+
 void set_password(myuser_t *mu, const char *newpassword)
 {
 	if (mu == NULL || newpassword == NULL)
@@ -42,6 +48,8 @@ void set_password(myuser_t *mu, const char *newpassword)
 		mu->flags &= ~MU_CRYPTPASS;			/* just in case */
 		mowgli_strlcpy(mu->pass, newpassword, PASSLEN);
 	}
+
+	hook_call_myuser_changed(mu);
 }
 
 bool verify_password(myuser_t *mu, const char *password)
@@ -67,6 +75,7 @@ bool verify_password(myuser_t *mu, const char *password)
 					      ci->id, ci_default->id, entity(mu)->name);
 
 				mowgli_strlcpy(mu->pass, ci_default->crypt(password, ci_default->salt()), PASSLEN);
+				hook_call_myuser_changed(mu);
 			}
 
 			return true;
@@ -84,3 +93,349 @@ bool verify_password(myuser_t *mu, const char *password)
 		return (strcmp(mu->pass, password) == 0);
 }
 
+
+#ifdef HAVE_PTHREAD
+#define VERIFY_MAX_IMPLS	8
+
+/*
+ * general::password_threads: verify_password_async() copies the password,
+ * the stored hash and the list of crypto providers into a request and
+ * queues it for a pool of threads. A thread runs the providers' crypt_r
+ * (and, if the hash is due to be transitioned, hashes the password again
+ * with the default provider), moves the request to the done list and
+ * pokes the main thread through a pipe. The main thread applies the
+ * result and calls the callback. Only the main thread touches mu, cb and
+ * priv; the threads only see the copies.
+ */
+struct verify_request_ {
+	myuser_t *mu;			/* NULL once the account is dropped */
+	verify_password_cb_t cb;
+	void *priv;
+	bool cancelled;
+	unsigned int queued;		/* verify_ms() at queueing */
+	mowgli_node_t node;		/* in verify_pending */
+
+	char *password;
+	char pass[PASSLEN];		/* mu->pass at queueing */
+	char salt[PASSLEN];		/* for rehashing with impls[0] */
+	const crypt_impl_t *impls[VERIFY_MAX_IMPLS];
+	unsigned int nimpls;
+
+	const crypt_impl_t *matched;
+	char newpass[PASSLEN];
+
+	verify_request_t *next;		/* in the queue or the done list */
+};
+
+static mowgli_list_t verify_pending;
+
+static pthread_mutex_t verify_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t verify_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t verify_idle = PTHREAD_COND_INITIALIZER;
+static verify_request_t *verify_queue_head, *verify_queue_tail;
+static verify_request_t *verify_done_head, *verify_done_tail;
+static unsigned int verify_busy;	/* queued or being worked on */
+
+static int verify_pipe[2] = { -1, -1 };
+static bool verify_started;
+static bool verify_forked;
+
+static unsigned int verify_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void *verify_worker_main(void *arg)
+{
+	verify_request_t *req;
+	char buf[BUFSIZE];
+	const char *cstr;
+	bool wasempty;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&verify_lock);
+		while (verify_queue_head == NULL)
+			pthread_cond_wait(&verify_wake, &verify_lock);
+		req = verify_queue_head;
+		verify_queue_head = req->next;
+		if (verify_queue_head == NULL)
+			verify_queue_tail = NULL;
+		pthread_mutex_unlock(&verify_lock);
+
+		req->matched = crypt_verify_password_r(req->password, req->pass, req->impls, req->nimpls, buf, sizeof buf);
+		if (req->matched != NULL && req->matched != req->impls[0])
+		{
+			cstr = req->impls[0]->crypt_r(req->password, req->salt, buf, sizeof buf);
+			if (cstr != NULL)
+				mowgli_strlcpy(req->newpass, cstr, PASSLEN);
+		}
+
+		pthread_mutex_lock(&verify_lock);
+		req->next = NULL;
+		wasempty = verify_done_head == NULL;
+		if (wasempty)
+			verify_done_head = req;
+		else
+			verify_done_tail->next = req;
+		verify_done_tail = req;
+		if (--verify_busy == 0)
+			pthread_cond_broadcast(&verify_idle);
+		pthread_mutex_unlock(&verify_lock);
+
+		if (wasempty)
+			(void)write(verify_pipe[1], "", 1);
+	}
+
+	return NULL;
+}
+
+static void verify_request_free(verify_request_t *req)
+{
+	memset(req->password, 0, strlen(req->password));
+	free(req->password);
+	memset(req, 0, sizeof *req);
+	free(req);
+}
+
+static void verify_request_done(verify_request_t *req)
+{
+	myuser_t *mu = req->mu;
+	bool verified;
+	unsigned int latency;
+
+	mowgli_node_delete(&req->node, &verify_pending);
+	verify_stats.pending--;
+
+	latency = verify_ms() - req->queued;
+	verify_stats.totallatency += latency;
+	if (latency > verify_stats.maxlatency)
+		verify_stats.maxlatency = latency;
+
+	if (req->cancelled)
+	{
+		verify_request_free(req);
+		return;
+	}
+
+	/* a password changed in the meantime is not the one we checked */
+	verified = mu != NULL && req->matched != NULL && !strcmp(mu->pass, req->pass);
+
+	/* the providers are still registered: crypt_unregister() drains us
+	 * first. the default may have changed since the request was queued.
+	 */
+	if (verified && req->newpass[0] != '\0' && req->impls[0] == crypt_get_default_provider())
+	{
+		slog(LG_INFO, "verify_password(): transitioning from crypt scheme '%s' to '%s' for account '%s'",
+			      req->matched->id, req->impls[0]->id, entity(mu)->name);
+
+		mowgli_strlcpy(mu->pass, req->newpass, PASSLEN);
+		hook_call_myuser_changed(mu);
+	}
+
+	req->cb(mu, verified, req->priv);
+	verify_request_free(req);
+}
+
+static void verify_done_run(void)
+{
+	verify_request_t *req, *next;
+
+	pthread_mutex_lock(&verify_lock);
+	req = verify_done_head;
+	verify_done_head = verify_done_tail = NULL;
+	pthread_mutex_unlock(&verify_lock);
+
+	for (; req != NULL; req = next)
+	{
+		next = req->next;
+		verify_request_done(req);
+	}
+}
+
+static void verify_done_read(connection_t *cptr)
+{
+	char buf[64];
+
+	while (read(cptr->fd, buf, sizeof buf) > 0)
+		;
+
+	verify_done_run();
+}
+
+static void verify_myuser_delete(myuser_t *mu)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, verify_pending.head)
+	{
+		verify_request_t *req = n->data;
+
+		if (req->mu == mu)
+			req->mu = NULL;
+	}
+}
+
+/* the threads do not exist in a fork()ed child */
+static void verify_atfork_child(void)
+{
+	verify_forked = true;
+}
+
+static bool verify_start(void)
+{
+	pthread_t thread;
+	sigset_t all, old;
+	unsigned int i;
+
+	if (verify_started)
+		return verify_stats.threads > 0;
+	verify_started = true;
+
+	if (pipe(verify_pipe) < 0)
+	{
+		slog(LG_ERROR, "verify_start(): pipe() failed: %s", strerror(errno));
+		return false;
+	}
+	fcntl(verify_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(verify_pipe[1], F_SETFL, O_NONBLOCK);
+
+	/* signals are for the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	for (i = 0; i < config_options.password_threads; i++)
+	{
+		if (pthread_create(&thread, NULL, verify_worker_main, NULL) != 0)
+			break;
+		pthread_detach(thread);
+		verify_stats.threads++;
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (verify_stats.threads == 0)
+	{
+		slog(LG_ERROR, "verify_start(): unable to start password verification threads");
+		close(verify_pipe[0]);
+		close(verify_pipe[1]);
+		return false;
+	}
+
+	connection_add("password verification pipe", verify_pipe[0], 0, verify_done_read, NULL);
+
+	pthread_atfork(NULL, NULL, verify_atfork_child);
+	hook_add_event("myuser_delete");
+	hook_add_myuser_delete(verify_myuser_delete);
+
+	return true;
+}
+
+static verify_request_t *verify_request_queue(myuser_t *mu, const char *password, verify_password_cb_t cb, void *priv)
+{
+	verify_request_t *req;
+	const crypt_impl_t *impls[VERIFY_MAX_IMPLS];
+	unsigned int nimpls;
+
+	if (config_options.password_threads == 0 || verify_forked)
+		return NULL;
+
+	if ((auth_module_loaded && auth_user_custom) || !(mu->flags & MU_CRYPTPASS) || !crypto_module_loaded)
+		return NULL;
+
+	if ((nimpls = crypt_get_reentrant_providers(impls, VERIFY_MAX_IMPLS)) == 0)
+		return NULL;
+
+	if (!verify_start())
+		return NULL;
+
+	if (verify_stats.pending >= config_options.password_queue)
+	{
+		verify_stats.full++;
+		return NULL;
+	}
+
+	req = scalloc(1, sizeof *req);
+	req->mu = mu;
+	req->cb = cb;
+	req->priv = priv;
+	req->queued = verify_ms();
+	req->password = sstrdup(password);
+	mowgli_strlcpy(req->pass, mu->pass, PASSLEN);
+	mowgli_strlcpy(req->salt, impls[0]->salt(), PASSLEN);
+	memcpy(req->impls, impls, nimpls * sizeof impls[0]);
+	req->nimpls = nimpls;
+
+	mowgli_node_add(req, &req->node, &verify_pending);
+	verify_stats.pending++;
+	verify_stats.queued++;
+
+	pthread_mutex_lock(&verify_lock);
+	if (verify_queue_tail != NULL)
+		verify_queue_tail->next = req;
+	else
+		verify_queue_head = req;
+	verify_queue_tail = req;
+	verify_busy++;
+	pthread_cond_signal(&verify_wake);
+	pthread_mutex_unlock(&verify_lock);
+
+	return req;
+}
+
+/* waits until the threads are no longer using any crypto provider and
+ * finishes the requests that refer to one
+ */
+void verify_password_drain(void)
+{
+	if (!verify_started || verify_forked)
+		return;
+
+	pthread_mutex_lock(&verify_lock);
+	while (verify_busy > 0)
+		pthread_cond_wait(&verify_idle, &verify_lock);
+	pthread_mutex_unlock(&verify_lock);
+
+	/* finished requests still point at the providers */
+	verify_done_run();
+}
+
+void verify_password_cancel(verify_request_t *req)
+{
+	return_if_fail(req != NULL);
+
+	req->cancelled = true;
+}
+#else
+static inline verify_request_t *verify_request_queue(myuser_t *mu, const char *password, verify_password_cb_t cb, void *priv) { return NULL; }
+void verify_password_drain(void) { }
+void verify_password_cancel(verify_request_t *req) { }
+#endif
+
+/*
+ * verify_password_async is verify_password() for callers that can wait:
+ * if the password can be checked by a general::password_threads thread,
+ * it returns VERIFY_PENDING and cb is called from the event loop with the
+ * result later, unless the request left in *reqp is cancelled first.
+ * Otherwise it checks the password right away and returns VERIFY_OK or
+ * VERIFY_FAIL without calling cb.
+ */
+int verify_password_async(myuser_t *mu, const char *password, verify_password_cb_t cb, void *priv, verify_request_t **reqp)
+{
+	verify_request_t *req;
+
+	*reqp = NULL;
+
+	if (mu == NULL || password == NULL)
+		return VERIFY_FAIL;
+
+	if ((req = verify_request_queue(mu, password, cb, priv)) != NULL)
+	{
+		*reqp = req;
+		return VERIFY_PENDING;
+	}
+
+	verify_stats.direct++;
+	return verify_password(mu, password) ? VERIFY_OK : VERIFY_FAIL;
+}
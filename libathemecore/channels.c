@@ -25,14 +25,103 @@
 
 mowgli_patricia_t *chanlist;
 
-mowgli_heap_t *chan_heap;
-mowgli_heap_t *chanuser_heap;
-mowgli_heap_t *chanban_heap;
+/*
+ * Every membership is also kept in an open addressing hash table keyed on
+ * the (channel, user) pair, so chanuser_find() does not have to walk
+ * either member list. Collisions are resolved by linear probing; the
+ * table is kept between 1/8 and 1/2 full.
+ */
+
+#define CHANUSER_MINSIZE	4096
+
+typedef struct
+{
+	unsigned int hash;
+	chanuser_t *cu;
+} chanuser_slot_t;
+
+static chanuser_slot_t *chanuser_table;
+static unsigned int chanuser_mask;
+static unsigned int chanuser_count;
+
+static inline unsigned int chanuser_hash(channel_t *chan, user_t *user)
+{
+	uint64_t h = (uint64_t)(uintptr_t)chan * 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uintptr_t)user;
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	return (unsigned int)h;
+}
+
+static void chanuser_resize(unsigned int size)
+{
+	chanuser_slot_t *old = chanuser_table;
+	unsigned int oldsize = chanuser_mask + 1, i, j;
+
+	chanuser_table = scalloc(sizeof(chanuser_slot_t), size);
+	chanuser_mask = size - 1;
+
+	if (old == NULL)
+		return;
+
+	for (i = 0; i < oldsize; i++)
+	{
+		if (old[i].cu == NULL)
+			continue;
+		for (j = old[i].hash & chanuser_mask; chanuser_table[j].cu != NULL; j = (j + 1) & chanuser_mask)
+			;
+		chanuser_table[j] = old[i];
+	}
+	free(old);
+}
+
+static void chanuser_index_add(chanuser_t *cu)
+{
+	unsigned int hash = chanuser_hash(cu->chan, cu->user), i;
+
+	for (i = hash & chanuser_mask; chanuser_table[i].cu != NULL; i = (i + 1) & chanuser_mask)
+		;
+	chanuser_table[i].hash = hash;
+	chanuser_table[i].cu = cu;
+
+	if (++chanuser_count * 2 > chanuser_mask + 1)
+		chanuser_resize((chanuser_mask + 1) * 2);
+}
+
+static void chanuser_index_delete(chanuser_t *cu)
+{
+	unsigned int i, j, k;
+
+	for (i = chanuser_hash(cu->chan, cu->user) & chanuser_mask; chanuser_table[i].cu != cu; i = (i + 1) & chanuser_mask)
+		return_if_fail(chanuser_table[i].cu != NULL);
+
+	/* move later entries of the same probe run up */
+	for (j = i;;)
+	{
+		j = (j + 1) & chanuser_mask;
+		if (chanuser_table[j].cu == NULL)
+			break;
+
+		k = chanuser_table[j].hash & chanuser_mask;
+
+		/* leave it if its home slot is cyclically in (i, j] */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		chanuser_table[i] = chanuser_table[j];
+		i = j;
+	}
+	chanuser_table[i].cu = NULL;
+
+	if (--chanuser_count * 8 < chanuser_mask + 1 && chanuser_mask + 1 > CHANUSER_MINSIZE)
+		chanuser_resize((chanuser_mask + 1) / 2);
+}
 
 /*
  * init_channels()
  *
- * Initializes the channel-related heaps and DTree structures.
+ * Initializes the channel-related hash tables and DTree structures.
  *
  * Inputs:
  *     - nothing
@@ -41,21 +130,12 @@ mowgli_heap_t *chanban_heap;
  *     - nothing
  *
  * Side Effects:
- *     - if the heaps or DTrees fail to initialize, the program will abort.
+ *     - if the DTree fails to initialize, the program will abort.
  */
 void init_channels(void)
 {
-	chan_heap = sharedheap_get(sizeof(channel_t));
-	chanuser_heap = sharedheap_get(sizeof(chanuser_t));
-	chanban_heap = sharedheap_get(sizeof(chanban_t));
-
-	if (chan_heap == NULL || chanuser_heap == NULL || chanban_heap == NULL)
-	{
-		slog(LG_INFO, "init_channels(): block allocator failure.");
-		exit(EXIT_FAILURE);
-	}
-
 	chanlist = mowgli_patricia_create(irccasecanon);
+	chanuser_resize(CHANUSER_MINSIZE);
 }
 
 /*
@@ -101,7 +181,7 @@ channel_t *channel_add(const char *name, time_t ts, server_t *creator)
 
 	slog(LG_DEBUG, "channel_add(): %s by %s", name, creator->name);
 
-	c = mowgli_heap_alloc(chan_heap);
+	c = sharedheap_alloc(&memtag_channels, sizeof(channel_t));
 
 	c->name = sstrdup(name);
 	c->ts = ts;
@@ -169,8 +249,11 @@ void channel_delete(channel_t *c)
 		cu = n->data;
 		soft_assert(is_internal_client(cu->user) && !me.connected);
 		mowgli_node_delete(&cu->cnode, &c->members);
+		if (is_internal_client(cu->user))
+			mowgli_node_delete(&cu->snode, &c->services);
 		mowgli_node_delete(&cu->unode, &cu->user->channels);
-		mowgli_heap_free(chanuser_heap, cu);
+		chanuser_index_delete(cu);
+		sharedheap_free(&memtag_chanusers, cu, sizeof(chanuser_t));
 		cnt.chanuser--;
 	}
 	c->nummembers = 0;
@@ -194,7 +277,7 @@ void channel_delete(channel_t *c)
 	if (c->topic_setter != NULL)
 		free(c->topic_setter);
 
-	mowgli_heap_free(chan_heap, c);
+	sharedheap_free(&memtag_channels, c, sizeof(channel_t));
 
 	cnt.chan--;
 }
@@ -240,11 +323,12 @@ chanban_t *chanban_add(channel_t *chan, const char *mask, int type)
 
 	slog(LG_DEBUG, "chanban_add(): %s +%c %s", chan->name, type, mask);
 
-	c = mowgli_heap_alloc(chanban_heap);
+	c = sharedheap_alloc(&memtag_chanbans, sizeof(chanban_t));
 
 	c->chan = chan;
 	c->mask = sstrdup(mask);
 	c->type = type;
+	mask_compile(&c->cmask, c->mask);
 
 	mowgli_node_add(c, &c->node, &chan->bans);
 
@@ -271,8 +355,9 @@ void chanban_delete(chanban_t * c)
 
 	mowgli_node_delete(&c->node, &c->chan->bans);
 
+	mask_free(&c->cmask);
 	free(c->mask);
-	mowgli_heap_free(chanban_heap, c);
+	sharedheap_free(&memtag_chanbans, c, sizeof(chanban_t));
 }
 
 /*
@@ -393,7 +478,7 @@ chanuser_t *chanuser_add(channel_t *chan, const char *nick)
 
 	slog(LG_DEBUG, "chanuser_add(): %s -> %s", chan->name, u->nick);
 
-	cu = mowgli_heap_alloc(chanuser_heap);
+	cu = sharedheap_alloc(&memtag_chanusers, sizeof(chanuser_t));
 
 	cu->chan = chan;
 	cu->user = u;
@@ -402,7 +487,10 @@ chanuser_t *chanuser_add(channel_t *chan, const char *nick)
 	chan->nummembers++;
 
 	mowgli_node_add(cu, &cu->cnode, &chan->members);
+	if (is_internal_client(u))
+		mowgli_node_add(cu, &cu->snode, &chan->services);
 	mowgli_node_add(cu, &cu->unode, &u->channels);
+	chanuser_index_add(cu);
 
 	cnt.chanuser++;
 
@@ -452,9 +540,12 @@ void chanuser_delete(channel_t *chan, user_t *user)
 	slog(LG_DEBUG, "chanuser_delete(): %s -> %s (%d)", cu->chan->name, cu->user->nick, cu->chan->nummembers - 1);
 
 	mowgli_node_delete(&cu->cnode, &chan->members);
+	if (is_internal_client(user))
+		mowgli_node_delete(&cu->snode, &chan->services);
 	mowgli_node_delete(&cu->unode, &user->channels);
+	chanuser_index_delete(cu);
 
-	mowgli_heap_free(chanuser_heap, cu);
+	sharedheap_free(&memtag_chanusers, cu, sizeof(chanuser_t));
 
 	chan->nummembers--;
 	cnt.chanuser--;
@@ -486,33 +577,16 @@ void chanuser_delete(channel_t *chan, user_t *user)
  */
 chanuser_t *chanuser_find(channel_t *chan, user_t *user)
 {
-	mowgli_node_t *n;
 	chanuser_t *cu;
+	unsigned int hash, i;
 
 	return_val_if_fail(chan != NULL, NULL);
 	return_val_if_fail(user != NULL, NULL);
 
-	/* choose shortest list to search -- jilles */
-	if (MOWGLI_LIST_LENGTH(&user->channels) < MOWGLI_LIST_LENGTH(&chan->members))
-	{
-		MOWGLI_ITER_FOREACH(n, user->channels.head)
-		{
-			cu = (chanuser_t *)n->data;
-
-			if (cu->chan == chan)
-				return cu;
-		}
-	}
-	else
-	{
-		MOWGLI_ITER_FOREACH(n, chan->members.head)
-		{
-			cu = (chanuser_t *)n->data;
-
-			if (cu->user == user)
-				return cu;
-		}
-	}
+	hash = chanuser_hash(chan, user);
+	for (i = hash & chanuser_mask; (cu = chanuser_table[i].cu) != NULL; i = (i + 1) & chanuser_mask)
+		if (chanuser_table[i].hash == hash && cu->chan == chan && cu->user == user)
+			return cu;
 
 	return NULL;
 }
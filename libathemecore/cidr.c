@@ -365,6 +365,33 @@ match_cidr(const char *s1, const char *s2)
 		return 1;
 }
 
+/* parse_ip()
+ *
+ * Input - IPv4 or IPv6 address, buffer of IN6ADDRSZ bytes
+ * Output - 4 or 6 for the address family, 0 if not an address
+ * Addresses containing ':' are IPv6, the same rule match_cidr() uses.
+ */
+int
+parse_ip(const char *ip, unsigned char *addr)
+{
+	if (ip == NULL)
+		return 0;
+	if (strchr(ip, ':'))
+		return inet_pton6(ip, addr) ? 6 : 0;
+	return inet_pton4(ip, addr) ? 4 : 0;
+}
+
+/* match_ip_bits()
+ *
+ * Input - two addresses from parse_ip(), number of bits to compare
+ * Output - 0 = Matched 1 = Did not match
+ */
+int
+match_ip_bits(const unsigned char *addr, const unsigned char *mask, unsigned int bits)
+{
+	return !comp_with_mask((void *)(uintptr_t)addr, (void *)(uintptr_t)mask, bits);
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
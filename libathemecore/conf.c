@@ -241,12 +241,21 @@ void init_newconf(void)
 	add_duration_conf_item("KLINE_TIME", &conf_gi_table, 0, &config_options.kline_time, "d", 0);
 	add_duration_conf_item("CLONE_TIME", &conf_gi_table, 0, &config_options.clone_time, "m", 0);
 	add_duration_conf_item("COMMIT_INTERVAL", &conf_gi_table, 0, &config_options.commit_interval, "m", 300);
+	add_bool_conf_item("DB_SAVE_FORK", &conf_gi_table, 0, &config_options.db_save_fork, false);
 	/* XXX: These options should probably move into operserv/clones eventually */
 	add_uint_conf_item("DEFAULT_CLONE_WARN", &conf_gi_table, 0, &config_options.default_clone_warn, 1, INT_MAX, 5);
 	add_uint_conf_item("DEFAULT_CLONE_ALLOWED", &conf_gi_table, 0, &config_options.default_clone_allowed, 1, INT_MAX, 5);
 	add_bool_conf_item("CLONE_IDENTIFIED_INCREASE_LIMIT", &conf_gi_table, 0, &config_options.clone_increase, false);
 
 	add_uint_conf_item("UPLINK_SENDQ_LIMIT", &conf_gi_table, 0, &config_options.uplink_sendq_limit, 10240, INT_MAX, 1048576);
+	add_uint_conf_item("UPLINK_RECVQ_BUDGET", &conf_gi_table, 0, &config_options.uplink_recvq_budget, 0, INT_MAX, 1000);
+	add_bool_conf_item("LOG_ASYNC", &conf_gi_table, 0, &config_options.log_async, false);
+	add_uint_conf_item("LOG_ASYNC_BUFFER", &conf_gi_table, 0, &config_options.log_async_buffer, 16, 1048576, 1024);
+	add_uint_conf_item("LOG_FLUSH_INTERVAL", &conf_gi_table, 0, &config_options.log_flush_interval, 10, 60000, 1000);
+	add_bool_conf_item("LOG_ASYNC_BLOCK", &conf_gi_table, 0, &config_options.log_async_block, false);
+	add_uint_conf_item("PASSWORD_THREADS", &conf_gi_table, 0, &config_options.password_threads, 0, 64, 2);
+	add_uint_conf_item("PASSWORD_QUEUE", &conf_gi_table, 0, &config_options.password_queue, 1, 65536, 256);
+	add_bool_conf_item("HUGEPAGES", &conf_gi_table, 0, &config_options.hugepages, false);
 	add_dupstr_conf_item("LANGUAGE", &conf_gi_table, 0, &config_options.language, "en");
 	add_conf_item("EXEMPTS", &conf_gi_table, c_gi_exempts);
 	add_conf_item("IMMUNE_LEVEL", &conf_gi_table, c_gi_immune_level);
@@ -31,6 +31,14 @@ static const char *generic_crypt_string(const char *str, const char *salt)
 	return str;
 }
 
+static const char *generic_crypt_string_r(const char *str, const char *salt, char *buf, size_t buflen)
+{
+	if (strlen(str) >= buflen)
+		return NULL;
+
+	return strcpy(buf, str);
+}
+
 static const char *generic_gen_salt(void)
 {
 	static char buf[BUFSIZE];
@@ -93,7 +101,10 @@ void crypt_register(crypt_impl_t *impl)
 	return_if_fail(impl != NULL);
 
 	if (impl->crypt == NULL)
+	{
 		impl->crypt = &generic_crypt_string;
+		impl->crypt_r = &generic_crypt_string_r;
+	}
 	if (impl->salt == NULL)
 		impl->salt = &generic_gen_salt;
 
@@ -106,6 +117,9 @@ void crypt_unregister(crypt_impl_t *impl)
 {
 	return_if_fail(impl != NULL);
 
+	/* password verification threads may be using it */
+	verify_password_drain();
+
 	mowgli_node_delete(&impl->node, &crypt_impl_list);
 
 	crypto_module_loaded = MOWGLI_LIST_LENGTH(&crypt_impl_list) > 0 ? true : false;
@@ -138,6 +152,54 @@ const crypt_impl_t *crypt_verify_password(const char *uinput, const char *pass)
 	return NULL;
 }
 
+/*
+ * crypt_get_reentrant_providers fills impls with the registered providers
+ * in the order crypt_verify_password() tries them, if every one of them
+ * has a crypt_r. Returns how many there are, or 0 if any of them lacks
+ * crypt_r or there are more than max.
+ */
+unsigned int crypt_get_reentrant_providers(const crypt_impl_t **impls, unsigned int max)
+{
+	mowgli_node_t *n;
+	unsigned int count = 0;
+
+	MOWGLI_ITER_FOREACH(n, crypt_impl_list.head)
+	{
+		crypt_impl_t *ci = n->data;
+
+		if (ci->crypt_r == NULL || count == max)
+			return 0;
+
+		impls[count++] = ci;
+	}
+
+	return count;
+}
+
+/*
+ * crypt_verify_password_r is crypt_verify_password() for other threads:
+ * it only uses the providers in impls, as returned by
+ * crypt_get_reentrant_providers(), and their crypt_r into buf.
+ */
+const crypt_impl_t *crypt_verify_password_r(const char *uinput, const char *pass, const crypt_impl_t *const *impls, unsigned int count, char *buf, size_t buflen)
+{
+	const char *cstr;
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+	{
+		cstr = impls[i]->crypt_r(uinput, pass, buf, buflen);
+
+		if (cstr != NULL && !strcmp(cstr, pass))
+			return impls[i];
+	}
+
+	if (!strcmp(uinput, pass))
+		return &fallback_crypt_impl;
+
+	return NULL;
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
@@ -19,11 +19,11 @@ db_open(const char *filename, database_transaction_t txn)
 	return db_mod->db_open(filename, txn);
 }
 
-void
+bool
 db_close(database_handle_t *db)
 {
-	return_if_fail(db_mod != NULL);
-	return_if_fail(db_mod->db_close != NULL);
+	return_val_if_fail(db_mod != NULL, false);
+	return_val_if_fail(db_mod->db_close != NULL, false);
 
 	return db_mod->db_close(db);
 }
@@ -238,6 +238,16 @@ db_commit_row(database_handle_t *db)
 	return db->vt->commit_row(db);
 }
 
+bool
+db_flush(database_handle_t *db)
+{
+	return_val_if_fail(db != NULL, false);
+	return_val_if_fail(db->vt != NULL, false);
+	return_val_if_fail(db->vt->flush != NULL, false);
+
+	return db->vt->flush(db);
+}
+
 void
 db_register_type_handler(const char *type, database_handler_f fun)
 {
@@ -23,13 +23,29 @@
 
 #include "atheme.h"
 #include "datastream.h"
+#include "uplink.h"
 
-#define SENDQSIZE (4096 - 40)
+#ifndef MOWGLI_OS_WIN
+# include <sys/uio.h>
+#endif
+
+#define SENDQSIZE (16384 - 40)
+
+/* most recv() calls made for one readable event */
+#define RECVQ_MAXREADS 16
+
+/* most sendq chunks handed to a single writev() */
+#define SENDQ_MAXIOV 64
 
 #ifdef MOWGLI_OS_WIN
 # define EWOULDBLOCK	WSAEWOULDBLOCK
 # define EALREADY	WSAEALREADY
 # define ENOBUFS	WSAENOBUFS
+
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
 #endif
 
 /* sendq struct */
@@ -40,6 +56,43 @@ struct sendq {
 	char buf[SENDQSIZE];
 };
 
+/* sendq and recvq chunks come from the arena rather than going back
+ * to malloc every time a burst fills and drains a queue
+ */
+static struct sendq *sendq_chunk_create(void)
+{
+	struct sendq *sq;
+
+	sq = sharedheap_alloc(&memtag_sendq, sizeof(struct sendq));
+	sq->firstused = sq->firstfree = 0;
+
+	return sq;
+}
+
+static void sendq_chunk_free(struct sendq *sq)
+{
+	sharedheap_free(&memtag_sendq, sq, sizeof(struct sendq));
+}
+
+/* number of bytes queued; only the first and last chunk can be
+ * partially used
+ */
+static size_t sendq_length(connection_t *cptr)
+{
+	struct sendq *head, *tail;
+	size_t count = MOWGLI_LIST_LENGTH(&cptr->sendq);
+
+	if (count == 0)
+		return 0;
+
+	head = cptr->sendq.head->data;
+	if (count == 1)
+		return head->firstfree - head->firstused;
+
+	tail = cptr->sendq.tail->data;
+	return (count - 2) * SENDQSIZE + (SENDQSIZE - head->firstused) + tail->firstfree;
+}
+
 void sendq_add(connection_t * cptr, char *buf, size_t len)
 {
 	mowgli_node_t *n;
@@ -59,7 +112,7 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 		return;
 
 	if (cptr->sendq_limit != 0 &&
-			MOWGLI_LIST_LENGTH(&cptr->sendq) * SENDQSIZE + len > cptr->sendq_limit)
+			sendq_length(cptr) + len > cptr->sendq_limit)
 	{
 		slog(LG_INFO, "sendq_add(): sendq limit exceeded on connection %s[%d]",
 				cptr->name, cptr->fd);
@@ -68,7 +121,13 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 	}
 
 	if (!sendq_nonempty(cptr))
+	{
 		connection_setselect_write(cptr, sendq_flush);
+#ifdef HAVE_GETTIMEOFDAY
+		if (cptr->flags & CF_UPLINK)
+			s_time(&uplink_stats.sendq_since);
+#endif
+	}
 
 	n = cptr->sendq.tail;
 	if (n != NULL)
@@ -85,8 +144,7 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 
 	while (len > 0)
 	{
-		sq = smalloc(sizeof(struct sendq));
-		sq->firstused = sq->firstfree = 0;
+		sq = sendq_chunk_create();
 		mowgli_node_add(sq, &sq->node, &cptr->sendq);
 		l = SENDQSIZE - sq->firstfree;
 		if (l > len)
@@ -96,6 +154,13 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 		pos += l;
 		len -= l;
 	}
+
+	if (cptr->flags & CF_UPLINK)
+	{
+		l = sendq_length(cptr);
+		if (l > uplink_stats.sendq_hwm)
+			uplink_stats.sendq_hwm = l;
+	}
 }
 
 void sendq_add_eof(connection_t * cptr)
@@ -114,24 +179,48 @@ void sendq_add_eof(connection_t * cptr)
 
 void sendq_flush(connection_t * cptr)
 {
-        mowgli_node_t *n, *tn;
-        struct sendq *sq;
-        int l;
+	mowgli_node_t *n, *tn;
+	struct sendq *sq;
+	struct iovec iov[SENDQ_MAXIOV];
+	int iovcnt;
+	ssize_t l;
+	bool wrote = false;
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval flushtime;
+	int ms;
+#endif
 
 	return_if_fail(cptr != NULL);
 
-        MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->sendq.head)
-        {
-                sq = (struct sendq *)n->data;
+	for (;;)
+	{
+		/* gather as much of the sendq as we can into one write */
+		iovcnt = 0;
+		MOWGLI_ITER_FOREACH(n, cptr->sendq.head)
+		{
+			sq = (struct sendq *)n->data;
+
+			if (sq->firstused == sq->firstfree || iovcnt == SENDQ_MAXIOV)
+				break;
+
+			iov[iovcnt].iov_base = sq->buf + sq->firstused;
+			iov[iovcnt].iov_len = sq->firstfree - sq->firstused;
+			iovcnt++;
+		}
 
-                if (sq->firstused == sq->firstfree)
-                        break;
+		if (iovcnt == 0)
+			break;
 
-                if ((l = send(cptr->fd, sq->buf + sq->firstused, sq->firstfree - sq->firstused, 0)) == -1)
-                {
-                        int err = ioerrno();
+#ifndef MOWGLI_OS_WIN
+		l = writev(cptr->fd, iov, iovcnt);
+#else
+		l = send(cptr->fd, iov[0].iov_base, iov[0].iov_len, 0);
+#endif
+		if (l == -1)
+		{
+			int err = ioerrno();
 
-                        if (!mowgli_eventloop_ignore_errno(err))
+			if (!mowgli_eventloop_ignore_errno(err))
 			{
 				slog(LG_DEBUG, "sendq_flush(): write error %d (%s) on connection %s[%d]",
 						err, strerror(err),
@@ -139,24 +228,58 @@ void sendq_flush(connection_t * cptr)
 				cptr->flags |= CF_DEAD;
 			}
 
-                        return;
-                }
+			return;
+		}
+
+		wrote = true;
+		if (cptr->flags & CF_UPLINK)
+		{
+			uplink_stats.writes++;
+			uplink_stats.writebytes += l;
+		}
+
+		/* release what was written */
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, cptr->sendq.head)
+		{
+			sq = (struct sendq *)n->data;
 
-                sq->firstused += l;
-                if (sq->firstused == sq->firstfree)
-                {
+			if (l < sq->firstfree - sq->firstused)
+			{
+				sq->firstused += l;
+				/* short write, wait until we are writable again */
+				return;
+			}
+
+			l -= sq->firstfree - sq->firstused;
 			if (MOWGLI_LIST_LENGTH(&cptr->sendq) > 1)
 			{
-                        	mowgli_node_delete(&sq->node, &cptr->sendq);
-                        	free(sq);
+				mowgli_node_delete(&sq->node, &cptr->sendq);
+				sendq_chunk_free(sq);
 			}
 			else
+			{
 				/* keep one struct sendq */
 				sq->firstused = sq->firstfree = 0;
-                }
-                else
-                        return;
-        }
+				break;
+			}
+
+			if (l == 0)
+				break;
+		}
+	}
+
+#ifdef HAVE_GETTIMEOFDAY
+	if (wrote && cptr->flags & CF_UPLINK)
+	{
+		e_time(uplink_stats.sendq_since, &flushtime);
+		ms = tv2ms(&flushtime);
+		uplink_stats.flushes++;
+		uplink_stats.flushms += ms;
+		if ((unsigned int) ms > uplink_stats.maxflushms)
+			uplink_stats.maxflushms = ms;
+	}
+#endif
+
 	if (cptr->flags & CF_SEND_EOF)
 	{
 		/* shut down write end, kill entire connection
@@ -209,8 +332,9 @@ int recvq_length(connection_t *cptr)
 void recvq_put(connection_t *cptr)
 {
 	mowgli_node_t *n;
-	struct sendq *sq = NULL;
+	struct sendq *sq;
 	int l, ll;
+	int reads = 0;
 
 	return_if_fail(cptr != NULL);
 
@@ -228,35 +352,49 @@ void recvq_put(connection_t *cptr)
 		return;
 	}
 
-	n = cptr->recvq.tail;
-	if (n != NULL)
+	/* keep reading as long as the kernel fills our buffers, so a
+	 * burst is pulled in with few wakeups; the handler below then
+	 * gets to see all of it at once
+	 */
+	do
 	{
-		sq = n->data;
-		l = SENDQSIZE - sq->firstfree;
-		if (l == 0)
-			sq = NULL;
-	}
-	if (sq == NULL)
-	{
-		sq = smalloc(sizeof(struct sendq));
-		sq->firstused = sq->firstfree = 0;
-		mowgli_node_add(sq, &sq->node, &cptr->recvq);
-		l = SENDQSIZE;
-	}
-	errno = 0;
+		sq = NULL;
+		n = cptr->recvq.tail;
+		if (n != NULL)
+		{
+			sq = n->data;
+			ll = SENDQSIZE - sq->firstfree;
+			if (ll == 0)
+				sq = NULL;
+		}
+		if (sq == NULL)
+		{
+			sq = sendq_chunk_create();
+			mowgli_node_add(sq, &sq->node, &cptr->recvq);
+			ll = SENDQSIZE;
+		}
+		errno = 0;
 
-	l = recv(cptr->fd, sq->buf + sq->firstfree, l, 0);
-	if (l == 0 || (l < 0 && !mowgli_eventloop_ignore_errno(ioerrno())))
-	{
-		if (l == 0)
-			slog(LG_DEBUG, "recvq_put(): fd %d closed the connection", cptr->fd);
-		else
-			slog(LG_DEBUG, "recvq_put(): lost connection on fd %d", cptr->fd);
-		connection_close(cptr);
-		return;
-	}
-	else if (l > 0)
-		sq->firstfree += l;
+		l = recv(cptr->fd, sq->buf + sq->firstfree, ll, 0);
+		if (l == 0 || (l < 0 && !mowgli_eventloop_ignore_errno(ioerrno())))
+		{
+			if (l == 0)
+				slog(LG_DEBUG, "recvq_put(): fd %d closed the connection", cptr->fd);
+			else
+				slog(LG_DEBUG, "recvq_put(): lost connection on fd %d", cptr->fd);
+			connection_close(cptr);
+			return;
+		}
+		else if (l > 0)
+		{
+			sq->firstfree += l;
+			if (cptr->flags & CF_UPLINK)
+			{
+				uplink_stats.reads++;
+				uplink_stats.readbytes += l;
+			}
+		}
+	} while (l == ll && ++reads < RECVQ_MAXREADS);
 
 	if (cptr->recvq_handler)
 	{
@@ -300,7 +438,7 @@ int recvq_get(connection_t *cptr, char *buf, size_t len)
 			if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
 			{
 				mowgli_node_delete(&sq->node, &cptr->recvq);
-				free(sq);
+				sendq_chunk_free(sq);
 			}
 			else
 				/* keep one struct sendq */
@@ -356,7 +494,7 @@ int recvq_getline(connection_t *cptr, char *buf, size_t len)
 			if (MOWGLI_LIST_LENGTH(&cptr->recvq) > 1)
 			{
 				mowgli_node_delete(&sq->node, &cptr->recvq);
-				free(sq);
+				sendq_chunk_free(sq);
 			}
 			else
 				/* keep one struct sendq */
@@ -378,7 +516,7 @@ void sendqrecvq_free(connection_t *cptr)
 		sq = nptr->data;
 
 		mowgli_node_delete(&sq->node, &cptr->recvq);
-		free(sq);
+		sendq_chunk_free(sq);
 	}
 
 	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, cptr->sendq.head)
@@ -386,7 +524,7 @@ void sendqrecvq_free(connection_t *cptr)
 		sq = nptr->data;
 
 		mowgli_node_delete(&sq->node, &cptr->sendq);
-		free(sq);
+		sendq_chunk_free(sq);
 	}
 }
 
@@ -305,12 +305,7 @@ static void canonicalize_emails(void)
 	myentity_t *mt;
 
 	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
-	{
-		myuser_t *mu = user(mt);
-
-		strshare_unref(mu->email_canonical);
-		mu->email_canonical = canonicalize_email(mu->email);
-	}
+		myuser_recanonicalize(user(mt));
 }
 
 void
@@ -376,9 +371,7 @@ void canonicalize_email_case(char email[EMAILLEN + 1], void *user_data)
 bool email_within_limits(const char *email)
 {
 	mowgli_node_t *n;
-	myentity_iteration_state_t state;
-	myentity_t *mt;
-	unsigned int tcnt = 0;
+	mowgli_list_t *l;
 	stringref email_canonical;
 	bool result = true;
 
@@ -393,19 +386,9 @@ bool email_within_limits(const char *email)
 
 	email_canonical = canonicalize_email(email);
 
-	MYENTITY_FOREACH_T(mt, &state, ENT_USER)
-	{
-		myuser_t *mu = user(mt);
-
-		if (mu->email_canonical == email_canonical)
-			tcnt++;
-
-		/* optimization: if tcnt >= me.maxusers, quit iterating. -nenolod */
-		if (tcnt >= me.maxusers) {
-			result = false;
-			break;
-		}
-	}
+	l = myuser_email_canonical_list(email_canonical);
+	if (l != NULL && MOWGLI_LIST_LENGTH(l) >= me.maxusers)
+		result = false;
 
 	strshare_unref(email_canonical);
 	return result;
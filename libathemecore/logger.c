@@ -28,6 +28,377 @@ int log_force;
 
 static mowgli_list_t log_files = { NULL, NULL, 0 };
 
+/* union of log_mask over log_files, see log_wanted() */
+static unsigned int log_interest;
+
+static void log_update_interest(void)
+{
+	mowgli_node_t *n;
+	logfile_t *lf;
+
+	log_interest = 0;
+	MOWGLI_ITER_FOREACH(n, log_files.head)
+	{
+		lf = n->data;
+		log_interest |= lf->log_mask;
+	}
+}
+
+/*
+ * Whether anything would be written for a message of this level. Until
+ * the main log file is open, errors and info still go to the terminal.
+ */
+static inline bool log_wanted(unsigned int level)
+{
+	if (log_force)
+		return true;
+	return (level & (log_file != NULL ? log_interest : log_interest | LG_ERROR | LG_INFO)) != 0;
+}
+
+/*
+ * The "[dd/mm/yyyy hh:mm:ss]" prefix, formatted at most once a second.
+ */
+static const char *log_timestamp(void)
+{
+	static char datetime[64];
+	static time_t lastt = 0;
+	time_t t;
+
+	time(&t);
+	if (t != lastt)
+	{
+		strftime(datetime, sizeof datetime, "[%d/%m/%Y %H:%M:%S]", localtime(&t));
+		lastt = t;
+	}
+
+	return datetime;
+}
+
+log_async_stats_t log_async_stats;
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+/*
+ * general::log_async: lines for log files are formatted by the main
+ * thread and copied into a ring with one producer (the main thread)
+ * and one consumer (the writer thread). The writer wakes up every
+ * log_flush_interval milliseconds, or when the ring is half full, and
+ * writes everything queued with one write() per file. While it runs,
+ * the main thread does not touch the files at all.
+ *
+ * head and tail only ever grow; head is advanced by the main thread
+ * once a record is complete, tail by the writer once it is on disk.
+ */
+typedef struct {
+	int fd;
+	unsigned int len;
+	unsigned int queued;	/* log_async_ms() at queueing */
+} log_record_t;
+
+static char *log_ring;
+static size_t log_ring_size;
+static size_t log_ring_head, log_ring_tail;
+
+static pthread_t log_writer;
+static pthread_mutex_t log_writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_writer_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_writer_done = PTHREAD_COND_INITIALIZER;
+static bool log_writer_stopping;
+static bool log_writer_forked;
+static bool log_writer_failed;	/* pthread_create() failed, until a rehash */
+
+static unsigned int log_async_ms(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void log_ring_read(size_t pos, void *data, size_t len)
+{
+	size_t off = pos % log_ring_size;
+	size_t n = len < log_ring_size - off ? len : log_ring_size - off;
+
+	memcpy(data, log_ring + off, n);
+	memcpy((char *)data + n, log_ring, len - n);
+}
+
+static void log_ring_write(size_t pos, const void *data, size_t len)
+{
+	size_t off = pos % log_ring_size;
+	size_t n = len < log_ring_size - off ? len : log_ring_size - off;
+
+	memcpy(log_ring + off, data, n);
+	memcpy(log_ring, (const char *)data + n, len - n);
+}
+
+static void log_writer_write(int fd, const char *buf, size_t len, unsigned int queued)
+{
+	ssize_t ret;
+	unsigned int latency;
+
+	while (len > 0)
+	{
+		ret = write(fd, buf, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		buf += ret;
+		len -= ret;
+	}
+
+	latency = log_async_ms() - queued;
+
+	pthread_mutex_lock(&log_writer_lock);
+	log_async_stats.batches++;
+	log_async_stats.totallatency += latency;
+	if (latency > log_async_stats.maxlatency)
+		log_async_stats.maxlatency = latency;
+	pthread_mutex_unlock(&log_writer_lock);
+}
+
+static void *log_writer_main(void *arg)
+{
+	static char batch[65536];
+	log_record_t rec;
+	size_t tail, head, batchlen;
+	int batchfd;
+	unsigned int batchqueued;
+	struct timeval now;
+	struct timespec deadline;
+	bool stopping;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&log_writer_lock);
+		if (!log_writer_stopping)
+		{
+			gettimeofday(&now, NULL);
+			deadline.tv_sec = now.tv_sec + config_options.log_flush_interval / 1000;
+			deadline.tv_nsec = now.tv_usec * 1000 + (config_options.log_flush_interval % 1000) * 1000000;
+			if (deadline.tv_nsec >= 1000000000)
+			{
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&log_writer_wake, &log_writer_lock, &deadline);
+		}
+		stopping = log_writer_stopping;
+		pthread_mutex_unlock(&log_writer_lock);
+
+		tail = __atomic_load_n(&log_ring_tail, __ATOMIC_RELAXED);
+		head = __atomic_load_n(&log_ring_head, __ATOMIC_ACQUIRE);
+		batchlen = 0;
+		batchfd = -1;
+		batchqueued = 0;
+
+		while (tail != head)
+		{
+			log_ring_read(tail, &rec, sizeof rec);
+
+			if (batchlen > 0 && (rec.fd != batchfd || batchlen + rec.len > sizeof batch))
+			{
+				log_writer_write(batchfd, batch, batchlen, batchqueued);
+				batchlen = 0;
+				__atomic_store_n(&log_ring_tail, tail, __ATOMIC_RELEASE);
+			}
+
+			if (batchlen == 0)
+			{
+				batchfd = rec.fd;
+				batchqueued = rec.queued;
+			}
+			log_ring_read(tail + sizeof rec, batch + batchlen, rec.len);
+			batchlen += rec.len;
+			tail += sizeof rec + rec.len;
+		}
+
+		if (batchlen > 0)
+			log_writer_write(batchfd, batch, batchlen, batchqueued);
+		__atomic_store_n(&log_ring_tail, tail, __ATOMIC_RELEASE);
+
+		/* wake up a full queue or log_writer_sync() */
+		pthread_mutex_lock(&log_writer_lock);
+		pthread_cond_broadcast(&log_writer_done);
+		pthread_mutex_unlock(&log_writer_lock);
+
+		if (stopping)
+			break;
+	}
+
+	return NULL;
+}
+
+/* waits until everything queued so far is written */
+static void log_writer_sync(void)
+{
+	if (!log_async_stats.running)
+		return;
+
+	pthread_mutex_lock(&log_writer_lock);
+	while (__atomic_load_n(&log_ring_tail, __ATOMIC_ACQUIRE) != log_ring_head)
+	{
+		pthread_cond_signal(&log_writer_wake);
+		pthread_cond_wait(&log_writer_done, &log_writer_lock);
+	}
+	pthread_mutex_unlock(&log_writer_lock);
+}
+
+static void log_writer_stop(void)
+{
+	if (!log_async_stats.running)
+		return;
+
+	pthread_mutex_lock(&log_writer_lock);
+	log_writer_stopping = true;
+	pthread_cond_signal(&log_writer_wake);
+	pthread_mutex_unlock(&log_writer_lock);
+
+	pthread_join(log_writer, NULL);
+	log_async_stats.running = false;
+
+	free(log_ring);
+	log_ring = NULL;
+}
+
+/* the thread does not exist in a fork()ed child, log directly there */
+static void log_writer_atfork_child(void)
+{
+	log_writer_forked = true;
+	log_async_stats.running = false;
+}
+
+/* try starting the thread again after a rehash */
+static void log_writer_config_ready(void *unused)
+{
+	log_writer_failed = false;
+}
+
+static bool log_writer_start(void)
+{
+	static bool registered = false;
+	sigset_t all, old;
+	int ret;
+
+	if (!registered)
+	{
+		pthread_atfork(NULL, NULL, log_writer_atfork_child);
+		atexit(log_writer_stop);
+		hook_add_event("config_ready");
+		hook_add_config_ready(log_writer_config_ready);
+		registered = true;
+	}
+
+	log_ring_size = config_options.log_async_buffer * 1024;
+	log_ring = smalloc(log_ring_size);
+	log_ring_head = log_ring_tail = 0;
+	log_writer_stopping = false;
+
+	/* signals are for the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&log_writer, NULL, log_writer_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (ret != 0)
+	{
+		free(log_ring);
+		log_ring = NULL;
+
+		/* set first: slog() comes back through log_writer_enabled() */
+		log_writer_failed = true;
+		slog(LG_ERROR, "log_writer_start(): pthread_create() failed: %s, logging synchronously until rehash", strerror(ret));
+		return false;
+	}
+
+	log_async_stats.running = true;
+	return true;
+}
+
+/* whether file sinks should go through the writer thread right now */
+static bool log_writer_enabled(void)
+{
+	if (!config_options.log_async || log_writer_forked)
+	{
+		log_writer_stop();
+		return false;
+	}
+
+	if (!log_async_stats.running)
+		return !log_writer_failed && log_writer_start();
+
+	return true;
+}
+
+static void log_writer_queue(int fd, const char *line, size_t len)
+{
+	log_record_t rec;
+	size_t need = sizeof rec + len;
+	size_t head = log_ring_head;
+
+	if (log_ring_size - (head - __atomic_load_n(&log_ring_tail, __ATOMIC_ACQUIRE)) < need)
+	{
+		if (!config_options.log_async_block)
+		{
+			log_async_stats.dropped++;
+			return;
+		}
+
+		log_async_stats.blocked++;
+		pthread_mutex_lock(&log_writer_lock);
+		while (log_ring_size - (head - __atomic_load_n(&log_ring_tail, __ATOMIC_ACQUIRE)) < need)
+		{
+			pthread_cond_signal(&log_writer_wake);
+			pthread_cond_wait(&log_writer_done, &log_writer_lock);
+		}
+		pthread_mutex_unlock(&log_writer_lock);
+	}
+
+	rec.fd = fd;
+	rec.len = len;
+	rec.queued = log_async_ms();
+	log_ring_write(head, &rec, sizeof rec);
+	log_ring_write(head + sizeof rec, line, len);
+	__atomic_store_n(&log_ring_head, head + need, __ATOMIC_RELEASE);
+	log_async_stats.lines++;
+
+	if (head + need - __atomic_load_n(&log_ring_tail, __ATOMIC_RELAXED) > log_ring_size / 2)
+	{
+		pthread_mutex_lock(&log_writer_lock);
+		pthread_cond_signal(&log_writer_wake);
+		pthread_mutex_unlock(&log_writer_lock);
+	}
+}
+#else
+static inline void log_writer_sync(void) { }
+static inline void log_writer_stop(void) { }
+static inline bool log_writer_enabled(void) { return false; }
+static inline void log_writer_queue(int fd, const char *line, size_t len) { }
+#endif
+
+/*
+ * log_flush(void)
+ *
+ * Waits until all queued log lines have been written. Only needed with
+ * general::log_async, before the process image goes away.
+ *
+ * Inputs:
+ *       - none
+ *
+ * Outputs:
+ *       - none
+ *
+ * Side Effects:
+ *       - none
+ */
+void log_flush(void)
+{
+	log_writer_sync();
+}
+
 /* private destructor function for logfile_t. */
 static void logfile_delete_file(void *vdata)
 {
@@ -35,6 +406,8 @@ static void logfile_delete_file(void *vdata)
 
 	logfile_unregister(lf);
 
+	/* nothing may be left queued for this file */
+	log_writer_sync();
 	fclose(lf->log_file);
 	free(lf->log_path);
 	metadata_delete_all(lf);
@@ -186,19 +559,26 @@ logfile_strip_control_codes(const char *buf)
  */
 static void logfile_write(logfile_t *lf, const char *buf)
 {
-	char datetime[BUFSIZE];
-	time_t t;
-	struct tm tm;
-
 	return_if_fail(lf != NULL);
 	return_if_fail(lf->log_file != NULL);
 	return_if_fail(buf != NULL);
 
-	time(&t);
-	tm = *localtime(&t);
-	strftime(datetime, sizeof datetime, "[%d/%m/%Y %H:%M:%S]", &tm);
+	if (log_writer_enabled())
+	{
+		char line[BUFSIZE * 2];
+		int len;
 
-	fprintf((FILE *) lf->log_file, "%s %s\n", datetime, logfile_strip_control_codes(buf));
+		len = snprintf(line, sizeof line, "%s %s\n", log_timestamp(), logfile_strip_control_codes(buf));
+		if (len >= (int)sizeof line)
+		{
+			len = sizeof line - 1;
+			line[len - 1] = '\n';
+		}
+		log_writer_queue(fileno((FILE *) lf->log_file), line, len);
+		return;
+	}
+
+	fprintf((FILE *) lf->log_file, "%s %s\n", log_timestamp(), logfile_strip_control_codes(buf));
 	fflush((FILE *) lf->log_file);
 }
 
@@ -311,6 +691,7 @@ static void logfile_write_snotices(logfile_t *lf, const char *buf)
 void logfile_register(logfile_t *lf)
 {
 	mowgli_node_add(lf, &lf->node, &log_files);
+	log_update_interest();
 }
 
 /*
@@ -330,6 +711,7 @@ void logfile_register(logfile_t *lf)
 void logfile_unregister(logfile_t *lf)
 {
 	mowgli_node_delete(&lf->node, &log_files);
+	log_update_interest();
 }
 
 /*
@@ -456,6 +838,8 @@ void log_shutdown(void)
 {
 	mowgli_node_t *n, *tn;
 
+	log_writer_stop();
+
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, log_files.head)
 		object_unref(n->data);
 }
@@ -476,18 +860,7 @@ void log_shutdown(void)
  */
 bool log_debug_enabled(void)
 {
-	mowgli_node_t *n;
-	logfile_t *lf;
-
-	if (log_force)
-		return true;
-	MOWGLI_ITER_FOREACH(n, log_files.head)
-	{
-		lf = n->data;
-		if (lf->log_mask & (LG_DEBUG | LG_RAWDATA))
-			return true;
-	}
-	return false;
+	return log_force || (log_interest & (LG_DEBUG | LG_RAWDATA));
 }
 
 /*
@@ -510,6 +883,7 @@ void log_master_set_mask(unsigned int mask)
 	if (log_file == NULL)
 		return;
 	log_file->log_mask = mask;
+	log_update_interest();
 }
 
 /*
@@ -558,20 +932,13 @@ static void vslog_ext(log_type_t type, unsigned int level, const char *fmt,
 	static bool in_slog = false;
 	char buf[BUFSIZE];
 	mowgli_node_t *n;
-	char datetime[BUFSIZE];
-	time_t t;
-	struct tm tm;
 
-	if (in_slog)
+	if (in_slog || !log_wanted(level))
 		return;
 	in_slog = true;
 
 	vsnprintf(buf, BUFSIZE, fmt, args);
 
-	time(&t);
-	tm = *localtime(&t);
-	strftime(datetime, sizeof datetime, "[%d/%m/%Y %H:%M:%S]", &tm);
-
 	MOWGLI_ITER_FOREACH(n, log_files.head)
 	{
 		logfile_t *lf = (logfile_t *) n->data;
@@ -593,7 +960,7 @@ static void vslog_ext(log_type_t type, unsigned int level, const char *fmt,
 	if (type != LOG_INTERACTIVE && ((runflags & (RF_LIVE | RF_STARTING) && 
 		(log_file != NULL ? log_file->log_mask : LG_ERROR | LG_INFO) & level) ||
 		(runflags & RF_LIVE && log_force)))
-		fprintf(stderr, "%s %s\n", datetime, logfile_strip_control_codes(buf));
+		fprintf(stderr, "%s %s\n", log_timestamp(), logfile_strip_control_codes(buf));
 
 	in_slog = false;
 }
@@ -658,6 +1025,9 @@ void logcommand(sourceinfo_t *si, int level, const char *fmt, ...)
 	va_list args;
 	char lbuf[BUFSIZE];
 
+	if (!log_wanted(level))
+		return;
+
 	va_start(args, fmt);
 	vsnprintf(lbuf, BUFSIZE, fmt, args);
 	va_end(args);
@@ -692,6 +1062,9 @@ void logcommand_user(service_t *svs, user_t *source, int level, const char *fmt,
 	char accountbuf[NICKLEN * 5]; /* entity name len is NICKLEN * 4, plus another for the ID */
 	bool showaccount;
 
+	if (!log_wanted(level))
+		return;
+
 	va_start(args, fmt);
 	vsnprintf(lbuf, BUFSIZE, fmt, args);
 	va_end(args);
@@ -744,6 +1117,9 @@ void logcommand_external(service_t *svs, const char *type, connection_t *source,
 	va_list args;
 	char lbuf[BUFSIZE];
 
+	if (!log_wanted(level))
+		return;
+
 	va_start(args, fmt);
 	vsnprintf(lbuf, BUFSIZE, fmt, args);
 	va_end(args);
@@ -780,6 +1156,9 @@ void logcommand_external(service_t *svs, const char *type, connection_t *source,
  */
 void logaudit_denycmd(sourceinfo_t *si, command_t *cmd, const char *userlevel)
 {
+	if (!log_wanted(LG_DENYCMD))
+		return;
+
 	slog_ext(LOG_NONINTERACTIVE, LG_DENYCMD, "DENYCMD: [%s] was denied execution of [%s], need privileges [%s %s]",
 		 get_source_security_label(si), cmd->name, cmd->access, userlevel != NULL ? userlevel : "");
 	slog_ext(LOG_INTERACTIVE, LG_DENYCMD, "DENYCMD: \2%s\2 was denied execution of \2%s\2, need privileges \2%s %s\2",
@@ -211,6 +211,127 @@ int match(const char *mask, const char *name)
 }
 
 
+/*
+ * mask_compile(compiled_mask_t *cm, const char *mask)
+ *
+ * Prepares a mask for mask_match(). The mask string must stay valid
+ * until mask_free() is called.
+ */
+#define IsMaskMeta(c)	((c) == '*' || (c) == '?' || (c) == '&' || (c) == '#' || (c) == '%' || (c) == '\\')
+
+void mask_compile(compiled_mask_t *cm, const char *mask)
+{
+	const char *p, *at, *slash;
+	size_t i;
+
+	memset(cm, 0, sizeof *cm);
+	cm->source = mask;
+	cm->len = strlen(mask);
+	cm->folded = smalloc(cm->len + 1);
+	for (i = 0; i <= cm->len; i++)
+		cm->folded[i] = ToLower(mask[i]);
+
+	if (!strcmp(mask, "*"))
+		cm->flags |= CMASK_ALL;
+
+	while (cm->prefixlen < cm->len && !IsMaskMeta(mask[cm->prefixlen]))
+		cm->prefixlen++;
+
+	if (cm->prefixlen == cm->len)
+		cm->flags |= CMASK_LITERAL;
+	else
+		while (!IsMaskMeta(mask[cm->len - cm->suffixlen - 1]))
+			cm->suffixlen++;
+
+	/* same parsing as match_cidr() */
+	if ((at = strrchr(mask, '@')) == NULL || (slash = strrchr(at, '/')) == NULL)
+		return;
+
+	cm->cidrbits = atoi(slash + 1);
+	if (cm->cidrbits == 0)
+		return;
+
+	cm->cidruser = smalloc(slash - mask + 1);
+	mowgli_strlcpy(cm->cidruser, mask, slash - mask + 1);
+	p = cm->cidruser + (at - mask);
+	cm->cidruser[at - mask] = '\0';
+
+	cm->cidrfamily = parse_ip(p + 1, cm->cidraddr);
+	if (cm->cidrfamily == 0 || cm->cidrbits > (cm->cidrfamily == 6 ? 128 : 32))
+	{
+		free(cm->cidruser);
+		cm->cidruser = NULL;
+		return;
+	}
+
+	cm->flags |= CMASK_CIDR;
+}
+
+void mask_free(compiled_mask_t *cm)
+{
+	free(cm->folded);
+	free(cm->cidruser);
+	cm->folded = cm->cidruser = NULL;
+}
+
+/*
+ * mask_match(const compiled_mask_t *cm, const char *name, size_t namelen)
+ *
+ * Same result as !match(mask, name), but cheap for names that cannot
+ * match. Every wildcard consumes at least zero characters of the name
+ * and every literal exactly one, so the literal head and tail of the
+ * mask must appear at the head and tail of any name it matches.
+ */
+bool mask_match(const compiled_mask_t *cm, const char *name, size_t namelen)
+{
+	size_t i;
+
+	if (cm->flags & CMASK_ALL)
+		return true;
+
+	if (cm->flags & CMASK_LITERAL)
+	{
+		if (namelen != cm->len)
+			return false;
+		for (i = 0; i < namelen; i++)
+			if (cm->folded[i] != ToLower(name[i]))
+				return false;
+		return true;
+	}
+
+	if (namelen < cm->prefixlen + cm->suffixlen)
+		return false;
+
+	for (i = 0; i < cm->prefixlen; i++)
+		if (cm->folded[i] != ToLower(name[i]))
+			return false;
+
+	for (i = 1; i <= cm->suffixlen; i++)
+		if (cm->folded[cm->len - i] != ToLower(name[namelen - i]))
+			return false;
+
+	return !match(cm->source, name);
+}
+
+/*
+ * mask_match_cidr(const compiled_mask_t *cm, const char *nickuser,
+ *                 int family, const unsigned char *addr)
+ *
+ * Same result as !match_cidr(mask, nickuser@ip), with the address
+ * already run through parse_ip().
+ */
+bool mask_match_cidr(const compiled_mask_t *cm, const char *nickuser, int family, const unsigned char *addr)
+{
+	if (!(cm->flags & CMASK_CIDR) || family != cm->cidrfamily)
+		return false;
+
+	if (match_ip_bits(addr, cm->cidraddr, cm->cidrbits))
+		return false;
+
+	return !match(cm->cidruser, nickuser);
+}
+
+
 /*
 ** collapse a pattern string into minimal components.
 ** This particular version is "in place", so that it changes the pattern
@@ -740,6 +861,455 @@ bool regex_destroy(atheme_regex_t *preg)
 	return true;
 }
 
+/*
+ * Regex sets.
+ *
+ * Each pattern contributes the longest run of characters that any match
+ * must contain, case folded. The runs are compiled into an Aho-Corasick
+ * automaton over the characters that actually occur in them, so one
+ * pass over the subject finds every pattern that can possibly match.
+ * Adding or removing a pattern only marks the automaton stale; it is
+ * rebuilt from the stored runs on the next match, which is cheap next to
+ * compiling the regexes themselves.
+ */
+
+#define REGEX_SET_LITERALLEN	32
+
+typedef struct regex_set_entry_ regex_set_entry_t;
+
+struct regex_set_entry_
+{
+	atheme_regex_t *preg;
+	void *priv;
+	char literal[REGEX_SET_LITERALLEN + 1];	/* empty: always run the regex */
+	unsigned int hit;			/* == set->gen if literal was seen */
+	regex_set_entry_t *outnext;		/* entries ending in the same state */
+	mowgli_node_t node;
+};
+
+struct regex_set_
+{
+	mowgli_list_t entries;
+	bool stale;
+	unsigned int gen;
+
+	unsigned char classmap[256];
+	unsigned int nclasses;
+	unsigned int nstates;
+	unsigned int *delta;			/* nstates * nclasses */
+	unsigned int *dict;			/* next suffix state with output */
+	regex_set_entry_t **out;
+};
+
+static inline unsigned char regex_fold(unsigned char c)
+{
+	return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/* skip a bracket expression starting at p, return the closing ']' */
+static const char *regex_skip_bracket(const char *p, int flags)
+{
+	p++;
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+	for (; *p != '\0'; p++)
+	{
+		if (*p == ']')
+			return p;
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+		{
+			char delim = p[1];
+
+			for (p += 2; *p != '\0' && !(p[0] == delim && p[1] == ']'); p++)
+				;
+			if (*p == '\0')
+				return NULL;
+			p++;
+		}
+		else if (*p == '\\' && (flags & AREGEX_PCRE))
+		{
+			if (*++p == '\0')
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+/* skip a parenthesised group starting at p, return the closing ')' */
+static const char *regex_skip_group(const char *p, int flags)
+{
+	int depth = 0;
+
+	for (; *p != '\0'; p++)
+	{
+		if (*p == '\\')
+		{
+			if (*++p == '\0')
+				return NULL;
+		}
+		else if (*p == '[')
+		{
+			if ((p = regex_skip_bracket(p, flags)) == NULL)
+				return NULL;
+		}
+		else if (*p == '(')
+			depth++;
+		else if (*p == ')' && --depth == 0)
+			return p;
+	}
+	return NULL;
+}
+
+/* skip whatever follows an escape like \x, \p or \c in PCRE */
+static const char *regex_skip_escape_arg(const char *p)
+{
+	char c = p[-1];
+
+	if (*p == '{' || *p == '<' || *p == '\'')
+	{
+		char close = *p == '{' ? '}' : *p == '<' ? '>' : '\'';
+
+		while (*p != '\0' && *p != close)
+			p++;
+		return *p != '\0' ? p + 1 : p;
+	}
+	if ((c == 'c' || c == 'p' || c == 'P') && *p != '\0')
+		return p + 1;
+	if (c == 'x' || c == 'o' || isdigit((unsigned char)c))
+		while (isxdigit((unsigned char)*p))
+			p++;
+	return p;
+}
+
+/*
+ * regex_required_literal()
+ *  Find the longest run of plain characters that every match of
+ *  `pattern' has to contain and store it folded in `out'. Anything that
+ *  is not obviously literal just ends the current run, so the result may
+ *  be shorter than it could be but is never wrong. Returns the length of
+ *  the run, or 0 if there is none (e.g. top level alternation).
+ *
+ *  Outside PCRE, only escaped metacharacters are literal: the GNU escapes
+ *  \< \> \` and \' are anchors, so "\<foo", "foo\>", "\`bar" and "x\'"
+ *  require "foo", "foo", "bar" and "x".
+ */
+static size_t regex_required_literal(const char *pattern, int flags, char *out)
+{
+	char run[REGEX_SET_LITERALLEN];
+	size_t runlen = 0, bestlen = 0;
+	const char *p = pattern;
+	unsigned char c;
+
+	/* inline options can turn on caseless or extended mode midway */
+	if ((flags & AREGEX_PCRE) && (strstr(pattern, "(?") != NULL || strstr(pattern, "\\Q") != NULL))
+		goto none;
+
+#define END_RUN() do { \
+	if (runlen > bestlen) \
+	{ \
+		memcpy(out, run, runlen); \
+		bestlen = runlen; \
+	} \
+	runlen = 0; \
+} while (0)
+
+	while (*p != '\0')
+	{
+		switch (*p)
+		{
+			case '|':
+				goto none;
+			case '(':
+				END_RUN();
+				if ((p = regex_skip_group(p, flags)) == NULL)
+					goto none;
+				p++;
+				continue;
+			case '[':
+				END_RUN();
+				if ((p = regex_skip_bracket(p, flags)) == NULL)
+					goto none;
+				p++;
+				continue;
+			case '{':
+				END_RUN();
+				if ((p = strchr(p, '}')) == NULL)
+					goto none;
+				p++;
+				continue;
+			case '?': case '*': case '+':
+			case '.': case '^': case '$': case ')':
+				END_RUN();
+				p++;
+				continue;
+			case '\\':
+				p++;
+				if (*p == '\0')
+					goto none;
+				/* PCRE takes any escaped non-alphanumeric literally */
+				if ((flags & AREGEX_PCRE) ? isalnum((unsigned char)*p) != 0 :
+						strchr(".[]()*+?{}|^$\\", *p) == NULL)
+				{
+					END_RUN();
+					p++;
+					if (flags & AREGEX_PCRE)
+						p = regex_skip_escape_arg(p);
+					continue;
+				}
+				break;
+		}
+
+		c = *p++;
+		if (c >= 0x80)
+		{
+			END_RUN();
+			continue;
+		}
+
+		/* a quantified character may not be there at all */
+		if (*p == '?' || *p == '*' || *p == '{')
+		{
+			END_RUN();
+			continue;
+		}
+
+		if (runlen < sizeof run)
+			run[runlen++] = regex_fold(c);
+
+		if (*p == '+')
+			END_RUN();
+	}
+	END_RUN();
+
+#undef END_RUN
+
+	out[bestlen] = '\0';
+	return bestlen;
+
+none:
+	/* a partial run may already have been copied */
+	out[0] = '\0';
+	return 0;
+}
+
+regex_set_t *regex_set_create(void)
+{
+	regex_set_t *set = smalloc(sizeof(regex_set_t));
+
+	set->stale = true;
+	return set;
+}
+
+static void regex_set_clear(regex_set_t *set)
+{
+	free(set->delta);
+	free(set->dict);
+	free(set->out);
+	set->delta = NULL;
+	set->dict = NULL;
+	set->out = NULL;
+	set->nstates = 0;
+}
+
+void regex_set_destroy(regex_set_t *set)
+{
+	mowgli_node_t *n, *tn;
+
+	return_if_fail(set != NULL);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, set->entries.head)
+	{
+		mowgli_node_delete(n, &set->entries);
+		free(n->data);
+	}
+	regex_set_clear(set);
+	free(set);
+}
+
+void regex_set_add(regex_set_t *set, atheme_regex_t *preg, const char *pattern, int flags, void *priv)
+{
+	regex_set_entry_t *e;
+
+	return_if_fail(set != NULL);
+	return_if_fail(preg != NULL);
+
+	e = smalloc(sizeof(regex_set_entry_t));
+	e->preg = preg;
+	e->priv = priv;
+	regex_required_literal(pattern, flags, e->literal);
+	mowgli_node_add(e, &e->node, &set->entries);
+
+	if (e->literal[0] != '\0')
+		set->stale = true;
+}
+
+void regex_set_delete(regex_set_t *set, void *priv)
+{
+	mowgli_node_t *n;
+
+	return_if_fail(set != NULL);
+
+	MOWGLI_ITER_FOREACH(n, set->entries.head)
+	{
+		regex_set_entry_t *e = n->data;
+
+		if (e->priv != priv)
+			continue;
+
+		mowgli_node_delete(&e->node, &set->entries);
+		if (e->literal[0] != '\0')
+			set->stale = true;
+		free(e);
+		return;
+	}
+}
+
+static void regex_set_build(regex_set_t *set)
+{
+	mowgli_node_t *n;
+	unsigned int maxstates = 1, *fail, *queue, qhead = 0, qtail = 0;
+	unsigned int s, r, u, a, nc;
+	const unsigned char *l;
+
+	regex_set_clear(set);
+	memset(set->classmap, 0, sizeof set->classmap);
+	set->nclasses = 1;	/* class 0: characters in no literal */
+
+	MOWGLI_ITER_FOREACH(n, set->entries.head)
+	{
+		regex_set_entry_t *e = n->data;
+
+		e->outnext = NULL;
+		for (l = (const unsigned char *)e->literal; *l != '\0'; l++, maxstates++)
+		{
+			if (set->classmap[*l] != 0)
+				continue;
+			set->classmap[*l] = set->nclasses;
+			if (*l >= 'a' && *l <= 'z')
+				set->classmap[*l - ('a' - 'A')] = set->nclasses;
+			set->nclasses++;
+		}
+	}
+
+	nc = set->nclasses;
+	set->delta = scalloc(sizeof(unsigned int), (size_t)maxstates * nc);
+	set->dict = scalloc(sizeof(unsigned int), maxstates);
+	set->out = scalloc(sizeof(regex_set_entry_t *), maxstates);
+	set->nstates = 1;
+
+	/* trie of the literals; 0 is the root and never a goto target */
+	MOWGLI_ITER_FOREACH(n, set->entries.head)
+	{
+		regex_set_entry_t *e = n->data;
+
+		if (e->literal[0] == '\0')
+			continue;
+
+		s = 0;
+		for (l = (const unsigned char *)e->literal; *l != '\0'; l++)
+		{
+			a = set->classmap[*l];
+			if (set->delta[s * nc + a] == 0)
+				set->delta[s * nc + a] = set->nstates++;
+			s = set->delta[s * nc + a];
+		}
+		e->outnext = set->out[s];
+		set->out[s] = e;
+	}
+
+	/* breadth first: fill in failure transitions to get a full DFA */
+	fail = scalloc(sizeof(unsigned int), set->nstates);
+	queue = scalloc(sizeof(unsigned int), set->nstates);
+
+	for (a = 0; a < nc; a++)
+		if ((u = set->delta[a]) != 0)
+			queue[qtail++] = u;
+
+	while (qhead < qtail)
+	{
+		r = queue[qhead++];
+		for (a = 0; a < nc; a++)
+		{
+			u = set->delta[r * nc + a];
+			if (u == 0)
+			{
+				set->delta[r * nc + a] = set->delta[fail[r] * nc + a];
+				continue;
+			}
+			fail[u] = set->delta[fail[r] * nc + a];
+			set->dict[u] = set->out[fail[u]] != NULL ? fail[u] : set->dict[fail[u]];
+			queue[qtail++] = u;
+		}
+	}
+
+	free(fail);
+	free(queue);
+	set->stale = false;
+}
+
+/*
+ * regex_set_match()
+ *  Match `string' against every regex in `set' and call `cb' with the
+ *  priv pointer of each one that matches, in the order they were added.
+ *  Returns the number of matches.
+ */
+unsigned int regex_set_match(regex_set_t *set, char *string, regex_set_cb_t cb, void *arg)
+{
+	mowgli_node_t *n, *tn;
+	const unsigned char *p;
+	unsigned int s, t, matches = 0;
+
+	return_val_if_fail(set != NULL, 0);
+	return_val_if_fail(string != NULL, 0);
+
+	if (MOWGLI_LIST_LENGTH(&set->entries) == 0)
+		return 0;
+
+	if (set->stale)
+		regex_set_build(set);
+
+	if (++set->gen == 0)
+	{
+		MOWGLI_ITER_FOREACH(n, set->entries.head)
+			((regex_set_entry_t *)n->data)->hit = 0;
+		set->gen = 1;
+	}
+
+	if (set->nstates > 1)
+	{
+		s = 0;
+		for (p = (const unsigned char *)string; *p != '\0'; p++)
+		{
+			s = set->delta[s * set->nclasses + set->classmap[*p]];
+			for (t = set->out[s] != NULL ? s : set->dict[s]; t != 0; t = set->dict[t])
+			{
+				regex_set_entry_t *e;
+
+				for (e = set->out[t]; e != NULL; e = e->outnext)
+					e->hit = set->gen;
+			}
+		}
+	}
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, set->entries.head)
+	{
+		regex_set_entry_t *e = n->data;
+
+		if (e->literal[0] != '\0' && e->hit != set->gen)
+			continue;
+		if (!regex_match(e->preg, string))
+			continue;
+
+		matches++;
+		if (cb != NULL)
+			cb(e->priv, arg);
+	}
+
+	return matches;
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
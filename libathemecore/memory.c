@@ -87,6 +87,56 @@ char *sstrndup(const char *s, int len)
 	return t;
 }
 
+mowgli_list_t memtag_list;
+
+memtag_t memtag_users = { "users" };
+memtag_t memtag_servers = { "servers" };
+memtag_t memtag_channels = { "channels" };
+memtag_t memtag_chanusers = { "chanusers" };
+memtag_t memtag_chanbans = { "chanbans" };
+memtag_t memtag_metadata = { "metadata" };
+memtag_t memtag_sendq = { "sendq" };
+memtag_t memtag_accounts = { "accounts" };
+memtag_t memtag_nicks = { "nicks" };
+memtag_t memtag_mychans = { "mychans" };
+memtag_t memtag_chanacs = { "chanacs" };
+memtag_t memtag_strings = { "strings" };
+memtag_t memtag_klines = { "klines" };
+
+void memtag_init(void)
+{
+	memtag_register(&memtag_users);
+	memtag_register(&memtag_servers);
+	memtag_register(&memtag_channels);
+	memtag_register(&memtag_chanusers);
+	memtag_register(&memtag_chanbans);
+	memtag_register(&memtag_metadata);
+	memtag_register(&memtag_sendq);
+	memtag_register(&memtag_accounts);
+	memtag_register(&memtag_nicks);
+	memtag_register(&memtag_mychans);
+	memtag_register(&memtag_chanacs);
+	memtag_register(&memtag_strings);
+	memtag_register(&memtag_klines);
+}
+
+/* modules can add their own tags; unregister before unloading */
+void memtag_register(memtag_t *tag)
+{
+	return_if_fail(tag != NULL);
+
+	mowgli_node_add(tag, &tag->node, &memtag_list);
+}
+
+void memtag_unregister(memtag_t *tag)
+{
+	return_if_fail(tag != NULL);
+
+	if (tag->objects != 0)
+		slog(LG_DEBUG, "memtag_unregister(): %s still has %zu allocations", tag->name, tag->objects);
+	mowgli_node_delete(&tag->node, &memtag_list);
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
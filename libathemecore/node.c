@@ -29,26 +29,12 @@ mowgli_list_t klnlist;
 mowgli_list_t xlnlist;
 mowgli_list_t qlnlist;
 
-mowgli_heap_t *kline_heap;	/* 16 */
-mowgli_heap_t *xline_heap;	/* 16 */
-mowgli_heap_t *qline_heap;	/* 16 */
-
 /*************
  * L I S T S *
  *************/
 
 void init_nodes(void)
 {
-	kline_heap = sharedheap_get(sizeof(kline_t));
-	xline_heap = sharedheap_get(sizeof(xline_t));
-	qline_heap = sharedheap_get(sizeof(qline_t));
-
-	if (kline_heap == NULL || xline_heap == NULL || qline_heap == NULL)
-	{
-		slog(LG_INFO, "init_nodes(): block allocator failed.");
-		exit(EXIT_FAILURE);
-	}
-
 	init_uplinks();
 	init_servers();
 	init_metadata();
@@ -119,16 +105,228 @@ void remove_illegals()
  * K L I N E *
  *************/
 
+/*
+ * AKILLs are looked up on every user introduction, so besides klnlist
+ * they are indexed by the shape of their host mask:
+ *
+ *  - literal hosts and IPs, by the host itself
+ *  - "*tail" masks with a literal tail, by the tail; lookups try every
+ *    tail length that is in use
+ *  - ip/bits masks, by the masked address, one table per prefix length
+ *  - anything else goes on kline_wild and is matched one by one
+ *
+ * Index hits are only candidates, they are checked with the same tests
+ * as before.
+ */
+static mowgli_patricia_t *kline_hosts;
+static mowgli_patricia_t *kline_tails;
+static unsigned int kline_taillen[HOSTLEN + 1];
+static mowgli_patricia_t *kline_cidr4[33];
+static mowgli_patricia_t *kline_cidr6[129];
+static mowgli_list_t kline_wild;
+static mowgli_patricia_t *kline_numbers;
+
+/* duration != 0 klines, ordered by expiry time */
+static kline_t **kline_heap_v;
+static unsigned int kline_heap_count, kline_heap_size;
+
+#define KLINE_INDEX_HOST	1
+#define KLINE_INDEX_TAIL	2
+#define KLINE_INDEX_WILD	3
+
+static int kline_classify(const char *host)
+{
+	const char *p;
+
+	for (p = host; *p != '\0'; p++)
+		if (*p == '*' || *p == '?' || *p == '&' || *p == '#' || *p == '%' || *p == '\\')
+			break;
+
+	if (*p == '\0' && p != host)
+		return KLINE_INDEX_HOST;
+
+	if (host[0] == '*' && host[1] != '\0' && p == host && strlen(host) <= HOSTLEN)
+	{
+		for (p = host + 1; *p != '\0'; p++)
+			if (*p == '*' || *p == '?' || *p == '&' || *p == '#' || *p == '%' || *p == '\\')
+				return KLINE_INDEX_WILD;
+		return KLINE_INDEX_TAIL;
+	}
+
+	return KLINE_INDEX_WILD;
+}
+
+/* address masked to bits, as a patricia key */
+static void kline_cidr_key(const unsigned char *addr, unsigned int bits, char *buf)
+{
+	unsigned int i;
+
+	for (i = 0; i * 8 < bits; i++)
+		buf += sprintf(buf, "%02x", addr[i] & (bits - i * 8 >= 8 ? 0xff : 0xff << (8 - bits + i * 8)));
+	*buf = '\0';
+}
+
+/* same rules as match_ips() */
+static mowgli_patricia_t **kline_cidr_table(const char *host, char *key)
+{
+	char ip[HOSTLEN + 1];
+	unsigned char addr[16];
+	const char *slash;
+	int bits, family;
+
+	if ((slash = strrchr(host, '/')) == NULL || (size_t)(slash - host) > HOSTLEN)
+		return NULL;
+
+	mowgli_strlcpy(ip, host, slash - host + 1);
+	bits = atoi(slash + 1);
+	family = parse_ip(ip, addr);
+
+	if (bits <= 0 || family == 0 || bits > (family == 6 ? 128 : 32))
+		return NULL;
+
+	kline_cidr_key(addr, bits, key);
+	return family == 6 ? &kline_cidr6[bits] : &kline_cidr4[bits];
+}
+
+static void kline_index_add(mowgli_patricia_t **dict, const char *key, kline_t *k, mowgli_node_t *n, void (*canon)(char *))
+{
+	mowgli_list_t *l;
+
+	if (*dict == NULL)
+		*dict = mowgli_patricia_create(canon);
+
+	if ((l = mowgli_patricia_retrieve(*dict, key)) == NULL)
+	{
+		l = mowgli_list_create();
+		mowgli_patricia_add(*dict, key, l);
+	}
+
+	mowgli_node_add(k, n, l);
+}
+
+static void kline_index_delete(mowgli_patricia_t *dict, const char *key, mowgli_node_t *n)
+{
+	mowgli_list_t *l = mowgli_patricia_retrieve(dict, key);
+
+	return_if_fail(l != NULL);
+
+	mowgli_node_delete(n, l);
+	if (MOWGLI_LIST_LENGTH(l) == 0)
+	{
+		mowgli_patricia_delete(dict, key);
+		mowgli_list_free(l);
+	}
+}
+
+static void kline_index(kline_t *k)
+{
+	mowgli_patricia_t **table;
+	char key[BUFSIZE];
+
+	switch (kline_classify(k->host))
+	{
+	case KLINE_INDEX_HOST:
+		kline_index_add(&kline_hosts, k->host, k, &k->inode, irccasecanon);
+		break;
+	case KLINE_INDEX_TAIL:
+		kline_index_add(&kline_tails, k->host + 1, k, &k->inode, irccasecanon);
+		kline_taillen[strlen(k->host + 1)]++;
+		break;
+	default:
+		mowgli_node_add(k, &k->inode, &kline_wild);
+	}
+
+	if ((table = kline_cidr_table(k->host, key)) != NULL)
+		kline_index_add(table, key, k, &k->cnode, noopcanon);
+}
+
+static void kline_unindex(kline_t *k)
+{
+	mowgli_patricia_t **table;
+	char key[BUFSIZE];
+
+	switch (kline_classify(k->host))
+	{
+	case KLINE_INDEX_HOST:
+		kline_index_delete(kline_hosts, k->host, &k->inode);
+		break;
+	case KLINE_INDEX_TAIL:
+		kline_index_delete(kline_tails, k->host + 1, &k->inode);
+		kline_taillen[strlen(k->host + 1)]--;
+		break;
+	default:
+		mowgli_node_delete(&k->inode, &kline_wild);
+	}
+
+	if ((table = kline_cidr_table(k->host, key)) != NULL)
+		kline_index_delete(*table, key, &k->cnode);
+}
+
+static void kline_heap_swap(unsigned int a, unsigned int b)
+{
+	kline_t *k = kline_heap_v[a];
+
+	kline_heap_v[a] = kline_heap_v[b];
+	kline_heap_v[b] = k;
+	kline_heap_v[a]->heapidx = a;
+	kline_heap_v[b]->heapidx = b;
+}
+
+static void kline_heap_fix(unsigned int i)
+{
+	unsigned int c;
+
+	while (i > 0 && kline_heap_v[i]->expires < kline_heap_v[(i - 1) / 2]->expires)
+	{
+		kline_heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+
+	while ((c = 2 * i + 1) < kline_heap_count)
+	{
+		if (c + 1 < kline_heap_count && kline_heap_v[c + 1]->expires < kline_heap_v[c]->expires)
+			c++;
+		if (kline_heap_v[i]->expires <= kline_heap_v[c]->expires)
+			break;
+		kline_heap_swap(i, c);
+		i = c;
+	}
+}
+
+static void kline_heap_add(kline_t *k)
+{
+	if (kline_heap_count == kline_heap_size)
+	{
+		kline_heap_size = kline_heap_size ? kline_heap_size * 2 : 64;
+		kline_heap_v = srealloc(kline_heap_v, kline_heap_size * sizeof(kline_t *));
+	}
+
+	k->heapidx = kline_heap_count++;
+	kline_heap_v[k->heapidx] = k;
+	kline_heap_fix(k->heapidx);
+}
+
+static void kline_heap_delete(kline_t *k)
+{
+	unsigned int i = k->heapidx;
+
+	if (i != --kline_heap_count)
+	{
+		kline_heap_swap(i, kline_heap_count);
+		kline_heap_fix(i);
+	}
+}
+
 kline_t *kline_add_with_id(const char *user, const char *host, const char *reason, long duration, const char *setby, unsigned long id)
 {
 	kline_t *k;
-	mowgli_node_t *n = mowgli_node_create();
+	char num[32];
 
 	slog(LG_DEBUG, "kline_add(): %s@%s -> %s (%ld)", user, host, reason, duration);
 
-	k = mowgli_heap_alloc(kline_heap);
+	k = sharedheap_alloc(&memtag_klines, sizeof(kline_t));
 
-	mowgli_node_add(k, n, &klnlist);
+	mowgli_node_add(k, &k->node, &klnlist);
 
 	k->user = sstrdup(user);
 	k->host = sstrdup(host);
@@ -139,6 +337,16 @@ kline_t *kline_add_with_id(const char *user, const char *host, const char *reaso
 	k->expires = CURRTIME + duration;
 	k->number = id;
 
+	kline_index(k);
+	if (k->duration != 0)
+		kline_heap_add(k);
+
+	if (kline_numbers == NULL)
+		kline_numbers = mowgli_patricia_create(noopcanon);
+	snprintf(num, sizeof num, "%lu", k->number);
+	if (!mowgli_patricia_add(kline_numbers, num, k))
+		slog(LG_DEBUG, "kline_add(): duplicate AKILL number %lu", k->number);
+
 	cnt.kline++;
 
 
@@ -165,7 +373,7 @@ kline_t *kline_add_user(user_t *u, const char *reason, long duration, const char
 
 void kline_delete(kline_t *k)
 {
-	mowgli_node_t *n;
+	char num[32];
 
 	return_if_fail(k != NULL);
 
@@ -175,64 +383,174 @@ void kline_delete(kline_t *k)
 	if (me.connected && (k->duration == 0 || k->expires > CURRTIME))
 		unkline_sts("*", k->user, k->host);
 
-	n = mowgli_node_find(k, &klnlist);
-	mowgli_node_delete(n, &klnlist);
-	mowgli_node_free(n);
+	mowgli_node_delete(&k->node, &klnlist);
+
+	kline_unindex(k);
+	if (k->duration != 0)
+		kline_heap_delete(k);
+
+	snprintf(num, sizeof num, "%lu", k->number);
+	if (mowgli_patricia_retrieve(kline_numbers, num) == k)
+		mowgli_patricia_delete(kline_numbers, num);
 
 	free(k->user);
 	free(k->host);
 	free(k->reason);
 	free(k->setby);
 
-	mowgli_heap_free(kline_heap, k);
+	sharedheap_free(&memtag_klines, k, sizeof(kline_t));
 
 	cnt.kline--;
 }
 
-kline_t *kline_find(const char *user, const char *host)
+/*
+ * kline_settime(kline_t *k, time_t settime)
+ *
+ * Changes when an AKILL was set, and with it when it expires. Used when
+ * loading AKILLs from a database.
+ */
+void kline_settime(kline_t *k, time_t settime)
 {
-	kline_t *k;
+	return_if_fail(k != NULL);
+
+	k->settime = settime;
+	k->expires = k->settime + k->duration;
+
+	if (k->duration != 0)
+		kline_heap_fix(k->heapidx);
+}
+
+/* calls func on every indexed kline whose host mask may match name */
+static kline_t *kline_search_host(const char *name, bool (*func)(kline_t *k, void *arg), void *arg)
+{
+	mowgli_list_t *l;
 	mowgli_node_t *n;
+	size_t len, i;
+
+	if (name == NULL)
+		return NULL;
+
+	if (kline_hosts != NULL && (l = mowgli_patricia_retrieve(kline_hosts, name)) != NULL)
+		MOWGLI_ITER_FOREACH(n, l->head)
+			if (func(n->data, arg))
+				return n->data;
 
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
+	if (kline_tails != NULL)
 	{
-		k = (kline_t *)n->data;
+		len = strlen(name);
+		for (i = 1; i <= len && i <= HOSTLEN; i++)
+		{
+			if (kline_taillen[i] == 0)
+				continue;
+			if ((l = mowgli_patricia_retrieve(kline_tails, name + len - i)) == NULL)
+				continue;
+			MOWGLI_ITER_FOREACH(n, l->head)
+				if (func(n->data, arg))
+					return n->data;
+		}
+	}
 
-		if ((!match(k->user, user)) && (!match(k->host, host)))
-			return k;
+	return NULL;
+}
+
+static kline_t *kline_search_ip(const char *ip, bool (*func)(kline_t *k, void *arg), void *arg)
+{
+	mowgli_patricia_t **tables;
+	mowgli_list_t *l;
+	mowgli_node_t *n;
+	unsigned char addr[16];
+	char key[BUFSIZE];
+	int family, bits;
+
+	if ((family = parse_ip(ip, addr)) == 0)
+		return NULL;
+
+	tables = family == 6 ? kline_cidr6 : kline_cidr4;
+	for (bits = family == 6 ? 128 : 32; bits > 0; bits--)
+	{
+		if (tables[bits] == NULL)
+			continue;
+		kline_cidr_key(addr, bits, key);
+		if ((l = mowgli_patricia_retrieve(tables[bits], key)) == NULL)
+			continue;
+		MOWGLI_ITER_FOREACH(n, l->head)
+			if (func(n->data, arg))
+				return n->data;
 	}
 
 	return NULL;
 }
 
-kline_t *kline_find_num(unsigned long number)
+struct kline_find_args
+{
+	const char *user;
+	const char *host;
+};
+
+static bool kline_matches(kline_t *k, void *arg)
 {
+	struct kline_find_args *a = arg;
+
+	return !match(k->user, a->user) && !match(k->host, a->host);
+}
+
+kline_t *kline_find(const char *user, const char *host)
+{
+	struct kline_find_args a = { user, host };
 	kline_t *k;
 	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
+	if ((k = kline_search_host(host, kline_matches, &a)) != NULL)
+		return k;
+
+	MOWGLI_ITER_FOREACH(n, kline_wild.head)
 	{
 		k = (kline_t *)n->data;
 
-		if (k->number == number)
+		if (kline_matches(k, &a))
 			return k;
 	}
 
 	return NULL;
 }
 
+kline_t *kline_find_num(unsigned long number)
+{
+	char num[32];
+
+	if (kline_numbers == NULL)
+		return NULL;
+
+	snprintf(num, sizeof num, "%lu", number);
+	return mowgli_patricia_retrieve(kline_numbers, num);
+}
+
+static bool kline_matches_user(kline_t *k, void *arg)
+{
+	user_t *u = arg;
+
+	if (k->duration != 0 && k->expires <= CURRTIME)
+		return false;
+	return !match(k->user, u->user) && (!match(k->host, u->host) || !match(k->host, u->ip) || !match_ips(k->host, u->ip));
+}
+
 kline_t *kline_find_user(user_t *u)
 {
 	kline_t *k;
 	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH(n, klnlist.head)
+	if ((k = kline_search_host(u->host, kline_matches_user, u)) != NULL)
+		return k;
+	if ((k = kline_search_host(u->ip, kline_matches_user, u)) != NULL)
+		return k;
+	if ((k = kline_search_ip(u->ip, kline_matches_user, u)) != NULL)
+		return k;
+
+	MOWGLI_ITER_FOREACH(n, kline_wild.head)
 	{
 		k = (kline_t *)n->data;
 
-		if (k->duration != 0 && k->expires <= CURRTIME)
-			continue;
-		if (!match(k->user, u->user) && (!match(k->host, u->host) || !match(k->host, u->ip) || !match_ips(k->host, u->ip)))
+		if (kline_matches_user(k, u))
 			return k;
 	}
 
@@ -243,28 +561,21 @@ void kline_expire(void *arg)
 {
 	kline_t *k;
 	char *reason;
-	mowgli_node_t *n, *tn;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, klnlist.head)
+	while (kline_heap_count > 0 && kline_heap_v[0]->expires <= CURRTIME)
 	{
-		k = (kline_t *)n->data;
+		k = kline_heap_v[0];
 
-		if (k->duration == 0)
-			continue;
-
-		if (k->expires <= CURRTIME)
-		{
-			/* TODO: determine validity of k->reason */
-			reason = k->reason ? k->reason : "(none)";
+		/* TODO: determine validity of k->reason */
+		reason = k->reason ? k->reason : "(none)";
 
-			slog(LG_INFO, _("KLINE:EXPIRE: \2%s@%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)"),
-				k->user, k->host, time_ago(k->settime), k->setby, reason);
+		slog(LG_INFO, _("KLINE:EXPIRE: \2%s@%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)"),
+			k->user, k->host, time_ago(k->settime), k->setby, reason);
 
-			verbose_wallops(_("AKILL expired on \2%s@%s\2, set by \2%s\2 (reason: %s)"),
-				k->user, k->host, k->setby, reason);
+		verbose_wallops(_("AKILL expired on \2%s@%s\2, set by \2%s\2 (reason: %s)"),
+			k->user, k->host, k->setby, reason);
 
-			kline_delete(k);
-		}
+		kline_delete(k);
 	}
 }
 
@@ -280,7 +591,7 @@ xline_t *xline_add(const char *realname, const char *reason, long duration, cons
 
 	slog(LG_DEBUG, "xline_add(): %s -> %s (%ld)", realname, reason, duration);
 
-	x = mowgli_heap_alloc(xline_heap);
+	x = sharedheap_alloc(&memtag_klines, sizeof(xline_t));
 
 	mowgli_node_add(x, n, &xlnlist);
 
@@ -325,7 +636,7 @@ void xline_delete(const char *realname)
 	free(x->reason);
 	free(x->setby);
 
-	mowgli_heap_free(xline_heap, x);
+	sharedheap_free(&memtag_klines, x, sizeof(xline_t));
 
 	cnt.xline--;
 }
@@ -418,7 +729,7 @@ qline_t *qline_add(const char *mask, const char *reason, long duration, const ch
 
 	slog(LG_DEBUG, "qline_add(): %s -> %s (%ld)", mask, reason, duration);
 
-	q = mowgli_heap_alloc(qline_heap);
+	q = sharedheap_alloc(&memtag_klines, sizeof(qline_t));
 	mowgli_node_add(q, n, &qlnlist);
 
 	q->mask = sstrdup(mask);
@@ -462,7 +773,7 @@ void qline_delete(const char *mask)
 	free(q->reason);
 	free(q->setby);
 
-	mowgli_heap_free(qline_heap, q);
+	sharedheap_free(&memtag_klines, q, sizeof(qline_t));
 
 	cnt.qline--;
 }
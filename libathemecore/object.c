@@ -27,17 +27,71 @@
 mowgli_list_t object_list = { NULL, NULL, 0 };
 #endif
 
-mowgli_heap_t *metadata_heap;	/* HEAP_CHANUSER */
+static mowgli_list_t metadata_indexes;
 
 void init_metadata(void)
 {
-	metadata_heap = sharedheap_get(sizeof(metadata_t));
+}
+
+static metadata_index_t *metadata_index_for(object_t *obj, metadata_t *md)
+{
+	mowgli_node_t *n;
+	metadata_index_t *mi;
 
-	if (metadata_heap == NULL)
+	MOWGLI_ITER_FOREACH(n, metadata_indexes.head)
 	{
-		slog(LG_ERROR, "init_metadata(): block allocator failure.");
-		exit(EXIT_FAILURE);
+		mi = n->data;
+
+		/* both names come from strshare */
+		if (mi->name == md->name && mi->kind == obj->destructor)
+			return mi;
 	}
+
+	return NULL;
+}
+
+/*
+ * metadata_index_create
+ *
+ * Starts keeping a list of the objects with the given destructor that
+ * carry the given metadata, so they can be found without looking at
+ * every object.
+ *
+ * Inputs:
+ *      - metadata name
+ *      - destructor of the objects to index
+ *
+ * Outputs:
+ *      - the index
+ *
+ * Side Effects:
+ *      - metadata added or deleted from now on updates the index; the
+ *        caller has to pass existing objects to metadata_index_scan()
+ */
+metadata_index_t *metadata_index_create(const char *name, destructor_t kind)
+{
+	metadata_index_t *mi;
+
+	mi = smalloc(sizeof(metadata_index_t));
+	mi->name = strshare_get(name);
+	mi->kind = kind;
+	mowgli_node_add(mi, &mi->node, &metadata_indexes);
+
+	return mi;
+}
+
+void metadata_index_scan(metadata_index_t *mi, void *target)
+{
+	metadata_t *md;
+
+	return_if_fail(mi != NULL);
+
+	md = metadata_find(target, mi->name);
+	if (md == NULL || md->inode != NULL || object(target)->destructor != mi->kind)
+		return;
+
+	md->inode = mowgli_node_create();
+	mowgli_node_add(target, md->inode, &mi->objects);
 }
 
 /*
@@ -220,6 +274,7 @@ metadata_t *metadata_add(void *target, const char *name, const char *value)
 {
 	object_t *obj;
 	metadata_t *md;
+	metadata_index_t *mi;
 
 	return_val_if_fail(name != NULL, NULL);
 	return_val_if_fail(value != NULL, NULL);
@@ -232,13 +287,21 @@ metadata_t *metadata_add(void *target, const char *name, const char *value)
 	if (metadata_find(target, name))
 		metadata_delete(target, name);
 
-	md = mowgli_heap_alloc(metadata_heap);
+	md = sharedheap_alloc(&memtag_metadata, sizeof(metadata_t));
 
 	md->name = strshare_get(name);
 	md->value = sstrdup(value);
 
 	mowgli_patricia_add(obj->metadata, md->name, md);
 
+	if (metadata_indexes.count != 0 && (mi = metadata_index_for(obj, md)) != NULL)
+	{
+		md->inode = mowgli_node_create();
+		mowgli_node_add(target, md->inode, &mi->objects);
+	}
+
+	registration_changed(target);
+
 	return md;
 }
 
@@ -246,6 +309,7 @@ void metadata_delete(void *target, const char *name)
 {
 	object_t *obj;
 	metadata_t *md = metadata_find(target, name);
+	metadata_index_t *mi;
 
 	if (!md)
 		return;
@@ -257,10 +321,19 @@ void metadata_delete(void *target, const char *name)
 
 	mowgli_patricia_delete(obj->metadata, name);
 
+	if (md->inode != NULL)
+	{
+		mi = metadata_index_for(obj, md);
+		mowgli_node_delete(md->inode, &mi->objects);
+		mowgli_node_free(md->inode);
+	}
+
 	strshare_unref(md->name);
 	free(md->value);
 
-	mowgli_heap_free(metadata_heap, md);
+	sharedheap_free(&memtag_metadata, md, sizeof(metadata_t));
+
+	registration_changed(target);
 }
 
 metadata_t *metadata_find(void *target, const char *name)
@@ -30,30 +30,93 @@
 struct timeval burstime;
 #endif
 
+/* lines received from the uplink while bursting */
+unsigned int burstlines = 0;
+
+uplink_stats_t uplink_stats;
+
 mowgli_eventloop_timer_t *ping_uplink_timer = NULL;
+static mowgli_eventloop_timer_t *recvq_resume_timer = NULL;
+
+static void irc_recvq_handler(connection_t *cptr);
+
+static void irc_recvq_resume(void *arg)
+{
+	recvq_resume_timer = NULL;
+
+	if (!me.connected || curr_uplink == NULL || curr_uplink->conn == NULL)
+		return;
 
+	if (curr_uplink->conn->recvq_handler == irc_recvq_handler)
+		irc_recvq_handler(curr_uplink->conn);
+}
+
+/* parses every complete line in the recvq, up to uplink_recvq_budget;
+ * if lines are left over, a timer picks them up on the next pass
+ * through the event loop, so timers and other connections still run
+ * during a large burst.
+ */
 static void irc_recvq_handler(connection_t *cptr)
 {
 	bool wasnonl;
 	char parsebuf[BUFSIZE + 1];
 	int count;
+	unsigned int lines = 0;
 
-	wasnonl = cptr->flags & CF_NONEWLINE ? true : false;
-	count = recvq_getline(cptr, parsebuf, sizeof parsebuf - 1);
-	if (count <= 0)
+	/* out of budget, wait for the timer */
+	if (recvq_resume_timer != NULL)
 		return;
-	cnt.bin += count;
-	/* ignore the excessive part of a too long line */
-	if (wasnonl)
+
+	while (!(cptr->flags & CF_DEAD))
+	{
+		if (config_options.uplink_recvq_budget != 0 && lines >= config_options.uplink_recvq_budget)
+		{
+			uplink_stats.deferred++;
+			recvq_resume_timer = mowgli_timer_add_once(base_eventloop, "irc_recvq_resume", irc_recvq_resume, NULL, 0);
+			break;
+		}
+
+		wasnonl = cptr->flags & CF_NONEWLINE ? true : false;
+		count = recvq_getline(cptr, parsebuf, sizeof parsebuf - 1);
+		if (count <= 0)
+			break;
+		cnt.bin += count;
+		lines++;
+		/* ignore the excessive part of a too long line */
+		if (wasnonl)
+			continue;
+		me.uplinkpong = CURRTIME;
+		if (parsebuf[count - 1] == '\n')
+			count--;
+		if (count > 0 && parsebuf[count - 1] == '\r')
+			count--;
+		parsebuf[count] = '\0';
+		if (me.bursting)
+			burstlines++;
+		parse(parsebuf);
+	}
+
+	if (lines == 0)
 		return;
-	me.uplinkpong = CURRTIME;
-	if (parsebuf[count - 1] == '\n')
-		count--;
-	if (count > 0 && parsebuf[count - 1] == '\r')
-		count--;
-	parsebuf[count] = '\0';
-	parse(parsebuf);
+
+	uplink_stats.wakeups++;
+	uplink_stats.lines += lines;
+	if (lines > uplink_stats.maxlines)
+		uplink_stats.maxlines = lines;
+}
+
+#ifdef HAVE_GETTIMEOFDAY
+/* parse rate over the burst, call after e_time(burstime, ...) */
+unsigned int burst_lines_per_sec(void)
+{
+	int ms = tv2ms(&burstime);
+
+	if (ms <= 0)
+		return burstlines;
+
+	return (unsigned int) ((unsigned long long) burstlines * 1000 / ms);
 }
+#endif
 
 static void ping_uplink(void *arg)
 {
@@ -88,12 +151,17 @@ void irc_handle_connect(connection_t *cptr)
 	{
 		cptr->flags = CF_UPLINK;
 		cptr->recvq_handler = irc_recvq_handler;
+		if (recvq_resume_timer != NULL)
+		{
+			mowgli_timer_destroy(base_eventloop, recvq_resume_timer);
+			recvq_resume_timer = NULL;
+		}
 		connection_setselect_read(cptr, recvq_put);
 		slog(LG_INFO, "irc_handle_connect(): connection to uplink established");
 		me.connected = true;
 		/* no SERVER message received */
 		me.recvsvr = false;
-
+		burstlines = 0;
 
 		server_login();
 
@@ -285,22 +285,14 @@ mowgli_node_t *generic_next_matching_ban(channel_t *c, user_t *u, int type, mowg
 {
 	chanban_t *cb;
 	mowgli_node_t *n;
-	char hostbuf[NICKLEN+USERLEN+HOSTLEN];
-	char cloakbuf[NICKLEN+USERLEN+HOSTLEN];
-	char realbuf[NICKLEN+USERLEN+HOSTLEN];
-	char ipbuf[NICKLEN+USERLEN+HOSTLEN];
-
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(cloakbuf, sizeof cloakbuf, "%s!%s@%s", u->nick, u->user, u->chost);
-	snprintf(realbuf, sizeof realbuf, "%s!%s@%s", u->nick, u->user, u->host);
-	/* will be nick!user@ if ip unknown, doesn't matter */
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	const user_masks_t *um = user_get_masks(u);
+
 	MOWGLI_ITER_FOREACH(n, first)
 	{
 		cb = n->data;
 
 		if (cb->type == type &&
-				(!match(cb->mask, hostbuf) || !match(cb->mask, cloakbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf) || (ircd->flags & IRCD_CIDR_BANS && !match_cidr(cb->mask, ipbuf))))
+				(mask_match(&cb->cmask, um->vhostmask, um->vhostlen) || mask_match(&cb->cmask, um->chostmask, um->chostlen) || mask_match(&cb->cmask, um->hostmask, um->hostlen) || mask_match(&cb->cmask, um->ipmask, um->iplen) || (ircd->flags & IRCD_CIDR_BANS && mask_match_cidr(&cb->cmask, um->nickuser, um->ipfamily, um->ipaddr))))
 			return n;
 	}
 	return NULL;
@@ -310,14 +302,7 @@ mowgli_node_t *generic_next_matching_host_chanacs(mychan_t *mc, user_t *u, mowgl
 {
 	chanacs_t *ca;
 	mowgli_node_t *n;
-	char hostbuf[NICKLEN+USERLEN+HOSTLEN];
-	char hostbuf2[NICKLEN+USERLEN+HOSTLEN];
-	char ipbuf[NICKLEN+USERLEN+HOSTLEN];
-
-	snprintf(hostbuf, sizeof hostbuf, "%s!%s@%s", u->nick, u->user, u->vhost);
-	snprintf(hostbuf2, sizeof hostbuf2, "%s!%s@%s", u->nick, u->user, u->chost);
-	/* will be nick!user@ if ip unknown, doesn't matter */
-	snprintf(ipbuf, sizeof ipbuf, "%s!%s@%s", u->nick, u->user, u->ip);
+	const user_masks_t *um = user_get_masks(u);
 
 	MOWGLI_ITER_FOREACH(n, first)
 	{
@@ -325,7 +310,7 @@ mowgli_node_t *generic_next_matching_host_chanacs(mychan_t *mc, user_t *u, mowgl
 
 		if (ca->entity != NULL)
 		       continue;
-		if (!match(ca->host, hostbuf) || !match(ca->host, hostbuf2) || !match(ca->host, ipbuf) || (ircd->flags & IRCD_CIDR_BANS && !match_cidr(ca->host, ipbuf)))
+		if (mask_match(&ca->cmask, um->vhostmask, um->vhostlen) || mask_match(&ca->cmask, um->chostmask, um->chostlen) || mask_match(&ca->cmask, um->ipmask, um->iplen) || (ircd->flags & IRCD_CIDR_BANS && mask_match_cidr(&ca->cmask, um->nickuser, um->ipfamily, um->ipaddr)))
 			return n;
 	}
 	return NULL;
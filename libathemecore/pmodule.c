@@ -39,6 +39,24 @@ ircd_t *ircd;
 bool pmodule_loaded = false;
 bool backend_loaded = false;
 
+/* small direct-mapped cache in front of the pcommands tree; the uplink
+ * only ever sends a few dozen distinct tokens, so nearly every lookup
+ * during a burst is served from here.
+ */
+#define PCOMMAND_CACHE_SIZE	64
+
+static pcommand_t *pcommand_cache[PCOMMAND_CACHE_SIZE];
+
+static inline unsigned int pcommand_cache_slot(const char *token)
+{
+	unsigned int h = 0;
+
+	while (*token != '\0')
+		h = (h * 31) + (unsigned char) *token++;
+
+	return h & (PCOMMAND_CACHE_SIZE - 1);
+}
+
 void pcommand_init(void)
 {
 	pcommand_heap = sharedheap_get(sizeof(pcommand_t));
@@ -83,6 +101,9 @@ void pcommand_delete(const char *token)
 
 	mowgli_patricia_delete(pcommands, pcmd->token);
 
+	if (pcommand_cache[pcommand_cache_slot(pcmd->token)] == pcmd)
+		pcommand_cache[pcommand_cache_slot(pcmd->token)] = NULL;
+
 	free(pcmd->token);
 	pcmd->handler = NULL;
 	mowgli_heap_free(pcommand_heap, pcmd);
@@ -90,7 +111,19 @@ void pcommand_delete(const char *token)
 
 pcommand_t *pcommand_find(const char *token)
 {
-	return mowgli_patricia_retrieve(pcommands, token);
+	pcommand_t *pcmd;
+	unsigned int slot;
+
+	slot = pcommand_cache_slot(token);
+	pcmd = pcommand_cache[slot];
+	if (pcmd != NULL && !strcmp(pcmd->token, token))
+		return pcmd;
+
+	pcmd = mowgli_patricia_retrieve(pcommands, token);
+	if (pcmd != NULL)
+		pcommand_cache[slot] = pcmd;
+
+	return pcmd;
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
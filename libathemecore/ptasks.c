@@ -96,6 +96,14 @@ void handle_stats(user_t *u, char req)
 
 	switch (req)
 	{
+	  case 'A':
+	  case 'a':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  report_dns_servers(u);
+		  break;
+
 	  case 'B':
 		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
 			  break;
@@ -246,6 +254,84 @@ void handle_stats(user_t *u, char req)
 		  numeric_sts(me.me, 249, u, "T :bytes recv %7.2f%s", bytes(cnt.bin), sbytes(cnt.bin));
 		  break;
 
+	  case 'R':
+	  case 'r':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  numeric_sts(me.me, 249, u, "R :reads      %7u", uplink_stats.reads);
+		  numeric_sts(me.me, 249, u, "R :bytes/read %7" PRIu64, uplink_stats.reads ? uplink_stats.readbytes / uplink_stats.reads : 0);
+		  numeric_sts(me.me, 249, u, "R :wakeups    %7u", uplink_stats.wakeups);
+		  numeric_sts(me.me, 249, u, "R :lines      %7u", uplink_stats.lines);
+		  numeric_sts(me.me, 249, u, "R :lines/wake %7u", uplink_stats.wakeups ? uplink_stats.lines / uplink_stats.wakeups : 0);
+		  numeric_sts(me.me, 249, u, "R :max lines  %7u", uplink_stats.maxlines);
+		  numeric_sts(me.me, 249, u, "R :deferred   %7u", uplink_stats.deferred);
+		  numeric_sts(me.me, 249, u, "R :writes     %7u", uplink_stats.writes);
+		  numeric_sts(me.me, 249, u, "R :bytes/write %6" PRIu64, uplink_stats.writes ? uplink_stats.writebytes / uplink_stats.writes : 0);
+		  numeric_sts(me.me, 249, u, "R :sendq hwm  %7.2f%s", bytes(uplink_stats.sendq_hwm), sbytes(uplink_stats.sendq_hwm));
+		  numeric_sts(me.me, 249, u, "R :flushes    %7u", uplink_stats.flushes);
+		  numeric_sts(me.me, 249, u, "R :avg flush  %7" PRIu64 " ms", uplink_stats.flushes ? uplink_stats.flushms / uplink_stats.flushes : 0);
+		  numeric_sts(me.me, 249, u, "R :max flush  %7u ms", uplink_stats.maxflushms);
+		  break;
+
+	  case 'L':
+	  case 'l':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  numeric_sts(me.me, 249, u, "L :async      %s", log_async_stats.running ? "running" : "off");
+		  numeric_sts(me.me, 249, u, "L :lines      %7u", log_async_stats.lines);
+		  numeric_sts(me.me, 249, u, "L :dropped    %7u", log_async_stats.dropped);
+		  numeric_sts(me.me, 249, u, "L :blocked    %7u", log_async_stats.blocked);
+		  numeric_sts(me.me, 249, u, "L :writes     %7u", log_async_stats.batches);
+		  numeric_sts(me.me, 249, u, "L :avg latency %6" PRIu64 " ms", log_async_stats.batches ? log_async_stats.totallatency / log_async_stats.batches : 0);
+		  numeric_sts(me.me, 249, u, "L :max latency %6u ms", log_async_stats.maxlatency);
+		  break;
+
+	  case 'M':
+	  case 'm':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  MOWGLI_ITER_FOREACH(n, memtag_list.head)
+		  {
+			  memtag_t *tag = n->data;
+
+			  numeric_sts(me.me, 249, u, "M :%-10s %8zu objects %10zu bytes", tag->name, tag->objects, tag->bytes);
+		  }
+		  numeric_sts(me.me, 249, u, "M :arena      %8u chunks (%u on huge pages, %u regions), %zu large objects",
+				  sharedheap_stats.chunks, sharedheap_stats.hugechunks, sharedheap_stats.hugeregions, sharedheap_stats.large);
+		  break;
+
+	  case 'P':
+	  case 'p':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  numeric_sts(me.me, 249, u, "P :threads    %7u", verify_stats.threads);
+		  numeric_sts(me.me, 249, u, "P :queued     %7u", verify_stats.queued);
+		  numeric_sts(me.me, 249, u, "P :pending    %7u", verify_stats.pending);
+		  numeric_sts(me.me, 249, u, "P :inline     %7u", verify_stats.direct);
+		  numeric_sts(me.me, 249, u, "P :queue full %7u", verify_stats.full);
+		  numeric_sts(me.me, 249, u, "P :avg latency %6" PRIu64 " ms", verify_stats.queued - verify_stats.pending ? verify_stats.totallatency / (verify_stats.queued - verify_stats.pending) : 0);
+		  numeric_sts(me.me, 249, u, "P :max latency %6u ms", verify_stats.maxlatency);
+		  break;
+
+	  case 'S':
+	  case 's':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  numeric_sts(me.me, 249, u, "S :strings    %7u (%zu bytes)", strshare_stats.strings, strshare_stats.bytes);
+		  numeric_sts(me.me, 249, u, "S :references %7u (%zu bytes unshared)", strshare_stats.refs, strshare_stats.refbytes);
+		  numeric_sts(me.me, 249, u, "S :dedup ratio %u.%02u, %zu bytes saved",
+				  strshare_stats.strings ? strshare_stats.refs / strshare_stats.strings : 0,
+				  strshare_stats.strings ? (unsigned int)(strshare_stats.refs * 100ULL / strshare_stats.strings % 100) : 0,
+				  strshare_stats.refbytes - strshare_stats.bytes);
+		  numeric_sts(me.me, 249, u, "S :table      %7u slots", strshare_stats.tablesize);
+		  numeric_sts(me.me, 249, u, "S :lookups %lu, %lu already shared", strshare_stats.lookups, strshare_stats.hits);
+		  break;
+
 	  case 'u':
 		  numeric_sts(me.me, 242, u, ":Services Uptime: %s", timediff(CURRTIME - me.start));
 		  break;
@@ -481,13 +567,12 @@ handle_channel_message(sourceinfo_t *si, char *target, bool is_notice, char *mes
 	vec[1] = message;
 	vec[2] = NULL;
 
-	MOWGLI_ITER_FOREACH(n, cdata.c->members.head)
+	/* only internal clients can be services, and the channel keeps
+	 * those on a list of their own */
+	MOWGLI_ITER_FOREACH(n, cdata.c->services.head)
 	{
 		chanuser_t *cu = (chanuser_t *) n->data;
 
-		if (!is_internal_client(cu->user))
-			continue;
-
 		svs = service_find_nick(cu->user->nick);
 
 		if (svs == NULL)
@@ -65,16 +65,40 @@ struct reslist
 	char sends;		/* number of sends (>1 means resent) */
 	time_t sentat;
 	time_t timeout;
+	struct timeval senttv;	/* for latency stats */
 	unsigned int lastns;	/* index of last server sent to */
 	sockaddr_any_t addr;
 	char *name;
 	dns_query_t *query;	/* query callback for this request */
+	struct reslist *hnext;	/* in request_hash */
+	unsigned int heapidx;	/* in request_heap */
 };
 
+/* Requests are also hashed by id, so replies are matched without walking
+ * request_list, and kept in a min-heap ordered by when they time out, so
+ * the timer only looks at requests that are due.
+ */
+#define RES_HASHSIZE	4096
+#define RES_DEADLINE(r)	((r)->sentat + (r)->timeout)
+
 static connection_t *res_fd;
 static mowgli_list_t request_list = { NULL, NULL, 0 };
+static struct reslist *request_hash[RES_HASHSIZE];
+static struct reslist **request_heap;
+static unsigned int request_heap_count, request_heap_size;
 static int ns_timeout_count[IRCD_MAXNS];
 
+/* per nameserver counters for report_dns_servers() */
+#define RES_LATENCY_SAMPLES 512
+
+static struct {
+	unsigned int sent;
+	unsigned int replies;
+	unsigned int timeouts;
+	unsigned int samples;	/* latency[samples % RES_LATENCY_SAMPLES] is next */
+	unsigned int latency[RES_LATENCY_SAMPLES];	/* ms, most recent replies */
+} ns_stats[IRCD_MAXNS];
+
 static void rem_request(struct reslist *request);
 static struct reslist *make_request(dns_query_t *query);
 static void do_query_name(dns_query_t *query, const char *name, struct reslist *request, int);
@@ -94,7 +118,7 @@ static dns_reply_t *make_dnsreply(struct reslist *request);
  *      looks up "inp" in irc_nsaddr_list[]
  * returns:
  *      0  : not found
- *      >0 : found
+ *      >0 : found, index in irc_nsaddr_list[] plus one
  * author:
  *      paul vixie, 29may94
  *      revised for ircd, cryogen(stu) may03
@@ -132,7 +156,7 @@ static int res_ourserver(const sockaddr_any_t *inp)
 						sizeof(struct in6_addr)) == 0))
 					  {
 						  ns_timeout_count[ns] = 0;
-						  return 1;
+						  return ns + 1;
 					  }
 			  break;
 #endif
@@ -143,7 +167,7 @@ static int res_ourserver(const sockaddr_any_t *inp)
 					      || (v4->sin_addr.s_addr == v4in->sin_addr.s_addr))
 					  {
 						  ns_timeout_count[ns] = 0;
-						  return 1;
+						  return ns + 1;
 					  }
 			  break;
 		  default:
@@ -154,47 +178,117 @@ static int res_ourserver(const sockaddr_any_t *inp)
 	return 0;
 }
 
+static void request_heap_swap(unsigned int a, unsigned int b)
+{
+	struct reslist *request = request_heap[a];
+
+	request_heap[a] = request_heap[b];
+	request_heap[b] = request;
+	request_heap[a]->heapidx = a;
+	request_heap[b]->heapidx = b;
+}
+
+/* restores the heap property after request_heap[i] changed */
+static void request_heap_fix(unsigned int i)
+{
+	unsigned int c;
+
+	while (i > 0 && RES_DEADLINE(request_heap[i]) < RES_DEADLINE(request_heap[(i - 1) / 2]))
+	{
+		request_heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+
+	while ((c = 2 * i + 1) < request_heap_count)
+	{
+		if (c + 1 < request_heap_count && RES_DEADLINE(request_heap[c + 1]) < RES_DEADLINE(request_heap[c]))
+			c++;
+		if (RES_DEADLINE(request_heap[i]) <= RES_DEADLINE(request_heap[c]))
+			break;
+		request_heap_swap(i, c);
+		i = c;
+	}
+}
+
+static void request_heap_add(struct reslist *request)
+{
+	if (request_heap_count == request_heap_size)
+	{
+		request_heap_size = request_heap_size ? request_heap_size * 2 : 64;
+		request_heap = srealloc(request_heap, request_heap_size * sizeof(struct reslist *));
+	}
+
+	request->heapidx = request_heap_count++;
+	request_heap[request->heapidx] = request;
+	request_heap_fix(request->heapidx);
+}
+
+static void request_heap_delete(struct reslist *request)
+{
+	unsigned int i = request->heapidx;
+
+	if (i != --request_heap_count)
+	{
+		request_heap_swap(i, request_heap_count);
+		request_heap_fix(i);
+	}
+}
+
+static void hash_request(struct reslist *request)
+{
+	struct reslist **bucket = &request_hash[request->id % RES_HASHSIZE];
+
+	request->hnext = *bucket;
+	*bucket = request;
+}
+
+static void unhash_request(struct reslist *request)
+{
+	struct reslist **p;
+
+	for (p = &request_hash[request->id % RES_HASHSIZE]; *p != NULL; p = &(*p)->hnext)
+	{
+		if (*p == request)
+		{
+			*p = request->hnext;
+			break;
+		}
+	}
+}
+
 /*
  * timeout_query_list - Remove queries from the list which have been 
  * there too long without being resolved.
  */
 static time_t timeout_query_list(time_t now)
 {
-	mowgli_node_t *ptr;
-	mowgli_node_t *next_ptr;
 	struct reslist *request;
-	time_t next_time = 0;
-	time_t timeout = 0;
 
-	MOWGLI_ITER_FOREACH_SAFE(ptr, next_ptr, request_list.head)
+	while (request_heap_count > 0)
 	{
-		request = ptr->data;
-		timeout = request->sentat + request->timeout;
+		request = request_heap[0];
+
+		if (now < RES_DEADLINE(request))
+			return RES_DEADLINE(request);
 
-		if (now >= timeout)
+		ns_stats[request->lastns].timeouts++;
+
+		if (--request->retries <= 0)
 		{
-			if (--request->retries <= 0)
-			{
-				(*request->query->callback) (request->query->ptr, NULL);
-				rem_request(request);
-				continue;
-			}
-			else
-			{
-				ns_timeout_count[request->lastns]++;
-				request->sentat = now;
-				request->timeout += request->timeout;
-				resend_query(request);
-			}
+			(*request->query->callback) (request->query->ptr, NULL);
+			rem_request(request);
 		}
-
-		if ((next_time == 0) || timeout < next_time)
+		else
 		{
-			next_time = timeout;
+			ns_timeout_count[request->lastns]++;
+			request->sentat = now;
+			request->timeout += request->timeout;
+			request_heap_fix(request->heapidx);
+			resend_query(request);
 		}
 	}
 
-	return (next_time > now) ? next_time : (now + AR_TTL);
+	return now + AR_TTL;
 }
 
 /*
@@ -218,6 +312,7 @@ static void start_resolver(void)
 	irc_res_init();
 	for (i = 0; i < irc_nscount; i++)
 		ns_timeout_count[i] = 0;
+	memset(ns_stats, 0, sizeof ns_stats);
 
 	if (res_fd == NULL)
 	{
@@ -292,6 +387,8 @@ static void rem_request(struct reslist *request)
 	return_if_fail(request != NULL);
 
 	mowgli_node_delete(&request->node, &request_list);
+	unhash_request(request);
+	request_heap_delete(request);
 	free(request->name);
 	free(request);
 }
@@ -309,6 +406,7 @@ static struct reslist *make_request(dns_query_t *query)
 	request->query = query;
 
 	mowgli_node_add(request, &request->node, &request_list);
+	request_heap_add(request);
 
 	return request;
 }
@@ -402,13 +500,10 @@ static int send_res_msg(const char *rmsg, int len, int rcount)
  */
 static struct reslist *find_id(int id)
 {
-	mowgli_node_t *ptr;
 	struct reslist *request;
 
-	MOWGLI_ITER_FOREACH(ptr, request_list.head)
+	for (request = request_hash[id % RES_HASHSIZE]; request != NULL; request = request->hnext)
 	{
-		request = ptr->data;
-
 		if (request->id == id)
 			return (request);
 	}
@@ -423,6 +518,7 @@ static struct reslist *find_id(int id)
 void gethost_byname_type(const char *name, dns_query_t *query, int type)
 {
 	return_if_fail(name != 0);
+	query->nxdomain = false;
 	do_query_name(query, name, NULL, type);
 }
 
@@ -431,6 +527,7 @@ void gethost_byname_type(const char *name, dns_query_t *query, int type)
  */
 void gethost_byaddr(const sockaddr_any_t *addr, dns_query_t *query)
 {
+	query->nxdomain = false;
 	do_query_number(query, addr, NULL);
 }
 
@@ -530,6 +627,8 @@ static void query_name(struct reslist *request)
 		int k = 0;
 		struct timeval tv;
 #endif
+
+		unhash_request(request);
 		/*
 		 * generate an unique id
 		 * NOTE: we don't have to worry about converting this to and from
@@ -550,11 +649,16 @@ static void query_name(struct reslist *request)
 		} while (find_id(header->id));
 #endif /* HAVE_LRAND48 */
 		request->id = header->id;
+		hash_request(request);
 		++request->sends;
 
 		ns = send_res_msg(buf, request_len, request->sends);
 		if (ns != -1)
+		{
 			request->lastns = ns;
+			ns_stats[ns].sent++;
+		}
+		s_time(&request->senttv);
 	}
 }
 
@@ -757,6 +861,8 @@ static int res_read_single_reply(connection_t *F)
 	int answer_count;
 	socklen_t len = sizeof(sockaddr_any_t);
 	sockaddr_any_t lsin;
+	struct timeval latency;
+	int ns;
 
 	rc = recvfrom(F->fd, buf, sizeof(buf), 0, (struct sockaddr *)&lsin, &len);
 
@@ -787,14 +893,22 @@ static int res_read_single_reply(connection_t *F)
 	/*
 	 * check against possibly fake replies
 	 */
-	if (!res_ourserver(&lsin))
+	if (!(ns = res_ourserver(&lsin)))
 		return 1;
 
 	if (!check_question(request, header, buf, buf + rc))
 		return 1;
 
+	ns--;
+	e_time(request->senttv, &latency);
+	ns_stats[ns].replies++;
+	ns_stats[ns].latency[ns_stats[ns].samples++ % RES_LATENCY_SAMPLES] = tv2ms(&latency);
+
 	if ((header->rcode != NO_ERRORS) || (header->ancount == 0))
 	{
+		/* asking again would get the same answer */
+		request->query->nxdomain = header->rcode == NXDOMAIN || header->rcode == NO_ERRORS;
+
 		if (NXDOMAIN == header->rcode)
 		{
 			(*request->query->callback) (request->query->ptr, NULL);
@@ -883,19 +997,41 @@ static dns_reply_t *make_dnsreply(struct reslist *request)
 	return (cp);
 }
 
-void report_dns_servers(sourceinfo_t *si)
+static int latency_cmp(const void *a, const void *b)
 {
+	unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * report_dns_servers - STATS A: requests in flight, and per nameserver
+ * the counters and the median and 99th percentile latency of the last
+ * RES_LATENCY_SAMPLES replies.
+ */
+void report_dns_servers(user_t *u)
+{
+	unsigned int sorted[RES_LATENCY_SAMPLES];
+	unsigned int n;
+	char ipaddr[128];
 	int i;
 
+	numeric_sts(me.me, 249, u, "A :in flight %zu", MOWGLI_LIST_LENGTH(&request_list));
+
 	for (i = 0; i < irc_nscount; i++)
 	{
-#if 0
-		char ipaddr[128];
-		if (!rb_inet_ntop_sock((struct sockaddr *)&(irc_nsaddr_list[i]),
-				ipaddr, sizeof ipaddr))
+		const sockaddr_any_t *sa = &irc_nsaddr_list[i].saddr;
+		const void *addr = sa->sa.sa_family == AF_INET6 ? (const void *)&sa->sin6.sin6_addr : (const void *)&sa->sin.sin_addr;
+
+		if (!inet_ntop(sa->sa.sa_family, addr, ipaddr, sizeof ipaddr))
 			mowgli_strlcpy(ipaddr, "?", sizeof ipaddr);
-		sendto_one_numeric(source_p, RPL_STATSDEBUG,
-				"A %s %d", ipaddr, ns_timeout_count[i]);
-#endif
+
+		n = ns_stats[i].samples < RES_LATENCY_SAMPLES ? ns_stats[i].samples : RES_LATENCY_SAMPLES;
+		memcpy(sorted, ns_stats[i].latency, n * sizeof sorted[0]);
+		qsort(sorted, n, sizeof sorted[0], latency_cmp);
+
+		numeric_sts(me.me, 249, u, "A :%s sent %u replies %u timeouts %u p50 %u ms p99 %u ms",
+				ipaddr, ns_stats[i].sent, ns_stats[i].replies, ns_stats[i].timeouts,
+				n ? sorted[n / 2] : 0, n ? sorted[(n * 99) / 100] : 0);
 	}
 }
@@ -0,0 +1,572 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * searchindex.c: Indexes for LIST style searches.
+ *
+ * Copyright (c) 2026 Atheme Development Group
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "atheme.h"
+
+/*
+ * Names are folded with ToLower() and padded with a start and an end
+ * marker, so "Foo" is indexed under "\1fo", "foo" and "oo\2". A pattern
+ * like "fo*" then still has a trigram to look up. Every trigram has a
+ * posting list of the objects whose name contains it. Posting lists are
+ * kept sorted by pointer so deletes and intersections can bisect them;
+ * bulk loads append and sort on first use.
+ */
+
+#define TRIGRAM_START		0x01
+#define TRIGRAM_END		0x02
+#define TRIGRAM_MINSIZE		1024
+
+typedef struct {
+	uint32_t key;		/* 0 if the slot is empty */
+	unsigned int count, size;
+	bool sorted;
+	void **objs;
+} trigram_posting_t;
+
+struct trigram_index_ {
+	trigram_posting_t *table;
+	unsigned int mask, used;
+};
+
+static inline uint32_t trigram_key(const unsigned char *p)
+{
+	return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+}
+
+static inline unsigned int trigram_slot(trigram_index_t *idx, uint32_t key)
+{
+	return (key * 0x9E3779B1U) & idx->mask;
+}
+
+trigram_index_t *trigram_index_create(void)
+{
+	trigram_index_t *idx = smalloc(sizeof *idx);
+
+	idx->table = scalloc(sizeof(trigram_posting_t), TRIGRAM_MINSIZE);
+	idx->mask = TRIGRAM_MINSIZE - 1;
+
+	return idx;
+}
+
+void trigram_index_destroy(trigram_index_t *idx)
+{
+	unsigned int i;
+
+	return_if_fail(idx != NULL);
+
+	for (i = 0; i <= idx->mask; i++)
+		free(idx->table[i].objs);
+	free(idx->table);
+	free(idx);
+}
+
+static trigram_posting_t *trigram_find(trigram_index_t *idx, uint32_t key)
+{
+	unsigned int i;
+
+	for (i = trigram_slot(idx, key); idx->table[i].key != 0; i = (i + 1) & idx->mask)
+		if (idx->table[i].key == key)
+			return &idx->table[i];
+
+	return NULL;
+}
+
+static trigram_posting_t *trigram_get(trigram_index_t *idx, uint32_t key)
+{
+	trigram_posting_t *old;
+	unsigned int oldsize, i, j;
+
+	if (idx->used * 2 >= idx->mask + 1)
+	{
+		old = idx->table;
+		oldsize = idx->mask + 1;
+		idx->table = scalloc(sizeof(trigram_posting_t), oldsize * 2);
+		idx->mask = oldsize * 2 - 1;
+
+		for (i = 0; i < oldsize; i++)
+		{
+			if (old[i].key == 0)
+				continue;
+			for (j = trigram_slot(idx, old[i].key); idx->table[j].key != 0; j = (j + 1) & idx->mask)
+				;
+			idx->table[j] = old[i];
+		}
+		free(old);
+	}
+
+	for (i = trigram_slot(idx, key); idx->table[i].key != 0; i = (i + 1) & idx->mask)
+		if (idx->table[i].key == key)
+			return &idx->table[i];
+
+	idx->table[i].key = key;
+	idx->table[i].sorted = true;
+	idx->used++;
+
+	return &idx->table[i];
+}
+
+static int trigram_ptrcmp(const void *a, const void *b)
+{
+	uintptr_t pa = (uintptr_t)*(void * const *)a, pb = (uintptr_t)*(void * const *)b;
+
+	return pa < pb ? -1 : pa > pb;
+}
+
+static void trigram_sort(trigram_posting_t *p)
+{
+	if (!p->sorted)
+	{
+		qsort(p->objs, p->count, sizeof(void *), trigram_ptrcmp);
+		p->sorted = true;
+	}
+}
+
+/* first position in a sorted posting list not below obj */
+static unsigned int trigram_bisect(trigram_posting_t *p, void *obj)
+{
+	unsigned int lo = 0, hi = p->count, mid;
+
+	while (lo < hi)
+	{
+		mid = lo + (hi - lo) / 2;
+		if ((uintptr_t)p->objs[mid] < (uintptr_t)obj)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* collects the distinct trigrams of a name; returns how many */
+static unsigned int trigram_split(const char *name, uint32_t **keysp, uint32_t *stackkeys, size_t stacksize)
+{
+	size_t len = strlen(name), i;
+	unsigned char c[3];
+	uint32_t *keys;
+	unsigned int n = 0, j;
+
+	keys = len + 1 <= stacksize ? stackkeys : smalloc((len + 1) * sizeof(uint32_t));
+
+	/* the padded name is len + 2 long, which makes len trigrams */
+	for (i = 0; i < len; i++)
+	{
+		c[0] = i == 0 ? TRIGRAM_START : ToLower(name[i - 1]);
+		c[1] = ToLower(name[i]);
+		c[2] = name[i + 1] == '\0' ? TRIGRAM_END : ToLower(name[i + 1]);
+		keys[n++] = trigram_key(c);
+	}
+
+	/* names are short; a quadratic dedup beats sorting them */
+	for (i = 0, j = 0; i < n; i++)
+	{
+		unsigned int k;
+
+		for (k = 0; k < j; k++)
+			if (keys[k] == keys[i])
+				break;
+		if (k == j)
+			keys[j++] = keys[i];
+	}
+
+	*keysp = keys;
+	return j;
+}
+
+void trigram_index_add(trigram_index_t *idx, const char *name, void *obj)
+{
+	uint32_t stackkeys[128], *keys;
+	trigram_posting_t *p;
+	unsigned int n, i, pos;
+
+	return_if_fail(idx != NULL);
+	return_if_fail(name != NULL);
+
+	n = trigram_split(name, &keys, stackkeys, ARRAY_SIZE(stackkeys));
+
+	for (i = 0; i < n; i++)
+	{
+		p = trigram_get(idx, keys[i]);
+
+		if (p->count == p->size)
+		{
+			p->size = p->size ? p->size * 2 : 4;
+			p->objs = srealloc(p->objs, p->size * sizeof(void *));
+		}
+
+		/* appending keeps bulk loads linear; sort later if needed */
+		if (!p->sorted || p->count == 0 || (uintptr_t)p->objs[p->count - 1] < (uintptr_t)obj)
+			p->objs[p->count++] = obj;
+		else if (p->count < 64)
+		{
+			pos = trigram_bisect(p, obj);
+			memmove(&p->objs[pos + 1], &p->objs[pos], (p->count - pos) * sizeof(void *));
+			p->objs[pos] = obj;
+			p->count++;
+		}
+		else
+		{
+			p->objs[p->count++] = obj;
+			p->sorted = false;
+		}
+	}
+
+	if (keys != stackkeys)
+		free(keys);
+}
+
+void trigram_index_delete(trigram_index_t *idx, const char *name, void *obj)
+{
+	uint32_t stackkeys[128], *keys;
+	trigram_posting_t *p;
+	unsigned int n, i, pos;
+
+	return_if_fail(idx != NULL);
+	return_if_fail(name != NULL);
+
+	n = trigram_split(name, &keys, stackkeys, ARRAY_SIZE(stackkeys));
+
+	for (i = 0; i < n; i++)
+	{
+		if ((p = trigram_find(idx, keys[i])) == NULL)
+			continue;
+
+		trigram_sort(p);
+		pos = trigram_bisect(p, obj);
+		if (pos == p->count || p->objs[pos] != obj)
+			continue;
+
+		memmove(&p->objs[pos], &p->objs[pos + 1], (p->count - pos - 1) * sizeof(void *));
+		p->count--;
+	}
+
+	if (keys != stackkeys)
+		free(keys);
+}
+
+/*
+ * Collects the trigrams every name matching the pattern must contain:
+ * those of its literal runs, padded with the start or end marker where
+ * the run is anchored. Returns how many, up to max.
+ */
+static unsigned int trigram_pattern(const char *pattern, uint32_t *keys, unsigned int max)
+{
+	unsigned char run[BUFSIZE + 2];
+	const unsigned char *p = (const unsigned char *)pattern;
+	size_t len = 0, i;
+	unsigned int n = 0;
+	bool end;
+
+	run[len++] = TRIGRAM_START;
+
+	for (;;)
+	{
+		end = *p == '\0';
+
+		if (end || *p == '*' || *p == '?' || *p == '&' || *p == '#' || *p == '%')
+		{
+			if (end)
+				run[len++] = TRIGRAM_END;
+
+			for (i = 0; i + 3 <= len && n < max; i++)
+				keys[n++] = trigram_key(&run[i]);
+
+			if (end)
+				break;
+
+			len = 0;
+			p++;
+			continue;
+		}
+
+		if (*p == '\\' && p[1] != '\0' && strchr("*?&#%", p[1]))
+			p++;
+
+		/* a very long run is looked up in pieces */
+		if (len == sizeof run - 1)
+		{
+			for (i = 0; i + 3 <= len && n < max; i++)
+				keys[n++] = trigram_key(&run[i]);
+			run[0] = run[len - 2];
+			run[1] = run[len - 1];
+			len = 2;
+		}
+
+		run[len++] = ToLower(*p);
+		p++;
+	}
+
+	return n;
+}
+
+unsigned int trigram_index_estimate(trigram_index_t *idx, const char *pattern)
+{
+	uint32_t keys[64];
+	trigram_posting_t *p;
+	unsigned int n, i, best = TRIGRAM_NOINDEX;
+
+	return_val_if_fail(idx != NULL, TRIGRAM_NOINDEX);
+	return_val_if_fail(pattern != NULL, TRIGRAM_NOINDEX);
+
+	n = trigram_pattern(pattern, keys, ARRAY_SIZE(keys));
+
+	for (i = 0; i < n; i++)
+	{
+		if ((p = trigram_find(idx, keys[i])) == NULL)
+			return 0;
+		if (p->count < best)
+			best = p->count;
+	}
+
+	return best;
+}
+
+/*
+ * trigram_index_search()
+ *
+ * Calls cb for every object whose name contains all trigrams of the
+ * pattern, and returns how many there were. Returns TRIGRAM_NOINDEX
+ * without calling cb if the pattern has no literal run long enough.
+ */
+unsigned int trigram_index_search(trigram_index_t *idx, const char *pattern, trigram_index_cb_t cb, void *priv)
+{
+	uint32_t keys[64];
+	trigram_posting_t *lists[64], *p;
+	unsigned int n, i, j, pos, found = 0;
+	void **objs;
+	size_t count;
+
+	return_val_if_fail(idx != NULL, TRIGRAM_NOINDEX);
+	return_val_if_fail(pattern != NULL, TRIGRAM_NOINDEX);
+
+	n = trigram_pattern(pattern, keys, ARRAY_SIZE(keys));
+	if (n == 0)
+		return TRIGRAM_NOINDEX;
+
+	for (i = 0; i < n; i++)
+	{
+		if ((lists[i] = trigram_find(idx, keys[i])) == NULL || lists[i]->count == 0)
+			return 0;
+		trigram_sort(lists[i]);
+
+		/* keep the shortest list first */
+		if (lists[i]->count < lists[0]->count)
+		{
+			p = lists[0];
+			lists[0] = lists[i];
+			lists[i] = p;
+		}
+	}
+
+	/* callbacks may change the index, so work on a copy */
+	count = lists[0]->count;
+	objs = smalloc(count * sizeof(void *));
+	memcpy(objs, lists[0]->objs, count * sizeof(void *));
+
+	for (i = 0; i < count; i++)
+	{
+		for (j = 1; j < n; j++)
+		{
+			if (lists[j] == lists[0])
+				continue;
+			pos = trigram_bisect(lists[j], objs[i]);
+			if (pos == lists[j]->count || lists[j]->objs[pos] != objs[i])
+				break;
+		}
+		if (j < n)
+			continue;
+
+		objs[found++] = objs[i];
+	}
+
+	for (i = 0; i < found; i++)
+		cb(objs[i], priv);
+
+	free(objs);
+	return found;
+}
+
+/*
+ * Time heaps work like the resolver's timeout heap, except that the
+ * nodes live inside the objects they index.
+ */
+
+static void timeheap_swap(timeheap_t *h, unsigned int a, unsigned int b)
+{
+	timeheap_node_t *n = h->nodes[a];
+
+	h->nodes[a] = h->nodes[b];
+	h->nodes[b] = n;
+	h->nodes[a]->idx = a;
+	h->nodes[b]->idx = b;
+}
+
+/* restores the heap property after h->nodes[i] changed */
+static void timeheap_fix(timeheap_t *h, unsigned int i)
+{
+	unsigned int c;
+
+	while (i > 0 && h->nodes[i]->key < h->nodes[(i - 1) / 2]->key)
+	{
+		timeheap_swap(h, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+
+	while ((c = 2 * i + 1) < h->count)
+	{
+		if (c + 1 < h->count && h->nodes[c + 1]->key < h->nodes[c]->key)
+			c++;
+		if (h->nodes[i]->key <= h->nodes[c]->key)
+			break;
+		timeheap_swap(h, i, c);
+		i = c;
+	}
+}
+
+void timeheap_add(timeheap_t *h, timeheap_node_t *n, void *data, time_t key)
+{
+	return_if_fail(h != NULL);
+	return_if_fail(n != NULL && n->data == NULL);
+
+	if (h->count == h->size)
+	{
+		h->size = h->size ? h->size * 2 : 256;
+		h->nodes = srealloc(h->nodes, h->size * sizeof(timeheap_node_t *));
+	}
+
+	n->key = key;
+	n->data = data;
+	n->idx = h->count++;
+	h->nodes[n->idx] = n;
+	timeheap_fix(h, n->idx);
+}
+
+void timeheap_delete(timeheap_t *h, timeheap_node_t *n)
+{
+	unsigned int i;
+
+	return_if_fail(h != NULL);
+
+	if (n->data == NULL)
+		return;
+
+	i = n->idx;
+	if (i != --h->count)
+	{
+		timeheap_swap(h, i, h->count);
+		timeheap_fix(h, i);
+	}
+
+	n->data = NULL;
+}
+
+void timeheap_update(timeheap_t *h, timeheap_node_t *n, time_t key)
+{
+	return_if_fail(h != NULL);
+
+	if (n->data == NULL || n->key == key)
+		return;
+
+	n->key = key;
+	timeheap_fix(h, n->idx);
+}
+
+void timeheap_clear(timeheap_t *h)
+{
+	unsigned int i;
+
+	return_if_fail(h != NULL);
+
+	for (i = 0; i < h->count; i++)
+		h->nodes[i]->data = NULL;
+
+	free(h->nodes);
+	h->nodes = NULL;
+	h->count = h->size = 0;
+}
+
+static unsigned int timeheap_count_from(timeheap_t *h, unsigned int i, time_t cutoff, unsigned int limit)
+{
+	unsigned int found;
+
+	if (i >= h->count || h->nodes[i]->key > cutoff || limit == 0)
+		return 0;
+
+	found = 1;
+	found += timeheap_count_from(h, 2 * i + 1, cutoff, limit - found);
+	found += timeheap_count_from(h, 2 * i + 2, cutoff, limit - found);
+
+	return found;
+}
+
+/*
+ * timeheap_count_before()
+ *
+ * Counts the nodes keyed at or before cutoff, giving up at limit. Only
+ * the matching part of the heap is visited.
+ */
+unsigned int timeheap_count_before(timeheap_t *h, time_t cutoff, unsigned int limit)
+{
+	return_val_if_fail(h != NULL, 0);
+
+	return timeheap_count_from(h, 0, cutoff, limit);
+}
+
+/*
+ * timeheap_foreach_before()
+ *
+ * Calls cb for every node keyed at or before cutoff. The nodes are
+ * collected first, so cb may re-key or delete them.
+ */
+unsigned int timeheap_foreach_before(timeheap_t *h, time_t cutoff, timeheap_cb_t cb, void *priv)
+{
+	timeheap_node_t **found;
+	unsigned int count = 0, i, c;
+
+	return_val_if_fail(h != NULL, 0);
+
+	if (h->count == 0 || h->nodes[0]->key > cutoff)
+		return 0;
+
+	/* breadth first, using the result array as the queue */
+	found = smalloc(h->count * sizeof(timeheap_node_t *));
+	found[count++] = h->nodes[0];
+	for (i = 0; i < count; i++)
+	{
+		for (c = 2 * found[i]->idx + 1; c <= 2 * found[i]->idx + 2 && c < h->count; c++)
+			if (h->nodes[c]->key <= cutoff)
+				found[count++] = h->nodes[c];
+	}
+
+	for (i = 0; i < count; i++)
+		cb(found[i], priv);
+
+	free(found);
+	return count;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -27,7 +27,6 @@ mowgli_patricia_t *sidlist;
 mowgli_patricia_t *servlist;
 mowgli_list_t tldlist;
 
-mowgli_heap_t *serv_heap;
 mowgli_heap_t *tld_heap;
 
 static void server_delete_serv(server_t *s);
@@ -49,10 +48,9 @@ static void server_delete_serv(server_t *s);
  */
 void init_servers(void)
 {
-	serv_heap = sharedheap_get(sizeof(server_t));
 	tld_heap = sharedheap_get(sizeof(tld_t));
 
-	if (serv_heap == NULL || tld_heap == NULL)
+	if (tld_heap == NULL)
 	{
 		slog(LG_INFO, "init_servers(): block allocator failure.");
 		exit(EXIT_FAILURE);
@@ -103,7 +101,7 @@ server_t *server_add(const char *name, unsigned int hops, server_t *uplink, cons
 	else
 		slog(LG_DEBUG, "server_add(): %s, root", name);
 
-	s = mowgli_heap_alloc(serv_heap);
+	s = sharedheap_alloc(&memtag_servers, sizeof(server_t));
 
 	if (id != NULL)
 	{
@@ -250,7 +248,7 @@ static void server_delete_serv(server_t *s)
 	if (s->sid)
 		free(s->sid);
 
-	mowgli_heap_free(serv_heap, s);
+	sharedheap_free(&memtag_servers, s, sizeof(server_t));
 
 	cnt.server--;
 }
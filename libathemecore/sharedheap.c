@@ -158,3 +158,294 @@ void sharedheap_unref(mowgli_heap_t *heap)
 
 	object_unref(s);
 }
+
+/*
+ * Size class arena.
+ *
+ * sharedheap_alloc() serves objects of up to ARENA_MAXSIZE bytes from
+ * 64 KB chunks, each carved into slots of a single size class: 16 byte
+ * steps up to 256 bytes and quarter powers of two above that. A chunk
+ * starts with its header and is aligned to its own size, so the chunk of
+ * any object is found by masking the pointer and callers only have to
+ * pass the size back to sharedheap_free(). A class keeps its chunks with
+ * free slots on a list; chunks that empty out are unmapped, except for
+ * the last one.
+ *
+ * With general::hugepages, a class that has grown past a huge page worth
+ * of chunks takes new ones from 2 MB regions backed by huge pages where
+ * the system allows it. Those regions are kept for reuse, not unmapped.
+ */
+
+#include <sys/mman.h>
+
+#ifndef SIGUSR1
+# define RAISE_EXCEPTION abort()
+#else
+# define RAISE_EXCEPTION raise(SIGUSR1)
+#endif
+
+#ifndef MAP_ANON
+# define MAP_ANON MAP_ANONYMOUS
+#endif
+
+#define ARENA_CHUNKSIZE		65536
+#define ARENA_REGIONSIZE	(2 * 1024 * 1024)
+#define ARENA_HUGEMIN		(ARENA_REGIONSIZE / ARENA_CHUNKSIZE)
+#define ARENA_QUANTUM		16
+#define ARENA_MAXSIZE		16384
+#define ARENA_MAXCLASSES	48
+
+typedef struct arena_chunk_ arena_chunk_t;
+
+typedef struct {
+	size_t size;
+	arena_chunk_t *partial;		/* chunks with free slots */
+	unsigned int chunks;
+} arena_class_t;
+
+struct arena_chunk_ {
+	arena_class_t *cls;
+	arena_chunk_t *prev, *next;	/* on cls->partial */
+	void *freelist;
+	char *unused;			/* slots never handed out start here */
+	unsigned int live;
+	bool partial;
+	bool huge;
+};
+
+#define ARENA_HEADERSIZE	((sizeof(arena_chunk_t) + ARENA_QUANTUM - 1) & ~(size_t)(ARENA_QUANTUM - 1))
+
+static arena_class_t arena_classes[ARENA_MAXCLASSES];
+static unsigned char arena_class_index[ARENA_MAXSIZE / ARENA_QUANTUM + 1];
+static bool arena_ready;
+static void *arena_hugepool;		/* free chunks from huge page regions */
+
+sharedheap_stats_t sharedheap_stats;
+
+static void arena_init(void)
+{
+	unsigned int n = 0, q;
+	size_t size, pow2;
+
+	for (size = ARENA_QUANTUM; size <= 256; size += ARENA_QUANTUM)
+		arena_classes[n++].size = size;
+	for (pow2 = 256; pow2 < ARENA_MAXSIZE; pow2 *= 2)
+		for (q = 5; q <= 8; q++)
+			arena_classes[n++].size = pow2 * q / 4;
+
+	soft_assert(n <= ARENA_MAXCLASSES);
+
+	for (q = 0, n = 0; q <= ARENA_MAXSIZE / ARENA_QUANTUM; q++)
+	{
+		while (arena_classes[n].size < q * ARENA_QUANTUM)
+			n++;
+		arena_class_index[q] = n;
+	}
+
+	arena_ready = true;
+}
+
+/* mmap() at an address that is a multiple of the size */
+static void *arena_map_aligned(size_t size)
+{
+	char *p, *aligned;
+	uintptr_t off;
+
+	p = mmap(NULL, size * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	off = (uintptr_t)p & (size - 1);
+	aligned = off != 0 ? p + (size - off) : p;
+	if (aligned > p)
+		munmap(p, aligned - p);
+	if (aligned + size < p + size * 2)
+		munmap(aligned + size, p + size * 2 - (aligned + size));
+
+	return aligned;
+}
+
+static arena_chunk_t *arena_huge_chunk(void)
+{
+	char *region = NULL;
+	void *chunk;
+	unsigned int i;
+
+	if (arena_hugepool == NULL)
+	{
+#ifdef MAP_HUGETLB
+		region = mmap(NULL, ARENA_REGIONSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_HUGETLB, -1, 0);
+		if (region == MAP_FAILED)
+			region = NULL;
+#endif
+		if (region == NULL)
+		{
+			if ((region = arena_map_aligned(ARENA_REGIONSIZE)) == NULL)
+				return NULL;
+#ifdef MADV_HUGEPAGE
+			madvise(region, ARENA_REGIONSIZE, MADV_HUGEPAGE);
+#endif
+		}
+
+		for (i = 0; i < ARENA_HUGEMIN; i++)
+		{
+			chunk = region + i * ARENA_CHUNKSIZE;
+			*(void **)chunk = arena_hugepool;
+			arena_hugepool = chunk;
+		}
+		sharedheap_stats.hugeregions++;
+	}
+
+	chunk = arena_hugepool;
+	arena_hugepool = *(void **)chunk;
+	return chunk;
+}
+
+static void arena_link(arena_chunk_t *c)
+{
+	arena_class_t *cls = c->cls;
+
+	c->prev = NULL;
+	c->next = cls->partial;
+	if (cls->partial != NULL)
+		cls->partial->prev = c;
+	cls->partial = c;
+	c->partial = true;
+}
+
+static void arena_unlink(arena_chunk_t *c)
+{
+	if (c->prev != NULL)
+		c->prev->next = c->next;
+	else
+		c->cls->partial = c->next;
+	if (c->next != NULL)
+		c->next->prev = c->prev;
+	c->partial = false;
+}
+
+static arena_chunk_t *arena_chunk_new(arena_class_t *cls)
+{
+	arena_chunk_t *c = NULL;
+	bool huge = false;
+
+	if (config_options.hugepages && cls->chunks >= ARENA_HUGEMIN)
+		huge = (c = arena_huge_chunk()) != NULL;
+	if (c == NULL && (c = arena_map_aligned(ARENA_CHUNKSIZE)) == NULL)
+	{
+		RAISE_EXCEPTION;
+		return NULL;
+	}
+
+	memset(c, 0, sizeof *c);
+	c->cls = cls;
+	c->unused = (char *)c + ARENA_HEADERSIZE;
+	c->huge = huge;
+	arena_link(c);
+
+	cls->chunks++;
+	sharedheap_stats.chunks++;
+	if (huge)
+		sharedheap_stats.hugechunks++;
+
+	return c;
+}
+
+static void arena_chunk_release(arena_chunk_t *c)
+{
+	arena_unlink(c);
+	c->cls->chunks--;
+	sharedheap_stats.chunks--;
+
+	if (c->huge)
+	{
+		sharedheap_stats.hugechunks--;
+		*(void **)c = arena_hugepool;
+		arena_hugepool = c;
+	}
+	else
+		munmap(c, ARENA_CHUNKSIZE);
+}
+
+/*
+ * sharedheap_alloc()
+ *  Allocate `size' zeroed bytes and count them against `tag'. The memory
+ *  must be released with sharedheap_free() and the same tag and size.
+ */
+void *sharedheap_alloc(memtag_t *tag, size_t size)
+{
+	arena_class_t *cls;
+	arena_chunk_t *c;
+	void *p;
+
+	return_val_if_fail(tag != NULL, NULL);
+
+	tag->objects++;
+	tag->bytes += size;
+
+	if (size > ARENA_MAXSIZE)
+	{
+		sharedheap_stats.large++;
+		return smalloc(size);
+	}
+
+	if (!arena_ready)
+		arena_init();
+
+	cls = &arena_classes[arena_class_index[(size + ARENA_QUANTUM - 1) / ARENA_QUANTUM]];
+	if ((c = cls->partial) == NULL && (c = arena_chunk_new(cls)) == NULL)
+		return NULL;
+
+	if (c->freelist != NULL)
+	{
+		p = c->freelist;
+		c->freelist = *(void **)p;
+	}
+	else
+	{
+		p = c->unused;
+		c->unused += cls->size;
+	}
+	c->live++;
+
+	if (c->freelist == NULL && c->unused + cls->size > (char *)c + ARENA_CHUNKSIZE)
+		arena_unlink(c);
+
+	memset(p, 0, size);
+	return p;
+}
+
+void sharedheap_free(memtag_t *tag, void *ptr, size_t size)
+{
+	arena_chunk_t *c;
+
+	return_if_fail(tag != NULL);
+
+	if (ptr == NULL)
+		return;
+
+	tag->objects--;
+	tag->bytes -= size;
+
+	if (size > ARENA_MAXSIZE)
+	{
+		sharedheap_stats.large--;
+		free(ptr);
+		return;
+	}
+
+	c = (arena_chunk_t *)((uintptr_t)ptr & ~(uintptr_t)(ARENA_CHUNKSIZE - 1));
+
+	*(void **)ptr = c->freelist;
+	c->freelist = ptr;
+	c->live--;
+
+	if (c->live == 0 && c->cls->chunks > 1)
+	{
+		if (!c->partial)
+			arena_link(c);
+		arena_chunk_release(c);
+	}
+	else if (!c->partial)
+		arena_link(c);
+}
@@ -23,35 +23,123 @@
 
 #include "atheme.h"
 
-mowgli_patricia_t *strshare_dict;
+/*
+ * Shared strings live in an open addressing hash table with linear
+ * probing. Each slot keeps the string's hash next to the pointer, so
+ * most collisions are rejected without touching the string. The strings
+ * themselves come from the size class arena instead of one malloc each.
+ */
+
+#define STRSHARE_MINSIZE	4096
 
 typedef struct
 {
-	int refcount;
+	unsigned int refcount;
+	unsigned int hash;
+	unsigned int len;
 } strshare_t;
 
+typedef struct
+{
+	unsigned int hash;
+	strshare_t *ss;
+} strshare_slot_t;
+
+static strshare_slot_t *strshare_table;
+static unsigned int strshare_mask;
+
+strshare_stats_t strshare_stats;
+
+static inline unsigned int strshare_hash(const char *str, size_t len)
+{
+	unsigned int h = 2166136261U;
+
+	while (len-- > 0)
+		h = (h ^ (unsigned char)*str++) * 16777619U;
+	return h;
+}
+
+static void strshare_resize(unsigned int size)
+{
+	strshare_slot_t *old = strshare_table;
+	unsigned int oldsize = strshare_mask + 1, i, j;
+
+	strshare_table = scalloc(sizeof(strshare_slot_t), size);
+	strshare_mask = size - 1;
+	strshare_stats.tablesize = size;
+
+	if (old == NULL)
+		return;
+
+	for (i = 0; i < oldsize; i++)
+	{
+		if (old[i].ss == NULL)
+			continue;
+		for (j = old[i].hash & strshare_mask; strshare_table[j].ss != NULL; j = (j + 1) & strshare_mask)
+			;
+		strshare_table[j] = old[i];
+	}
+	free(old);
+}
+
 void strshare_init(void)
 {
-	strshare_dict = mowgli_patricia_create(noopcanon);
+	strshare_resize(STRSHARE_MINSIZE);
+}
+
+static strshare_t *strshare_alloc(size_t len)
+{
+	return sharedheap_alloc(&memtag_strings, sizeof(strshare_t) + len + 1);
+}
+
+static void strshare_free(strshare_t *ss)
+{
+	sharedheap_free(&memtag_strings, ss, sizeof(strshare_t) + ss->len + 1);
 }
 
 stringref strshare_get(const char *str)
 {
 	strshare_t *ss;
+	size_t len;
+	unsigned int hash, i;
 
 	if (str == NULL)
 		return NULL;
 
-	ss = mowgli_patricia_retrieve(strshare_dict, str);
-	if (ss != NULL)
-		ss->refcount++;
-	else
+	len = strlen(str);
+	hash = strshare_hash(str, len);
+	strshare_stats.lookups++;
+
+	for (i = hash & strshare_mask; (ss = strshare_table[i].ss) != NULL; i = (i + 1) & strshare_mask)
 	{
-		ss = smalloc(sizeof(strshare_t) + strlen(str) + 1);
-		ss->refcount = 1;
-		strcpy((char *)(ss + 1), str);
-		mowgli_patricia_add(strshare_dict, (char *)(ss + 1), ss);
+		if (strshare_table[i].hash == hash && ss->len == len && !memcmp(ss + 1, str, len))
+		{
+			ss->refcount++;
+			strshare_stats.hits++;
+			strshare_stats.refs++;
+			strshare_stats.refbytes += len + 1;
+			return (char *)(ss + 1);
+		}
 	}
+
+	ss = strshare_alloc(len);
+	ss->refcount = 1;
+	ss->hash = hash;
+	ss->len = len;
+	memcpy(ss + 1, str, len + 1);
+
+	strshare_table[i].hash = hash;
+	strshare_table[i].ss = ss;
+
+	strshare_stats.strings++;
+	strshare_stats.refs++;
+	strshare_stats.bytes += len + 1;
+	strshare_stats.refbytes += len + 1;
+
+	/* keep the table at most half full */
+	if (strshare_stats.strings * 2 > strshare_mask + 1)
+		strshare_resize((strshare_mask + 1) * 2);
+
 	return (char *)(ss + 1);
 }
 
@@ -65,25 +153,62 @@ stringref strshare_ref(stringref str)
 	/* intermediate cast to suppress gcc -Wcast-qual */
 	ss = (strshare_t *)(uintptr_t)str - 1;
 	ss->refcount++;
+	strshare_stats.refs++;
+	strshare_stats.refbytes += ss->len + 1;
 
 	return str;
 }
 
+/* remove slot i, moving later entries of the same probe run up */
+static void strshare_delete_slot(unsigned int i)
+{
+	unsigned int j = i, k;
+
+	for (;;)
+	{
+		j = (j + 1) & strshare_mask;
+		if (strshare_table[j].ss == NULL)
+			break;
+
+		k = strshare_table[j].hash & strshare_mask;
+
+		/* leave it if its home slot is cyclically in (i, j] */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+
+		strshare_table[i] = strshare_table[j];
+		i = j;
+	}
+
+	strshare_table[i].ss = NULL;
+}
+
 void strshare_unref(stringref str)
 {
 	strshare_t *ss;
+	unsigned int i;
 
 	if (str == NULL)
 		return;
 
 	/* intermediate cast to suppress gcc -Wcast-qual */
 	ss = (strshare_t *)(uintptr_t)str - 1;
-	ss->refcount--;
-	if (ss->refcount == 0)
-	{
-		mowgli_patricia_delete(strshare_dict, str);
-		free(ss);
-	}
+	strshare_stats.refs--;
+	strshare_stats.refbytes -= ss->len + 1;
+
+	if (--ss->refcount > 0)
+		return;
+
+	for (i = ss->hash & strshare_mask; strshare_table[i].ss != ss; i = (i + 1) & strshare_mask)
+		return_if_fail(strshare_table[i].ss != NULL);
+	strshare_delete_slot(i);
+
+	strshare_stats.strings--;
+	strshare_stats.bytes -= ss->len + 1;
+	strshare_free(ss);
+
+	if (strshare_mask + 1 > STRSHARE_MINSIZE && strshare_stats.strings * 8 < strshare_mask + 1)
+		strshare_resize((strshare_mask + 1) / 2);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -25,6 +25,146 @@
 
 mowgli_list_t svs_ignore_list;
 
+/*
+ * Ignores are checked on every message to a service, so besides
+ * svs_ignore_list they are indexed like AKILLs, by the host part of
+ * their mask:
+ *
+ *  - masks ending in a literal @host, by the host
+ *  - masks ending in @*tail with a literal tail, by the tail
+ *  - anything else goes on svsignore_wild and is matched one by one
+ *
+ * Index hits are only candidates, they are checked with mask_match().
+ * The verdict for a user is kept in its user_masks_t, which is rebuilt
+ * when the nick, user or host changes, and stays valid until the ignore
+ * list changes and svsignore_generation moves on.
+ */
+static mowgli_patricia_t *svsignore_hosts;
+static mowgli_patricia_t *svsignore_tails;
+static unsigned int svsignore_taillen[HOSTLEN + 1];
+static mowgli_list_t svsignore_wild;
+static unsigned int svsignore_generation = 1;
+
+#define SVSIGNORE_INDEX_HOST	1
+#define SVSIGNORE_INDEX_TAIL	2
+#define SVSIGNORE_INDEX_WILD	3
+
+#define IsMaskMeta(c)	((c) == '*' || (c) == '?' || (c) == '&' || (c) == '#' || (c) == '%' || (c) == '\\')
+
+/* returns the index for the mask, and its key in *key */
+static int svsignore_classify(const char *mask, const char **key)
+{
+	const char *host, *p;
+
+	if ((host = strrchr(mask, '@')) == NULL)
+		return SVSIGNORE_INDEX_WILD;
+	host++;
+
+	for (p = host; *p != '\0'; p++)
+		if (IsMaskMeta(*p))
+			break;
+
+	if (*p == '\0' && p != host)
+	{
+		*key = host;
+		return SVSIGNORE_INDEX_HOST;
+	}
+
+	if (host[0] == '*' && host[1] != '\0' && p == host && strlen(host) <= HOSTLEN)
+	{
+		for (p = host + 1; *p != '\0'; p++)
+			if (IsMaskMeta(*p))
+				return SVSIGNORE_INDEX_WILD;
+		*key = host + 1;
+		return SVSIGNORE_INDEX_TAIL;
+	}
+
+	return SVSIGNORE_INDEX_WILD;
+}
+
+static void svsignore_index_add(mowgli_patricia_t **dict, const char *key, svsignore_t *svsignore)
+{
+	mowgli_list_t *l;
+
+	if (*dict == NULL)
+		*dict = mowgli_patricia_create(irccasecanon);
+
+	if ((l = mowgli_patricia_retrieve(*dict, key)) == NULL)
+	{
+		l = mowgli_list_create();
+		mowgli_patricia_add(*dict, key, l);
+	}
+
+	mowgli_node_add(svsignore, &svsignore->inode, l);
+}
+
+static void svsignore_index_delete(mowgli_patricia_t *dict, const char *key, svsignore_t *svsignore)
+{
+	mowgli_list_t *l = mowgli_patricia_retrieve(dict, key);
+
+	return_if_fail(l != NULL);
+
+	mowgli_node_delete(&svsignore->inode, l);
+	if (MOWGLI_LIST_LENGTH(l) == 0)
+	{
+		mowgli_patricia_delete(dict, key);
+		mowgli_list_free(l);
+	}
+}
+
+static void svsignore_index(svsignore_t *svsignore)
+{
+	const char *key = NULL;
+
+	switch (svsignore_classify(svsignore->mask, &key))
+	{
+	case SVSIGNORE_INDEX_HOST:
+		svsignore_index_add(&svsignore_hosts, key, svsignore);
+		break;
+	case SVSIGNORE_INDEX_TAIL:
+		svsignore_index_add(&svsignore_tails, key, svsignore);
+		svsignore_taillen[strlen(key)]++;
+		break;
+	default:
+		mowgli_node_add(svsignore, &svsignore->inode, &svsignore_wild);
+	}
+}
+
+static void svsignore_unindex(svsignore_t *svsignore)
+{
+	const char *key = NULL;
+
+	switch (svsignore_classify(svsignore->mask, &key))
+	{
+	case SVSIGNORE_INDEX_HOST:
+		svsignore_index_delete(svsignore_hosts, key, svsignore);
+		break;
+	case SVSIGNORE_INDEX_TAIL:
+		svsignore_index_delete(svsignore_tails, key, svsignore);
+		svsignore_taillen[strlen(key)]--;
+		break;
+	default:
+		mowgli_node_delete(&svsignore->inode, &svsignore_wild);
+	}
+}
+
+/* first ignore in l matching name */
+static svsignore_t *svsignore_match_list(mowgli_list_t *l, const char *name, size_t namelen)
+{
+	mowgli_node_t *n;
+	svsignore_t *svsignore;
+
+	MOWGLI_ITER_FOREACH(n, l->head)
+	{
+		svsignore = (svsignore_t *)n->data;
+
+		if (mask_match(&svsignore->cmask, name, namelen))
+			return svsignore;
+	}
+
+	return NULL;
+}
+
 /*
  * svsignore_add(const char *mask, const char *reason)
  *
@@ -56,6 +196,10 @@ svsignore_t *svsignore_add(const char *mask, const char *reason)
         svsignore->settime = CURRTIME;
         svsignore->reason = sstrdup(reason);
         cnt.svsignore++;
+
+        mask_compile(&svsignore->cmask, svsignore->mask);
+        svsignore_index(svsignore);
+        svsignore_generation++;
          
         return svsignore;
 }
@@ -73,33 +217,51 @@ svsignore_t *svsignore_add(const char *mask, const char *reason)
  *     - if none match, NULL
  *
  * Side Effects:
- *     - none
+ *     - the result is cached for the user until it or the ignore list
+ *       changes
  */                
 svsignore_t *svsignore_find(user_t *source)
-{       
-        svsignore_t *svsignore;
-        mowgli_node_t *n;
-        char host[BUFSIZE];
+{
+	svsignore_t *svsignore = NULL;
+	user_masks_t *um;
+	mowgli_list_t *l;
+	const char *host;
+	size_t len, i;
 
 	if (!use_svsignore)
 		return NULL;
 
-        *host = '\0';
-        mowgli_strlcpy(host, source->nick, BUFSIZE);
-        mowgli_strlcat(host, "!", BUFSIZE);
-        mowgli_strlcat(host, source->user, BUFSIZE);
-        mowgli_strlcat(host, "@", BUFSIZE);
-        mowgli_strlcat(host, source->host, BUFSIZE);
-                
-        MOWGLI_ITER_FOREACH(n, svs_ignore_list.head)
-        {
-                svsignore = (svsignore_t *)n->data;
-        
-                if (!match(svsignore->mask, host))
-                        return svsignore;
-        }
+	user_get_masks(source);
+	um = source->masks;
+
+	if (um->svsignore_gen == svsignore_generation)
+		return um->svsignore;
 
-        return NULL;
+	host = source->host != NULL ? source->host : "";
+
+	if (svsignore_hosts != NULL && (l = mowgli_patricia_retrieve(svsignore_hosts, host)) != NULL)
+		svsignore = svsignore_match_list(l, um->hostmask, um->hostlen);
+
+	if (svsignore == NULL && svsignore_tails != NULL)
+	{
+		len = strlen(host);
+		for (i = 1; svsignore == NULL && i <= len && i <= HOSTLEN; i++)
+		{
+			if (svsignore_taillen[i] == 0)
+				continue;
+			if ((l = mowgli_patricia_retrieve(svsignore_tails, host + len - i)) == NULL)
+				continue;
+			svsignore = svsignore_match_list(l, um->hostmask, um->hostlen);
+		}
+	}
+
+	if (svsignore == NULL)
+		svsignore = svsignore_match_list(&svsignore_wild, um->hostmask, um->hostlen);
+
+	um->svsignore_gen = svsignore_generation;
+	um->svsignore = svsignore;
+
+	return svsignore;
 }
 
 /*
@@ -122,8 +284,14 @@ void svsignore_delete(svsignore_t *svsignore)
 
 	n = mowgli_node_find(svsignore, &svs_ignore_list);
 	mowgli_node_delete(n, &svs_ignore_list);
+	mowgli_node_free(n);
+
+	svsignore_unindex(svsignore);
+	svsignore_generation++;
 
+	mask_free(&svsignore->cmask);
 	free(svsignore->mask);
+	free(svsignore->setby);
 	free(svsignore->reason);
 	free(svsignore);
 }
@@ -87,56 +87,23 @@ int sjtoken(char *message, char delimiter, char **parv)
 /* this splits apart a message with origin and command picked off already */
 int tokenize(char *message, char **parv)
 {
-	char *pos = NULL;
 	char *next;
 	unsigned int count = 0;
 
 	if (!message)
 		return -1;
 
-	/* first we fid out of there's a : in the message, save that string
-	 * somewhere so we can set it to the last param in parv
-	 * also make sure there's a space before it... if not then we're screwed
+	/* walk the message once, setting the spaces to \0 as we go;
+	 * a parameter starting with : swallows the rest of the line.
+	 * the first parameter is never treated as :delimited, the
+	 * callers strip that case off themselves.
 	 */
-	pos = message;
-	while (true)
-	{
-		if ((pos = strchr(pos, ':')))
-		{
-			pos--;
-			if (*pos != ' ')
-			{
-				pos += 2;
-				continue;
-			}
-			*pos = '\0';
-			pos++;
-			*pos = '\0';
-			pos++;
-			break;
-		}
-		else
-			break;
-	}
-
-	/* now we take the beginning of the message and find all the spaces...
-	 * set them to \0 and use 'next' to go through the string
-	 */
-
 	next = message;
 	parv[0] = message;
 	count = 1;
 
 	while (*next)
 	{
-		if (count == MAXPARC)
-		{
-			/* we've reached one less than our max limit
-			 * to handle the parameter we already ripped off
-			 */
-			slog(LG_DEBUG, "tokenize(): reached para limit");
-			return count;
-		}
 		if (*next == ' ')
 		{
 			*next = '\0';
@@ -145,10 +112,22 @@ int tokenize(char *message, char **parv)
 			while (*next == ' ')
 				next++;
 			/* if it's the end of the string, it's simply
-			 * an extra space before the :parameter. break.
+			 * an extra space at the end. break.
 			 */
 			if (*next == '\0')
 				break;
+			if (count == MAXPARC)
+			{
+				/* we've reached our limit */
+				slog(LG_DEBUG, "tokenize(): reached para limit");
+				return count;
+			}
+			if (*next == ':')
+			{
+				parv[count] = next + 1;
+				count++;
+				break;
+			}
 			parv[count] = next;
 			count++;
 		}
@@ -156,12 +135,6 @@ int tokenize(char *message, char **parv)
 			next++;
 	}
 
-	if (pos)
-	{
-		parv[count] = pos;
-		count++;
-	}
-
 	return count;
 }
 
@@ -23,11 +23,12 @@
 
 #include "atheme.h"
 
-mowgli_heap_t *user_heap;
 
 mowgli_patricia_t *userlist;
 mowgli_patricia_t *uidlist;
 
+static void user_masks_free(user_t *u);
+
 /*
  * init_users()
  *
@@ -40,18 +41,10 @@ mowgli_patricia_t *uidlist;
  *     - none
  *
  * Side Effects:
- *     - the users heap and DTree are initialized.
+ *     - the users DTrees are initialized.
  */
 void init_users(void)
 {
-	user_heap = sharedheap_get(sizeof(user_t));
-
-	if (user_heap == NULL)
-	{
-		slog(LG_DEBUG, "init_users(): block allocator failure.");
-		exit(EXIT_FAILURE);
-	}
-
 	userlist = mowgli_patricia_create(irccasecanon);
 	uidlist = mowgli_patricia_create(noopcanon);
 }
@@ -150,7 +143,7 @@ user_t *user_add(const char *nick, const char *user, const char *host,
 		}
 	}
 
-	u = mowgli_heap_alloc(user_heap);
+	u = sharedheap_alloc(&memtag_users, sizeof(user_t));
 	object_init(object(u), nick, (destructor_t) user_delete);
 
 	if (uid != NULL)
@@ -269,6 +262,8 @@ void user_delete(user_t *u, const char *comment)
 		u->myuser = NULL;
 	}
 
+	user_masks_free(u);
+
 	strshare_unref(u->uid);
 	strshare_unref(u->nick);
 	strshare_unref(u->user);
@@ -278,7 +273,7 @@ void user_delete(user_t *u, const char *comment)
 	strshare_unref(u->chost);
 	strshare_unref(u->ip);
 
-	mowgli_heap_free(user_heap, u);
+	sharedheap_free(&memtag_users, u, sizeof(user_t));
 
 	cnt.user--;
 
@@ -638,6 +633,85 @@ const char *user_get_umodestr(user_t *u)
 	return result;
 }
 
+static void user_masks_free(user_t *u)
+{
+	user_masks_t *um = u->masks;
+
+	if (um == NULL)
+		return;
+
+	strshare_unref(um->nick);
+	strshare_unref(um->user);
+	strshare_unref(um->host);
+	strshare_unref(um->chost);
+	strshare_unref(um->vhost);
+	strshare_unref(um->ip);
+	free(um->nickuser);
+	free(um);
+
+	u->masks = NULL;
+}
+
+/*
+ * user_get_masks(user_t *u)
+ *
+ * Returns the nick!user@host forms of a user, rebuilding them if the
+ * nick, username or any of the hosts changed since the last call.
+ *
+ * Inputs:
+ *     - user
+ *
+ * Outputs:
+ *     - masks, valid until the user changes or is deleted
+ *
+ * Side Effects:
+ *     - none
+ */
+const user_masks_t *user_get_masks(user_t *u)
+{
+	user_masks_t *um = u->masks;
+	size_t nulen, size;
+	char *p;
+
+	if (um != NULL && um->nick == u->nick && um->user == u->user &&
+			um->host == u->host && um->chost == u->chost &&
+			um->vhost == u->vhost && um->ip == u->ip)
+		return um;
+
+	user_masks_free(u);
+	um = u->masks = scalloc(1, sizeof(user_masks_t));
+
+	um->nick = strshare_ref(u->nick);
+	um->user = strshare_ref(u->user);
+	um->host = strshare_ref(u->host);
+	um->chost = strshare_ref(u->chost);
+	um->vhost = strshare_ref(u->vhost);
+	um->ip = strshare_ref(u->ip);
+
+	nulen = strlen(u->nick) + 1 + strlen(u->user);
+	um->hostlen = nulen + 1 + (u->host != NULL ? strlen(u->host) : 0);
+	um->chostlen = nulen + 1 + (u->chost != NULL ? strlen(u->chost) : 0);
+	um->vhostlen = nulen + 1 + (u->vhost != NULL ? strlen(u->vhost) : 0);
+	um->iplen = nulen + 1 + (u->ip != NULL ? strlen(u->ip) : 0);
+	size = nulen + um->hostlen + um->chostlen + um->vhostlen + um->iplen + 5;
+
+	/* one allocation, all five strings share the nick!user head */
+	p = um->nickuser = smalloc(size);
+	p += snprintf(p, nulen + 1, "%s!%s", u->nick, u->user) + 1;
+	um->hostmask = p;
+	p += snprintf(p, um->hostlen + 1, "%s@%s", um->nickuser, u->host != NULL ? u->host : "") + 1;
+	um->chostmask = p;
+	p += snprintf(p, um->chostlen + 1, "%s@%s", um->nickuser, u->chost != NULL ? u->chost : "") + 1;
+	um->vhostmask = p;
+	p += snprintf(p, um->vhostlen + 1, "%s@%s", um->nickuser, u->vhost != NULL ? u->vhost : "") + 1;
+	um->ipmask = p;
+	snprintf(p, um->iplen + 1, "%s@%s", um->nickuser, u->ip != NULL ? u->ip : "");
+
+	um->ipfamily = parse_ip(u->ip, um->ipaddr);
+
+	return um;
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
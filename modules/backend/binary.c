@@ -0,0 +1,881 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * A compact binary database backend.
+ *
+ * The file starts with the magic "ATHEMEDB" and a version byte, followed by
+ * records. A string record defines the next entry of the string table; a row
+ * record holds a cell count and the cells. Cells are either a reference into
+ * the string table, an inline length-prefixed string, or a varint-encoded
+ * number, so loading needs neither tokenizing nor strtoul().
+ *
+ * Words are inlined the first time they are written and moved into the
+ * string table on their second use, so unique values such as password
+ * hashes never enter it. String table entries are obtained through
+ * strshare_get(), which means setters, flags, metadata keys and the like
+ * are already shared when the handlers intern them.
+ *
+ * tools/dbconv converts between this format and OpenSEX.
+ */
+
+#include "atheme.h"
+
+#ifndef MOWGLI_OS_WIN
+# include <sys/mman.h>
+#endif
+
+DECLARE_MODULE_V1
+(
+	"backend/binary", true, _modinit, NULL,
+	PACKAGE_STRING,
+	"Atheme Development Group <http://www.atheme.org>"
+);
+
+#define BINARY_MAGIC		"ATHEMEDB"
+#define BINARY_MAGICLEN		8
+#define BINARY_VERSION		1
+
+/* record types */
+#define REC_STRING		0x01
+#define REC_ROW			0x02
+
+/* cell types */
+#define CELL_REF		0x01
+#define CELL_INLINE		0x02
+#define CELL_INT		0x03
+#define CELL_UINT		0x04
+#define CELL_STRING		0x05	/* like CELL_INLINE, but ends the row's text form */
+
+typedef struct {
+	unsigned char type;
+	const char *str;
+	size_t len;
+	uint64_t num;
+	char numbuf[24];
+} binary_cell_t;
+
+typedef struct binary_ {
+	/* Reading state */
+	const unsigned char *buf;
+	size_t len;
+	size_t pos;
+	bool mapped;
+
+	stringref *strtab;
+	unsigned int strcount;
+	unsigned int strsize;
+
+	binary_cell_t *cells;
+	unsigned int ncells;
+	unsigned int cellsize;
+	unsigned int cur;
+
+	char *scratch;
+	size_t scratchsize;
+	char *join;
+	size_t joinsize;
+
+	/* Writing state */
+	FILE *f;
+	mowgli_patricia_t *strings;
+	unsigned int nextidx;
+
+	unsigned char *row;
+	size_t rowlen;
+	size_t rowsize;
+	unsigned int rowcells;
+} binary_t;
+
+/*****************************************************************************
+ * Reading.                                                                  *
+ *****************************************************************************/
+
+static bool binary_get_varint(binary_t *bs, uint64_t *res)
+{
+	uint64_t v = 0;
+	unsigned int shift = 0;
+	unsigned char c;
+
+	do
+	{
+		if (bs->pos >= bs->len || shift > 63)
+			return false;
+
+		c = bs->buf[bs->pos++];
+		v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	*res = v;
+	return true;
+}
+
+static bool binary_read_string_record(binary_t *bs)
+{
+	uint64_t len;
+	char *str;
+
+	if (!binary_get_varint(bs, &len) || len > bs->len - bs->pos)
+		return false;
+
+	if (bs->strcount == bs->strsize)
+	{
+		bs->strsize = bs->strsize ? bs->strsize * 2 : 1024;
+		bs->strtab = srealloc(bs->strtab, bs->strsize * sizeof(stringref));
+	}
+
+	if (len >= bs->scratchsize)
+	{
+		bs->scratchsize = len + 1;
+		bs->scratch = srealloc(bs->scratch, bs->scratchsize);
+	}
+
+	str = bs->scratch;
+	memcpy(str, bs->buf + bs->pos, len);
+	str[len] = '\0';
+	bs->pos += len;
+
+	bs->strtab[bs->strcount++] = strshare_get(str);
+
+	return true;
+}
+
+static bool binary_read_row_record(binary_t *bs)
+{
+	uint64_t ncells, v;
+	binary_cell_t *cell;
+	size_t need = 0;
+	char *p;
+	unsigned int i;
+
+	if (!binary_get_varint(bs, &ncells) || ncells > bs->len - bs->pos)
+		return false;
+
+	if (ncells > bs->cellsize)
+	{
+		bs->cellsize = ncells;
+		bs->cells = srealloc(bs->cells, bs->cellsize * sizeof(binary_cell_t));
+	}
+
+	for (i = 0; i < ncells; i++)
+	{
+		cell = &bs->cells[i];
+
+		if (bs->pos >= bs->len)
+			return false;
+
+		cell->type = bs->buf[bs->pos++];
+		cell->str = NULL;
+		cell->numbuf[0] = '\0';
+
+		switch (cell->type)
+		{
+		case CELL_REF:
+			if (!binary_get_varint(bs, &v) || v >= bs->strcount)
+				return false;
+			cell->str = bs->strtab[v];
+			break;
+		case CELL_INLINE:
+		case CELL_STRING:
+			if (!binary_get_varint(bs, &v) || v > bs->len - bs->pos)
+				return false;
+			cell->str = (const char *)bs->buf + bs->pos;
+			cell->len = v;
+			bs->pos += v;
+			need += v + 1;
+			break;
+		case CELL_INT:
+		case CELL_UINT:
+			if (!binary_get_varint(bs, &cell->num))
+				return false;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	/* inline strings are not terminated in the file; copy them out */
+	if (need > bs->scratchsize)
+	{
+		bs->scratchsize = need;
+		bs->scratch = srealloc(bs->scratch, bs->scratchsize);
+	}
+
+	for (i = 0, p = bs->scratch; i < ncells; i++)
+	{
+		cell = &bs->cells[i];
+		if (cell->type != CELL_INLINE && cell->type != CELL_STRING)
+			continue;
+
+		memcpy(p, cell->str, cell->len);
+		p[cell->len] = '\0';
+		cell->str = p;
+		p += cell->len + 1;
+	}
+
+	bs->ncells = ncells;
+	bs->cur = 0;
+
+	return true;
+}
+
+static bool binary_read_next_row(database_handle_t *db)
+{
+	binary_t *bs = (binary_t *)db->priv;
+	unsigned char type;
+
+	while (bs->pos < bs->len)
+	{
+		type = bs->buf[bs->pos];
+
+		/* files may be concatenated (journals are), so a header can
+		 * appear at any record boundary.
+		 */
+		if (type == BINARY_MAGIC[0])
+		{
+			if (bs->len - bs->pos < BINARY_MAGICLEN + 1 ||
+					memcmp(bs->buf + bs->pos, BINARY_MAGIC, BINARY_MAGICLEN) ||
+					bs->buf[bs->pos + BINARY_MAGICLEN] != BINARY_VERSION)
+				break;
+
+			bs->pos += BINARY_MAGICLEN + 1;
+			continue;
+		}
+
+		bs->pos++;
+
+		if (type == REC_STRING)
+		{
+			if (!binary_read_string_record(bs))
+				break;
+			continue;
+		}
+
+		if (type != REC_ROW || !binary_read_row_record(bs))
+			break;
+
+		db->line++;
+		db->token = 0;
+		return true;
+	}
+
+	if (bs->pos < bs->len)
+	{
+		slog(LG_ERROR, "binary: %s: bad record near offset %zu, ignoring the rest of the file", db->file, bs->pos);
+		db->error = true;
+	}
+
+	return false;
+}
+
+static const char *binary_read_word(database_handle_t *db)
+{
+	binary_t *bs = (binary_t *)db->priv;
+	binary_cell_t *cell;
+
+	if (bs->cur >= bs->ncells)
+		return NULL;
+
+	cell = &bs->cells[bs->cur++];
+	db->token++;
+
+	switch (cell->type)
+	{
+	case CELL_INT:
+		snprintf(cell->numbuf, sizeof cell->numbuf, "%lld", (long long)(int64_t)cell->num);
+		return cell->numbuf;
+	case CELL_UINT:
+		snprintf(cell->numbuf, sizeof cell->numbuf, "%llu", (unsigned long long)cell->num);
+		return cell->numbuf;
+	default:
+		return cell->str;
+	}
+}
+
+static const char *binary_read_str(database_handle_t *db)
+{
+	binary_t *bs = (binary_t *)db->priv;
+	const char *s;
+	size_t len, need = 0;
+	unsigned int i, first;
+
+	if (bs->cur + 1 >= bs->ncells)
+		return binary_read_word(db);
+
+	/* rows converted from OpenSEX may split a string into words;
+	 * join them back the way grammar version 1 would have read them.
+	 */
+	for (i = bs->cur; i < bs->ncells; i++)
+	{
+		if (bs->cells[i].type == CELL_INLINE || bs->cells[i].type == CELL_STRING)
+			need += bs->cells[i].len + 1;
+		else if (bs->cells[i].type == CELL_REF)
+			need += strlen(bs->cells[i].str) + 1;
+		else
+			need += sizeof bs->cells[i].numbuf;
+	}
+
+	if (need > bs->joinsize)
+	{
+		bs->joinsize = need;
+		bs->join = srealloc(bs->join, bs->joinsize);
+	}
+
+	len = 0;
+	first = bs->cur;
+	while ((s = binary_read_word(db)) != NULL)
+	{
+		if (bs->cur - 1 > first)
+			bs->join[len++] = ' ';
+		mowgli_strlcpy(bs->join + len, s, bs->joinsize - len);
+		len += strlen(s);
+	}
+
+	return bs->join;
+}
+
+static bool binary_read_uint64(database_handle_t *db, uint64_t *res, bool *negative)
+{
+	binary_t *bs = (binary_t *)db->priv;
+	binary_cell_t *cell;
+	const char *s;
+	char *rp;
+
+	if (bs->cur >= bs->ncells)
+		return false;
+
+	cell = &bs->cells[bs->cur];
+	*negative = false;
+
+	switch (cell->type)
+	{
+	case CELL_INT:
+		bs->cur++;
+		db->token++;
+		*negative = (int64_t)cell->num < 0;
+		*res = cell->num;
+		return true;
+	case CELL_UINT:
+		bs->cur++;
+		db->token++;
+		*res = cell->num;
+		return true;
+	default:
+		s = binary_read_word(db);
+		if (*s == '-')
+		{
+			*negative = true;
+			*res = (uint64_t)strtoll(s, &rp, 0);
+		}
+		else
+			*res = strtoull(s, &rp, 0);
+		return *s && !*rp;
+	}
+}
+
+static bool binary_read_int(database_handle_t *db, int *res)
+{
+	uint64_t v;
+	bool negative;
+
+	if (!binary_read_uint64(db, &v, &negative))
+		return false;
+
+	*res = (int)(int64_t)v;
+	return negative ? (int64_t)v >= INT_MIN : v <= INT_MAX;
+}
+
+static bool binary_read_uint(database_handle_t *db, unsigned int *res)
+{
+	uint64_t v;
+	bool negative;
+
+	if (!binary_read_uint64(db, &v, &negative))
+		return false;
+
+	*res = (unsigned int)v;
+	return !negative && v <= UINT_MAX;
+}
+
+static bool binary_read_time(database_handle_t *db, time_t *res)
+{
+	uint64_t v;
+	bool negative;
+
+	if (!binary_read_uint64(db, &v, &negative))
+		return false;
+
+	*res = (time_t)v;
+	return !negative;
+}
+
+/*****************************************************************************
+ * Writing.                                                                  *
+ *****************************************************************************/
+
+static void binary_put(binary_t *bs, const void *data, size_t len)
+{
+	if (bs->rowlen + len > bs->rowsize)
+	{
+		while (bs->rowlen + len > bs->rowsize)
+			bs->rowsize = bs->rowsize ? bs->rowsize * 2 : 512;
+		bs->row = srealloc(bs->row, bs->rowsize);
+	}
+
+	memcpy(bs->row + bs->rowlen, data, len);
+	bs->rowlen += len;
+}
+
+static size_t binary_encode_varint(unsigned char *buf, uint64_t v)
+{
+	size_t len = 0;
+
+	while (v >= 0x80)
+	{
+		buf[len++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	buf[len++] = v;
+
+	return len;
+}
+
+static void binary_put_varint(binary_t *bs, uint64_t v)
+{
+	unsigned char buf[10];
+
+	binary_put(bs, buf, binary_encode_varint(buf, v));
+}
+
+static void binary_put_cell(binary_t *bs, unsigned char type, uint64_t v)
+{
+	binary_put(bs, &type, 1);
+	binary_put_varint(bs, v);
+	bs->rowcells++;
+}
+
+static bool binary_start_row(database_handle_t *db, const char *type)
+{
+	binary_t *bs;
+
+	return_val_if_fail(db != NULL, false);
+	return_val_if_fail(type != NULL, false);
+	bs = (binary_t *)db->priv;
+
+	bs->rowlen = 0;
+	bs->rowcells = 0;
+
+	return db_write_word(db, type);
+}
+
+static bool binary_write_inline(binary_t *bs, unsigned char type, const char *str)
+{
+	size_t len = strlen(str);
+
+	binary_put_cell(bs, type, len);
+	binary_put(bs, str, len);
+
+	return true;
+}
+
+/* The patricia holds 1 for a word seen once, or its string table index + 2. */
+static bool binary_write_word(database_handle_t *db, const char *word)
+{
+	binary_t *bs;
+	uintptr_t v;
+	unsigned char buf[11];
+	size_t len;
+
+	return_val_if_fail(db != NULL, false);
+	bs = (binary_t *)db->priv;
+
+	if (word == NULL)
+		word = "*";
+
+	/* appended files cannot refer to an earlier string table */
+	if (bs->strings == NULL)
+		return binary_write_inline(bs, CELL_INLINE, word);
+
+	v = (uintptr_t)mowgli_patricia_retrieve(bs->strings, word);
+	if (v == 0)
+	{
+		mowgli_patricia_add(bs->strings, word, (void *)(uintptr_t)1);
+		return binary_write_inline(bs, CELL_INLINE, word);
+	}
+
+	if (v == 1)
+	{
+		/* second use: the row is still buffered, so the definition
+		 * reaches the file before it.
+		 */
+		v = bs->nextidx++ + 2;
+		mowgli_patricia_delete(bs->strings, word);
+		mowgli_patricia_add(bs->strings, word, (void *)v);
+
+		len = strlen(word);
+		buf[0] = REC_STRING;
+		fwrite(buf, 1, 1 + binary_encode_varint(buf + 1, len), bs->f);
+		fwrite(word, 1, len, bs->f);
+	}
+
+	binary_put_cell(bs, CELL_REF, v - 2);
+
+	return true;
+}
+
+static bool binary_write_str(database_handle_t *db, const char *str)
+{
+	return_val_if_fail(db != NULL, false);
+
+	return binary_write_inline((binary_t *)db->priv, CELL_STRING, str != NULL ? str : "*");
+}
+
+static bool binary_write_int(database_handle_t *db, int num)
+{
+	return_val_if_fail(db != NULL, false);
+
+	binary_put_cell((binary_t *)db->priv, CELL_INT, (uint64_t)(int64_t)num);
+	return true;
+}
+
+static bool binary_write_uint(database_handle_t *db, unsigned int num)
+{
+	return_val_if_fail(db != NULL, false);
+
+	binary_put_cell((binary_t *)db->priv, CELL_UINT, num);
+	return true;
+}
+
+static bool binary_write_time(database_handle_t *db, time_t tm)
+{
+	return_val_if_fail(db != NULL, false);
+
+	binary_put_cell((binary_t *)db->priv, CELL_UINT, (uint64_t)tm);
+	return true;
+}
+
+static bool binary_commit_row(database_handle_t *db)
+{
+	binary_t *bs;
+	unsigned char buf[11];
+
+	return_val_if_fail(db != NULL, false);
+	bs = (binary_t *)db->priv;
+
+	buf[0] = REC_ROW;
+	fwrite(buf, 1, 1 + binary_encode_varint(buf + 1, bs->rowcells), bs->f);
+	fwrite(bs->row, 1, bs->rowlen, bs->f);
+
+	bs->rowlen = 0;
+	bs->rowcells = 0;
+
+	return true;
+}
+
+static bool binary_flush(database_handle_t *db)
+{
+	binary_t *bs;
+
+	return_val_if_fail(db != NULL, false);
+	bs = (binary_t *)db->priv;
+
+	return fflush(bs->f) == 0;
+}
+
+static database_vtable_t binary_vt = {
+	.name = "binary",
+
+	.read_next_row = binary_read_next_row,
+
+	.read_word = binary_read_word,
+	.read_str = binary_read_str,
+	.read_int = binary_read_int,
+	.read_uint = binary_read_uint,
+	.read_time = binary_read_time,
+
+	.start_row = binary_start_row,
+	.write_word = binary_write_word,
+	.write_str = binary_write_str,
+	.write_int = binary_write_int,
+	.write_uint = binary_write_uint,
+	.write_time = binary_write_time,
+	.commit_row = binary_commit_row,
+	.flush = binary_flush
+};
+
+/*****************************************************************************
+ * Opening, parsing and closing.                                             *
+ *****************************************************************************/
+
+static void binary_db_parse(database_handle_t *db)
+{
+	const char *cmd;
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval loadtime;
+	int ms;
+
+	s_time(&loadtime);
+#endif
+
+	while (db_read_next_row(db))
+	{
+		cmd = db_read_word(db);
+		if (!cmd || !*cmd)
+			continue;
+		db_process(db, cmd);
+	}
+
+#ifdef HAVE_GETTIMEOFDAY
+	e_time(loadtime, &loadtime);
+	ms = tv2ms(&loadtime);
+	slog(LG_INFO, "binary: loaded %u rows in %d ms (%u rows/s)", db->line, ms,
+			ms > 0 ? (unsigned int) ((unsigned long long) db->line * 1000 / ms) : db->line);
+#endif
+}
+
+static database_handle_t *binary_db_open_read(const char *filename)
+{
+	database_handle_t *db;
+	binary_t *bs;
+	FILE *f;
+	int errno1;
+	char path[BUFSIZE];
+	struct stat sb;
+	unsigned char *buf = NULL;
+	bool mapped = false;
+#ifndef MOWGLI_OS_WIN
+	void *map;
+#endif
+
+	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+	f = fopen(path, "rb");
+	if (!f)
+	{
+		errno1 = errno;
+
+		/* ENOENT can happen if the database does not exist yet. */
+		if (errno == ENOENT)
+		{
+			slog(LG_ERROR, "db-open-read: database '%s' does not yet exist; a new one will be created.", path);
+			return NULL;
+		}
+
+		slog(LG_ERROR, "db-open-read: cannot open '%s' for reading: %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-open-read: cannot open '%s' for reading: %s"), path, strerror(errno1));
+		return NULL;
+	}
+
+	if (fstat(fileno(f), &sb) < 0)
+	{
+		errno1 = errno;
+		fclose(f);
+		slog(LG_ERROR, "db-open-read: cannot stat '%s': %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-open-read: cannot stat '%s': %s"), path, strerror(errno1));
+		return NULL;
+	}
+
+	/* like a missing one; opensex starts fresh on an empty file too */
+	if (sb.st_size == 0)
+	{
+		fclose(f);
+		slog(LG_ERROR, "db-open-read: database '%s' is empty; a new one will be created.", path);
+		return NULL;
+	}
+
+#ifndef MOWGLI_OS_WIN
+	map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	if (map != MAP_FAILED)
+	{
+#ifdef MADV_SEQUENTIAL
+		madvise(map, sb.st_size, MADV_SEQUENTIAL);
+#endif
+		buf = map;
+		mapped = true;
+	}
+	else
+#endif
+	{
+		buf = smalloc(sb.st_size);
+		if (fread(buf, 1, sb.st_size, f) != (size_t)sb.st_size)
+		{
+			fclose(f);
+			free(buf);
+			slog(LG_ERROR, "db-open-read: cannot read '%s'", path);
+			wallops(_("\2DATABASE ERROR\2: db-open-read: cannot read '%s'"), path);
+			return NULL;
+		}
+	}
+
+	fclose(f);
+
+	if (sb.st_size < BINARY_MAGICLEN + 1 || memcmp(buf, BINARY_MAGIC, BINARY_MAGICLEN) ||
+			buf[BINARY_MAGICLEN] != BINARY_VERSION)
+	{
+#ifndef MOWGLI_OS_WIN
+		if (mapped)
+			munmap(map, sb.st_size);
+		else
+#endif
+			free(buf);
+
+		slog(LG_ERROR, "db-open-read: '%s' is not a version %d binary database; convert it with tools/dbconv", path, BINARY_VERSION);
+		wallops(_("\2DATABASE ERROR\2: db-open-read: '%s' is not a version %d binary database"), path, BINARY_VERSION);
+		return NULL;
+	}
+
+	bs = scalloc(sizeof(binary_t), 1);
+	bs->buf = buf;
+	bs->len = sb.st_size;
+	bs->pos = 0;
+	bs->mapped = mapped;
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = bs;
+	db->vt = &binary_vt;
+	db->txn = DB_READ;
+	db->file = sstrdup(path);
+	db->line = 0;
+	db->token = 0;
+
+	return db;
+}
+
+static database_handle_t *binary_db_open_write(const char *filename, database_transaction_t txn)
+{
+	database_handle_t *db;
+	binary_t *bs;
+	FILE *f;
+	int errno1;
+	char bpath[BUFSIZE], path[BUFSIZE];
+	unsigned char version = BINARY_VERSION;
+
+	snprintf(bpath, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
+
+	mowgli_strlcpy(path, bpath, sizeof path);
+	if (txn == DB_WRITE)
+		mowgli_strlcat(path, ".new", sizeof path);
+
+	f = fopen(path, txn == DB_WRITE ? "wb" : "ab");
+	if (!f)
+	{
+		errno1 = errno;
+		slog(LG_ERROR, "db-open-write: cannot open '%s' for writing: %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-open-write: cannot open '%s' for writing: %s"), path, strerror(errno1));
+		return NULL;
+	}
+
+	bs = scalloc(sizeof(binary_t), 1);
+	bs->f = f;
+	if (txn == DB_WRITE)
+		bs->strings = mowgli_patricia_create(noopcanon);
+
+	fseek(f, 0, SEEK_END);
+	if (ftell(f) == 0)
+	{
+		fwrite(BINARY_MAGIC, 1, BINARY_MAGICLEN, f);
+		fwrite(&version, 1, 1, f);
+	}
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = bs;
+	db->vt = &binary_vt;
+	db->txn = txn;
+	db->file = sstrdup(bpath);
+	db->line = 0;
+	db->token = 0;
+
+	return db;
+}
+
+static database_handle_t *binary_db_open(const char *filename, database_transaction_t txn)
+{
+	if (txn == DB_READ)
+		return binary_db_open_read(filename);
+	return binary_db_open_write(filename, txn);
+}
+
+/* returns false if a new database could not be put in place */
+static bool binary_db_close(database_handle_t *db)
+{
+	binary_t *bs;
+	int errno1;
+	unsigned int i;
+	char oldpath[BUFSIZE], newpath[BUFSIZE];
+	bool ret = true;
+
+	return_val_if_fail(db != NULL, false);
+	bs = db->priv;
+
+	if (db->txn == DB_READ)
+	{
+#ifndef MOWGLI_OS_WIN
+		if (bs->mapped)
+			munmap((void *)bs->buf, bs->len);
+		else
+#endif
+			free((void *)bs->buf);
+
+		for (i = 0; i < bs->strcount; i++)
+			strshare_unref(bs->strtab[i]);
+
+		free(bs->strtab);
+		free(bs->cells);
+		free(bs->scratch);
+		free(bs->join);
+	}
+	else
+	{
+		fclose(bs->f);
+
+		if (bs->strings != NULL)
+			mowgli_patricia_destroy(bs->strings, NULL, NULL);
+		free(bs->row);
+	}
+
+	if (db->txn == DB_WRITE)
+	{
+		mowgli_strlcpy(oldpath, db->file, sizeof oldpath);
+		mowgli_strlcat(oldpath, ".new", sizeof oldpath);
+
+		mowgli_strlcpy(newpath, db->file, sizeof newpath);
+
+		/* now, replace the old database with the new one, using an atomic rename */
+		if (srename(oldpath, newpath) < 0)
+		{
+			errno1 = errno;
+			slog(LG_ERROR, "db_save(): cannot rename services.db.new to services.db: %s", strerror(errno1));
+			wallops(_("\2DATABASE ERROR\2: db_save(): cannot rename services.db.new to services.db: %s"), strerror(errno1));
+			ret = false;
+		}
+	}
+
+	free(bs);
+	free(db->file);
+	free(db);
+
+	return ret;
+}
+
+static database_module_t binary_mod = {
+	.db_open = binary_db_open,
+	.db_close = binary_db_close,
+	.db_parse = binary_db_parse,
+};
+
+void _modinit(module_t *m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "backend/corestorage");
+
+	m->mflags = MODTYPE_CORE;
+
+	db_mod = &binary_mod;
+
+	backend_loaded = true;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
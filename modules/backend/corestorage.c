@@ -18,6 +18,10 @@
 
 #include "atheme.h"
 
+#ifndef MOWGLI_OS_WIN
+# include <sys/wait.h>
+#endif
+
 DECLARE_MODULE_V1
 (
 	"backend/corestorage", true, _modinit, NULL,
@@ -836,8 +840,7 @@ static void corestorage_h_kl(database_handle_t *db, const char *type)
 	strip(buf);
 
 	k = kline_add_with_id(user, host, buf, duration, setby, id ? id : ++me.kline_id);
-	k->settime = settime;
-	k->expires = k->settime + k->duration;
+	kline_settime(k, settime);
 }
 
 static void corestorage_h_xid(database_handle_t *db, const char *type)
@@ -925,16 +928,138 @@ static void corestorage_db_load(const char *filename)
 	db_close(db);
 }
 
-static void corestorage_db_write(void *filename)
+static bool corestorage_db_write_file(const char *filename)
 {
 	database_handle_t *db;
 
 	db = db_open(filename, DB_WRITE);
+	if (db == NULL)
+		return false;
 
 	corestorage_db_save(db);
 	hook_call_db_write(db);
 
-	db_close(db);
+	return db_close(db);
+}
+
+#ifdef HAVE_FORK
+/* pid of the child doing a background save, if any */
+static pid_t save_pid = 0;
+#ifdef HAVE_GETTIMEOFDAY
+static struct timeval save_start;
+#endif
+
+static void corestorage_db_write_done(pid_t pid, int status, void *data)
+{
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval savetime;
+#endif
+
+	save_pid = 0;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		slog(LG_ERROR, "db_save(): background save (pid %d) failed with status %d", (int)pid, status);
+		wallops(_("\2DATABASE ERROR\2: background save failed, see the log for details"));
+		return;
+	}
+
+	/* the child renamed the file into place; tell the rest of services */
+	hook_call_db_saved();
+
+#ifdef HAVE_GETTIMEOFDAY
+	e_time(save_start, &savetime);
+	slog(LG_DEBUG, "db_save(): background save finished in %d ms", tv2ms(&savetime));
+#endif
+}
+
+/* waits for a running background save; a foreground save must not
+ * write the same file at the same time
+ */
+static void corestorage_db_write_wait(void)
+{
+	int status;
+
+	if (save_pid == 0)
+		return;
+
+	slog(LG_DEBUG, "db_save(): waiting for background save (pid %d)", (int)save_pid);
+
+	if (waitpid(save_pid, &status, 0) == save_pid)
+	{
+		childproc_delete_all(corestorage_db_write_done);
+		corestorage_db_write_done(save_pid, status, NULL);
+	}
+	else
+	{
+		childproc_delete_all(corestorage_db_write_done);
+		save_pid = 0;
+	}
+}
+#endif
+
+static void corestorage_db_write(void *filename)
+{
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval savetime;
+
+	s_time(&savetime);
+#endif
+
+#ifdef HAVE_FORK
+	corestorage_db_write_wait();
+#endif
+
+	if (!corestorage_db_write_file(filename))
+		return;
+
+	hook_call_db_saved();
+
+#ifdef HAVE_GETTIMEOFDAY
+	e_time(savetime, &savetime);
+	slog(LG_DEBUG, "db_save(): saved in %d ms", tv2ms(&savetime));
+#endif
+}
+
+/* periodic save: fork, and let the child write out its copy of
+ * everything while we continue serving
+ */
+static void corestorage_db_write_background(void *filename)
+{
+#ifdef HAVE_FORK
+	pid_t pid;
+
+	if (!config_options.db_save_fork)
+	{
+		corestorage_db_write(filename);
+		return;
+	}
+
+	if (save_pid != 0)
+	{
+		slog(LG_INFO, "db_save(): previous background save (pid %d) still running, skipping", (int)save_pid);
+		return;
+	}
+
+#ifdef HAVE_GETTIMEOFDAY
+	s_time(&save_start);
+#endif
+
+	switch (pid = fork())
+	{
+		case -1:
+			slog(LG_ERROR, "db_save(): fork failed (%s), saving in the foreground", strerror(errno));
+			corestorage_db_write(filename);
+			return;
+		case 0:
+			_exit(corestorage_db_write_file(filename) ? 0 : 1);
+	}
+
+	save_pid = pid;
+	childproc_add(pid, "db_save", corestorage_db_write_done, NULL);
+#else
+	corestorage_db_write(filename);
+#endif
 }
 
 void _modinit(module_t *m)
@@ -943,6 +1068,7 @@ void _modinit(module_t *m)
 
 	db_load = &corestorage_db_load;
 	db_save = &corestorage_db_write;
+	db_save_background = &corestorage_db_write_background;
 
 	db_register_type_handler("DBV", corestorage_h_dbv);
 	db_register_type_handler("MDEP", corestorage_ignore_row);
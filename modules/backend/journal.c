@@ -0,0 +1,881 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Append-only journal of account and channel registration changes.
+ *
+ * Between two full database writes, every change to an account or channel
+ * that is announced through a hook is written to services.db.journal as a
+ * complete record of the changed object (accounts are keyed by their UID,
+ * channels by name). On startup, the journal is replayed on top of the
+ * snapshot, so a crash loses at most the changes made since the last
+ * flush of the journal rather than those since the last database write.
+ *
+ * Every database write starts a new journal generation: the current journal
+ * is closed and renamed to services.db.journal.<generation>, and the write
+ * records the new generation in a JGEN row. On startup, only the closed
+ * journals of that generation or later are replayed, followed by the
+ * current one; older ones are covered by the snapshot and are removed. A
+ * closed journal is also removed once a later write has been completed.
+ * Records that are replayed on top of a snapshot that already contains them
+ * do no harm, since every record carries the full state of its object.
+ */
+
+#include "atheme.h"
+#include "conf.h"
+
+DECLARE_MODULE_V1
+(
+	"backend/journal", true, _modinit, NULL,
+	PACKAGE_STRING,
+	"Atheme Development Group <http://www.atheme.org>"
+);
+
+static database_handle_t *journal;
+static char journal_name[BUFSIZE];
+
+/* the database given to db_load(), for the writes we start ourselves */
+static char *journal_db_name;
+
+/* objects changed since the last flush, written out from a timer */
+static mowgli_patricia_t *journal_dirty_users;
+static mowgli_patricia_t *journal_dirty_chans;
+static bool journal_flush_pending;
+
+/* generation of the current journal; journals of generations from
+ * journal_done on have not been covered by a confirmed database write yet
+ */
+static unsigned int journal_gen, journal_done;
+
+/* generation recorded in the database that was loaded */
+static unsigned int journal_snapshot_gen;
+
+/* the process that started the write; a forked writer must not touch the
+ * journal (services may also have daemonized since the module was loaded)
+ */
+static pid_t journal_pid;
+
+/* size in kilobytes at which a database write is forced; 0 disables */
+static unsigned int journal_size;
+
+static void (*journal_next_load)(const char *arg);
+static void (*journal_next_save)(void *arg);
+static void (*journal_next_save_background)(void *arg);
+
+static void journal_flush(void *arg);
+
+static void journal_path(char *buf, size_t size, const char *name)
+{
+	snprintf(buf, size, "%s/%s", datadir, name);
+}
+
+/* name of the closed journal of a generation, relative to datadir */
+static void journal_gen_name(char *buf, size_t size, unsigned int gen)
+{
+	snprintf(buf, size, "%s.%u", journal_name, gen);
+}
+
+/*****************************************************************************
+ * Writing.                                                                  *
+ *****************************************************************************/
+
+static void journal_mark_user(myuser_t *mu)
+{
+	if (journal == NULL || mu == NULL)
+		return;
+
+	mowgli_patricia_add(journal_dirty_users, entity(mu)->id, journal_dirty_users);
+
+	if (!journal_flush_pending)
+	{
+		mowgli_timer_add_once(base_eventloop, "journal_flush", journal_flush, NULL, 0);
+		journal_flush_pending = true;
+	}
+}
+
+static void journal_mark_chan(mychan_t *mc)
+{
+	if (journal == NULL || mc == NULL)
+		return;
+
+	mowgli_patricia_add(journal_dirty_chans, mc->name, journal_dirty_chans);
+
+	if (!journal_flush_pending)
+	{
+		mowgli_timer_add_once(base_eventloop, "journal_flush", journal_flush, NULL, 0);
+		journal_flush_pending = true;
+	}
+}
+
+static void journal_write_metadata(const char *type, const char *name, object_t *obj)
+{
+	mowgli_patricia_iteration_state_t state;
+	metadata_t *md;
+
+	if (obj->metadata == NULL)
+		return;
+
+	MOWGLI_PATRICIA_FOREACH(md, &state, obj->metadata)
+	{
+		db_start_row(journal, type);
+		db_write_word(journal, name);
+		db_write_word(journal, md->name);
+		db_write_str(journal, md->value);
+		db_commit_row(journal);
+	}
+}
+
+static int journal_write_user_delete(const char *key, void *data, void *privdata)
+{
+	if (myuser_find_uid(key) != NULL)
+		return 0;
+
+	/* JMUD <uid> */
+	db_start_row(journal, "JMUD");
+	db_write_word(journal, key);
+	db_commit_row(journal);
+
+	return 0;
+}
+
+static int journal_write_user(const char *key, void *data, void *privdata)
+{
+	myuser_t *mu;
+	mowgli_node_t *n;
+	char *flags;
+
+	if ((mu = myuser_find_uid(key)) == NULL)
+		return 0;
+
+	flags = gflags_tostr(mu_flags, MOWGLI_LIST_LENGTH(&mu->logins) ? mu->flags & ~MU_NOBURSTLOGIN : mu->flags);
+
+	/* JMU <uid> <name> <pass> <email> <registered> <lastlogin> <flags> <language> */
+	db_start_row(journal, "JMU");
+	db_write_word(journal, entity(mu)->id);
+	db_write_word(journal, entity(mu)->name);
+	db_write_word(journal, mu->pass);
+	db_write_word(journal, mu->email);
+	db_write_time(journal, mu->registered);
+	db_write_time(journal, mu->lastlogin);
+	db_write_word(journal, flags);
+	db_write_word(journal, language_get_name(mu->language));
+	db_commit_row(journal);
+
+	journal_write_metadata("JMDU", entity(mu)->id, object(mu));
+
+	MOWGLI_ITER_FOREACH(n, mu->nicks.head)
+	{
+		mynick_t *mn = n->data;
+
+		db_start_row(journal, "JMN");
+		db_write_word(journal, entity(mu)->id);
+		db_write_word(journal, mn->nick);
+		db_write_time(journal, mn->registered);
+		db_write_time(journal, mn->lastseen);
+		db_commit_row(journal);
+	}
+
+	MOWGLI_ITER_FOREACH(n, mu->access_list.head)
+	{
+		db_start_row(journal, "JAC");
+		db_write_word(journal, entity(mu)->id);
+		db_write_word(journal, (char *)n->data);
+		db_commit_row(journal);
+	}
+
+	MOWGLI_ITER_FOREACH(n, mu->cert_fingerprints.head)
+	{
+		mycertfp_t *mcfp = n->data;
+
+		db_start_row(journal, "JCFP");
+		db_write_word(journal, entity(mu)->id);
+		db_write_word(journal, mcfp->certfp);
+		db_commit_row(journal);
+	}
+
+	return 0;
+}
+
+static int journal_write_chan(const char *key, void *data, void *privdata)
+{
+	mychan_t *mc;
+	chanacs_t *ca;
+	mowgli_node_t *n;
+
+	mc = mychan_find(key);
+	if (mc == NULL)
+	{
+		/* JMCD <name> */
+		db_start_row(journal, "JMCD");
+		db_write_word(journal, key);
+		db_commit_row(journal);
+		return 0;
+	}
+
+	/* JMC <name> <registered> <used> <flags> <mlock_on> <mlock_off> <mlock_limit> [mlock_key] */
+	db_start_row(journal, "JMC");
+	db_write_word(journal, mc->name);
+	db_write_time(journal, mc->registered);
+	db_write_time(journal, mc->used);
+	db_write_word(journal, gflags_tostr(mc_flags, mc->flags));
+	db_write_uint(journal, mc->mlock_on);
+	db_write_uint(journal, mc->mlock_off);
+	db_write_uint(journal, mc->mlock_limit);
+	db_write_word(journal, mc->mlock_key ? mc->mlock_key : "");
+	db_commit_row(journal);
+
+	MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
+	{
+		ca = n->data;
+
+		/* JCA <channel> <target> <flags> <tmodified> <setter> */
+		db_start_row(journal, "JCA");
+		db_write_word(journal, mc->name);
+		db_write_word(journal, ca->entity ? ca->entity->name : ca->host);
+		db_write_word(journal, bitmask_to_flags(ca->level));
+		db_write_time(journal, ca->tmodified);
+		db_write_word(journal, ca->setter ? ca->setter : "*");
+		db_commit_row(journal);
+	}
+
+	journal_write_metadata("JMDC", mc->name, object(mc));
+
+	return 0;
+}
+
+static void journal_maybe_save(void)
+{
+	struct stat sb;
+	char path[BUFSIZE];
+
+	/* the journal is rotated when a write starts, so this does not
+	 * fire again while that write is running
+	 */
+	if (journal_size == 0 || readonly)
+		return;
+
+	journal_path(path, sizeof path, journal_name);
+	if (stat(path, &sb) < 0 || sb.st_size / 1024 < journal_size)
+		return;
+
+	slog(LG_DEBUG, "journal_maybe_save(): journal is %ld KB, writing database", (long)(sb.st_size / 1024));
+
+	if (db_save_background != NULL)
+		db_save_background(journal_db_name);
+	else
+		db_save(journal_db_name);
+}
+
+/* arg is NULL when called from the timer; journal_rotate() passes the old
+ * journal handle so that flushing cannot start another database write.
+ */
+static void journal_flush(void *arg)
+{
+	journal_flush_pending = false;
+
+	if (journal == NULL)
+		return;
+
+	/* accounts first: chanacs refer to them by name. deletions go before
+	 * the rest, as JMU falls back to looking an account up by name: an
+	 * account dropped and registered again under a new uid would
+	 * otherwise be updated in place and then deleted.
+	 */
+	if (mowgli_patricia_size(journal_dirty_users) > 0)
+	{
+		mowgli_patricia_foreach(journal_dirty_users, journal_write_user_delete, NULL);
+		mowgli_patricia_foreach(journal_dirty_users, journal_write_user, NULL);
+		mowgli_patricia_destroy(journal_dirty_users, NULL, NULL);
+		journal_dirty_users = mowgli_patricia_create(noopcanon);
+	}
+
+	if (mowgli_patricia_size(journal_dirty_chans) > 0)
+	{
+		mowgli_patricia_foreach(journal_dirty_chans, journal_write_chan, NULL);
+		mowgli_patricia_destroy(journal_dirty_chans, NULL, NULL);
+		journal_dirty_chans = mowgli_patricia_create(irccasecanon);
+	}
+
+	/* one write to disk per flush, not per row */
+	if (!db_flush(journal))
+		slog(LG_ERROR, "journal_flush(): cannot write to %s: %s", journal_name, strerror(errno));
+
+	if (arg == NULL)
+		journal_maybe_save();
+}
+
+/*****************************************************************************
+ * Rotation around database writes.                                          *
+ *****************************************************************************/
+
+/* closes the current journal as the given generation and opens a new one */
+static void journal_close_gen(unsigned int gen)
+{
+	char path[BUFSIZE], name[BUFSIZE], genpath[BUFSIZE];
+
+	if (journal != NULL)
+	{
+		db_close(journal);
+		journal = NULL;
+	}
+
+	journal_gen_name(name, sizeof name, gen);
+	journal_path(path, sizeof path, journal_name);
+	journal_path(genpath, sizeof genpath, name);
+
+	if (srename(path, genpath) < 0 && errno != ENOENT)
+		slog(LG_ERROR, "journal_close_gen(): cannot rename %s to %s: %s", path, genpath, strerror(errno));
+
+	journal = db_open(journal_name, DB_APPEND);
+}
+
+/* removes closed journals older than the given generation */
+static void journal_remove_before(unsigned int gen)
+{
+	char name[BUFSIZE], path[BUFSIZE];
+
+	/* they are removed oldest first, so the first gap ends the search */
+	while (gen-- > 0)
+	{
+		journal_gen_name(name, sizeof name, gen);
+		journal_path(path, sizeof path, name);
+
+		if (unlink(path) < 0)
+		{
+			if (errno != ENOENT)
+				slog(LG_ERROR, "journal_remove_before(): cannot remove %s: %s", path, strerror(errno));
+			break;
+		}
+	}
+}
+
+/* every write gets a generation of its own, even if an earlier write has
+ * not finished yet: the journal being closed only holds changes that this
+ * write includes.
+ */
+static void journal_rotate(void)
+{
+	if (journal == NULL)
+		return;
+
+	/* anything still queued belongs in the journal being retired */
+	journal_flush(journal);
+
+	journal_close_gen(journal_gen++);
+	journal_pid = getpid();
+}
+
+static void journal_db_save(void *arg)
+{
+	journal_rotate();
+	journal_next_save(arg);
+}
+
+static void journal_db_save_background(void *arg)
+{
+	journal_rotate();
+	journal_next_save_background(arg);
+}
+
+/* JGEN <generation>, written into every database */
+static void journal_db_write(database_handle_t *db)
+{
+	db_start_row(db, "JGEN");
+	db_write_uint(db, journal_gen);
+	db_commit_row(db);
+}
+
+static void journal_h_gen(database_handle_t *db, const char *type)
+{
+	journal_snapshot_gen = db_sread_uint(db);
+}
+
+/* db_saved is only signalled in the parent, once the new database has been
+ * renamed into place. writes finish in the order they were started, but
+ * one that failed or was skipped is not signalled at all, so this assumes
+ * the oldest one has finished; at worst a closed journal is kept longer
+ * than needed, and startup skips it anyway.
+ */
+static void journal_db_saved(void *unused)
+{
+	if (journal_done >= journal_gen || getpid() != journal_pid)
+		return;
+
+	journal_remove_before(++journal_done);
+}
+
+/*****************************************************************************
+ * Replay.                                                                   *
+ *****************************************************************************/
+
+static bool journal_r_mu(database_handle_t *db)
+{
+	const char *uid, *name, *pass, *email, *sflags, *language;
+	time_t reg, login;
+	unsigned int flags = 0;
+	myuser_t *mu;
+	mowgli_node_t *n, *tn;
+
+	if ((uid = db_read_word(db)) == NULL || (name = db_read_word(db)) == NULL ||
+			(pass = db_read_word(db)) == NULL || (email = db_read_word(db)) == NULL ||
+			!db_read_time(db, &reg) || !db_read_time(db, &login) ||
+			(sflags = db_read_word(db)) == NULL)
+		return false;
+	language = db_read_word(db);
+
+	if (!gflags_fromstr(mu_flags, sflags, &flags))
+		slog(LG_INFO, "journal: line %d: confused by flags: %s", db->line, sflags);
+
+	mu = myuser_find_uid(uid);
+	if (mu == NULL)
+		mu = myuser_find(name);
+
+	if (mu == NULL)
+	{
+		mu = myuser_add_id(uid, name, pass, email, flags);
+	}
+	else
+	{
+		if (irccasecmp(entity(mu)->name, name))
+			myuser_rename(mu, name);
+
+		mowgli_strlcpy(mu->pass, pass, sizeof mu->pass);
+		myuser_set_email(mu, email);
+		mu->flags = flags;
+
+		/* the rows that follow carry the complete lists */
+		metadata_delete_all(mu);
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->nicks.head)
+			object_unref(n->data);
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->access_list.head)
+			myuser_access_delete(mu, (char *)n->data);
+
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->cert_fingerprints.head)
+			mycertfp_delete(n->data);
+	}
+
+	mu->registered = reg;
+	mu->lastlogin = login;
+	if (language)
+		mu->language = language_add(language);
+
+	return true;
+}
+
+static bool journal_r_mud(database_handle_t *db)
+{
+	const char *uid;
+	myuser_t *mu;
+
+	if ((uid = db_read_word(db)) == NULL)
+		return false;
+
+	if ((mu = myuser_find_uid(uid)) != NULL)
+		object_dispose(mu);
+
+	return true;
+}
+
+static bool journal_r_mn(database_handle_t *db)
+{
+	const char *uid, *nick;
+	time_t reg, seen;
+	myuser_t *mu;
+	mynick_t *mn;
+
+	if ((uid = db_read_word(db)) == NULL || (nick = db_read_word(db)) == NULL ||
+			!db_read_time(db, &reg) || !db_read_time(db, &seen))
+		return false;
+
+	if ((mu = myuser_find_uid(uid)) == NULL)
+		return true;
+
+	/* the nick may still be on record for its previous owner */
+	if ((mn = mynick_find(nick)) != NULL)
+		object_unref(mn);
+
+	mn = mynick_add(mu, nick);
+	mn->registered = reg;
+	mn->lastseen = seen;
+
+	return true;
+}
+
+static bool journal_r_ac(database_handle_t *db)
+{
+	const char *uid, *mask;
+	myuser_t *mu;
+
+	if ((uid = db_read_word(db)) == NULL || (mask = db_read_word(db)) == NULL)
+		return false;
+
+	if ((mu = myuser_find_uid(uid)) != NULL)
+		myuser_access_add(mu, mask);
+
+	return true;
+}
+
+static bool journal_r_cfp(database_handle_t *db)
+{
+	const char *uid, *certfp;
+	myuser_t *mu;
+
+	if ((uid = db_read_word(db)) == NULL || (certfp = db_read_word(db)) == NULL)
+		return false;
+
+	if ((mu = myuser_find_uid(uid)) != NULL)
+		mycertfp_add(mu, certfp);
+
+	return true;
+}
+
+static bool journal_r_mc(database_handle_t *db)
+{
+	char buf[4096];
+	const char *name, *sflags, *key;
+	time_t reg, used;
+	unsigned int flags = 0, mlock_on, mlock_off, mlock_limit;
+	mychan_t *mc;
+	mowgli_node_t *n, *tn;
+
+	if ((name = db_read_word(db)) == NULL || !db_read_time(db, &reg) ||
+			!db_read_time(db, &used) || (sflags = db_read_word(db)) == NULL ||
+			!db_read_uint(db, &mlock_on) || !db_read_uint(db, &mlock_off) ||
+			!db_read_uint(db, &mlock_limit))
+		return false;
+	key = db_read_word(db);
+
+	if (!gflags_fromstr(mc_flags, sflags, &flags))
+		slog(LG_INFO, "journal: line %d: confused by flags %s", db->line, sflags);
+
+	mc = mychan_find(name);
+	if (mc == NULL)
+	{
+		mowgli_strlcpy(buf, name, sizeof buf);
+		mc = mychan_add(buf);
+	}
+	else
+	{
+		MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
+			object_unref(n->data);
+
+		metadata_delete_all(mc);
+
+		free(mc->mlock_key);
+		mc->mlock_key = NULL;
+	}
+
+	mc->registered = reg;
+	mc->used = used;
+	mc->flags = flags;
+	mc->mlock_on = mlock_on;
+	mc->mlock_off = mlock_off;
+	mc->mlock_limit = mlock_limit;
+
+	if (key != NULL && *key != '\0')
+		mc->mlock_key = sstrdup(key);
+
+	return true;
+}
+
+static bool journal_r_mcd(database_handle_t *db)
+{
+	const char *name;
+	mychan_t *mc;
+
+	if ((name = db_read_word(db)) == NULL)
+		return false;
+
+	if ((mc = mychan_find(name)) != NULL)
+		object_unref(mc);
+
+	return true;
+}
+
+static bool journal_r_ca(database_handle_t *db)
+{
+	const char *chan, *target, *sflags, *ssetter;
+	time_t tmod;
+	mychan_t *mc;
+	myentity_t *mt;
+
+	if ((chan = db_read_word(db)) == NULL || (target = db_read_word(db)) == NULL ||
+			(sflags = db_read_word(db)) == NULL || !db_read_time(db, &tmod) ||
+			(ssetter = db_read_word(db)) == NULL)
+		return false;
+
+	if ((mc = mychan_find(chan)) == NULL)
+		return true;
+
+	if ((mt = myentity_find(target)) != NULL)
+		chanacs_add(mc, mt, flags_to_bitmask(sflags, 0), tmod, myentity_find(ssetter));
+	else if (validhostmask(target))
+		chanacs_add_host(mc, target, flags_to_bitmask(sflags, 0), tmod, myentity_find(ssetter));
+	else
+		slog(LG_INFO, "journal: line %d: chanacs for nonexistent target %s on %s", db->line, target, chan);
+
+	return true;
+}
+
+static bool journal_r_md(database_handle_t *db, const char *type)
+{
+	const char *name, *prop, *value;
+	void *obj;
+
+	if ((name = db_read_word(db)) == NULL || (prop = db_read_word(db)) == NULL ||
+			(value = db_read_str(db)) == NULL)
+		return false;
+
+	if (!strcmp(type, "JMDU"))
+		obj = myuser_find_uid(name);
+	else
+		obj = mychan_find(name);
+
+	if (obj != NULL)
+		metadata_add(obj, prop, value);
+
+	return true;
+}
+
+/* sets *torn if the journal ends in a row that cannot be read */
+static unsigned int journal_replay(const char *name, bool *torn)
+{
+	database_handle_t *db;
+	const char *type;
+	char path[BUFSIZE];
+	unsigned int rows = 0;
+	bool ok;
+
+	journal_path(path, sizeof path, name);
+	if (access(path, R_OK) < 0)
+		return 0;
+
+	if ((db = db_open(name, DB_READ)) == NULL)
+		return 0;
+
+	while (db_read_next_row(db))
+	{
+		type = db_read_word(db);
+		if (!type || !*type || strchr("#\n\t \r", *type))
+			continue;
+
+		if (!strcmp(type, "JMU"))
+			ok = journal_r_mu(db);
+		else if (!strcmp(type, "JMUD"))
+			ok = journal_r_mud(db);
+		else if (!strcmp(type, "JMN"))
+			ok = journal_r_mn(db);
+		else if (!strcmp(type, "JAC"))
+			ok = journal_r_ac(db);
+		else if (!strcmp(type, "JCFP"))
+			ok = journal_r_cfp(db);
+		else if (!strcmp(type, "JMC"))
+			ok = journal_r_mc(db);
+		else if (!strcmp(type, "JMCD"))
+			ok = journal_r_mcd(db);
+		else if (!strcmp(type, "JCA"))
+			ok = journal_r_ca(db);
+		else if (!strcmp(type, "JMDU") || !strcmp(type, "JMDC"))
+			ok = journal_r_md(db, type);
+		else
+			ok = false;
+
+		/* a torn row can only be the last one written before a crash */
+		if (!ok)
+		{
+			slog(LG_ERROR, "journal: %s line %d: bad %s row, ignoring the rest of the journal", path, db->line, type);
+			*torn = true;
+			break;
+		}
+
+		rows++;
+	}
+
+	/* the backend could not even make a row out of it */
+	if (db->error)
+		*torn = true;
+
+	db_close(db);
+
+	return rows;
+}
+
+static void journal_db_load(const char *arg)
+{
+	char name[BUFSIZE], path[BUFSIZE];
+	unsigned int rows = 0;
+	bool torn = false;
+
+	free(journal_db_name);
+	journal_db_name = arg != NULL ? sstrdup(arg) : NULL;
+
+	snprintf(journal_name, sizeof journal_name, "%s.journal", arg != NULL ? arg : "services.db");
+
+	journal_snapshot_gen = 0;
+	journal_next_load(arg);
+
+	/* the closed journals from the snapshot's generation on, then the
+	 * current one, which is always newer than the snapshot
+	 */
+	for (journal_gen = journal_snapshot_gen; ; journal_gen++)
+	{
+		journal_gen_name(name, sizeof name, journal_gen);
+		journal_path(path, sizeof path, name);
+		if (access(path, F_OK) < 0)
+			break;
+
+		rows += journal_replay(name, &torn);
+	}
+	rows += journal_replay(journal_name, &torn);
+
+	if (rows > 0)
+		slog(LG_INFO, "journal: replayed %u rows", rows);
+
+	journal_done = journal_gen;
+
+	if (readonly)
+		return;
+
+	journal_remove_before(journal_snapshot_gen);
+
+	journal = db_open(journal_name, DB_APPEND);
+
+	/* rows appended behind a torn one would never be replayed; start
+	 * a new generation so the damaged journal is only read from now on
+	 */
+	if (torn && journal != NULL)
+	{
+		slog(LG_INFO, "journal: closing damaged journal as generation %u", journal_gen);
+		journal_close_gen(journal_gen++);
+		journal_done++;
+	}
+}
+
+/*****************************************************************************
+ * Hooks.                                                                    *
+ *****************************************************************************/
+
+static void journal_user_register(myuser_t *mu)
+{
+	journal_mark_user(mu);
+}
+
+static void journal_myuser_delete(myuser_t *mu)
+{
+	mowgli_node_t *n;
+	chanacs_t *ca;
+
+	journal_mark_user(mu);
+
+	/* the account's access entries go away with it */
+	MOWGLI_ITER_FOREACH(n, entity(mu)->chanacs.head)
+	{
+		ca = n->data;
+		journal_mark_chan(ca->mychan);
+	}
+}
+
+static void journal_user_rename(hook_user_rename_t *data)
+{
+	journal_mark_user(data->mu);
+}
+
+static void journal_user_req(hook_user_req_t *req)
+{
+	journal_mark_user(req->mu);
+}
+
+static void journal_user_identify(user_t *u)
+{
+	journal_mark_user(u->myuser);
+}
+
+
+static void journal_channel_req(hook_channel_req_t *req)
+{
+	journal_mark_chan(req->mc);
+}
+
+static void journal_channel_drop(mychan_t *mc)
+{
+	journal_mark_chan(mc);
+}
+
+static void journal_channel_acl_change(hook_channel_acl_req_t *req)
+{
+	journal_mark_chan(req->ca->mychan);
+}
+
+static void journal_channel_succession(hook_channel_succession_req_t *req)
+{
+	journal_mark_chan(req->mc);
+}
+
+void _modinit(module_t *m)
+{
+	MODULE_TRY_REQUEST_DEPENDENCY(m, "backend/corestorage");
+
+	m->mflags = MODTYPE_CORE;
+
+	if (db_load == NULL || db_save == NULL)
+	{
+		slog(LG_ERROR, "backend/journal: no database backend loaded");
+		m->mflags = MODTYPE_FAIL;
+		return;
+	}
+
+	journal_dirty_users = mowgli_patricia_create(noopcanon);
+	journal_dirty_chans = mowgli_patricia_create(irccasecanon);
+
+	journal_next_load = db_load;
+	db_load = journal_db_load;
+	journal_next_save = db_save;
+	db_save = journal_db_save;
+	if (db_save_background != NULL)
+	{
+		journal_next_save_background = db_save_background;
+		db_save_background = journal_db_save_background;
+	}
+
+	add_uint_conf_item("JOURNAL_SIZE", &conf_gi_table, 0, &journal_size, 0, INT_MAX, 16384);
+
+	hook_add_event("db_saved");
+	hook_add_db_saved(journal_db_saved);
+	hook_add_event("db_write");
+	hook_add_db_write(journal_db_write);
+	db_register_type_handler("JGEN", journal_h_gen);
+	hook_add_event("user_register");
+	hook_add_user_register(journal_user_register);
+	hook_add_event("myuser_delete");
+	hook_add_myuser_delete(journal_myuser_delete);
+	hook_add_event("user_rename");
+	hook_add_user_rename(journal_user_rename);
+	hook_add_event("nick_group");
+	hook_add_nick_group(journal_user_req);
+	hook_add_event("nick_ungroup");
+	hook_add_nick_ungroup(journal_user_req);
+	hook_add_event("user_verify_register");
+	hook_add_user_verify_register(journal_user_req);
+	hook_add_event("user_identify");
+	hook_add_user_identify(journal_user_identify);
+	hook_add_event("myuser_changed");
+	hook_add_myuser_changed(journal_mark_user);
+	hook_add_event("mychan_changed");
+	hook_add_mychan_changed(journal_mark_chan);
+	hook_add_event("channel_register");
+	hook_add_channel_register(journal_channel_req);
+	hook_add_event("channel_drop");
+	hook_add_channel_drop(journal_channel_drop);
+	hook_add_event("channel_acl_change");
+	hook_add_channel_acl_change(journal_channel_acl_change);
+	hook_add_event("channel_succession");
+	hook_add_channel_succession(journal_channel_succession);
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
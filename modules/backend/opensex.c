@@ -10,6 +10,10 @@
 
 #include "atheme.h"
 
+#ifndef MOWGLI_OS_WIN
+# include <sys/mman.h>
+#endif
+
 DECLARE_MODULE_V1
 (
 	"backend/opensex", true, _modinit, NULL,
@@ -24,6 +28,11 @@ typedef struct opensex_ {
 	char *token;
 	FILE *f;
 
+	/* the database file mapped into memory, when reading */
+	char *map;
+	size_t maplen;
+	size_t mappos;
+
 	/* Interpreting state */
 	unsigned int grver;
 } opensex_t;
@@ -31,12 +40,26 @@ typedef struct opensex_ {
 static void opensex_db_parse(database_handle_t *db)
 {
 	const char *cmd;
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval loadtime;
+	int ms;
+
+	s_time(&loadtime);
+#endif
+
 	while (db_read_next_row(db))
 	{
 		cmd = db_read_word(db);
 		if (!cmd || !*cmd || strchr("#\n\t \r", *cmd)) continue;
 		db_process(db, cmd);
 	}
+
+#ifdef HAVE_GETTIMEOFDAY
+	e_time(loadtime, &loadtime);
+	ms = tv2ms(&loadtime);
+	slog(LG_INFO, "opensex: loaded %u rows in %d ms (%u rows/s)", db->line, ms,
+			ms > 0 ? (unsigned int) ((unsigned long long) db->line * 1000 / ms) : db->line);
+#endif
 }
 
 static void opensex_h_grver(database_handle_t *db, const char *type)
@@ -48,12 +71,66 @@ static void opensex_h_grver(database_handle_t *db, const char *type)
 
 /***************************************************************************************************/
 
+/* every row written ends in a newline, so a last line without one was cut
+ * short while it was being written (a journal, when services crashed);
+ * appending to the file would glue the next row onto it
+ */
+static void opensex_incomplete_row(database_handle_t *hdl)
+{
+	slog(LG_ERROR, "opensex: %s line %d: incomplete last row, ignoring it", hdl->file, hdl->line + 1);
+	hdl->error = true;
+}
+
+/* rows come out of the mapped file with memchr(); each one is copied
+ * once into the row buffer so the tokenizer can NUL-terminate cells
+ * without dirtying the mapping
+ */
+static bool opensex_read_next_row_map(database_handle_t *hdl)
+{
+	opensex_t *rs = (opensex_t *)hdl->priv;
+	char *start, *nl;
+	size_t n;
+
+	if (rs->mappos >= rs->maplen)
+		return false;
+
+	start = rs->map + rs->mappos;
+	nl = memchr(start, '\n', rs->maplen - rs->mappos);
+	if (nl == NULL)
+	{
+		rs->mappos = rs->maplen;
+		opensex_incomplete_row(hdl);
+		return false;
+	}
+
+	n = nl - start;
+	rs->mappos += n + 1;
+
+	if (n >= rs->bufsize)
+	{
+		while (n >= rs->bufsize)
+			rs->bufsize *= 2;
+		rs->buf = srealloc(rs->buf, rs->bufsize);
+	}
+
+	memcpy(rs->buf, start, n);
+	rs->buf[n] = '\0';
+	rs->token = rs->buf;
+
+	hdl->line++;
+	hdl->token = 0;
+	return true;
+}
+
 static bool opensex_read_next_row(database_handle_t *hdl)
 {
 	int c = 0;
 	unsigned int n = 0;
 	opensex_t *rs = (opensex_t *)hdl->priv;
 
+	if (rs->map != NULL)
+		return opensex_read_next_row_map(hdl);
+
 	while ((c = getc(rs->f)) != EOF && c != '\n')
 	{
 		rs->buf[n++] = c;
@@ -76,6 +153,12 @@ static bool opensex_read_next_row(database_handle_t *hdl)
 	if (c == EOF && n == 0)
 		return false;
 
+	if (c == EOF)
+	{
+		opensex_incomplete_row(hdl);
+		return false;
+	}
+
 	hdl->line++;
 	hdl->token = 0;
 	return true;
@@ -86,7 +169,6 @@ static const char *opensex_read_word(database_handle_t *db)
 	opensex_t *rs = (opensex_t *)db->priv;
 	char *ptr = rs->token;
 	char *res;
-	static char buf[BUFSIZE];
 
 	switch (rs->grver)
 	{
@@ -99,8 +181,9 @@ static const char *opensex_read_word(database_handle_t *db)
 			char *bi, *pi;
 			bool escaped = false;
 
+			/* unescape in place, the result is never longer than the cell */
 			ptr++;
-			for (bi = buf, pi = ptr; *pi != '\0' && (bi - buf) < sizeof buf; pi++)
+			for (bi = ptr, pi = ptr; *pi != '\0'; pi++)
 			{
 				switch (*pi)
 				{
@@ -118,9 +201,10 @@ static const char *opensex_read_word(database_handle_t *db)
 				}
 			}
 demarshal_out:
+			/* step past the closing paren before it may be overwritten */
+			rs->token = *pi != '\0' ? pi + 1 : pi;
 			*bi++ = '\0';
-			rs->token = pi;
-			res = buf;
+			res = ptr;
 			slog(LG_DEBUG, "opensex_read_word(): read [%s], pi [%s]", res, pi);
 		}
 		else
@@ -327,6 +411,16 @@ static bool opensex_commit_row(database_handle_t *db)
 	return true;
 }
 
+static bool opensex_flush(database_handle_t *db)
+{
+	opensex_t *rs;
+
+	return_val_if_fail(db != NULL, false);
+	rs = (opensex_t *)db->priv;
+
+	return fflush(rs->f) == 0;
+}
+
 static database_vtable_t opensex_vt = {
 	.name = "opensex",
 
@@ -344,7 +438,8 @@ static database_vtable_t opensex_vt = {
 	.write_int = opensex_write_int,
 	.write_uint = opensex_write_uint,
 	.write_time = opensex_write_time,
-	.commit_row = opensex_commit_row
+	.commit_row = opensex_commit_row,
+	.flush = opensex_flush
 };
 
 static database_handle_t *opensex_db_open_read(const char *filename)
@@ -354,6 +449,10 @@ static database_handle_t *opensex_db_open_read(const char *filename)
 	FILE *f;
 	int errno1;
 	char path[BUFSIZE];
+#ifndef MOWGLI_OS_WIN
+	struct stat sb;
+	void *map;
+#endif
 
 	snprintf(path, BUFSIZE, "%s/%s", datadir, filename != NULL ? filename : "services.db");
 	f = fopen(path, "r");
@@ -380,6 +479,25 @@ static database_handle_t *opensex_db_open_read(const char *filename)
 	rs->token = NULL;
 	rs->f = f;
 
+#ifndef MOWGLI_OS_WIN
+	/* map the whole file if we can, otherwise fall back to stdio */
+	if (fstat(fileno(f), &sb) == 0 && sb.st_size > 0)
+	{
+		map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+		if (map != MAP_FAILED)
+		{
+#ifdef MADV_SEQUENTIAL
+			madvise(map, sb.st_size, MADV_SEQUENTIAL);
+#endif
+			rs->map = map;
+			rs->maplen = sb.st_size;
+			rs->mappos = 0;
+		}
+		else
+			slog(LG_DEBUG, "db-open-read: cannot map '%s': %s", path, strerror(errno));
+	}
+#endif
+
 	db = scalloc(sizeof(database_handle_t), 1);
 	db->priv = rs;
 	db->vt = &opensex_vt;
@@ -439,20 +557,64 @@ static database_handle_t *opensex_db_open_write(const char *filename)
 	return db;
 }
 
+/* Appends rows to an existing file (or creates it) without the usual
+ * write-to-new-and-rename dance; used for journals. No GRVER row is written,
+ * so appended rows always use grammar version 1.
+ */
+static database_handle_t *opensex_db_open_append(const char *filename)
+{
+	database_handle_t *db;
+	opensex_t *rs;
+	FILE *f;
+	int errno1;
+	char path[BUFSIZE];
+
+	return_val_if_fail(filename != NULL, NULL);
+
+	snprintf(path, BUFSIZE, "%s/%s", datadir, filename);
+
+	f = fopen(path, "a");
+	if (!f)
+	{
+		errno1 = errno;
+		slog(LG_ERROR, "db-open-append: cannot open '%s' for appending: %s", path, strerror(errno1));
+		wallops(_("\2DATABASE ERROR\2: db-open-append: cannot open '%s' for appending: %s"), path, strerror(errno1));
+		return NULL;
+	}
+
+	rs = scalloc(sizeof(opensex_t), 1);
+	rs->f = f;
+	rs->grver = 1;
+
+	db = scalloc(sizeof(database_handle_t), 1);
+	db->priv = rs;
+	db->vt = &opensex_vt;
+	db->txn = DB_APPEND;
+	db->file = sstrdup(path);
+	db->line = 0;
+	db->token = 0;
+
+	return db;
+}
+
 static database_handle_t *opensex_db_open(const char *filename, database_transaction_t txn)
 {
 	if (txn == DB_WRITE)
 		return opensex_db_open_write(filename);
+	if (txn == DB_APPEND)
+		return opensex_db_open_append(filename);
 	return opensex_db_open_read(filename);
 }
 
-static void opensex_db_close(database_handle_t *db)
+/* returns false if a new database could not be put in place */
+static bool opensex_db_close(database_handle_t *db)
 {
 	opensex_t *rs;
 	int errno1;
 	char oldpath[BUFSIZE], newpath[BUFSIZE];
+	bool ret = true;
 
-	return_if_fail(db != NULL);
+	return_val_if_fail(db != NULL, false);
 	rs = db->priv;
 
 	mowgli_strlcpy(oldpath, db->file, sizeof oldpath);
@@ -460,6 +622,11 @@ static void opensex_db_close(database_handle_t *db)
 
 	mowgli_strlcpy(newpath, db->file, sizeof newpath);
 
+#ifndef MOWGLI_OS_WIN
+	if (rs->map != NULL)
+		munmap(rs->map, rs->maplen);
+#endif
+
 	fclose(rs->f);
 
 	if (db->txn == DB_WRITE)
@@ -470,15 +637,16 @@ static void opensex_db_close(database_handle_t *db)
 			errno1 = errno;
 			slog(LG_ERROR, "db_save(): cannot rename services.db.new to services.db: %s", strerror(errno1));
 			wallops(_("\2DATABASE ERROR\2: db_save(): cannot rename services.db.new to services.db: %s"), strerror(errno1));
+			ret = false;
 		}
-
-		hook_call_db_saved();
 	}
 
 	free(rs->buf);
 	free(rs);
 	free(db->file);
 	free(db);
+
+	return ret;
 }
 
 static database_module_t opensex_mod = {
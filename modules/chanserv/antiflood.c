@@ -424,6 +424,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	if (!strcasecmp(parv[1], "OFF"))
 	{
 		mc->flags &= ~MC_ANTIFLOOD;
+		hook_call_mychan_changed(mc);
 		metadata_delete(mc, METADATA_KEY_ENFORCE_METHOD);
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD:NONE: \2%s\2",  mc->name);
@@ -433,6 +434,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	else if (!strcasecmp(parv[1], "ON"))
 	{
 		mc->flags |= MC_ANTIFLOOD;
+		hook_call_mychan_changed(mc);
 		metadata_delete(mc, METADATA_KEY_ENFORCE_METHOD);
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "DEFAULT");
@@ -442,6 +444,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	else if (!strcasecmp(parv[1], "QUIET"))
 	{
 		mc->flags |= MC_ANTIFLOOD;
+		hook_call_mychan_changed(mc);
 		metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "QUIET");
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "QUIET");
@@ -451,6 +454,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	else if (!strcasecmp(parv[1], "KICKBAN"))
 	{
 		mc->flags |= MC_ANTIFLOOD;
+		hook_call_mychan_changed(mc);
 		metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "KICKBAN");
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "KICKBAN");
@@ -462,6 +466,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 		if (has_priv(si, PRIV_AKILL))
 		{
 			mc->flags |= MC_ANTIFLOOD;
+			hook_call_mychan_changed(mc);
 			metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "AKILL");
 
 			logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "AKILL");
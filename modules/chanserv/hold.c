@@ -64,6 +64,8 @@ static void cs_cmd_hold(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mc->flags |= MC_HOLD;
+		hook_call_mychan_changed(mc);
+		mychan_reindex(mc);
 
 		wallops("%s set the HOLD option for the channel \2%s\2.", get_oper_name(si), target);
 		logcommand(si, CMDLOG_ADMIN, "HOLD:ON: \2%s\2", mc->name);
@@ -78,6 +80,8 @@ static void cs_cmd_hold(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mc->flags &= ~MC_HOLD;
+		hook_call_mychan_changed(mc);
+		mychan_reindex(mc);
 
 		wallops("%s removed the HOLD option on the channel \2%s\2.", get_oper_name(si), target);
 		logcommand(si, CMDLOG_ADMIN, "HOLD:OFF: \2%s\2", mc->name);
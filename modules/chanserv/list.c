@@ -134,122 +134,205 @@ static void build_criteriastr(char *buf, int parc, char *parv[])
 	}
 }
 
-static void cs_cmd_list(sourceinfo_t *si, int parc, char *parv[])
+typedef struct {
+	sourceinfo_t *si;
+	char *chanpattern, *markpattern, *closedpattern;
+	bool closed, marked;
+	unsigned int flagset;
+	int aclsize;
+	time_t age, lastused;
+	unsigned int matches;
+} list_query_t;
+
+static void list_channel_cb(void *obj, void *priv)
 {
-	mychan_t *mc;
-	metadata_t *md, *mdclosed;
-	char *chanpattern = NULL, *markpattern = NULL, *closedpattern = NULL;
+	list_query_t *q = priv;
+	mychan_t *mc = obj;
+	metadata_t *md;
 	char buf[BUFSIZE];
-	char criteriastr[BUFSIZE];
-	unsigned int matches = 0;
-	unsigned int flagset = 0;
-	int aclsize = 0;
-	time_t age = 0, lastused = 0;
-	bool closed = false, marked = false, markmatch, closedmatch;
-	mowgli_patricia_iteration_state_t state;
-	list_option_t optstable[] = {
-		{"pattern",	OPT_STRING,	{.strval = &chanpattern}, 0},
-		{"mark-reason", OPT_STRING,	{.strval = &markpattern}, 0},
-		{"close-reason", OPT_STRING,    {.strval = &closedpattern}, 0},
-		{"noexpire",	OPT_FLAG,	{.flagval = &flagset}, MC_HOLD},
-		{"held",	OPT_FLAG,	{.flagval = &flagset}, MC_HOLD},
-		{"hold",	OPT_FLAG,	{.flagval = &flagset}, MC_HOLD},
-		{"noop",	OPT_FLAG,	{.flagval = &flagset}, MC_NOOP},
-		{"limitflags",	OPT_FLAG,	{.flagval = &flagset}, MC_LIMITFLAGS},
-		{"secure",	OPT_FLAG,	{.flagval = &flagset}, MC_SECURE},
-		{"nosync",	OPT_FLAG,	{.flagval = &flagset}, MC_NOSYNC},
-		{"verbose",	OPT_FLAG,	{.flagval = &flagset}, MC_VERBOSE},
-		{"restricted",	OPT_FLAG,	{.flagval = &flagset}, MC_RESTRICTED},
-		{"keeptopic",	OPT_FLAG,	{.flagval = &flagset}, MC_KEEPTOPIC},
-		{"verbose-ops",	OPT_FLAG,	{.flagval = &flagset}, MC_VERBOSE_OPS},
-		{"topiclock",	OPT_FLAG,	{.flagval = &flagset}, MC_TOPICLOCK},
-		{"guard",	OPT_FLAG,	{.flagval = &flagset}, MC_GUARD},
-		{"private",	OPT_FLAG,	{.flagval = &flagset}, MC_PRIVATE},
-		{"closed",	OPT_BOOL,	{.boolval = &closed}, 0},
-		{"marked",	OPT_BOOL,	{.boolval = &marked}, 0},
-		{"aclsize",	OPT_INT,	{.intval = &aclsize}, 0},
-		{"registered",	OPT_AGE,	{.ageval = &age}, 0},
-		{"lastused",	OPT_AGE,	{.ageval = &lastused}, 0},
-	};
 
-	process_parvarray(optstable, ARRAY_SIZE(optstable), parc, parv);
-	build_criteriastr(criteriastr, parc, parv);
+	if (q->chanpattern != NULL && match(q->chanpattern, mc->name))
+		return;
 
-	command_success_nodata(si, _("Channels matching \2%s\2:"), criteriastr);
+	if (q->markpattern)
+	{
+		md = metadata_find(mc, "private:mark:reason");
+		if (md == NULL || match(q->markpattern, md->value))
+			return;
+	}
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	if (q->closedpattern)
 	{
-		if (chanpattern != NULL && match(chanpattern, mc->name))
-			continue;
+		md = metadata_find(mc, "private:close:reason");
+		if (md == NULL || match(q->closedpattern, md->value))
+			return;
+	}
 
-		if (markpattern)
-		{
-			markmatch = false;
-			md = metadata_find(mc, "private:mark:reason");
-			if (md != NULL && !match(markpattern, md->value))
-				markmatch = true;
+	if (q->marked && !metadata_find(mc, "private:mark:setter"))
+		return;
 
-			if (!markmatch)
-				continue;
-		}
+	if (q->closed && !metadata_find(mc, "private:close:closer"))
+		return;
 
-		if (closedpattern)
-		{
-			closedmatch = false;
-			mdclosed = metadata_find(mc, "private:close:reason");
-			if (mdclosed != NULL && !match(closedpattern, mdclosed->value))
-				closedmatch = true;
+	if (q->flagset && (mc->flags & q->flagset) != q->flagset)
+		return;
 
-			if (!closedmatch)
-				continue;
-		}
+	if (q->aclsize && MOWGLI_LIST_LENGTH(&mc->chanacs) < (unsigned int)q->aclsize)
+		return;
 
-		if (marked && !metadata_find(mc, "private:mark:setter"))
-			continue;
+	if (q->age && (CURRTIME - mc->registered) < q->age)
+		return;
 
-		if (closed && !metadata_find(mc, "private:close:closer"))
-			continue;
+	if (q->lastused && (CURRTIME - mc->used) < q->lastused)
+		return;
 
-		if (flagset && (mc->flags & flagset) != flagset)
-			continue;
+	/* in the future we could add a LIMIT parameter */
+	*buf = '\0';
 
-		if (aclsize && MOWGLI_LIST_LENGTH(&mc->chanacs) < (unsigned int)aclsize)
-			continue;
+	if (metadata_find(mc, "private:mark:setter")) {
+		mowgli_strlcat(buf, "\2[marked]\2", BUFSIZE);
+	}
+	if (metadata_find(mc, "private:close:closer")) {
+		if (*buf)
+			mowgli_strlcat(buf, " ", BUFSIZE);
 
-		if (age && (CURRTIME - mc->registered) < age)
-			continue;
+		mowgli_strlcat(buf, "\2[closed]\2", BUFSIZE);
+	}
+	if (mc->flags & MC_HOLD) {
+		if (*buf)
+			mowgli_strlcat(buf, " ", BUFSIZE);
 
-		if (lastused && (CURRTIME - mc->used) < lastused)
-			continue;
+		mowgli_strlcat(buf, "\2[held]\2", BUFSIZE);
+	}
 
-		/* in the future we could add a LIMIT parameter */
-		*buf = '\0';
+	command_success_nodata(q->si, "- %s (%s) %s", mc->name, mychan_founder_names(mc), buf);
+	q->matches++;
+}
 
-		if (metadata_find(mc, "private:mark:setter")) {
-			mowgli_strlcat(buf, "\2[marked]\2", BUFSIZE);
-		}
-		if (metadata_find(mc, "private:close:closer")) {
-			if (*buf)
-				mowgli_strlcat(buf, " ", BUFSIZE);
+typedef enum {
+	SRC_SCAN,
+	SRC_NAME,
+	SRC_MARKED,
+	SRC_CLOSED,
+	SRC_HELD,
+	SRC_REGISTERED,
+	SRC_USED,
+} list_source_t;
+
+/* pick the index that yields the fewest candidates */
+static list_source_t list_plan(list_query_t *q, mychan_index_t *idx)
+{
+	list_source_t best = SRC_SCAN;
+	unsigned int bestcount = TRIGRAM_NOINDEX, n;
+
+#define CONSIDER(src, count) \
+	do { \
+		n = (count); \
+		if (n < bestcount) \
+		{ \
+			best = (src); \
+			bestcount = n; \
+		} \
+	} while (0)
+
+	if (q->chanpattern)
+		CONSIDER(SRC_NAME, trigram_index_estimate(idx->names, q->chanpattern));
+	if (q->marked)
+		CONSIDER(SRC_MARKED, MOWGLI_LIST_LENGTH(&idx->marked->objects));
+	if (q->closed)
+		CONSIDER(SRC_CLOSED, MOWGLI_LIST_LENGTH(&idx->closed->objects));
+	if (q->flagset & MC_HOLD)
+		CONSIDER(SRC_HELD, MOWGLI_LIST_LENGTH(&idx->held));
+	if (q->age)
+		CONSIDER(SRC_REGISTERED, timeheap_count_before(&idx->registered, CURRTIME - q->age, bestcount));
+	if (q->lastused)
+		CONSIDER(SRC_USED, timeheap_count_before(&idx->used, CURRTIME - q->lastused, bestcount));
+
+#undef CONSIDER
+
+	return best;
+}
 
-			mowgli_strlcat(buf, "\2[closed]\2", BUFSIZE);
-		}
-		if (mc->flags & MC_HOLD) {
-			if (*buf)
-				mowgli_strlcat(buf, " ", BUFSIZE);
+static void list_foreach_node(mowgli_list_t *l, list_query_t *q)
+{
+	mowgli_node_t *n;
 
-			mowgli_strlcat(buf, "\2[held]\2", BUFSIZE);
-		}
+	MOWGLI_ITER_FOREACH(n, l->head)
+		list_channel_cb(n->data, q);
+}
+
+static void cs_cmd_list(sourceinfo_t *si, int parc, char *parv[])
+{
+	mychan_t *mc;
+	char criteriastr[BUFSIZE];
+	mowgli_patricia_iteration_state_t state;
+	mychan_index_t *idx;
+	list_query_t q = { .si = si };
+
+	list_option_t optstable[] = {
+		{"pattern",	OPT_STRING,	{.strval = &q.chanpattern}, 0},
+		{"mark-reason", OPT_STRING,	{.strval = &q.markpattern}, 0},
+		{"close-reason", OPT_STRING,    {.strval = &q.closedpattern}, 0},
+		{"noexpire",	OPT_FLAG,	{.flagval = &q.flagset}, MC_HOLD},
+		{"held",	OPT_FLAG,	{.flagval = &q.flagset}, MC_HOLD},
+		{"hold",	OPT_FLAG,	{.flagval = &q.flagset}, MC_HOLD},
+		{"noop",	OPT_FLAG,	{.flagval = &q.flagset}, MC_NOOP},
+		{"limitflags",	OPT_FLAG,	{.flagval = &q.flagset}, MC_LIMITFLAGS},
+		{"secure",	OPT_FLAG,	{.flagval = &q.flagset}, MC_SECURE},
+		{"nosync",	OPT_FLAG,	{.flagval = &q.flagset}, MC_NOSYNC},
+		{"verbose",	OPT_FLAG,	{.flagval = &q.flagset}, MC_VERBOSE},
+		{"restricted",	OPT_FLAG,	{.flagval = &q.flagset}, MC_RESTRICTED},
+		{"keeptopic",	OPT_FLAG,	{.flagval = &q.flagset}, MC_KEEPTOPIC},
+		{"verbose-ops",	OPT_FLAG,	{.flagval = &q.flagset}, MC_VERBOSE_OPS},
+		{"topiclock",	OPT_FLAG,	{.flagval = &q.flagset}, MC_TOPICLOCK},
+		{"guard",	OPT_FLAG,	{.flagval = &q.flagset}, MC_GUARD},
+		{"private",	OPT_FLAG,	{.flagval = &q.flagset}, MC_PRIVATE},
+		{"closed",	OPT_BOOL,	{.boolval = &q.closed}, 0},
+		{"marked",	OPT_BOOL,	{.boolval = &q.marked}, 0},
+		{"aclsize",	OPT_INT,	{.intval = &q.aclsize}, 0},
+		{"registered",	OPT_AGE,	{.ageval = &q.age}, 0},
+		{"lastused",	OPT_AGE,	{.ageval = &q.lastused}, 0},
+	};
 
-		command_success_nodata(si, "- %s (%s) %s", mc->name, mychan_founder_names(mc), buf);
-		matches++;
+	process_parvarray(optstable, ARRAY_SIZE(optstable), parc, parv);
+	build_criteriastr(criteriastr, parc, parv);
+
+	command_success_nodata(si, _("Channels matching \2%s\2:"), criteriastr);
+
+	idx = mychan_index();
+
+	switch (list_plan(&q, idx))
+	{
+	case SRC_NAME:
+		trigram_index_search(idx->names, q.chanpattern, list_channel_cb, &q);
+		break;
+	case SRC_MARKED:
+		list_foreach_node(&idx->marked->objects, &q);
+		break;
+	case SRC_CLOSED:
+		list_foreach_node(&idx->closed->objects, &q);
+		break;
+	case SRC_HELD:
+		list_foreach_node(&idx->held, &q);
+		break;
+	case SRC_REGISTERED:
+		mychan_index_foreach_registered(CURRTIME - q.age, (mychan_index_cb_t) list_channel_cb, &q);
+		break;
+	case SRC_USED:
+		mychan_index_foreach_used(CURRTIME - q.lastused, (mychan_index_cb_t) list_channel_cb, &q);
+		break;
+	case SRC_SCAN:
+	default:
+		MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+			list_channel_cb(mc, &q);
+		break;
 	}
 
-	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", criteriastr, matches);
-	if (matches == 0)
+	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", criteriastr, q.matches);
+	if (q.matches == 0)
 		command_success_nodata(si, _("No channel matched criteria \2%s\2"), criteriastr);
 	else
-		command_success_nodata(si, ngettext(N_("\2%d\2 match for criteria \2%s\2"), N_("\2%d\2 matches for criteria \2%s\2"), matches), matches, criteriastr);
+		command_success_nodata(si, ngettext(N_("\2%d\2 match for criteria \2%s\2"), N_("\2%d\2 matches for criteria \2%s\2"), q.matches), q.matches, criteriastr);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -88,6 +88,7 @@ static void cs_cmd_set_guard(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:GUARD:ON: \2%s\2", mc->name);
 
 		mc->flags |= MC_GUARD;
+		hook_call_mychan_changed(mc);
 
 		if (!(mc->flags & MC_INHABIT))
 			join(mc->name, chansvs.nick);
@@ -106,6 +107,7 @@ static void cs_cmd_set_guard(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:GUARD:OFF: \2%s\2", mc->name);
 
 		mc->flags &= ~MC_GUARD;
+		hook_call_mychan_changed(mc);
 
 		if (mc->chan != NULL && !(mc->flags & MC_INHABIT) && !(mc->chan->flags & CHAN_LOG))
 			part(mc->name, chansvs.nick);
@@ -230,6 +230,7 @@ static void cs_cmd_set_mlock(sourceinfo_t *si, int parc, char *parv[])
 		free(mc->mlock_key);
 		mc->mlock_key = *newlock_key != '\0' ? sstrdup(newlock_key) : NULL;
 	}
+	hook_call_mychan_changed(mc);
 
 	ext_plus[0] = '\0';
 	ext_minus[0] = '\0';
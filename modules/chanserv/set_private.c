@@ -71,6 +71,7 @@ static void cs_cmd_set_private(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:PRIVATE:ON: \2%s\2", mc->name);
 
 		mc->flags |= MC_PRIVATE;
+		hook_call_mychan_changed(mc);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for \2%s\2."), "PRIVATE", mc->name);
 
@@ -88,6 +89,7 @@ static void cs_cmd_set_private(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:PRIVATE:OFF: \2%s\2", mc->name);
 
 		mc->flags &= ~MC_PRIVATE;
+		hook_call_mychan_changed(mc);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for \2%s\2."), "PRIVATE", mc->name);
 
@@ -67,6 +67,7 @@ static void cs_cmd_set_secure(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:SECURE:ON: \2%s\2", mc->name);
 
 		mc->flags |= MC_SECURE;
+		hook_call_mychan_changed(mc);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for channel \2%s\2."), "SECURE", mc->name);
 		return;
@@ -82,6 +83,7 @@ static void cs_cmd_set_secure(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:SECURE:OFF: \2%s\2", mc->name);
 
 		mc->flags &= ~MC_SECURE;
+		hook_call_mychan_changed(mc);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for channel \2%s\2."), "SECURE", mc->name);
 		return;
@@ -68,6 +68,7 @@ static void cs_cmd_set_verbose(sourceinfo_t *si, int parc, char *parv[])
 
  		mc->flags &= ~MC_VERBOSE_OPS;
  		mc->flags |= MC_VERBOSE;
+		hook_call_mychan_changed(mc);
 
 		verbose(mc, "\2%s\2 enabled the VERBOSE flag", get_source_name(si));
 		command_success_nodata(si, _("The \2%s\2 flag has been set for channel \2%s\2."), "VERBOSE", mc->name);
@@ -89,10 +90,12 @@ static void cs_cmd_set_verbose(sourceinfo_t *si, int parc, char *parv[])
 			verbose(mc, "\2%s\2 restricted VERBOSE to chanops", get_source_name(si));
  			mc->flags &= ~MC_VERBOSE;
  			mc->flags |= MC_VERBOSE_OPS;
+			hook_call_mychan_changed(mc);
 		}
 		else
 		{
  			mc->flags |= MC_VERBOSE_OPS;
+			hook_call_mychan_changed(mc);
 			verbose(mc, "\2%s\2 enabled the VERBOSE_OPS flag", get_source_name(si));
 		}
 
@@ -114,6 +117,7 @@ static void cs_cmd_set_verbose(sourceinfo_t *si, int parc, char *parv[])
 		else
 			verbose(mc, "\2%s\2 disabled the VERBOSE_OPS flag", get_source_name(si));
 		mc->flags &= ~(MC_VERBOSE | MC_VERBOSE_OPS);
+		hook_call_mychan_changed(mc);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for channel \2%s\2."), "VERBOSE", mc->name);
 		return;
@@ -113,12 +113,14 @@ DECLARE_MODULE_V1
 	"Jilles Tjoelker <jilles@stack.nl>"
 );
 
-static const char *ircservices_crypt_string(const char *key, const char *salt)
+static const char *ircservices_crypt_r(const char *key, const char *salt, char *output, size_t outlen)
 {
-	static char output[PASSMAX];
+	if (outlen < PASSMAX)
+		return NULL;
+
 	if (salt[0] == '$' && salt[1] == '1') /* this is a new pw XXX */
 	{
-		myencrypt(key, strlen(key), output, PASSMAX);
+		myencrypt(key, strlen(key), output, outlen);
 		return output;
 	}
 	else
@@ -133,9 +135,17 @@ static const char *ircservices_crypt_string(const char *key, const char *salt)
 	}
 }
 
+static const char *ircservices_crypt_string(const char *key, const char *salt)
+{
+	static char output[PASSMAX];
+
+	return ircservices_crypt_r(key, salt, output, sizeof output);
+}
+
 static crypt_impl_t ircservices_crypt_impl = {
 	.id = "ircservices",
 	.crypt = &ircservices_crypt_string,
+	.crypt_r = &ircservices_crypt_r,
 };
 
 void _modinit(module_t *m)
@@ -24,68 +24,87 @@
 
 DECLARE_MODULE_V1("crypto/pbkdf2", false, _modinit, _moddeinit, PACKAGE_VERSION, "Atheme Development Group <http://www.atheme.org>");
 
-#include <openssl/evp.h>
 #include <openssl/sha.h>
-#include <openssl/hmac.h>
 
 #define ROUNDS		(128000)
 #define SALTLEN		(16)
 
 /* This is an implementation of PKCS#5 v2.0 password based encryption key
- * derivation function PBKDF2.
- * SHA1 version verified against test vectors posted by Peter Gutmann
- * <pgut001@cs.auckland.ac.nz> to the PKCS-TNG <pkcs-tng@rsa.com> mailing list.
+ * derivation function PBKDF2 with HMAC-SHA512, as in RFC 2898 and 2104.
+ *
+ * Every round is HMAC(pass, U) for the previous U. The key is the same
+ * each time, so the SHA512 states after absorbing key^ipad and key^opad
+ * are computed once and copied per round; a round then costs two
+ * compression function calls, since U and the inner digest are 64 bytes
+ * and fit a single block with their padding.
  */
-int PKCS5_PBKDF2_HMAC(const char *pass, int passlen,
-			   const unsigned char *salt, int saltlen, int iter,
-			   const EVP_MD *digest,
-			   int keylen, unsigned char *out)
+static void pbkdf2_hmac_sha512(const char *pass, size_t passlen,
+			       const unsigned char *salt, size_t saltlen, int iter,
+			       unsigned char *out, size_t keylen)
 {
-	unsigned char digtmp[EVP_MAX_MD_SIZE], *p, itmp[4];
-	int cplen, j, k, tkeylen, mdlen;
+	unsigned char key[SHA512_CBLOCK], pad[SHA512_CBLOCK];
+	unsigned char u[SHA512_DIGEST_LENGTH], itmp[4];
+	SHA512_CTX ictx, octx, ctx;
+	size_t cplen, k;
 	unsigned long i = 1;
-	HMAC_CTX hctx;
-
-	mdlen = EVP_MD_size(digest);
-
-	HMAC_CTX_init(&hctx);
-	p = out;
-	tkeylen = keylen;
-	if(!pass)
-		passlen = 0;
-	else if(passlen == -1)
-		passlen = strlen(pass);
-	while(tkeylen)
+	int j;
+
+	memset(key, 0, sizeof key);
+	if (passlen > SHA512_CBLOCK)
+		SHA512((const unsigned char *)pass, passlen, key);
+	else
+		memcpy(key, pass, passlen);
+
+	for (k = 0; k < SHA512_CBLOCK; k++)
+		pad[k] = key[k] ^ 0x36;
+	SHA512_Init(&ictx);
+	SHA512_Update(&ictx, pad, SHA512_CBLOCK);
+
+	for (k = 0; k < SHA512_CBLOCK; k++)
+		pad[k] = key[k] ^ 0x5c;
+	SHA512_Init(&octx);
+	SHA512_Update(&octx, pad, SHA512_CBLOCK);
+
+	while (keylen)
 	{
-		if(tkeylen > mdlen)
-			cplen = mdlen;
-		else
-			cplen = tkeylen;
-		/* We are unlikely to ever use more than 256 blocks (5120 bits!)
-		 * but just in case...
-		 */
+		cplen = keylen > SHA512_DIGEST_LENGTH ? SHA512_DIGEST_LENGTH : keylen;
+
+		/* U_1 = HMAC(pass, salt || INT(i)) */
 		itmp[0] = (unsigned char)((i >> 24) & 0xff);
 		itmp[1] = (unsigned char)((i >> 16) & 0xff);
 		itmp[2] = (unsigned char)((i >> 8) & 0xff);
 		itmp[3] = (unsigned char)(i & 0xff);
-		HMAC_Init_ex(&hctx, pass, passlen, digest, NULL);
-		HMAC_Update(&hctx, salt, saltlen);
-		HMAC_Update(&hctx, itmp, 4);
-		HMAC_Final(&hctx, digtmp, NULL);
-		memcpy(p, digtmp, cplen);
-		for(j = 1; j < iter; j++)
+		ctx = ictx;
+		SHA512_Update(&ctx, salt, saltlen);
+		SHA512_Update(&ctx, itmp, 4);
+		SHA512_Final(u, &ctx);
+		ctx = octx;
+		SHA512_Update(&ctx, u, SHA512_DIGEST_LENGTH);
+		SHA512_Final(u, &ctx);
+		memcpy(out, u, cplen);
+
+		for (j = 1; j < iter; j++)
 		{
-			HMAC(digest, pass, passlen,
-				 digtmp, mdlen, digtmp, NULL);
-			for(k = 0; k < cplen; k++)
-				p[k] ^= digtmp[k];
+			ctx = ictx;
+			SHA512_Update(&ctx, u, SHA512_DIGEST_LENGTH);
+			SHA512_Final(u, &ctx);
+			ctx = octx;
+			SHA512_Update(&ctx, u, SHA512_DIGEST_LENGTH);
+			SHA512_Final(u, &ctx);
+			for (k = 0; k < cplen; k++)
+				out[k] ^= u[k];
 		}
-		tkeylen-= cplen;
+
+		keylen -= cplen;
 		i++;
-		p+= cplen;
+		out += cplen;
 	}
-	HMAC_CTX_cleanup(&hctx);
-	return 1;
+
+	memset(key, 0, sizeof key);
+	memset(pad, 0, sizeof pad);
+	memset(&ictx, 0, sizeof ictx);
+	memset(&octx, 0, sizeof octx);
+	memset(&ctx, 0, sizeof ctx);
 }
 
 /*******************************************************************************************/
@@ -102,29 +121,39 @@ static const char *pbkdf2_salt(void)
 	return buf;
 }
 
-static const char *pbkdf2_crypt(const char *key, const char *salt)
+static const char *pbkdf2_crypt_r(const char *key, const char *salt, char *buf, size_t buflen)
 {
-	static char outbuf[PASSLEN];
-	static unsigned char digestbuf[SHA512_DIGEST_LENGTH];
-	int res, iter;
+	unsigned char digestbuf[SHA512_DIGEST_LENGTH];
+	int iter;
 
-	if (strlen(salt) < SALTLEN)
-		salt = pbkdf2_salt();
+	if (strlen(salt) < SALTLEN || buflen < SALTLEN + 2 * SHA512_DIGEST_LENGTH + 1)
+		return NULL;
 
-	memcpy(outbuf, salt, SALTLEN);
+	memcpy(buf, salt, SALTLEN);
 
-	res = PKCS5_PBKDF2_HMAC(key, strlen(key), (const unsigned char *)salt, SALTLEN, ROUNDS, EVP_sha512(), SHA512_DIGEST_LENGTH, digestbuf);
+	pbkdf2_hmac_sha512(key, strlen(key), (const unsigned char *)salt, SALTLEN, ROUNDS, digestbuf, SHA512_DIGEST_LENGTH);
 
 	for (iter = 0; iter < SHA512_DIGEST_LENGTH; iter++)
-		sprintf(outbuf + SALTLEN + (iter * 2), "%02x", 255 & digestbuf[iter]);
+		sprintf(buf + SALTLEN + (iter * 2), "%02x", 255 & digestbuf[iter]);
+
+	return buf;
+}
+
+static const char *pbkdf2_crypt(const char *key, const char *salt)
+{
+	static char outbuf[PASSLEN];
+
+	if (strlen(salt) < SALTLEN)
+		salt = pbkdf2_salt();
 
-	return outbuf;
+	return pbkdf2_crypt_r(key, salt, outbuf, sizeof outbuf);
 }
 
 static crypt_impl_t pbkdf2_crypt_impl = {
 	.id = "pbkdf2",
 	.crypt = &pbkdf2_crypt,
-	.salt = &pbkdf2_salt
+	.salt = &pbkdf2_salt,
+	.crypt_r = &pbkdf2_crypt_r,
 };
 
 void _modinit(module_t *m)
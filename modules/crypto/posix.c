@@ -203,13 +203,50 @@ static const char *(*crypt_impl_)(const char *key, const char *salt) = &stub_cry
 
 #endif
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+/* crypt() and openssl_md5crypt() use static buffers, so calls from
+ * password verification threads take turns with each other and with
+ * the main thread.
+ */
+static pthread_mutex_t posix_crypt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *posix_crypt_r(const char *key, const char *salt, char *buf, size_t buflen)
+{
+	const char *result;
+
+	pthread_mutex_lock(&posix_crypt_lock);
+	result = crypt_impl_(key, salt);
+	if (result != NULL && strlen(result) < buflen)
+		result = strcpy(buf, result);
+	else
+		result = NULL;
+	pthread_mutex_unlock(&posix_crypt_lock);
+
+	return result;
+}
+
+static const char *posix_crypt_string(const char *key, const char *salt)
+{
+	static char buf[BUFSIZE];
+
+	return posix_crypt_r(key, salt, buf, sizeof buf);
+}
+#endif
+
 static crypt_impl_t posix_crypt_impl = {
 	.id = "posix",
 };
 
 void _modinit(module_t *m)
 {
+#ifdef HAVE_PTHREAD
+	posix_crypt_impl.crypt = &posix_crypt_string;
+	posix_crypt_impl.crypt_r = &posix_crypt_r;
+#else
 	posix_crypt_impl.crypt = crypt_impl_;
+#endif
 
 #if defined(HAVE_CRYPT) || defined(HAVE_OPENSSL)
 	crypt_register(&posix_crypt_impl);
@@ -18,13 +18,15 @@ DECLARE_MODULE_V1
 
 #define RAWMD5_PREFIX "$rawmd5$"
 
-static const char *rawmd5_crypt_string(const char *key, const char *salt)
+static const char *rawmd5_crypt_r(const char *key, const char *salt, char *output, size_t outlen)
 {
-	static char output[2 * 16 + sizeof(RAWMD5_PREFIX)];
 	md5_state_t ctx;
 	unsigned char digest[16];
 	int i;
 
+	if (outlen < 2 * 16 + sizeof(RAWMD5_PREFIX))
+		return NULL;
+
 	md5_init(&ctx);
 	md5_append(&ctx, (const unsigned char *)key, strlen(key));
 	md5_finish(&ctx, digest);
@@ -37,9 +39,17 @@ static const char *rawmd5_crypt_string(const char *key, const char *salt)
 	return output;
 }
 
+static const char *rawmd5_crypt_string(const char *key, const char *salt)
+{
+	static char output[2 * 16 + sizeof(RAWMD5_PREFIX)];
+
+	return rawmd5_crypt_r(key, salt, output, sizeof output);
+}
+
 static crypt_impl_t rawmd5_crypt_impl = {
 	.id = "rawmd5",
 	.crypt = &rawmd5_crypt_string,
+	.crypt_r = &rawmd5_crypt_r,
 };
 
 void _modinit(module_t *m)
@@ -22,13 +22,15 @@ DECLARE_MODULE_V1
 
 #define RAWSHA1_PREFIX "$rawsha1$"
 
-static const char *rawsha1_crypt_string(const char *key, const char *salt)
+static const char *rawsha1_crypt_r(const char *key, const char *salt, char *output, size_t outlen)
 {
-	static char output[2 * SHA_DIGEST_LENGTH + sizeof(RAWSHA1_PREFIX)];
 	SHA_CTX ctx;
 	unsigned char digest[SHA_DIGEST_LENGTH];
 	int i;
 
+	if (outlen < 2 * SHA_DIGEST_LENGTH + sizeof(RAWSHA1_PREFIX))
+		return NULL;
+
 	SHA1_Init(&ctx);
 	SHA1_Update(&ctx, key, strlen(key));
 	SHA1_Final(digest, &ctx);
@@ -41,9 +43,17 @@ static const char *rawsha1_crypt_string(const char *key, const char *salt)
 	return output;
 }
 
+static const char *rawsha1_crypt_string(const char *key, const char *salt)
+{
+	static char output[2 * SHA_DIGEST_LENGTH + sizeof(RAWSHA1_PREFIX)];
+
+	return rawsha1_crypt_r(key, salt, output, sizeof output);
+}
+
 static crypt_impl_t rawsha1_crypt_impl = {
 	.id = "rawsha1",
 	.crypt = &rawsha1_crypt_string,
+	.crypt_r = &rawsha1_crypt_r,
 };
 
 void _modinit(module_t *m)
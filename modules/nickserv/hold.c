@@ -58,6 +58,8 @@ static void ns_cmd_hold(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mu->flags |= MU_HOLD;
+		hook_call_myuser_changed(mu);
+		myuser_reindex(mu);
 
 		wallops("%s set the HOLD option for the account \2%s\2.", get_oper_name(si), entity(mu)->name);
 		logcommand(si, CMDLOG_ADMIN, "HOLD:ON: \2%s\2", entity(mu)->name);
@@ -72,6 +74,8 @@ static void ns_cmd_hold(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		mu->flags &= ~MU_HOLD;
+		hook_call_myuser_changed(mu);
+		myuser_reindex(mu);
 
 		wallops("%s removed the HOLD option on the account \2%s\2.", get_oper_name(si), entity(mu)->name);
 		logcommand(si, CMDLOG_ADMIN, "HOLD:OFF: \2%s\2", entity(mu)->name);
@@ -25,6 +25,17 @@ DECLARE_MODULE_V1
 );
 
 static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[]);
+static void ns_login_user_delete(user_t *u);
+
+/* a login waiting for a password verification thread */
+typedef struct {
+	sourceinfo_t *si;
+	verify_request_t *req;
+	char *target;
+	mowgli_node_t node;
+} login_pending_t;
+
+static mowgli_list_t login_pending;
 
 #ifdef NICKSERV_LOGIN
 command_t ns_login = { "LOGIN", N_("Authenticates to a services account."), AC_NONE, 2, ns_cmd_login, { .path = "nickserv/login" } };
@@ -39,6 +50,17 @@ void _modinit(module_t *m)
 #else
 	service_named_bind_command("nickserv", &ns_identify);
 #endif
+
+	hook_add_event("user_delete");
+	hook_add_user_delete(ns_login_user_delete);
+}
+
+static void login_pending_free(login_pending_t *lp)
+{
+	mowgli_node_delete(&lp->node, &login_pending);
+	object_unref(lp->si);
+	free(lp->target);
+	free(lp);
 }
 
 void _moddeinit(module_unload_intent_t intent)
@@ -48,57 +70,45 @@ void _moddeinit(module_unload_intent_t intent)
 #else
 	service_named_unbind_command("nickserv", &ns_identify);
 #endif
-}
 
-static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
-{
-	user_t *u = si->su;
-	myuser_t *mu;
-	mowgli_node_t *n, *tn;
-	const char *target = parv[0];
-	const char *password = parv[1];
-	char lau[BUFSIZE];
+	hook_del_user_delete(ns_login_user_delete);
 
-	if (si->su == NULL)
+	while (login_pending.head != NULL)
 	{
-		command_fail(si, fault_noprivs, _("\2%s\2 can only be executed via IRC."), COMMAND_UC);
-		return;
-	}
+		login_pending_t *lp = login_pending.head->data;
 
-#ifndef NICKSERV_LOGIN
-	if (!nicksvs.no_nick_ownership && target && !password)
-	{
-		password = target;
-		target = si->su->nick;
+		verify_password_cancel(lp->req);
+		login_pending_free(lp);
 	}
-#endif
+}
 
-	if (!target || !password)
-	{
-		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, COMMAND_UC);
-		command_fail(si, fault_needmoreparams, nicksvs.no_nick_ownership ? "Syntax: " COMMAND_UC " <account> <password>" : "Syntax: " COMMAND_UC " [nick] <password>");
-		return;
-	}
+static void ns_login_user_delete(user_t *u)
+{
+	mowgli_node_t *n, *tn;
 
-	mu = myuser_find_by_nick(target);
-	if (!mu)
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, login_pending.head)
 	{
-		command_fail(si, fault_nosuch_target, _("\2%s\2 is not a registered nickname."), target);
-		return;
-	}
+		login_pending_t *lp = n->data;
 
-	if (metadata_find(mu, "private:freeze:freezer"))
-	{
-		command_fail(si, fault_authfail, nicksvs.no_nick_ownership ? "You cannot login as \2%s\2 because the account has been frozen." : "You cannot identify to \2%s\2 because the nickname has been frozen.", entity(mu)->name);
-		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (frozen)", entity(mu)->name);
-		return;
+		if (lp->si->su == u)
+		{
+			verify_password_cancel(lp->req);
+			login_pending_free(lp);
+		}
 	}
+}
+
+/* the rest of ns_cmd_login(), once the password has been checked */
+static void ns_login_verified(sourceinfo_t *si, myuser_t *mu, bool verified)
+{
+	user_t *u = si->su;
+	mowgli_node_t *n, *tn;
+	char lau[BUFSIZE];
 
+	/* these may have changed while the password was being checked */
 	if (u->myuser == mu)
 	{
 		command_fail(si, fault_nochange, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
-		if (mu->flags & MU_WAITAUTH)
-			command_fail(si, fault_nochange, _("Please check your email for instructions to complete your registration."));
 		return;
 	}
 	else if (u->myuser != NULL && !command_find(si->service->commands, "LOGOUT"))
@@ -107,7 +117,7 @@ static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	if (verify_password(mu, password))
+	if (verified)
 	{
 		if (MOWGLI_LIST_LENGTH(&mu->logins) >= me.maxlogins)
 		{
@@ -159,6 +169,105 @@ static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
 	bad_password(si, mu);
 }
 
+static void ns_login_resume(myuser_t *mu, bool verified, void *priv)
+{
+	login_pending_t *lp = priv;
+	sourceinfo_t *si = lp->si;
+
+	if (mu == NULL)
+		command_fail(si, fault_nosuch_target, _("\2%s\2 is not a registered nickname."), lp->target);
+	else
+		ns_login_verified(si, mu, verified);
+
+	login_pending_free(lp);
+}
+
+static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
+{
+	user_t *u = si->su;
+	myuser_t *mu;
+	mowgli_node_t *n;
+	login_pending_t *lp;
+	const char *target = parv[0];
+	const char *password = parv[1];
+
+	if (si->su == NULL)
+	{
+		command_fail(si, fault_noprivs, _("\2%s\2 can only be executed via IRC."), COMMAND_UC);
+		return;
+	}
+
+#ifndef NICKSERV_LOGIN
+	if (!nicksvs.no_nick_ownership && target && !password)
+	{
+		password = target;
+		target = si->su->nick;
+	}
+#endif
+
+	if (!target || !password)
+	{
+		command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, COMMAND_UC);
+		command_fail(si, fault_needmoreparams, nicksvs.no_nick_ownership ? "Syntax: " COMMAND_UC " <account> <password>" : "Syntax: " COMMAND_UC " [nick] <password>");
+		return;
+	}
+
+	mu = myuser_find_by_nick(target);
+	if (!mu)
+	{
+		command_fail(si, fault_nosuch_target, _("\2%s\2 is not a registered nickname."), target);
+		return;
+	}
+
+	if (metadata_find(mu, "private:freeze:freezer"))
+	{
+		command_fail(si, fault_authfail, nicksvs.no_nick_ownership ? "You cannot login as \2%s\2 because the account has been frozen." : "You cannot identify to \2%s\2 because the nickname has been frozen.", entity(mu)->name);
+		logcommand(si, CMDLOG_LOGIN, "failed " COMMAND_UC " to \2%s\2 (frozen)", entity(mu)->name);
+		return;
+	}
+
+	if (u->myuser == mu)
+	{
+		command_fail(si, fault_nochange, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+		if (mu->flags & MU_WAITAUTH)
+			command_fail(si, fault_nochange, _("Please check your email for instructions to complete your registration."));
+		return;
+	}
+	else if (u->myuser != NULL && !command_find(si->service->commands, "LOGOUT"))
+	{
+		command_fail(si, fault_alreadyexists, _("You are already logged in as \2%s\2."), entity(u->myuser)->name);
+		return;
+	}
+
+	MOWGLI_ITER_FOREACH(n, login_pending.head)
+	{
+		if (((login_pending_t *)n->data)->si->su == u)
+		{
+			command_fail(si, fault_alreadyexists, _("Your previous %s has not completed yet."), COMMAND_UC);
+			return;
+		}
+	}
+
+	lp = smalloc(sizeof *lp);
+
+	switch (verify_password_async(mu, password, ns_login_resume, lp, &lp->req))
+	{
+	case VERIFY_PENDING:
+		lp->si = object_ref(si);
+		lp->target = sstrdup(target);
+		mowgli_node_add(lp, &lp->node, &login_pending);
+		return;
+	case VERIFY_OK:
+		free(lp);
+		ns_login_verified(si, mu, true);
+		return;
+	default:
+		free(lp);
+		ns_login_verified(si, mu, false);
+		return;
+	}
+}
+
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
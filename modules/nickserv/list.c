@@ -199,49 +199,213 @@ static void list_one(sourceinfo_t *si, myuser_t *mu, mynick_t *mn)
 		command_success_nodata(si, "- %s (%s) (%s) %s", mn->nick, mu->email, entity(mu)->name, buf);
 }
 
+typedef struct {
+	sourceinfo_t *si;
+	char *nickpattern, *hostpattern, *email;
+	char *markpattern, *frozenpattern, *restrictedpattern;
+	bool frozen, marked, restricted;
+	unsigned int flagset;
+	time_t age, lastlogin;
+	int matches;
+} list_query_t;
+
+/* everything but the nick pattern */
+static bool list_account_matches(list_query_t *q, myuser_t *mu)
+{
+	metadata_t *md;
+	bool hostmatch;
+
+	if (q->hostpattern)
+	{
+		hostmatch = false;
+		md = metadata_find(mu, "private:host:actual");
+		if (md != NULL && !match(q->hostpattern, md->value))
+			hostmatch = true;
+		md = metadata_find(mu, "private:host:vhost");
+		if (md != NULL && !match(q->hostpattern, md->value))
+			hostmatch = true;
+		if (!hostmatch)
+			return false;
+	}
+
+	if (q->email && match(q->email, mu->email))
+		return false;
+
+	if (q->markpattern)
+	{
+		md = metadata_find(mu, "private:mark:reason");
+		if (md == NULL || match(q->markpattern, md->value))
+			return false;
+	}
+
+	if (q->frozenpattern)
+	{
+		md = metadata_find(mu, "private:freeze:reason");
+		if (md == NULL || match(q->frozenpattern, md->value))
+			return false;
+	}
+
+	if (q->restrictedpattern)
+	{
+		md = metadata_find(mu, "private:restrict:reason");
+		if (md == NULL || match(q->restrictedpattern, md->value))
+			return false;
+	}
+
+	if (q->marked && !metadata_find(mu, "private:mark:setter"))
+		return false;
+
+	if (q->frozen && !metadata_find(mu, "private:freeze:freezer"))
+		return false;
+
+	if (q->restricted && !metadata_find(mu, "private:restrict:setter"))
+		return false;
+
+	if (q->flagset && (mu->flags & q->flagset) != q->flagset)
+		return false;
+
+	if (q->age && (CURRTIME - mu->registered) < q->age)
+		return false;
+
+	if (q->lastlogin && (CURRTIME - mu->lastlogin) < q->lastlogin)
+		return false;
+
+	return true;
+}
+
+static void list_nick_cb(void *obj, void *priv)
+{
+	list_query_t *q = priv;
+	mynick_t *mn = obj;
+
+	if (q->nickpattern && match(q->nickpattern, mn->nick))
+		return;
+	if (!list_account_matches(q, mn->owner))
+		return;
+
+	list_one(q->si, NULL, mn);
+	q->matches++;
+}
+
+/* an account candidate; with nick ownership, stands for all its nicks */
+static void list_account_cb(void *obj, void *priv)
+{
+	list_query_t *q = priv;
+	myuser_t *mu = obj;
+	mowgli_node_t *n;
+
+	if (!nicksvs.no_nick_ownership)
+	{
+		MOWGLI_ITER_FOREACH(n, mu->nicks.head)
+			list_nick_cb(n->data, q);
+		return;
+	}
+
+	if (q->nickpattern && match(q->nickpattern, entity(mu)->name))
+		return;
+	if (!list_account_matches(q, mu))
+		return;
+
+	list_one(q->si, mu, NULL);
+	q->matches++;
+}
+
+typedef enum {
+	SRC_SCAN,
+	SRC_NICK,
+	SRC_EMAIL,
+	SRC_MARKED,
+	SRC_FROZEN,
+	SRC_RESTRICTED,
+	SRC_HELD,
+	SRC_REGISTERED,
+	SRC_LASTLOGIN,
+} list_source_t;
+
+/* pick the index that yields the fewest candidates */
+static list_source_t list_plan(list_query_t *q, myuser_index_t *idx)
+{
+	list_source_t best = SRC_SCAN;
+	unsigned int bestcount = TRIGRAM_NOINDEX, n;
+
+#define CONSIDER(src, count) \
+	do { \
+		n = (count); \
+		if (n < bestcount) \
+		{ \
+			best = (src); \
+			bestcount = n; \
+		} \
+	} while (0)
+
+	if (q->nickpattern)
+		CONSIDER(SRC_NICK, trigram_index_estimate(nicksvs.no_nick_ownership ? idx->names : idx->nicks, q->nickpattern));
+	if (q->email)
+		CONSIDER(SRC_EMAIL, trigram_index_estimate(idx->emails, q->email));
+	if (q->marked)
+		CONSIDER(SRC_MARKED, MOWGLI_LIST_LENGTH(&idx->marked->objects));
+	if (q->frozen)
+		CONSIDER(SRC_FROZEN, MOWGLI_LIST_LENGTH(&idx->frozen->objects));
+	if (q->restricted)
+		CONSIDER(SRC_RESTRICTED, MOWGLI_LIST_LENGTH(&idx->restricted->objects));
+	if (q->flagset & MU_HOLD)
+		CONSIDER(SRC_HELD, MOWGLI_LIST_LENGTH(&idx->held));
+	if (q->age)
+		CONSIDER(SRC_REGISTERED, timeheap_count_before(&idx->registered, CURRTIME - q->age, bestcount));
+	if (q->lastlogin)
+		CONSIDER(SRC_LASTLOGIN, timeheap_count_before(&idx->lastlogin, CURRTIME - q->lastlogin, bestcount));
+
+#undef CONSIDER
+
+	return best;
+}
+
+static void list_foreach_node(mowgli_list_t *l, list_query_t *q)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, l->head)
+		list_account_cb(n->data, q);
+}
+
 static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 {
 	char criteriastr[BUFSIZE];
-	char pat[512], *pattern = NULL, *nickpattern = NULL, *hostpattern = NULL, *p, *email = NULL, *markpattern = NULL, *frozenpattern = NULL, *restrictedpattern = NULL;
-	bool hostmatch, markmatch, frozenmatch, restrictedmatch;
+	char pat[512], *pattern = NULL, *p;
 	mowgli_patricia_iteration_state_t state;
 	myentity_iteration_state_t mestate;
-	myuser_t *mu;
 	myentity_t *mt;
 	mynick_t *mn;
-	metadata_t *md, *mdmark, *mdfrozen, *mdrestricted;
-	int matches = 0;
-	bool frozen = false, marked = false, restricted = false;
-	unsigned int flagset = 0;
-	time_t age = 0, lastlogin = 0;
+	myuser_index_t *idx;
+	list_query_t q = { .si = si };
 
 	list_option_t optstable[] = {
 		{"pattern",	OPT_STRING,	{.strval = &pattern}, 0},
-		{"email",	OPT_STRING,	{.strval = &email}, 0},
-		{"mail",	OPT_STRING,	{.strval = &email}, 0},
-		{"mark-reason", OPT_STRING,	{.strval = &markpattern}, 0},
-		{"frozen-reason", OPT_STRING,   {.strval = &frozenpattern}, 0},
-		{"restricted-reason", OPT_STRING, {.strval = &restrictedpattern}, 0},
-		{"noexpire",	OPT_FLAG,	{.flagval = &flagset}, MU_HOLD},
-		{"held",	OPT_FLAG,	{.flagval = &flagset}, MU_HOLD},
-		{"hold",	OPT_FLAG,	{.flagval = &flagset}, MU_HOLD},
-		{"noop",	OPT_FLAG,	{.flagval = &flagset}, MU_NOOP},
-		{"neverop",	OPT_FLAG,	{.flagval = &flagset}, MU_NEVEROP},
-		{"nevergroup",  OPT_FLAG,	{.flagval = &flagset}, MU_NEVERGROUP},
-		{"waitauth",	OPT_FLAG,	{.flagval = &flagset}, MU_WAITAUTH},
-		{"hidemail",	OPT_FLAG,	{.flagval = &flagset}, MU_HIDEMAIL},
-		{"nomemo",	OPT_FLAG,	{.flagval = &flagset}, MU_NOMEMO},
-		{"emailmemos",	OPT_FLAG,	{.flagval = &flagset}, MU_EMAILMEMOS},
-		{"use-privmsg",	OPT_FLAG,	{.flagval = &flagset}, MU_USE_PRIVMSG},
-		{"private",	OPT_FLAG,	{.flagval = &flagset}, MU_PRIVATE},
-		{"quietchg",	OPT_FLAG,	{.flagval = &flagset}, MU_QUIETCHG},
-		{"nogreet",	OPT_FLAG,	{.flagval = &flagset}, MU_NOGREET},
-		{"regnolimit",	OPT_FLAG,	{.flagval = &flagset}, MU_REGNOLIMIT},
-		{"frozen",	OPT_BOOL,	{.boolval = &frozen}, 0},
-		{"marked",	OPT_BOOL,	{.boolval = &marked}, 0},
-		{"restricted",	OPT_BOOL,	{.boolval = &restricted}, 0},
-		{"registered",	OPT_AGE,	{.ageval = &age}, 0},
-		{"lastlogin",	OPT_AGE,	{.ageval = &lastlogin}, 0},
+		{"email",	OPT_STRING,	{.strval = &q.email}, 0},
+		{"mail",	OPT_STRING,	{.strval = &q.email}, 0},
+		{"mark-reason", OPT_STRING,	{.strval = &q.markpattern}, 0},
+		{"frozen-reason", OPT_STRING,   {.strval = &q.frozenpattern}, 0},
+		{"restricted-reason", OPT_STRING, {.strval = &q.restrictedpattern}, 0},
+		{"noexpire",	OPT_FLAG,	{.flagval = &q.flagset}, MU_HOLD},
+		{"held",	OPT_FLAG,	{.flagval = &q.flagset}, MU_HOLD},
+		{"hold",	OPT_FLAG,	{.flagval = &q.flagset}, MU_HOLD},
+		{"noop",	OPT_FLAG,	{.flagval = &q.flagset}, MU_NOOP},
+		{"neverop",	OPT_FLAG,	{.flagval = &q.flagset}, MU_NEVEROP},
+		{"nevergroup",  OPT_FLAG,	{.flagval = &q.flagset}, MU_NEVERGROUP},
+		{"waitauth",	OPT_FLAG,	{.flagval = &q.flagset}, MU_WAITAUTH},
+		{"hidemail",	OPT_FLAG,	{.flagval = &q.flagset}, MU_HIDEMAIL},
+		{"nomemo",	OPT_FLAG,	{.flagval = &q.flagset}, MU_NOMEMO},
+		{"emailmemos",	OPT_FLAG,	{.flagval = &q.flagset}, MU_EMAILMEMOS},
+		{"use-privmsg",	OPT_FLAG,	{.flagval = &q.flagset}, MU_USE_PRIVMSG},
+		{"private",	OPT_FLAG,	{.flagval = &q.flagset}, MU_PRIVATE},
+		{"quietchg",	OPT_FLAG,	{.flagval = &q.flagset}, MU_QUIETCHG},
+		{"nogreet",	OPT_FLAG,	{.flagval = &q.flagset}, MU_NOGREET},
+		{"regnolimit",	OPT_FLAG,	{.flagval = &q.flagset}, MU_REGNOLIMIT},
+		{"frozen",	OPT_BOOL,	{.boolval = &q.frozen}, 0},
+		{"marked",	OPT_BOOL,	{.boolval = &q.marked}, 0},
+		{"restricted",	OPT_BOOL,	{.boolval = &q.restricted}, 0},
+		{"registered",	OPT_AGE,	{.ageval = &q.age}, 0},
+		{"lastlogin",	OPT_AGE,	{.ageval = &q.lastlogin}, 0},
 	};
 
 	if (!process_parvarray(si, optstable, ARRAY_SIZE(optstable), parc, parv))
@@ -258,179 +422,68 @@ static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 		if (p != NULL)
 		{
 			*p++ = '\0';
-			nickpattern = pat;
-			hostpattern = p;
+			q.nickpattern = pat;
+			q.hostpattern = p;
 		}
 		else if (strchr(pat, '@'))
-			hostpattern = pat;
+			q.hostpattern = pat;
 		else
-			nickpattern = pat;
-		if (nickpattern && !strcmp(nickpattern, "*"))
-			nickpattern = NULL;
+			q.nickpattern = pat;
+		if (q.nickpattern && !strcmp(q.nickpattern, "*"))
+			q.nickpattern = NULL;
 	}
 
-	if (nicksvs.no_nick_ownership)
+	idx = myuser_index();
+
+	switch (list_plan(&q, idx))
 	{
-		MYENTITY_FOREACH_T(mt, &mestate, ENT_USER)
+	case SRC_NICK:
+		if (nicksvs.no_nick_ownership)
+			trigram_index_search(idx->names, q.nickpattern, list_account_cb, &q);
+		else
+			trigram_index_search(idx->nicks, q.nickpattern, list_nick_cb, &q);
+		break;
+	case SRC_EMAIL:
+		trigram_index_search(idx->emails, q.email, list_account_cb, &q);
+		break;
+	case SRC_MARKED:
+		list_foreach_node(&idx->marked->objects, &q);
+		break;
+	case SRC_FROZEN:
+		list_foreach_node(&idx->frozen->objects, &q);
+		break;
+	case SRC_RESTRICTED:
+		list_foreach_node(&idx->restricted->objects, &q);
+		break;
+	case SRC_HELD:
+		list_foreach_node(&idx->held, &q);
+		break;
+	case SRC_REGISTERED:
+		myuser_index_foreach_registered(CURRTIME - q.age, (myuser_index_cb_t) list_account_cb, &q);
+		break;
+	case SRC_LASTLOGIN:
+		myuser_index_foreach_lastlogin(CURRTIME - q.lastlogin, (myuser_index_cb_t) list_account_cb, &q);
+		break;
+	case SRC_SCAN:
+	default:
+		if (nicksvs.no_nick_ownership)
 		{
-			mu = user(mt);
-			if (nickpattern && match(nickpattern, entity(mu)->name))
-				continue;
-			if (hostpattern)
-			{
-				hostmatch = false;
-				md = metadata_find(mu, "private:host:actual");
-				if (md != NULL && !match(hostpattern, md->value))
-					hostmatch = true;
-				md = metadata_find(mu, "private:host:vhost");
-				if (md != NULL && !match(hostpattern, md->value))
-					hostmatch = true;
-				if (!hostmatch)
-					continue;
-			}
-
-			if (email && match(email, mu->email))
-				continue;
-
-			if (markpattern)
-			{
-				markmatch = false;
-				mdmark = metadata_find(mu, "private:mark:reason");
-				if (mdmark != NULL && !match(markpattern, mdmark->value))
-					markmatch = true;
-
-				if (!markmatch)
-					continue;
-			}
-
-			if (frozenpattern)
-			{
-				frozenmatch = false;
-				mdfrozen = metadata_find(mu, "private:freeze:reason");
-				if (mdfrozen != NULL && !match(frozenpattern, mdfrozen->value))
-					frozenmatch = true;
-
-				if (!frozenmatch)
-					continue;
-			}
-
-			if (restrictedpattern)
-			{
-				restrictedmatch = false;
-				mdrestricted = metadata_find(mu, "private:restrict:reason");
-				if (mdrestricted != NULL && !match(restrictedpattern, mdrestricted->value))
-					restrictedmatch = true;
-
-				if (!restrictedmatch)
-					continue;
-			}
-
-			if (marked && !metadata_find(mu, "private:mark:setter"))
-				continue;
-
-			if (frozen && !metadata_find(mu, "private:freeze:freezer"))
-				continue;
-
-			if (restricted && !metadata_find(mu, "private:restrict:setter"))
-				continue;
-
-			if (flagset && (mu->flags & flagset) != flagset)
-				continue;
-
-			if (age && (CURRTIME - mu->registered) < age)
-				continue;
-
-			if (lastlogin && (CURRTIME - mu->lastlogin) < lastlogin)
-				continue;
-
-			list_one(si, mu, NULL);
-			matches++;
+			MYENTITY_FOREACH_T(mt, &mestate, ENT_USER)
+				list_account_cb(user(mt), &q);
 		}
-	}
-	else
-	{
-		MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+		else
 		{
-			if (nickpattern && match(nickpattern, mn->nick))
-				continue;
-			mu = mn->owner;
-			if (hostpattern)
-			{
-				hostmatch = false;
-				md = metadata_find(mu, "private:host:actual");
-				if (md != NULL && !match(hostpattern, md->value))
-					hostmatch = true;
-				md = metadata_find(mu, "private:host:vhost");
-				if (md != NULL && !match(hostpattern, md->value))
-					hostmatch = true;
-				if (!hostmatch)
-					continue;
-			}
-
-			if (email && match(email, mu->email))
-				continue;
-
-			if (markpattern)
-			{
-				markmatch = false;
-				mdmark = metadata_find(mu, "private:mark:reason");
-				if (mdmark != NULL && !match(markpattern, mdmark->value))
-					markmatch = true;
-
-				if (!markmatch)
-					continue;
-			}
-
-			if (frozenpattern)
-			{
-				frozenmatch = false;
-				mdfrozen = metadata_find(mu, "private:freeze:reason");
-				if (mdfrozen != NULL && !match(frozenpattern, mdfrozen->value))
-					frozenmatch = true;
-
-				if (!frozenmatch)
-					continue;
-			}
-			
-			if (restrictedpattern)
-			{
-				restrictedmatch = false;
-				mdrestricted = metadata_find(mu, "private:restrict:reason");
-				if (mdrestricted != NULL && !match(restrictedpattern, mdrestricted->value))
-					restrictedmatch = true;
-
-				if (!restrictedmatch)
-					continue;
-			}
-
-			if (marked && !metadata_find(mu, "private:mark:setter"))
-				continue;
-
-			if (frozen && !metadata_find(mu, "private:freeze:freezer"))
-				continue;
-			
-			if (restricted && !metadata_find(mu, "private:restrict:setter"))
-				continue;
-
-			if (flagset && (mu->flags & flagset) != flagset)
-				continue;
-
-			if (age && (CURRTIME - mu->registered) < age)
-				continue;
-
-			if (lastlogin && (CURRTIME - mu->lastlogin) < lastlogin)
-				continue;
-
-			list_one(si, NULL, mn);
-			matches++;
+			MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+				list_nick_cb(mn, &q);
 		}
+		break;
 	}
 
-	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", criteriastr, matches);
-	if (matches == 0)
+	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", criteriastr, q.matches);
+	if (q.matches == 0)
 		command_success_nodata(si, _("No nicknames matched criteria \2%s\2"), criteriastr);
 	else
-		command_success_nodata(si, ngettext(N_("\2%d\2 match for criteria \2%s\2"), N_("\2%d\2 matches for criteria \2%s\2"), matches), matches, criteriastr);
+		command_success_nodata(si, ngettext(N_("\2%d\2 match for criteria \2%s\2"), N_("\2%d\2 matches for criteria \2%s\2"), q.matches), q.matches, criteriastr);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -37,28 +37,44 @@ struct listmail_state
 	int matches;
 };
 
+static void listmail_one(struct listmail_state *state, myuser_t *mu)
+{
+	/* in the future we could add a LIMIT parameter */
+	if (state->matches == 0)
+		command_success_nodata(state->origin, "Accounts matching e-mail address \2%s\2:", state->pattern);
+
+	command_success_nodata(state->origin, "- %s (%s)", entity(mu)->name, mu->email);
+	state->matches++;
+}
+
 static int listmail_foreach_cb(myentity_t *mt, void *privdata)
 {
 	struct listmail_state *state = (struct listmail_state *) privdata;
 	myuser_t *mu = user(mt);
 
 	if (state->email_canonical == mu->email_canonical || !match(state->pattern, mu->email))
-	{
-		/* in the future we could add a LIMIT parameter */
-		if (state->matches == 0)
-			command_success_nodata(state->origin, "Accounts matching e-mail address \2%s\2:", state->pattern);
-
-		command_success_nodata(state->origin, "- %s (%s)", entity(mu)->name, mu->email);
-		state->matches++;
-	}
+		listmail_one(state, mu);
 
 	return 0;
 }
 
+/* the canonical matches have been listed already */
+static void listmail_index_cb(void *obj, void *privdata)
+{
+	struct listmail_state *state = (struct listmail_state *) privdata;
+	myuser_t *mu = obj;
+
+	if (state->email_canonical != mu->email_canonical && !match(state->pattern, mu->email))
+		listmail_one(state, mu);
+}
+
 static void ns_cmd_listmail(sourceinfo_t *si, int parc, char *parv[])
 {
 	char *email = parv[0];
 	struct listmail_state state;
+	myuser_index_t *idx;
+	mowgli_list_t *l;
+	mowgli_node_t *n;
 
 	if (!email)
 	{
@@ -71,7 +87,22 @@ static void ns_cmd_listmail(sourceinfo_t *si, int parc, char *parv[])
 	state.pattern = email;
 	state.email_canonical = canonicalize_email(email);
 	state.origin = si;
-	myentity_foreach_t(ENT_USER, listmail_foreach_cb, &state);
+
+	/* without a literal run in the pattern the index cannot help */
+	idx = myuser_index();
+	if (trigram_index_estimate(idx->emails, email) == TRIGRAM_NOINDEX)
+		myentity_foreach_t(ENT_USER, listmail_foreach_cb, &state);
+	else
+	{
+		if ((l = myuser_email_canonical_list(state.email_canonical)) != NULL)
+		{
+			MOWGLI_ITER_FOREACH(n, l->head)
+				listmail_one(&state, n->data);
+		}
+
+		trigram_index_search(idx->emails, email, listmail_index_cb, &state);
+	}
+
 	strshare_unref(state.email_canonical);
 
 	logcommand(si, CMDLOG_ADMIN, "LISTMAIL: \2%s\2 (\2%d\2 matches)", email, state.matches);
@@ -63,6 +63,7 @@ static void ns_cmd_set_language(sourceinfo_t *si, int parc, char *parv[])
 	logcommand(si, CMDLOG_SET, "SET:LANGUAGE: \2%s\2", language_get_name(lang));
 
 	si->smu->language = lang;
+	hook_call_myuser_changed(si->smu);
 
 	command_success_nodata(si, _("The language for \2%s\2 has been changed to \2%s\2."), entity(si->smu)->name, language_get_name(lang));
 
@@ -57,6 +57,7 @@ static void ns_cmd_set_neverop(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NEVEROP:ON");
 
 		si->smu->flags |= MU_NEVEROP;
+		hook_call_myuser_changed(si->smu);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "NEVEROP", entity(si->smu)->name);
 
@@ -74,6 +75,7 @@ static void ns_cmd_set_neverop(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NEVEROP:OFF");
 
 		si->smu->flags &= ~MU_NEVEROP;
+		hook_call_myuser_changed(si->smu);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NEVEROP", entity(si->smu)->name);
 
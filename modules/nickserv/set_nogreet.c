@@ -57,6 +57,7 @@ static void ns_cmd_set_nogreet(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NOGREET:ON");
 
 		si->smu->flags |= MU_NOGREET;
+		hook_call_myuser_changed(si->smu);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been set for account \2%s\2."), "NOGREET" ,entity(si->smu)->name);
 
@@ -73,6 +74,7 @@ static void ns_cmd_set_nogreet(sourceinfo_t *si, int parc, char *parv[])
 		logcommand(si, CMDLOG_SET, "SET:NOGREET:OFF");
 
 		si->smu->flags &= ~MU_NOGREET;
+		hook_call_myuser_changed(si->smu);
 
 		command_success_nodata(si, _("The \2%s\2 flag has been removed for account \2%s\2."), "NOGREET", entity(si->smu)->name);
 
@@ -8,6 +8,11 @@
 
 #include "atheme.h"
 
+#include <sys/mman.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 DECLARE_MODULE_V1
 (
 	"operserv/greplog", false, _modinit, _moddeinit,
@@ -16,20 +21,757 @@ DECLARE_MODULE_V1
 );
 
 static void os_cmd_greplog(sourceinfo_t *si, int parc, char *parv[]);
+static void greplog_user_delete(user_t *u);
+static void greplog_stop(void);
 
 command_t os_greplog = { "GREPLOG", N_("Searches through the logs."), PRIV_CHAN_AUSPEX, 3, os_cmd_greplog, { .path = "oservice/greplog" } };
 
 void _modinit(module_t *m)
 {
 	service_named_bind_command("operserv", &os_greplog);
+
+	hook_add_event("user_delete");
+	hook_add_user_delete(greplog_user_delete);
 }
 
 void _moddeinit(module_unload_intent_t intent)
 {
 	service_named_unbind_command("operserv", &os_greplog);
+
+	hook_del_user_delete(greplog_user_delete);
+	greplog_stop();
 }
 
 #define MAXMATCHES 100
+#define MAXDAYS 120
+
+/*
+ * Rotated logs get a sidecar index, <logfile>.idx, the first time they are
+ * searched; they do not change after that. The log is cut into blocks at
+ * line boundaries and each block gets a bloom filter of the case folded
+ * three character substrings of its lines, so blocks that cannot contain
+ * the literal parts of the pattern (or the service name) are skipped
+ * without being looked at.
+ */
+#define INDEX_MAGIC		0x474c4931	/* "GLI1" */
+#define INDEX_BLOCKSIZE		8192
+#define INDEX_BLOOMBITS		4096
+#define INDEX_BLOOMBYTES	(INDEX_BLOOMBITS / 8)
+#define MAXTRIGRAMS		64
+
+typedef struct {
+	uint32_t magic;
+	uint32_t bloombits;
+	uint64_t logsize;
+	int64_t logmtime;
+	uint64_t nblocks;
+} greplog_index_header_t;
+
+typedef struct {
+	size_t nblocks;
+	uint64_t *offsets;		/* nblocks + 1 entries */
+	unsigned char *blooms;		/* nblocks * INDEX_BLOOMBYTES */
+} greplog_index_t;
+
+typedef struct greplog_job_ greplog_job_t;
+typedef struct greplog_result_ greplog_result_t;
+
+/* a line of output, or the end of a search, on its way to the main thread */
+struct greplog_result_
+{
+	greplog_job_t *job;
+	greplog_result_t *next;
+	bool done;
+	char text[];
+};
+
+struct greplog_job_
+{
+	sourceinfo_t *si;
+	char *service;
+	char *pattern;
+	char *files[MAXDAYS + 1];
+	unsigned int nfiles;
+
+	uint32_t bits[MAXTRIGRAMS * 2];	/* bloom bits every hit must have */
+	unsigned int nbits;
+
+	int matches;
+	bool async;
+	bool cancelled;			/* under greplog_lock if async */
+	greplog_result_t done;
+
+	greplog_job_t *next;		/* in the worker's queue */
+	mowgli_node_t node;
+};
+
+static mowgli_list_t greplog_jobs;
+
+#ifdef HAVE_PTHREAD
+static pthread_t greplog_thread;
+static pthread_mutex_t greplog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t greplog_wake = PTHREAD_COND_INITIALIZER;
+static greplog_job_t *greplog_queue_head, *greplog_queue_tail;
+static greplog_result_t *greplog_results_head, *greplog_results_tail;
+static bool greplog_started, greplog_stopping;
+static int greplog_pipe[2] = { -1, -1 };
+static connection_t *greplog_conn;
+#endif
+
+/* case folding that is at least as loose as any match() casemapping */
+static inline unsigned char greplog_fold(unsigned char c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c + ('a' - 'A');
+	switch (c)
+	{
+		case '{': return '[';
+		case '}': return ']';
+		case '|': return '\\';
+		case '^': return '~';
+	}
+	return c;
+}
+
+static inline uint32_t greplog_trigram_hash(unsigned char a, unsigned char b, unsigned char c)
+{
+	uint32_t h = (uint32_t)a << 16 | (uint32_t)b << 8 | c;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return h;
+}
+
+static void greplog_add_literal(greplog_job_t *job, const unsigned char *s, size_t len)
+{
+	uint32_t h;
+	size_t i;
+
+	for (i = 0; i + 3 <= len && job->nbits + 2 <= MAXTRIGRAMS * 2; i++)
+	{
+		h = greplog_trigram_hash(s[i], s[i + 1], s[i + 2]);
+		job->bits[job->nbits++] = h % INDEX_BLOOMBITS;
+		job->bits[job->nbits++] = (h >> 16) % INDEX_BLOOMBITS;
+	}
+}
+
+/* collect the runs of plain characters in the pattern and the service */
+static void greplog_query_trigrams(greplog_job_t *job)
+{
+	unsigned char run[BUFSIZE];
+	size_t len = 0;
+	const char *p;
+	unsigned char c;
+
+	for (p = job->pattern; *p != '\0'; p++)
+	{
+		if (*p == '\\' && p[1] != '\0' && strchr("*?&#%", p[1]) != NULL)
+			c = *++p;
+		else if (strchr("*?&#%", *p) != NULL || (unsigned char)*p >= 0x80)
+		{
+			greplog_add_literal(job, run, len);
+			len = 0;
+			continue;
+		}
+		else
+			c = *p;
+
+		if (len < sizeof run)
+			run[len++] = greplog_fold(c);
+	}
+	greplog_add_literal(job, run, len);
+
+	if (strcmp(job->service, "*"))
+	{
+		for (p = job->service, len = 0; *p != '\0' && len < sizeof run; p++)
+			run[len++] = greplog_fold(*p);
+		greplog_add_literal(job, run, len);
+	}
+}
+
+static void greplog_index_free(greplog_index_t *idx)
+{
+	free(idx->offsets);
+	free(idx->blooms);
+	idx->offsets = NULL;
+	idx->blooms = NULL;
+	idx->nblocks = 0;
+}
+
+static bool greplog_index_load(const char *path, const struct stat *sb, greplog_index_t *idx)
+{
+	greplog_index_header_t hdr;
+	FILE *f;
+	size_t i;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		return false;
+
+	if (fread(&hdr, sizeof hdr, 1, f) != 1 || hdr.magic != INDEX_MAGIC ||
+			hdr.bloombits != INDEX_BLOOMBITS ||
+			hdr.logsize != (uint64_t)sb->st_size ||
+			hdr.logmtime != (int64_t)sb->st_mtime ||
+			hdr.nblocks > (uint64_t)sb->st_size / INDEX_BLOCKSIZE + 1)
+	{
+		fclose(f);
+		return false;
+	}
+
+	idx->nblocks = hdr.nblocks;
+	idx->offsets = malloc((idx->nblocks + 1) * sizeof(uint64_t));
+	idx->blooms = malloc(idx->nblocks * INDEX_BLOOMBYTES + 1);
+	if (idx->offsets == NULL || idx->blooms == NULL ||
+			fread(idx->offsets, sizeof(uint64_t), idx->nblocks + 1, f) != idx->nblocks + 1 ||
+			fread(idx->blooms, INDEX_BLOOMBYTES, idx->nblocks, f) != idx->nblocks)
+	{
+		fclose(f);
+		greplog_index_free(idx);
+		return false;
+	}
+	fclose(f);
+
+	for (i = 0; i < idx->nblocks; i++)
+		if (idx->offsets[i] > idx->offsets[i + 1])
+			break;
+	if (i < idx->nblocks || idx->offsets[0] != 0 || idx->offsets[idx->nblocks] != hdr.logsize)
+	{
+		greplog_index_free(idx);
+		return false;
+	}
+
+	return true;
+}
+
+static bool greplog_index_build(const unsigned char *buf, size_t len, greplog_index_t *idx)
+{
+	size_t start, end, i;
+	unsigned char *bloom, a, b, c;
+	uint32_t h;
+
+	idx->nblocks = 0;
+	idx->offsets = malloc((len / INDEX_BLOCKSIZE + 2) * sizeof(uint64_t));
+	idx->blooms = calloc(len / INDEX_BLOCKSIZE + 1, INDEX_BLOOMBYTES);
+	if (idx->offsets == NULL || idx->blooms == NULL)
+	{
+		greplog_index_free(idx);
+		return false;
+	}
+
+	for (start = 0; start < len; start = end)
+	{
+		/* blocks end after a newline, so no line spans two of them */
+		end = start + INDEX_BLOCKSIZE;
+		if (end >= len)
+			end = len;
+		else
+		{
+			while (end < len && buf[end - 1] != '\n')
+				end++;
+		}
+
+		bloom = idx->blooms + idx->nblocks * INDEX_BLOOMBYTES;
+		a = b = '\n';
+		for (i = start; i < end; i++)
+		{
+			c = greplog_fold(buf[i]);
+			if (a != '\n' && b != '\n' && c != '\n')
+			{
+				h = greplog_trigram_hash(a, b, c);
+				bloom[(h % INDEX_BLOOMBITS) >> 3] |= 1 << (h % 8);
+				bloom[((h >> 16) % INDEX_BLOOMBITS) >> 3] |= 1 << ((h >> 16) % 8);
+			}
+			a = b;
+			b = c;
+		}
+
+		idx->offsets[idx->nblocks++] = start;
+	}
+	idx->offsets[idx->nblocks] = len;
+
+	return true;
+}
+
+static void greplog_index_save(const char *path, const struct stat *sb, const greplog_index_t *idx)
+{
+	greplog_index_header_t hdr;
+	char tmppath[BUFSIZE];
+	FILE *f;
+	bool ok;
+
+	memset(&hdr, 0, sizeof hdr);
+	hdr.magic = INDEX_MAGIC;
+	hdr.bloombits = INDEX_BLOOMBITS;
+	hdr.logsize = sb->st_size;
+	hdr.logmtime = sb->st_mtime;
+	hdr.nblocks = idx->nblocks;
+
+	snprintf(tmppath, sizeof tmppath, "%s.tmp", path);
+	if ((f = fopen(tmppath, "wb")) == NULL)
+		return;
+
+	ok = fwrite(&hdr, sizeof hdr, 1, f) == 1 &&
+		fwrite(idx->offsets, sizeof(uint64_t), idx->nblocks + 1, f) == idx->nblocks + 1 &&
+		fwrite(idx->blooms, INDEX_BLOOMBYTES, idx->nblocks, f) == idx->nblocks;
+	if (fclose(f) != 0)
+		ok = false;
+
+	if (!ok || rename(tmppath, path) < 0)
+		unlink(tmppath);
+}
+
+static bool greplog_block_wanted(const greplog_job_t *job, const unsigned char *bloom)
+{
+	unsigned int i;
+
+	for (i = 0; i < job->nbits; i++)
+		if (!(bloom[job->bits[i] >> 3] & (1 << (job->bits[i] % 8))))
+			return false;
+	return true;
+}
+
+static bool greplog_cancelled(greplog_job_t *job)
+{
+	bool cancelled;
+
+#ifdef HAVE_PTHREAD
+	if (job->async)
+	{
+		pthread_mutex_lock(&greplog_lock);
+		cancelled = job->cancelled;
+		pthread_mutex_unlock(&greplog_lock);
+		return cancelled;
+	}
+#endif
+
+	cancelled = job->cancelled;
+	return cancelled;
+}
+
+#ifdef HAVE_PTHREAD
+static void greplog_post(greplog_result_t *r)
+{
+	bool wasempty;
+
+	pthread_mutex_lock(&greplog_lock);
+	r->next = NULL;
+	wasempty = greplog_results_head == NULL;
+	if (wasempty)
+		greplog_results_head = r;
+	else
+		greplog_results_tail->next = r;
+	greplog_results_tail = r;
+	pthread_mutex_unlock(&greplog_lock);
+
+	if (wasempty)
+		(void)write(greplog_pipe[1], "", 1);
+}
+#endif
+
+/* send a line to the oper, from whichever thread is doing the search */
+static void greplog_emit(greplog_job_t *job, const char *fmt, ...)
+{
+	char buf[BUFSIZE * 2];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, sizeof buf, fmt, ap);
+	va_end(ap);
+
+#ifdef HAVE_PTHREAD
+	if (job->async)
+	{
+		greplog_result_t *r;
+		size_t len = strlen(buf);
+
+		/* not smalloc(), this runs in the worker */
+		if ((r = malloc(sizeof *r + len + 1)) == NULL)
+			return;
+		r->job = job;
+		r->done = false;
+		memcpy(r->text, buf, len + 1);
+		greplog_post(r);
+		return;
+	}
+#endif
+
+	command_success_nodata(job->si, "%s", buf);
+}
+
+/* returns false once there are enough matches */
+static bool greplog_line(greplog_job_t *job, const char *line, size_t len, int *lines, int *linesv)
+{
+	char str[1024];
+	char *p, *q;
+
+	if (len >= sizeof str)
+		len = sizeof str - 1;
+	memcpy(str, line, len);
+	str[len] = '\0';
+
+	(*lines)++;
+	p = *str == '[' ? strchr(str, ']') : NULL;
+	if (p == NULL)
+		return true;
+	p++;
+	if (*p++ != ' ')
+		return true;
+	q = strchr(p, ' ');
+	if (q == NULL)
+		return true;
+	(*linesv)++;
+	*q = '\0';
+	if (strcmp(job->service, "*") && strcasecmp(job->service, p))
+		return true;
+	*q++ = ' ';
+	if (match(job->pattern, q))
+		return true;
+
+	job->matches++;
+	greplog_emit(job, "[%d] %s", job->matches, str);
+	return job->matches < MAXMATCHES;
+}
+
+/* newest lines first, like the log is read back to front */
+static bool greplog_scan(greplog_job_t *job, const char *buf, size_t start, size_t end, int *lines, int *linesv)
+{
+	size_t s, e;
+
+	while (end > start)
+	{
+		e = end;
+		if (buf[e - 1] == '\n')
+			e--;
+		for (s = e; s > start && buf[s - 1] != '\n'; s--)
+			;
+		if (!greplog_line(job, buf + s, e - s, lines, linesv))
+			return false;
+		end = s;
+	}
+	return true;
+}
+
+/* today's log is still being written to, so it is read rather than mapped */
+static char *greplog_map(int fd, size_t len, bool live)
+{
+	char *buf;
+	ssize_t n;
+	size_t got = 0;
+
+	if (!live)
+	{
+		buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		return buf != MAP_FAILED ? buf : NULL;
+	}
+
+	if ((buf = malloc(len)) == NULL)
+		return NULL;
+	while (got < len && (n = read(fd, buf + got, len - got)) > 0)
+		got += n;
+	if (got < len)
+		memset(buf + got, '\n', len - got);
+	return buf;
+}
+
+static void greplog_search_file(greplog_job_t *job, const char *logfile, bool live, int *lines, int *linesv)
+{
+	struct stat sb;
+	greplog_index_t idx = { 0, NULL, NULL };
+	char idxpath[BUFSIZE];
+	char *buf;
+	size_t len, i, start, end;
+	int fd;
+
+	if ((fd = open(logfile, O_RDONLY)) < 0)
+	{
+		greplog_emit(job, "Failed to open log file %s", logfile);
+		return;
+	}
+	if (job->matches == -1)
+		job->matches = 0;
+
+	if (fstat(fd, &sb) < 0 || sb.st_size == 0)
+	{
+		close(fd);
+		return;
+	}
+	len = sb.st_size;
+
+	if ((buf = greplog_map(fd, len, live)) == NULL)
+	{
+		close(fd);
+		greplog_emit(job, "Failed to read log file %s", logfile);
+		return;
+	}
+	close(fd);
+
+	if (!live && job->nbits > 0)
+	{
+		snprintf(idxpath, sizeof idxpath, "%s.idx", logfile);
+		if (!greplog_index_load(idxpath, &sb, &idx) &&
+				greplog_index_build((const unsigned char *)buf, len, &idx))
+			greplog_index_save(idxpath, &sb, &idx);
+	}
+
+	if (idx.nblocks > 0)
+	{
+		for (i = idx.nblocks; i-- > 0; )
+		{
+			if (greplog_cancelled(job))
+				break;
+			if (!greplog_block_wanted(job, idx.blooms + i * INDEX_BLOOMBYTES))
+				continue;
+			if (!greplog_scan(job, buf, idx.offsets[i], idx.offsets[i + 1], lines, linesv))
+				break;
+		}
+	}
+	else
+	{
+		for (end = len; end > 0; end = start)
+		{
+			if (greplog_cancelled(job))
+				break;
+			start = end > INDEX_BLOCKSIZE ? end - INDEX_BLOCKSIZE : 0;
+			while (start > 0 && buf[start - 1] != '\n')
+				start--;
+			if (!greplog_scan(job, buf, start, end, lines, linesv))
+				break;
+		}
+	}
+
+	greplog_index_free(&idx);
+	if (live)
+		free(buf);
+	else
+		munmap(buf, len);
+}
+
+static void greplog_run(greplog_job_t *job)
+{
+	unsigned int i;
+	int lines, linesv;
+
+	for (i = 0; i < job->nfiles; i++)
+	{
+		if (greplog_cancelled(job))
+			return;
+
+		lines = linesv = 0;
+		greplog_search_file(job, job->files[i], i == 0, &lines, &linesv);
+
+		if (job->matches == 0 && lines > linesv && lines > 0)
+			greplog_emit(job, "Log file may be corrupted, %d/%d unexpected lines", lines - linesv, lines);
+		if (job->matches >= MAXMATCHES)
+		{
+			greplog_emit(job, "Too many matches, halting search");
+			break;
+		}
+	}
+}
+
+static void greplog_job_free(greplog_job_t *job)
+{
+	unsigned int i;
+
+	mowgli_node_delete(&job->node, &greplog_jobs);
+	object_unref(job->si);
+	free(job->service);
+	free(job->pattern);
+	for (i = 0; i < job->nfiles; i++)
+		free(job->files[i]);
+	free(job);
+}
+
+/* the end of os_cmd_greplog(), once the search is over */
+static void greplog_finish(greplog_job_t *job)
+{
+	sourceinfo_t *si = job->si;
+	int matches = job->matches;
+
+	if (job->cancelled)
+	{
+		greplog_job_free(job);
+		return;
+	}
+
+	logcommand(si, CMDLOG_ADMIN, "GREPLOG: \2%s\2 \2%s\2 (\2%d\2 matches)", job->service, job->pattern, matches);
+	if (matches == 0)
+		command_success_nodata(si, _("No lines matched pattern \2%s\2"), job->pattern);
+	else if (matches > 0)
+		command_success_nodata(si, ngettext(N_("\2%d\2 match for pattern \2%s\2"),
+						    N_("\2%d\2 matches for pattern \2%s\2"), matches), matches, job->pattern);
+
+	greplog_job_free(job);
+}
+
+static void greplog_user_delete(user_t *u)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, greplog_jobs.head)
+	{
+		greplog_job_t *job = n->data;
+
+		if (job->si->su != u)
+			continue;
+
+#ifdef HAVE_PTHREAD
+		pthread_mutex_lock(&greplog_lock);
+		job->cancelled = true;
+		pthread_mutex_unlock(&greplog_lock);
+#else
+		job->cancelled = true;
+#endif
+	}
+}
+
+#ifdef HAVE_PTHREAD
+static void *greplog_worker_main(void *arg)
+{
+	greplog_job_t *job;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&greplog_lock);
+		while (greplog_queue_head == NULL && !greplog_stopping)
+			pthread_cond_wait(&greplog_wake, &greplog_lock);
+		job = greplog_queue_head;
+		if (job == NULL)
+		{
+			pthread_mutex_unlock(&greplog_lock);
+			break;
+		}
+		greplog_queue_head = job->next;
+		if (greplog_queue_head == NULL)
+			greplog_queue_tail = NULL;
+		pthread_mutex_unlock(&greplog_lock);
+
+		greplog_run(job);
+
+		/* the job belongs to the main thread again after this */
+		job->done.job = job;
+		job->done.done = true;
+		greplog_post(&job->done);
+	}
+
+	return NULL;
+}
+
+static void greplog_results_read(connection_t *cptr)
+{
+	greplog_result_t *r, *next;
+	char buf[64];
+
+	while (read(cptr->fd, buf, sizeof buf) > 0)
+		;
+
+	pthread_mutex_lock(&greplog_lock);
+	r = greplog_results_head;
+	greplog_results_head = greplog_results_tail = NULL;
+	pthread_mutex_unlock(&greplog_lock);
+
+	for (; r != NULL; r = next)
+	{
+		next = r->next;
+		if (r->done)
+		{
+			greplog_finish(r->job);
+			continue;
+		}
+		if (!r->job->cancelled)
+			command_success_nodata(r->job->si, "%s", r->text);
+		free(r);
+	}
+}
+
+static bool greplog_start(void)
+{
+	sigset_t all, old;
+	int ret;
+
+	if (greplog_started)
+		return true;
+
+	if (pipe(greplog_pipe) < 0)
+	{
+		slog(LG_ERROR, "greplog_start(): pipe() failed: %s", strerror(errno));
+		return false;
+	}
+	fcntl(greplog_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(greplog_pipe[1], F_SETFL, O_NONBLOCK);
+
+	/* signals are for the main thread */
+	greplog_stopping = false;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	ret = pthread_create(&greplog_thread, NULL, greplog_worker_main, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (ret != 0)
+	{
+		slog(LG_ERROR, "greplog_start(): unable to start search thread");
+		close(greplog_pipe[0]);
+		close(greplog_pipe[1]);
+		return false;
+	}
+
+	greplog_conn = connection_add("greplog results pipe", greplog_pipe[0], 0, greplog_results_read, NULL);
+	greplog_started = true;
+	return true;
+}
+
+static void greplog_stop(void)
+{
+	mowgli_node_t *n;
+
+	if (!greplog_started)
+		return;
+
+	pthread_mutex_lock(&greplog_lock);
+	MOWGLI_ITER_FOREACH(n, greplog_jobs.head)
+		((greplog_job_t *)n->data)->cancelled = true;
+	greplog_stopping = true;
+	pthread_cond_signal(&greplog_wake);
+	pthread_mutex_unlock(&greplog_lock);
+
+	pthread_join(greplog_thread, NULL);
+	greplog_started = false;
+
+	/* throws away what is left and frees the jobs */
+	greplog_results_read(greplog_conn);
+	connection_close(greplog_conn);
+	close(greplog_pipe[1]);
+	greplog_conn = NULL;
+}
+
+static bool greplog_queue(greplog_job_t *job)
+{
+	/* other sources need their replies before the command returns */
+	if (job->si->su == NULL || !greplog_start())
+		return false;
+
+	job->async = true;
+	mowgli_node_add(job, &job->node, &greplog_jobs);
+
+	pthread_mutex_lock(&greplog_lock);
+	job->next = NULL;
+	if (greplog_queue_tail != NULL)
+		greplog_queue_tail->next = job;
+	else
+		greplog_queue_head = job;
+	greplog_queue_tail = job;
+	pthread_cond_signal(&greplog_wake);
+	pthread_mutex_unlock(&greplog_lock);
+
+	return true;
+}
+#else
+static void greplog_stop(void) { }
+static inline bool greplog_queue(greplog_job_t *job) { return false; }
+#endif
+
 
 static const char *get_logfile(const unsigned int *masks)
 {
@@ -73,15 +815,11 @@ static const char *get_account_log(void)
 static void os_cmd_greplog(sourceinfo_t *si, int parc, char *parv[])
 {
 	const char *service, *pattern, *baselog;
-	int maxdays, matches = -1, matches1, day, days, lines, linesv;
-	FILE *in;
-	char str[1024];
-	char *p, *q;
+	int maxdays, day, days;
 	char logfile[256];
 	time_t t;
 	struct tm tm;
-	mowgli_list_t loglines = { NULL, NULL, 0 };
-	mowgli_node_t *n, *tn;
+	greplog_job_t *job;
 
 	/* require user, channel and server auspex
 	 * (channel auspex checked via in command_t)
@@ -110,7 +848,7 @@ static void os_cmd_greplog(sourceinfo_t *si, int parc, char *parv[])
 	if (parc >= 3)
 	{
 		days = atoi(parv[2]);
-		maxdays = !strcmp(service, "*") ? 120 : 30;
+		maxdays = !strcmp(service, "*") ? MAXDAYS : 30;
 		if (days < 0 || days > maxdays)
 		{
 			command_fail(si, fault_badparams, _("Too many days, maximum is %d."), maxdays);
@@ -127,6 +865,12 @@ static void os_cmd_greplog(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
+	job = smalloc(sizeof *job);
+	job->si = object_ref(si);
+	job->service = sstrdup(service);
+	job->pattern = sstrdup(pattern);
+	job->matches = -1;
+
 	for (day = 0; day <= days; day++)
 	{
 		if (day == 0)
@@ -139,74 +883,17 @@ static void os_cmd_greplog(sourceinfo_t *si, int parc, char *parv[])
 					baselog, tm.tm_year + 1900,
 					tm.tm_mon + 1, tm.tm_mday);
 		}
-		in = fopen(logfile, "r");
-		if (in == NULL)
-		{
-			command_success_nodata(si, "Failed to open log file %s", logfile);
-			continue;
-		}
-		if (matches == -1)
-			matches = 0;
-		matches1 = matches;
-		lines = linesv = 0;
-		while (fgets(str, sizeof str, in) != NULL)
-		{
-			p = strchr(str, '\n');
-			if (p != NULL)
-				*p = '\0';
-			lines++;
-			p = *str == '[' ? strchr(str, ']') : NULL;
-			if (p == NULL)
-				continue;
-			p++;
-			if (*p++ != ' ')
-				continue;
-			q = strchr(p, ' ');
-			if (q == NULL)
-				continue;
-			linesv++;
-			*q = '\0';
-			if (strcmp(service, "*") && strcasecmp(service, p))
-				continue;
-			*q++ = ' ';
-			if (match(pattern, q))
-				continue;
-			matches++;
-			mowgli_node_add_head(sstrdup(str), mowgli_node_create(), &loglines);
-			if (matches > MAXMATCHES)
-			{
-				n = loglines.tail;
-				mowgli_node_delete(n, &loglines);
-				free(n->data);
-				mowgli_node_free(n);
-			}
-		}
-		fclose(in);
-		matches = matches1;
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, loglines.head)
-		{
-			p = n->data;
-			matches++;
-			command_success_nodata(si, "[%d] %s", matches, p);
-			mowgli_node_delete(n, &loglines);
-			free(n->data);
-			mowgli_node_free(n);
-		}
-		if (matches == 0 && lines > linesv && lines > 0)
-			command_success_nodata(si, "Log file may be corrupted, %d/%d unexpected lines", lines - linesv, lines);
-		if (matches >= MAXMATCHES)
-		{
-			command_success_nodata(si, "Too many matches, halting search");
-			break;
-		}
+		job->files[job->nfiles++] = sstrdup(logfile);
 	}
 
-	logcommand(si, CMDLOG_ADMIN, "GREPLOG: \2%s\2 \2%s\2 (\2%d\2 matches)", service, pattern, matches);
-	if (matches == 0)
-		command_success_nodata(si, _("No lines matched pattern \2%s\2"), pattern);
-	else if (matches > 0)
-		command_success_nodata(si, ngettext(N_("\2%d\2 match for pattern \2%s\2"),
-						    N_("\2%d\2 matches for pattern \2%s\2"), matches), matches, pattern);
+	greplog_query_trigrams(job);
+
+	if (greplog_queue(job))
+		return;
+
+	mowgli_node_add(job, &job->node, &greplog_jobs);
+	greplog_run(job);
+	greplog_finish(job);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -39,6 +39,7 @@ void _moddeinit(module_unload_intent_t intent)
 static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 {
 	atheme_regex_t *regex;
+	regex_set_t *set;
 	char usermask[512];
 	unsigned int matches = 0, maxmatches;
 	mowgli_patricia_iteration_state_t state;
@@ -83,12 +84,16 @@ static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 		command_fail(si, fault_badparams, _("The provided regex \2%s\2 is invalid."), pattern);
 		return;
 	}
-		
+
+	/* the set's literal prefilter rejects most clients without regexec */
+	set = regex_set_create();
+	regex_set_add(set, regex, pattern, flags, NULL);
+
 	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
 	{
 		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
 
-		if (regex_match(regex, usermask))
+		if (regex_set_match(set, usermask, NULL, NULL))
 		{
 			matches++;
 			if (matches <= maxmatches)
@@ -101,6 +106,7 @@ static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 		}
 	}
 	
+	regex_set_destroy(set);
 	regex_destroy(regex);
 	command_success_nodata(si, _("\2%d\2 matches for %s"), matches, pattern);
 	logcommand(si, CMDLOG_ADMIN, "RMATCH: \2%s\2 (\2%d\2 matches)", pattern, matches);
@@ -32,6 +32,7 @@ static void db_h_rr(database_handle_t *db, const char *type);
 mowgli_patricia_t *os_rwatch_cmds;
 
 mowgli_list_t rwatch_list;
+static regex_set_t *rwatch_set;
 
 #define RWACT_SNOOP 		1
 #define RWACT_KLINE 		2
@@ -47,6 +48,14 @@ struct rwatch_
 	atheme_regex_t *re;
 };
 
+/* what the per-pattern match callbacks need to know about the client */
+typedef struct {
+	user_t *u;
+	char *usermask;
+	char *oldusermask;
+	const char *oldnick;
+} rwatch_match_t;
+
 command_t os_rwatch = { "RWATCH", N_("Performs actions on connecting clients matching regexes."), PRIV_USER_AUSPEX, 2, os_cmd_rwatch, { .path = "oservice/rwatch" } };
 
 command_t os_rwatch_add = { "ADD", N_("Adds an entry to the regex watch list."), AC_NONE, 1, os_cmd_rwatch_add, { .path = "" } };
@@ -62,6 +71,7 @@ void _modinit(module_t *m)
 	service_named_bind_command("operserv", &os_rwatch);
 
 	os_rwatch_cmds = mowgli_patricia_create(strcasecanon);
+	rwatch_set = regex_set_create();
 
 	command_add(&os_rwatch_add, os_rwatch_cmds);
 	command_add(&os_rwatch_del, os_rwatch_cmds);
@@ -108,6 +118,8 @@ void _moddeinit(module_unload_intent_t intent)
 		mowgli_node_free(n);
 	}
 
+	regex_set_destroy(rwatch_set);
+
 	service_named_unbind_command("operserv", &os_rwatch);
 
 	command_delete(&os_rwatch_add, os_rwatch_cmds);
@@ -189,6 +201,8 @@ static void load_rwatchdb(char *path)
 				rw->actions = atoi(actionstr);
 				rw->reason = sstrdup(reason);
 				mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+				if (rw->re != NULL)
+					regex_set_add(rwatch_set, rw->re, rw->regex, rw->reflags, rw);
 				rw = NULL;
 			}
 		}
@@ -235,6 +249,8 @@ static void db_h_rr(database_handle_t *db, const char *type)
 	rwread->actions = actions;
 	rwread->reason = sstrdup(reason);
 	mowgli_node_add(rwread, mowgli_node_create(), &rwatch_list);
+	if (rwread->re != NULL)
+		regex_set_add(rwatch_set, rwread->re, rwread->regex, rwread->reflags, rwread);
 	rwread = NULL;
 }
 
@@ -323,6 +339,7 @@ static void os_cmd_rwatch_add(sourceinfo_t *si, int parc, char *parv[])
 	rw->re = regex;
 
 	mowgli_node_add(rw, mowgli_node_create(), &rwatch_list);
+	regex_set_add(rwatch_set, rw->re, rw->regex, rw->reflags, rw);
 	command_success_nodata(si, _("Added \2%s\2 to regex watch list."), pattern);
 	logcommand(si, CMDLOG_ADMIN, "RWATCH:ADD: \2%s\2 (reason: \2%s\2)", pattern, reason);
 }
@@ -373,6 +390,7 @@ static void os_cmd_rwatch_del(sourceinfo_t *si, int parc, char *parv[])
 				}
 				wallops("\2%s\2 disabled quarantine on regex watch pattern \2%s\2", get_oper_name(si), pattern);
 			}
+			regex_set_delete(rwatch_set, rw);
 			free(rw->regex);
 			free(rw->reason);
 			if (rw->re != NULL)
@@ -513,12 +531,52 @@ static void os_cmd_rwatch_set(sourceinfo_t *si, int parc, char *parv[])
 	command_fail(si, fault_nosuch_target, _("\2%s\2 not found in regex watch list."), pattern);
 }
 
+static void rwatch_newuser_match(void *priv, void *arg)
+{
+	rwatch_t *rw = priv;
+	rwatch_match_t *m = arg;
+
+	if (rw->actions & RWACT_SNOOP)
+	{
+		slog(LG_INFO, "RWATCH:%s \2%s\2 matches \2%s\2 (reason: \2%s\2)",
+				rw->actions & RWACT_KLINE ? "KLINE:" : "",
+				m->usermask, rw->regex, rw->reason);
+	}
+	if (rw->actions & RWACT_KLINE)
+	{
+		if (is_autokline_exempt(m->u))
+			slog(LG_INFO, "rwatch_newuser(): not klining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
+					m->u->host, m->u->nick, m->u->user, m->u->host,
+					rw->regex, rw->reason);
+		else
+		{
+			slog(LG_VERBOSE, "rwatch_newuser(): klining *@%s (user %s!%s@%s matches %s %s)",
+					m->u->host, m->u->nick, m->u->user, m->u->host,
+					rw->regex, rw->reason);
+			kline_sts("*", "*", m->u->host, 86400, rw->reason);
+		}
+	}
+	else if (rw->actions & RWACT_QUARANTINE)
+	{
+		if (is_autokline_exempt(m->u))
+			slog(LG_INFO, "rwatch_newuser(): not qurantining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
+					m->u->host, m->u->nick, m->u->user, m->u->host,
+					rw->regex, rw->reason);
+		else
+		{
+			slog(LG_VERBOSE, "rwatch_newuser(): quaranting *@%s (user %s!%s@%s matches %s %s)",
+					m->u->host, m->u->nick, m->u->user, m->u->host,
+					rw->regex, rw->reason);
+			quarantine_sts(service_find("operserv")->me, m->u, 86400, rw->reason);
+		}
+	}
+}
+
 static void rwatch_newuser(hook_user_nick_t *data)
 {
 	user_t *u = data->u;
 	char usermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
-	mowgli_node_t *n;
-	rwatch_t *rw;
+	rwatch_match_t m;
 
 	/* If the user has been killed, don't do anything. */
 	if (!u)
@@ -529,47 +587,53 @@ static void rwatch_newuser(hook_user_nick_t *data)
 
 	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
 
-	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
+	m.u = u;
+	m.usermask = usermask;
+	m.oldusermask = NULL;
+	m.oldnick = NULL;
+	regex_set_match(rwatch_set, usermask, rwatch_newuser_match, &m);
+}
+
+static void rwatch_nickchange_match(void *priv, void *arg)
+{
+	rwatch_t *rw = priv;
+	rwatch_match_t *m = arg;
+
+	/* Only process if they did not match before. */
+	if (regex_match(rw->re, m->oldusermask))
+		return;
+	if (rw->actions & RWACT_SNOOP)
 	{
-		rw = n->data;
-		if (!rw->re)
-			continue;
-		if (regex_match(rw->re, usermask))
+		slog(LG_INFO, "RWATCH:NICKCHANGE:%s \2%s\2 -> \2%s\2 matches \2%s\2 (reason: \2%s\2)",
+				rw->actions & RWACT_KLINE ? "KLINE:" : "",
+				m->oldnick, m->usermask, rw->regex, rw->reason);
+	}
+	if (rw->actions & RWACT_KLINE)
+	{
+		if (is_autokline_exempt(m->u))
+			slog(LG_INFO, "rwatch_nickchange(): not klining *@%s (user %s -> %s!%s@%s is autokline exempt but matches %s %s)",
+					m->u->host, m->oldnick, m->u->nick, m->u->user, m->u->host,
+					rw->regex, rw->reason);
+		else
 		{
-			if (rw->actions & RWACT_SNOOP)
-			{
-				slog(LG_INFO, "RWATCH:%s \2%s\2 matches \2%s\2 (reason: \2%s\2)",
-						rw->actions & RWACT_KLINE ? "KLINE:" : "",
-						usermask, rw->regex, rw->reason);
-			}
-			if (rw->actions & RWACT_KLINE)
-			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "rwatch_newuser(): not klining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "rwatch_newuser(): klining *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					kline_sts("*", "*", u->host, 86400, rw->reason);
-				}
-			}
-			else if (rw->actions & RWACT_QUARANTINE)
-			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "rwatch_newuser(): not qurantining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "rwatch_newuser(): quaranting *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
-				}
-			}
+			slog(LG_VERBOSE, "rwatch_nickchange(): klining *@%s (user %s -> %s!%s@%s matches %s %s)",
+					m->u->host, m->oldnick, m->u->nick, m->u->user, m->u->host,
+					rw->regex, rw->reason);
+			kline_sts("*", "*", m->u->host, 86400, rw->reason);
+		}
+	}
+	else if (rw->actions & RWACT_QUARANTINE)
+	{
+		if (is_autokline_exempt(m->u))
+			slog(LG_INFO, "rwatch_newuser(): not qurantining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
+					m->u->host, m->u->nick, m->u->user, m->u->host,
+					rw->regex, rw->reason);
+		else
+		{
+			slog(LG_VERBOSE, "rwatch_newuser(): quaranting *@%s (user %s!%s@%s matches %s %s)",
+					m->u->host, m->u->nick, m->u->user, m->u->host,
+					rw->regex, rw->reason);
+			quarantine_sts(service_find("operserv")->me, m->u, 86400, rw->reason);
 		}
 	}
 }
@@ -579,8 +643,7 @@ static void rwatch_nickchange(hook_user_nick_t *data)
 	user_t *u = data->u;
 	char usermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
 	char oldusermask[NICKLEN+USERLEN+HOSTLEN+GECOSLEN];
-	mowgli_node_t *n;
-	rwatch_t *rw;
+	rwatch_match_t m;
 
 	/* If the user has been killed, don't do anything. */
 	if (!u)
@@ -592,52 +655,11 @@ static void rwatch_nickchange(hook_user_nick_t *data)
 	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
 	snprintf(oldusermask, sizeof oldusermask, "%s!%s@%s %s", data->oldnick, u->user, u->host, u->gecos);
 
-	MOWGLI_ITER_FOREACH(n, rwatch_list.head)
-	{
-		rw = n->data;
-		if (!rw->re)
-			continue;
-		if (regex_match(rw->re, usermask))
-		{
-			/* Only process if they did not match before. */
-			if (regex_match(rw->re, oldusermask))
-				continue;
-			if (rw->actions & RWACT_SNOOP)
-			{
-				slog(LG_INFO, "RWATCH:NICKCHANGE:%s \2%s\2 -> \2%s\2 matches \2%s\2 (reason: \2%s\2)",
-						rw->actions & RWACT_KLINE ? "KLINE:" : "",
-						data->oldnick, usermask, rw->regex, rw->reason);
-			}
-			if (rw->actions & RWACT_KLINE)
-			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "rwatch_nickchange(): not klining *@%s (user %s -> %s!%s@%s is autokline exempt but matches %s %s)",
-							u->host, data->oldnick, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "rwatch_nickchange(): klining *@%s (user %s -> %s!%s@%s matches %s %s)",
-							u->host, data->oldnick, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					kline_sts("*", "*", u->host, 86400, rw->reason);
-				}
-			}
-			else if (rw->actions & RWACT_QUARANTINE)
-			{
-				if (is_autokline_exempt(u))
-					slog(LG_INFO, "rwatch_newuser(): not qurantining *@%s (user %s!%s@%s is autokline exempt but matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-				else
-				{
-					slog(LG_VERBOSE, "rwatch_newuser(): quaranting *@%s (user %s!%s@%s matches %s %s)",
-							u->host, u->nick, u->user, u->host,
-							rw->regex, rw->reason);
-					quarantine_sts(service_find("operserv")->me, u, 86400, rw->reason);
-				}
-			}
-		}
-	}
+	m.u = u;
+	m.usermask = usermask;
+	m.oldusermask = oldusermask;
+	m.oldnick = data->oldnick;
+	regex_set_match(rwatch_set, usermask, rwatch_nickchange_match, &m);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -367,7 +367,7 @@ static void m_pong(sourceinfo_t *si, int parc, char *parv[])
 #ifdef HAVE_GETTIMEOFDAY
 		e_time(burstime, &burstime);
 
-		slog(LG_INFO, "m_pong(): finished synching with uplink (%d %s)", (tv2ms(&burstime) > 1000) ? (tv2ms(&burstime) / 1000) : tv2ms(&burstime), (tv2ms(&burstime) > 1000) ? "s" : "ms");
+		slog(LG_INFO, "m_pong(): finished synching with uplink (%d %s, %u lines, %u lines/s)", (tv2ms(&burstime) > 1000) ? (tv2ms(&burstime) / 1000) : tv2ms(&burstime), (tv2ms(&burstime) > 1000) ? "s" : "ms", burstlines, burst_lines_per_sec());
 
 		wallops("Finished synchronizing with network in %d %s.", (tv2ms(&burstime) > 1000) ? (tv2ms(&burstime) / 1000) : tv2ms(&burstime), (tv2ms(&burstime) > 1000) ? "s" : "ms");
 #else
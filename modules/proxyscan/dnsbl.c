@@ -58,6 +58,11 @@
  *	"dnsbl.dronebl.org";
  *	"rbl.efnetrbl.org";
  * };
+ *
+ * Answers are cached per address and blacklist, for dnsbl_positive_ttl
+ * (default 1 hour) if the address is listed and dnsbl_negative_ttl
+ * (default 10 minutes) if not; 0 disables caching. Lookups that time out
+ * or fail are not cached.
  */
 
 #include "atheme.h"
@@ -85,14 +90,31 @@ struct Blacklist {
 	mowgli_node_t node;
 };
 
-/* A lookup in progress for a particular DNSBL for a particular client */
-struct BlacklistClient {
+/* A lookup of one address in one DNSBL, in flight or cached */
+struct BlacklistLookup {
+	char *name;		/* query name, e.g. 2.0.0.127.dnsbl.example.org */
 	struct Blacklist *blacklist;
-	user_t *u;
+	bool pending;
+	bool listed;
+	time_t expires;
 	dns_query_t dns_query;
-	mowgli_node_t node;
+	mowgli_list_t clients;	/* waiting for the answer */
+};
+
+/* A client waiting for a lookup in progress */
+struct BlacklistClient {
+	struct BlacklistLookup *lookup;
+	user_t *u;
+	mowgli_node_t node;	/* in lookup->clients */
+	mowgli_node_t unode;	/* in dnsbl_queries(u) */
 };
 
+/* query name -> struct BlacklistLookup */
+static mowgli_patricia_t *dnsbl_cache;
+static mowgli_eventloop_timer_t *dnsbl_expire_timer;
+static unsigned int dnsbl_positive_ttl, dnsbl_negative_ttl;
+static unsigned int dnsbl_cache_hits, dnsbl_cache_misses, dnsbl_coalesced;
+
 struct dnsbl_exempt_ {
 	char *ip;
 	time_t exempt_ts;
@@ -310,74 +332,170 @@ static struct Blacklist *find_blacklist(char *name)
 	return NULL;
 }
 
+static void dnsbl_client_free(struct BlacklistClient *blcptr)
+{
+	mowgli_node_delete(&blcptr->node, &blcptr->lookup->clients);
+	mowgli_node_delete(&blcptr->unode, dnsbl_queries(blcptr->u));
+	free(blcptr);
+}
+
+static void dnsbl_lookup_free(struct BlacklistLookup *lookup)
+{
+	mowgli_node_t *n, *tn;
+
+	if (lookup->pending)
+		delete_resolver_queries(&lookup->dns_query);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, lookup->clients.head)
+		dnsbl_client_free(n->data);
+
+	lookup->blacklist->refcount--;
+	mowgli_patricia_delete(dnsbl_cache, lookup->name);
+	free(lookup->name);
+	free(lookup);
+}
+
 static void blacklist_dns_callback(void *vptr, dns_reply_t *reply)
 {
-	struct BlacklistClient *blcptr = (struct BlacklistClient *) vptr;
-	int listed = 0;
-	mowgli_list_t *l;
+	struct BlacklistLookup *lookup = (struct BlacklistLookup *) vptr;
+	struct BlacklistClient *blcptr;
+	mowgli_node_t *n, *tn;
 
-	if (blcptr == NULL)
+	if (lookup == NULL)
 		return;
 
-	if (blcptr->u == NULL)
-	{
-		free(blcptr);
-		return;
-	}
+	lookup->pending = false;
 
 	if (reply != NULL)
 	{
 		/* only accept 127.x.y.z as a listing */
 		if (reply->addr.saddr.sa.sa_family == AF_INET &&
 				!memcmp(&((struct sockaddr_in *)&reply->addr)->sin_addr, "\177", 1))
-			listed++;
-		else if (blcptr->blacklist->lastwarning + 3600 < CURRTIME)
+			lookup->listed = true;
+		else if (lookup->blacklist->lastwarning + 3600 < CURRTIME)
 		{
 			slog(LG_DEBUG,
 					"Garbage reply from blacklist %s",
-					blcptr->blacklist->host);
-			blcptr->blacklist->lastwarning = CURRTIME;
+					lookup->blacklist->host);
+			lookup->blacklist->lastwarning = CURRTIME;
 		}
 	}
 
-	/* they have a blacklist entry for this client */
-	if (listed)
+	/* a timeout or a server failure says nothing about the address */
+	if (reply == NULL && !lookup->dns_query.nxdomain)
+		lookup->expires = CURRTIME;
+	else
+		lookup->expires = CURRTIME + (lookup->listed ? dnsbl_positive_ttl : dnsbl_negative_ttl);
+
+	/* they have a blacklist entry for these clients */
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, lookup->clients.head)
 	{
-		dnsbl_hit(blcptr->u, blcptr->blacklist);
-		return;
-	}
+		blcptr = n->data;
 
-	l = dnsbl_queries(blcptr->u);
-	mowgli_node_delete(&blcptr->node, l);
+		if (lookup->listed)
+			dnsbl_hit(blcptr->u, lookup->blacklist);
 
-	free(blcptr);
+		dnsbl_client_free(blcptr);
+	}
+
+	if (lookup->expires <= CURRTIME)
+		dnsbl_lookup_free(lookup);
 }
 
 /* XXX: no IPv6 implementation, not to concerned right now though. */
 static void initiate_blacklist_dnsquery(struct Blacklist *blptr, user_t *u)
 {
-	struct BlacklistClient *blcptr = malloc(sizeof(struct BlacklistClient));
+	struct BlacklistLookup *lookup;
+	struct BlacklistClient *blcptr;
 	char buf[IRCD_RES_HOSTLEN + 1];
 	int ip[4];
-	mowgli_list_t *l;
-
-	blcptr->blacklist = blptr;
-	blcptr->u = u;
-
-	blcptr->dns_query.ptr = blcptr;
-	blcptr->dns_query.callback = blacklist_dns_callback;
+	bool query;
 
 	/* A sscanf worked fine for chary for many years, it'll be fine here */
-	sscanf(u->ip, "%d.%d.%d.%d", &ip[3], &ip[2], &ip[1], &ip[0]); 
+	if (sscanf(u->ip, "%d.%d.%d.%d", &ip[3], &ip[2], &ip[1], &ip[0]) != 4)
+		return;
 
 	/* becomes 2.0.0.127.torbl.ahbl.org or whatever */
 	snprintf(buf, sizeof buf, "%d.%d.%d.%d.%s", ip[0], ip[1], ip[2], ip[3], blptr->host);
 
-	gethost_byname_type(buf, &blcptr->dns_query, T_A);
+	lookup = mowgli_patricia_retrieve(dnsbl_cache, buf);
+	if (lookup != NULL && !lookup->pending && lookup->expires <= CURRTIME)
+	{
+		dnsbl_lookup_free(lookup);
+		lookup = NULL;
+	}
+
+	if (lookup != NULL && !lookup->pending)
+	{
+		dnsbl_cache_hits++;
+		if (lookup->listed)
+			dnsbl_hit(u, blptr);
+		return;
+	}
+
+	query = lookup == NULL;
+	if (query)
+	{
+		dnsbl_cache_misses++;
+
+		lookup = scalloc(1, sizeof(struct BlacklistLookup));
+		lookup->name = sstrdup(buf);
+		lookup->blacklist = blptr;
+		lookup->pending = true;
+		lookup->dns_query.ptr = lookup;
+		lookup->dns_query.callback = blacklist_dns_callback;
+		mowgli_patricia_add(dnsbl_cache, lookup->name, lookup);
+		blptr->refcount++;
+	}
+	else
+		dnsbl_coalesced++;
+
+	blcptr = smalloc(sizeof(struct BlacklistClient));
+	blcptr->lookup = lookup;
+	blcptr->u = u;
+	mowgli_node_add(blcptr, &blcptr->node, &lookup->clients);
+	mowgli_node_add(blcptr, &blcptr->unode, dnsbl_queries(u));
+
+	if (query)
+		gethost_byname_type(buf, &lookup->dns_query, T_A);
+}
+
+/* drops cached answers past their TTL */
+static void dnsbl_expire(void *unused)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct BlacklistLookup *lookup;
+
+	MOWGLI_PATRICIA_FOREACH(lookup, &state, dnsbl_cache)
+	{
+		if (!lookup->pending && lookup->expires <= CURRTIME)
+			dnsbl_lookup_free(lookup);
+	}
+}
+
+static void dnsbl_cache_flush(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	struct BlacklistLookup *lookup;
 
-	l = dnsbl_queries(u);
-	mowgli_node_add(blcptr, &blcptr->node, l);
-	blptr->refcount++;
+	MOWGLI_PATRICIA_FOREACH(lookup, &state, dnsbl_cache)
+		dnsbl_lookup_free(lookup);
+}
+
+static void dnsbl_user_delete(user_t *u)
+{
+	mowgli_list_t *l;
+	mowgli_node_t *n, *tn;
+
+	l = privatedata_get(u, "dnsbl:queries");
+	if (l == NULL)
+		return;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, l->head)
+		dnsbl_client_free(n->data);
+
+	/* the user's privatedata goes away with it */
+	mowgli_list_free(l);
 }
 
 /* public interfaces */
@@ -450,6 +568,8 @@ static int dnsbl_config_handler(mowgli_config_file_entry_t *ce)
 
 static void dnsbl_config_purge(void *unused)
 {
+	/* lookups point to the blacklists */
+	dnsbl_cache_flush();
 	destroy_blacklists();
 }
 
@@ -484,6 +604,11 @@ static void dnsbl_hit(user_t *u, struct Blacklist *blptr)
 
 	svs = service_find("operserv");
 
+	blptr->hits++;
+
+	if (action == NULL)
+		return;
+
 	if (!strcasecmp("SNOOP", action))
 	{
 		slog(LG_INFO, "DNSBL: \2%s\2!%s@%s [%s] is listed in DNS Blacklist %s.", u->nick, u->user, u->host, u->gecos, blptr->host);
@@ -522,6 +647,9 @@ static void osinfo_hook(sourceinfo_t *si)
 
 		command_success_nodata(si, "Blacklist(s): %s", blptr->host);
 	}
+
+	command_success_nodata(si, "DNSBL cache: %u entries, %u hits, %u misses, %u coalesced lookups",
+			mowgli_patricia_size(dnsbl_cache), dnsbl_cache_hits, dnsbl_cache_misses, dnsbl_coalesced);
 }
 
 static void write_dnsbl_exempt_db(database_handle_t *db)
@@ -587,11 +715,19 @@ _modinit(module_t *m)
 	hook_add_event("user_add");
 	hook_add_user_add(check_dnsbls);
 
+	hook_add_event("user_delete");
+	hook_add_user_delete(dnsbl_user_delete);
+
 	hook_add_event("operserv_info");
 	hook_add_operserv_info(osinfo_hook);
 
 	add_dupstr_conf_item("dnsbl_action", &proxyscan->conf_table, 0, &action, NULL);
 	add_conf_item("BLACKLISTS", &proxyscan->conf_table, dnsbl_config_handler);
+	add_duration_conf_item("DNSBL_POSITIVE_TTL", &proxyscan->conf_table, 0, &dnsbl_positive_ttl, "m", 3600);
+	add_duration_conf_item("DNSBL_NEGATIVE_TTL", &proxyscan->conf_table, 0, &dnsbl_negative_ttl, "m", 600);
+
+	dnsbl_cache = mowgli_patricia_create(strcasecanon);
+	dnsbl_expire_timer = mowgli_timer_add(base_eventloop, "dnsbl_expire", dnsbl_expire, NULL, 300);
 
 	command_add(&os_set_dnsblaction, *os_set_cmdtree);
 }
@@ -603,6 +739,7 @@ _moddeinit(module_unload_intent_t intent)
 
 	hook_del_db_write(write_dnsbl_exempt_db);
 	hook_del_user_add(check_dnsbls);
+	hook_del_user_delete(dnsbl_user_delete);
 	hook_del_config_purge(dnsbl_config_purge);
 	hook_del_operserv_info(osinfo_hook);
 
@@ -612,6 +749,12 @@ _moddeinit(module_unload_intent_t intent)
 
 	del_conf_item("dnsbl_action", &proxyscan->conf_table);
 	del_conf_item("BLACKLISTS", &proxyscan->conf_table);
+	del_conf_item("DNSBL_POSITIVE_TTL", &proxyscan->conf_table);
+	del_conf_item("DNSBL_NEGATIVE_TTL", &proxyscan->conf_table);
+
+	mowgli_timer_destroy(base_eventloop, dnsbl_expire_timer);
+	dnsbl_cache_flush();
+	mowgli_patricia_destroy(dnsbl_cache, NULL, NULL);
 
 	command_delete(&os_set_dnsblaction, *os_set_cmdtree);
 
@@ -24,6 +24,8 @@ void destroy_session(sasl_session_t *p);
 static void sasl_logcommand(sasl_session_t *p, myuser_t *login, int level, const char *fmt, ...);
 static void sasl_input(sasl_message_t *smsg);
 static void sasl_packet(sasl_session_t *p, char *buf, int len);
+static void sasl_step_result(sasl_session_t *p, int rc, char *out, size_t out_len);
+void sasl_resume(sasl_session_t *p, int rc);
 static void sasl_write(char *target, char *data, int length);
 static bool may_impersonate(myuser_t *source_mu, myuser_t *target_mu);
 static myuser_t *login_user(sasl_session_t *p);
@@ -198,6 +200,14 @@ static void sasl_input(sasl_message_t *smsg)
 	if(smsg->mode != 'S' && smsg->mode != 'C')
 		return;
 
+	/* nothing more is expected until the mechanism resumes the session */
+	if(p->flags & ASASL_PENDING_STEP)
+	{
+		sasl_sts(p->uid, 'D', "F");
+		destroy_session(p);
+		return;
+	}
+
 	if(smsg->mode == 'S' && smsg->ext != NULL &&
 			!strcmp(smsg->buf, "EXTERNAL"))
 	{
@@ -265,11 +275,10 @@ static void sasl_packet(sasl_session_t *p, char *buf, int len)
 {
 	int rc;
 	size_t tlen = 0;
-	char *cloak, *out = NULL;
+	char *out = NULL;
 	char temp[BUFSIZE];
 	char mech[61];
 	size_t out_len = 0;
-	metadata_t *md;
 
 	/* First piece of data in a session is the name of
 	 * the SASL mechanism that will be used.
@@ -326,6 +335,16 @@ static void sasl_packet(sasl_session_t *p, char *buf, int len)
 			rc = ASASL_FAIL;
 	}
 
+	sasl_step_result(p, rc, out, out_len);
+}
+
+/* act on what mech_start or mech_step returned */
+static void sasl_step_result(sasl_session_t *p, int rc, char *out, size_t out_len)
+{
+	char *cloak;
+	char temp[BUFSIZE];
+	metadata_t *md;
+
 	/* Some progress has been made, reset timeout. */
 	p->flags &= ~ASASL_MARKED_FOR_DELETION;
 
@@ -369,12 +388,27 @@ static void sasl_packet(sasl_session_t *p, char *buf, int len)
 			return;
 		}
 	}
+	else if(rc == ASASL_PENDING)
+	{
+		p->flags |= ASASL_PENDING_STEP;
+		free(out);
+		return;
+	}
 
 	free(out);
 	sasl_sts(p->uid, 'D', "F");
 	destroy_session(p);
 }
 
+/* called by a mechanism that returned ASASL_PENDING once it knows the outcome */
+void sasl_resume(sasl_session_t *p, int rc)
+{
+	return_if_fail(p->flags & ASASL_PENDING_STEP);
+
+	p->flags &= ~ASASL_PENDING_STEP;
+	sasl_step_result(p, rc, NULL, 0);
+}
+
 /* output an arbitrary amount of data to the SASL client */
 static void sasl_write(char *target, char *data, int length)
 {
@@ -22,9 +22,12 @@ static int mech_step(sasl_session_t *p, char *message, size_t len, char **out, s
 static void mech_finish(sasl_session_t *p);
 sasl_mechanism_t mech = {"PLAIN", &mech_start, &mech_step, &mech_finish};
 
+static void (*sasl_resume)(sasl_session_t *p, int rc);
+
 void _modinit(module_t *m)
 {
 	MODULE_TRY_REQUEST_SYMBOL(m, mechanisms, "saslserv/main", "sasl_mechanisms");
+	MODULE_TRY_REQUEST_SYMBOL(m, sasl_resume, "saslserv/main", "sasl_resume");
 	mnode = mowgli_node_create();
 	mowgli_node_add(&mech, mnode, mechanisms);
 }
@@ -39,12 +42,21 @@ static int mech_start(sasl_session_t *p, char **out, size_t *out_len)
 	return ASASL_MORE;
 }
 
+static void mech_verified(myuser_t *mu, bool verified, void *priv)
+{
+	sasl_session_t *p = priv;
+
+	p->mechdata = NULL;
+	sasl_resume(p, verified ? ASASL_DONE : ASASL_FAIL);
+}
+
 static int mech_step(sasl_session_t *p, char *message, size_t len, char **out, size_t *out_len)
 {
 	char authz[256];
 	char authc[256];
 	char pass[256];
 	myuser_t *mu;
+	verify_request_t *req;
 	char *end;
 
 	/* Copy the authzid */
@@ -86,11 +98,23 @@ static int mech_step(sasl_session_t *p, char *message, size_t len, char **out, s
 
 	p->username = strdup(authc);
 	p->authzid = strdup(authz);
-	return verify_password(mu, pass) ? ASASL_DONE : ASASL_FAIL;
+
+	switch (verify_password_async(mu, pass, mech_verified, p, &req))
+	{
+	case VERIFY_OK:
+		return ASASL_DONE;
+	case VERIFY_PENDING:
+		p->mechdata = req;
+		return ASASL_PENDING;
+	default:
+		return ASASL_FAIL;
+	}
 }
 
 static void mech_finish(sasl_session_t *p)
 {
+	if (p->mechdata != NULL)
+		verify_password_cancel(p->mechdata);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -40,4 +40,5 @@ void _modinit(module_t *m)
 void _moddeinit(module_unload_intent_t intent)
 {
 	parse = NULL;
+	irc_parse_cleanup();
 }
@@ -26,6 +26,70 @@
 #include "pmodule.h"
 #include "rfc1459.h"
 
+/* spare sourceinfo, reused for the next line as long as no handler
+ * kept a reference to it
+ */
+static sourceinfo_t *parse_si = NULL;
+
+static sourceinfo_t *irc_parse_sourceinfo(void)
+{
+	sourceinfo_t *si = parse_si;
+
+	if (si == NULL)
+		return sourceinfo_create();
+
+	parse_si = NULL;
+
+	/* clear everything but the object header */
+	memset((char *) si + sizeof(object_t), 0, sizeof(sourceinfo_t) - sizeof(object_t));
+
+	return si;
+}
+
+static void irc_parse_release(sourceinfo_t *si)
+{
+	if (object(si)->refcount == 1 && parse_si == NULL)
+	{
+		parse_si = si;
+		return;
+	}
+
+	object_unref(si);
+}
+
+/* drops the spare sourceinfo when the module goes away */
+void irc_parse_cleanup(void)
+{
+	if (parse_si == NULL)
+		return;
+
+	object_unref(parse_si);
+	parse_si = NULL;
+}
+
+/* resolve a prefix once, based on what it looks like:
+ * server names contain a dot, SIDs are three characters starting
+ * with a digit, everything else is a nick or UID.
+ */
+static void irc_parse_origin(sourceinfo_t *si, const char *origin)
+{
+	if (strchr(origin, '.') != NULL)
+	{
+		si->s = server_find(origin);
+		return;
+	}
+
+	if (ircd->uses_uid && isdigit((unsigned char) *origin) && strlen(origin) == 3)
+	{
+		si->s = server_find(origin);
+		return;
+	}
+
+	si->su = user_find(origin);
+	if (si->su == NULL)
+		si->s = server_find(origin);
+}
+
 /* parses a standard 2.8.21 style IRC stream */
 void irc_parse(char *line)
 {
@@ -40,67 +104,55 @@ void irc_parse(char *line)
 	unsigned int i;
 	pcommand_t *pcmd;
 
+	if (line == NULL)
+		return;
+
+	/* sometimes we'll get a blank line with just a \n on it...
+	 * catch those here... they'll core us later on if we don't
+	 */
+	if (*line == '\n')
+		return;
+	if (*line == '\000')
+		return;
+
 	/* clear the parv */
 	for (i = 0; i <= MAXPARC; i++)
 		parv[i] = NULL;
 
-	si = sourceinfo_create();
+	si = irc_parse_sourceinfo();
 	si->connection = curr_uplink->conn;
 	si->output_limit = MAX_IRC_OUTPUT_LINES;
 
-	if (line != NULL)
+	/* copy the original line so we know what we crashed on */
+	mowgli_strlcpy(coreLine, line, BUFSIZE);
+
+	slog(LG_RAWDATA, "-> %s", line);
+
+	/* find the first space */
+	if ((pos = strchr(line, ' ')))
 	{
-		/* sometimes we'll get a blank line with just a \n on it...
-		 * catch those here... they'll core us later on if we don't
+		*pos = '\0';
+		pos++;
+		/* if it starts with a : we have a prefix/origin
+		 * pull the origin off into `origin', and have pos for the
+		 * command, message will be the part afterwards
 		 */
-		if (*line == '\n')
-			goto cleanup;
-		if (*line == '\000')
-			goto cleanup;
-
-		/* copy the original line so we know what we crashed on */
-		memset((char *)&coreLine, '\0', BUFSIZE);
-		mowgli_strlcpy(coreLine, line, BUFSIZE);
+		if (*line == ':')
+		{
+			origin = line + 1;
 
-		slog(LG_RAWDATA, "-> %s", line);
+			irc_parse_origin(si, origin);
 
-		/* find the first space */
-		if ((pos = strchr(line, ' ')))
-		{
-			*pos = '\0';
-			pos++;
-			/* if it starts with a : we have a prefix/origin
-			 * pull the origin off into `origin', and have pos for the
-			 * command, message will be the part afterwards
-			 */
-			if (*line == ':')
+			if ((message = strchr(pos, ' ')))
 			{
-                        	origin = line + 1;
-
-				si->s = server_find(origin);
-				si->su = user_find(origin);
-
-				if ((message = strchr(pos, ' ')))
-				{
-					*message = '\0';
-					message++;
-					command = pos;
-				}
-				else
-				{
-					command = pos;
-					message = NULL;
-				}
+				*message = '\0';
+				message++;
+				command = pos;
 			}
 			else
 			{
-				if (me.recvsvr)
-				{
-					origin = me.actual;
-					si->s = server_find(origin);
-				}
-				message = pos;
-				command = line;
+				command = pos;
+				message = NULL;
 			}
 		}
 		else
@@ -110,85 +162,95 @@ void irc_parse(char *line)
 				origin = me.actual;
 				si->s = server_find(origin);
 			}
+			message = pos;
 			command = line;
-			message = NULL;
-		}
-                if (!si->s && !si->su && me.recvsvr)
-                {
-                        slog(LG_DEBUG, "irc_parse(): got message from nonexistant user or server: %s", origin);
-                        goto cleanup;
-                }
-		if (si->s == me.me)
-		{
-                        slog(LG_INFO, "irc_parse(): got message supposedly from myself %s: %s", si->s->name, coreLine);
-                        goto cleanup;
 		}
-		if (si->su != NULL && si->su->server == me.me)
+	}
+	else
+	{
+		if (me.recvsvr)
 		{
-                        slog(LG_INFO, "irc_parse(): got message supposedly from my own client %s: %s", si->su->nick, coreLine);
-                        goto cleanup;
+			origin = me.actual;
+			si->s = server_find(origin);
 		}
-		si->smu = si->su != NULL ? si->su->myuser : NULL;
+		command = line;
+		message = NULL;
+	}
+	if (!si->s && !si->su && me.recvsvr)
+	{
+		slog(LG_DEBUG, "irc_parse(): got message from nonexistant user or server: %s", origin);
+		goto cleanup;
+	}
+	if (si->s == me.me)
+	{
+		slog(LG_INFO, "irc_parse(): got message supposedly from myself %s: %s", si->s->name, coreLine);
+		goto cleanup;
+	}
+	if (si->su != NULL && si->su->server == me.me)
+	{
+		slog(LG_INFO, "irc_parse(): got message supposedly from my own client %s: %s", si->su->nick, coreLine);
+		goto cleanup;
+	}
+	si->smu = si->su != NULL ? si->su->myuser : NULL;
 
-		/* okay, the nasty part is over, now we need to make a
-		 * parv out of what's left
-		 */
+	/* okay, the nasty part is over, now we need to make a
+	 * parv out of what's left
+	 */
 
-		if (message)
+	if (message)
+	{
+		if (*message == ':')
 		{
-			if (*message == ':')
-			{
-				message++;
-				parv[0] = message;
-				parc = 1;
-			}
-			else
-				parc = tokenize(message, parv);
+			message++;
+			parv[0] = message;
+			parc = 1;
 		}
 		else
-			parc = 0;
+			parc = tokenize(message, parv);
+	}
+	else
+		parc = 0;
 
-		/* now we should have origin (or NULL), command, and a parv
-		 * with it's accompanying parc... let's make ABSOLUTELY sure
-		 */
-		if (!command)
+	/* now we should have origin (or NULL), command, and a parv
+	 * with it's accompanying parc... let's make ABSOLUTELY sure
+	 */
+	if (!command)
+	{
+		slog(LG_DEBUG, "irc_parse(): command not found: %s", coreLine);
+		goto cleanup;
+	}
+
+	/* take the command through the hash table */
+	if ((pcmd = pcommand_find(command)))
+	{
+		if (si->su && !(pcmd->sourcetype & MSRC_USER))
 		{
-			slog(LG_DEBUG, "irc_parse(): command not found: %s", coreLine);
+			slog(LG_INFO, "irc_parse(): user %s sent disallowed command %s", si->su->nick, pcmd->token);
 			goto cleanup;
 		}
-
-		/* take the command through the hash table */
-		if ((pcmd = pcommand_find(command)))
+		else if (si->s && !(pcmd->sourcetype & MSRC_SERVER))
 		{
-			if (si->su && !(pcmd->sourcetype & MSRC_USER))
-			{
-				slog(LG_INFO, "irc_parse(): user %s sent disallowed command %s", si->su->nick, pcmd->token);
-				goto cleanup;
-			}
-			else if (si->s && !(pcmd->sourcetype & MSRC_SERVER))
-			{
-				slog(LG_INFO, "irc_parse(): server %s sent disallowed command %s", si->s->name, pcmd->token);
-				goto cleanup;
-			}
-			else if (!me.recvsvr && !(pcmd->sourcetype & MSRC_UNREG))
-			{
-				slog(LG_INFO, "irc_parse(): unregistered server sent disallowed command %s", pcmd->token);
-				goto cleanup;
-			}
-			if (parc < pcmd->minparc)
-			{
-				slog(LG_INFO, "irc_parse(): insufficient parameters for command %s", pcmd->token);
-				goto cleanup;
-			}
-			if (pcmd->handler)
-			{
-				pcmd->handler(si, parc, parv);
-			}
+			slog(LG_INFO, "irc_parse(): server %s sent disallowed command %s", si->s->name, pcmd->token);
+			goto cleanup;
+		}
+		else if (!me.recvsvr && !(pcmd->sourcetype & MSRC_UNREG))
+		{
+			slog(LG_INFO, "irc_parse(): unregistered server sent disallowed command %s", pcmd->token);
+			goto cleanup;
+		}
+		if (parc < pcmd->minparc)
+		{
+			slog(LG_INFO, "irc_parse(): insufficient parameters for command %s", pcmd->token);
+			goto cleanup;
+		}
+		if (pcmd->handler)
+		{
+			pcmd->handler(si, parc, parv);
 		}
 	}
 
 cleanup:
-	object_unref(si);
+	irc_parse_release(si);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
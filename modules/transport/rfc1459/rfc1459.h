@@ -10,6 +10,7 @@
 #define RFC1459_H
 
 E void irc_parse(char *line);
+E void irc_parse_cleanup(void);
 
 #endif
 
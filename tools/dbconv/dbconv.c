@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2026 Atheme Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Converts databases between OpenSEX (grammar version 1) and the format
+ * of modules/backend/binary.
+ *
+ * make dbconv
+ * ./dbconv -b services.db services.db.bin     (OpenSEX to binary)
+ * ./dbconv -t services.db.bin services.db     (binary to OpenSEX)
+ *
+ * Stop services first, convert, move the result into place and switch
+ * the backend module in atheme.conf.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<stdint.h>
+
+/* keep in sync with modules/backend/binary.c */
+#define BINARY_MAGIC		"ATHEMEDB"
+#define BINARY_MAGICLEN		8
+#define BINARY_VERSION		1
+
+#define REC_STRING		0x01
+#define REC_ROW			0x02
+
+#define CELL_REF		0x01
+#define CELL_INLINE		0x02
+#define CELL_INT		0x03
+#define CELL_UINT		0x04
+#define CELL_STRING		0x05
+
+#define HASHSIZE		65536
+
+struct word
+{
+	struct word *next;
+	long idx;		/* -1 until the second use */
+	char str[];
+};
+
+static struct word *words[HASHSIZE];
+static long nextidx;
+
+static unsigned char *row;
+static size_t rowlen, rowsize;
+static unsigned long rowcells;
+
+static void *
+xrealloc(void *ptr, size_t size)
+{
+	if ((ptr = realloc(ptr, size)) == NULL)
+	{
+		fprintf(stderr, "dbconv: out of memory\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+static size_t
+encode_varint(unsigned char *buf, uint64_t v)
+{
+	size_t len = 0;
+
+	while (v >= 0x80)
+	{
+		buf[len++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	buf[len++] = v;
+
+	return len;
+}
+
+static void
+put(const void *data, size_t len)
+{
+	while (rowlen + len > rowsize)
+	{
+		rowsize = rowsize ? rowsize * 2 : 512;
+		row = xrealloc(row, rowsize);
+	}
+	memcpy(row + rowlen, data, len);
+	rowlen += len;
+}
+
+static void
+put_cell(unsigned char type, uint64_t v)
+{
+	unsigned char buf[10];
+
+	put(&type, 1);
+	put(buf, encode_varint(buf, v));
+	rowcells++;
+}
+
+static unsigned int
+hash(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h % HASHSIZE;
+}
+
+/* same scheme as the backend: inline on first use, string table after */
+static void
+put_word(FILE *out, const char *s)
+{
+	struct word *w;
+	unsigned int h = hash(s);
+	unsigned char buf[11];
+	size_t len = strlen(s);
+
+	for (w = words[h]; w != NULL; w = w->next)
+		if (!strcmp(w->str, s))
+			break;
+
+	if (w == NULL)
+	{
+		w = xrealloc(NULL, sizeof *w + len + 1);
+		w->idx = -1;
+		memcpy(w->str, s, len + 1);
+		w->next = words[h];
+		words[h] = w;
+
+		put_cell(CELL_INLINE, len);
+		put(s, len);
+		return;
+	}
+
+	if (w->idx < 0)
+	{
+		w->idx = nextidx++;
+		buf[0] = REC_STRING;
+		fwrite(buf, 1, 1 + encode_varint(buf + 1, len), out);
+		fwrite(s, 1, len, out);
+	}
+
+	put_cell(CELL_REF, w->idx);
+}
+
+static int
+to_binary(FILE *in, FILE *out)
+{
+	char *line = NULL, *p, *sp;
+	size_t linesize = 0, len;
+	unsigned char buf[11];
+	unsigned long lineno = 0;
+
+	fwrite(BINARY_MAGIC, 1, BINARY_MAGICLEN, out);
+	fputc(BINARY_VERSION, out);
+
+	for (;;)
+	{
+		/* read one line of any length */
+		len = 0;
+		for (;;)
+		{
+			if (linesize - len < 2)
+			{
+				linesize = linesize ? linesize * 2 : 4096;
+				line = xrealloc(line, linesize);
+			}
+			if (fgets(line + len, linesize - len, in) == NULL)
+				break;
+			len += strlen(line + len);
+			if (len > 0 && line[len - 1] == '\n')
+				break;
+		}
+		if (len == 0)
+			break;
+		lineno++;
+
+		if (line[len - 1] == '\n')
+			line[--len] = '\0';
+
+		if (*line == '\0' || strchr("#\t \r", *line))
+			continue;
+
+		if (!strncmp(line, "GRVER ", 6))
+		{
+			if (atoi(line + 6) != 1)
+			{
+				fprintf(stderr, "dbconv: line %lu: only grammar version 1 is supported\n", lineno);
+				return 1;
+			}
+			continue;
+		}
+
+		/* Split exactly like the OpenSEX reader. Word cells are always
+		 * followed by a space, so a row that does not end in one ends
+		 * in a string cell. A row that does end in one still gets an
+		 * empty string cell: a string whose last byte is a space reads
+		 * back whole when the reader joins the trailing cells, and the
+		 * text form comes out byte for byte the same.
+		 */
+		rowlen = 0;
+		rowcells = 0;
+		for (p = line; ; p = sp + 1)
+		{
+			sp = strchr(p, ' ');
+			if (sp == NULL)
+			{
+				if (*p != '\0' || p != line)
+				{
+					put_cell(CELL_STRING, strlen(p));
+					put(p, strlen(p));
+				}
+				break;
+			}
+			*sp = '\0';
+			put_word(out, p);
+		}
+
+		buf[0] = REC_ROW;
+		fwrite(buf, 1, 1 + encode_varint(buf + 1, rowcells), out);
+		fwrite(row, 1, rowlen, out);
+	}
+
+	free(line);
+	return ferror(in) || ferror(out);
+}
+
+static int
+get_varint(const unsigned char *buf, size_t len, size_t *pos, uint64_t *res)
+{
+	uint64_t v = 0;
+	unsigned int shift = 0;
+	unsigned char c;
+
+	do
+	{
+		if (*pos >= len || shift > 63)
+			return 0;
+		c = buf[(*pos)++];
+		v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	*res = v;
+	return 1;
+}
+
+static int
+to_text(FILE *in, FILE *out)
+{
+	unsigned char *buf = NULL;
+	size_t len = 0, size = 0, pos, n;
+	char **strtab = NULL;
+	size_t strcount = 0, strsize = 0;
+	uint64_t v, ncells, i;
+	unsigned char type;
+
+	do
+	{
+		size += 1 << 20;
+		buf = xrealloc(buf, size);
+		n = fread(buf + len, 1, size - len, in);
+		len += n;
+	} while (n > 0);
+
+	fprintf(out, "GRVER 1\n");
+
+	for (pos = 0; pos < len; )
+	{
+		type = buf[pos];
+
+		if (type == (unsigned char)BINARY_MAGIC[0])
+		{
+			if (len - pos < BINARY_MAGICLEN + 1 || memcmp(buf + pos, BINARY_MAGIC, BINARY_MAGICLEN) ||
+					buf[pos + BINARY_MAGICLEN] != BINARY_VERSION)
+				goto bad;
+			pos += BINARY_MAGICLEN + 1;
+			continue;
+		}
+		pos++;
+
+		if (type == REC_STRING)
+		{
+			if (!get_varint(buf, len, &pos, &v) || v > len - pos)
+				goto bad;
+			if (strcount == strsize)
+			{
+				strsize = strsize ? strsize * 2 : 1024;
+				strtab = xrealloc(strtab, strsize * sizeof *strtab);
+			}
+			strtab[strcount] = xrealloc(NULL, v + 1);
+			memcpy(strtab[strcount], buf + pos, v);
+			strtab[strcount++][v] = '\0';
+			pos += v;
+			continue;
+		}
+
+		if (type != REC_ROW || !get_varint(buf, len, &pos, &ncells))
+			goto bad;
+
+		for (i = 0; i < ncells; i++)
+		{
+			if (pos >= len)
+				goto bad;
+			type = buf[pos++];
+			if (!get_varint(buf, len, &pos, &v))
+				goto bad;
+
+			switch (type)
+			{
+			case CELL_REF:
+				if (v >= strcount)
+					goto bad;
+				fprintf(out, "%s ", strtab[v]);
+				break;
+			case CELL_INLINE:
+			case CELL_STRING:
+				if (v > len - pos)
+					goto bad;
+				fwrite(buf + pos, 1, v, out);
+				if (type == CELL_INLINE)
+					fputc(' ', out);
+				pos += v;
+				break;
+			case CELL_INT:
+				fprintf(out, "%lld ", (long long)(int64_t)v);
+				break;
+			case CELL_UINT:
+				fprintf(out, "%llu ", (unsigned long long)v);
+				break;
+			default:
+				goto bad;
+			}
+		}
+		fputc('\n', out);
+	}
+
+	free(buf);
+	return ferror(in) || ferror(out);
+
+bad:
+	fprintf(stderr, "dbconv: bad record near offset %lu\n", (unsigned long)pos);
+	return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+	FILE *in, *out;
+	int ret;
+
+	if (argc != 4 || (strcmp(argv[1], "-b") && strcmp(argv[1], "-t")))
+	{
+		fprintf(stderr, "Usage: %s -b|-t infile outfile\n", argv[0]);
+		fprintf(stderr, "  -b  convert OpenSEX to binary\n");
+		fprintf(stderr, "  -t  convert binary to OpenSEX\n");
+		return 1;
+	}
+
+	if ((in = fopen(argv[2], "rb")) == NULL)
+	{
+		perror(argv[2]);
+		return 1;
+	}
+
+	if ((out = fopen(argv[3], "wb")) == NULL)
+	{
+		perror(argv[3]);
+		return 1;
+	}
+
+	ret = argv[1][1] == 'b' ? to_binary(in, out) : to_text(in, out);
+
+	fclose(in);
+	if (fclose(out) != 0)
+		ret = 1;
+
+	return ret;
+}